@@ -6,11 +6,20 @@ CONFIG_MINICACHE_AUTOMOUNT	?= y
 CONFIG_MINICACHE_MINDER_PRINT	?= n
 CONFIG_MINICACHE_TRACE_BOOTTIME ?= y
 
+# Maximum number of frames that are taken from the network interface
+#  per main loop iteration (0 = no limit), so that block device
+#  completions get polled in between. Can be changed with boot
+#  argument -r
+CONFIG_MINICACHE_RX_BUDGET	?= 64
+
 ######################################
 ## µSh
 ######################################
 CONFIG_SHELL			?= y
 CONFIG_SHELL_COLORPROMPT	?= y
+# Binary control protocol: batched shell commands over a TCP port or a
+#  UNIX domain socket (Linux only), see: -k
+CONFIG_CTLSOCK			?= y
 
 ######################################
 ## SHFS
@@ -18,10 +27,31 @@ CONFIG_SHELL_COLORPROMPT	?= y
 CONFIG_SHFS_OPENBYNAME		?= y
 CONFIG_SHFS_CACHEINFO		?= y
 
+# Background cache warm-up (see shell command 'warmup')
+#  Default queue depth (parallel chunk reads) and bandwidth limit
+#  in MiB/s (0 = unlimited)
+CONFIG_SHFS_WARMUP		?= y
+CONFIG_SHFS_WARMUP_QDEPTH	?= 8
+CONFIG_SHFS_WARMUP_RATE		?= 64
+
+# Chunk checksums (CRC32C): verification on cache fill and background
+#  scrubbing (see shell command 'scrub') on volumes that were created
+#  with a checksum area (shfs_mkfs -k). Default queue depth and bandwidth
+#  limit in MiB/s (0 = unlimited) of the scrubber
+CONFIG_SHFS_CSUM		?= y
+CONFIG_SHFS_SCRUB_QDEPTH	?= 2
+CONFIG_SHFS_SCRUB_RATE		?= 16
+
 # Enable statistic capabilities of SHFS
 #  If this option is disabled, STATS_HTTP is disabled as well
 CONFIG_SHFS_STATS		?= y
 
+# Number of elements that are tracked for miss statistics
+#  Memory is bounded by this value: When the table is full, the least
+#  missed element is replaced (Space-Saving), so that miss counts
+#  of the top missed elements become approximations
+CONFIG_SHFS_STATS_MISS_SLOTS	?= 1024
+
 # Advanced statistics from HTTP
 #  This enables counting the number of successful downloads
 #  (including range requests) and download progress
@@ -50,6 +80,14 @@ CONFIG_HTTP_INFO		?= y
 CONFIG_HTTP_URL_CUTARGS		?= y
 # Provide a performance test file on hash digest 0x0
 CONFIG_HTTP_TESTFILE		?= n
+# Coalesce ACK callbacks of a session within one RX burst
+CONFIG_HTTP_ACK_COALESCE	?= y
+# Flush enqueued output of a session once per loop iteration
+CONFIG_HTTP_FLUSH_COALESCE	?= y
+# Authenticated PUT/DELETE of objects on a writable volume (see: -w)
+CONFIG_HTTP_INGEST		?= n
+# HTTPS listeners via mbed TLS >= 3.2 in MBEDTLS_ROOT (see: -t, -l)
+CONFIG_HTTP_TLS			?= n
 
 ######################################
 ## ctldir (only available on Mini-OS)
@@ -62,6 +100,21 @@ CONFIG_CTLDIR_NOCHMOD		?= y
 ######################################
 CONFIG_TESTSUITE		?= n
 
+# Static tracepoints (cache, AIO, HTTP sessions/requests)
+#  Tracing is enabled at runtime with the 'trace' shell command;
+#  events are recorded to an in-memory ring (number of events per CPU)
+CONFIG_TRACE			?= y
+CONFIG_TRACE_RING_NB_EVENTS	?= 8192
+
+# Event loop monitor: per-phase duration histograms and stall detection
+#  (see shell command 'loop-stats'); threshold in milliseconds
+CONFIG_LOOPMON			?= y
+CONFIG_LOOPMON_STALL_THRESHOLD	?= 10
+
+# Memory accounting: current/peak usage and allocation failures per
+#  subsystem, memory pool occupancy (see shell command 'mem-stats')
+CONFIG_MEMACCT			?= y
+
 ######################################
 ## Debugging options
 ######################################
@@ -8,6 +8,9 @@ MCCFLAGS-$(CONFIG_MINICACHE_AUTOMOUNT)		+= -DCONFIG_AUTOMOUNT
 MCCFLAGS-$(CONFIG_MINICACHE_MINDER_PRINT)	+= -DCONFIG_MINDER_PRINT
 MCCFLAGS-$(CONFIG_MINICACHE_DEBUG_PRINT)	+= -DCONFIG_DEBUG_PRINT
 MCCFLAGS-$(CONFIG_MINICACHE_TRACE_BOOTTIME)	+= -DTRACE_BOOTTIME
+ifneq ($(CONFIG_MINICACHE_RX_BUDGET),)
+MCCFLAGS					+= -DCONFIG_RX_BUDGET=$(CONFIG_MINICACHE_RX_BUDGET)
+endif
 
 MCOBJS						= ring.o \
 						  mempool.o \
@@ -45,8 +48,19 @@ endif
 
 MCOBJS		+= shell.o shell_extras.o
 MCCFLAGS	+= -DHAVE_SHELL
+
+ifeq ($(CONFIG_CTLSOCK),y)
+MCOBJS		+= ctlsock.o
+MCCFLAGS	+= -DHAVE_CTLSOCK
+ifeq ($(TARGET),linux)
+ifneq ($(CONFIG_OSVAPP),y)
+MCCFLAGS	+= -DCTLSOCK_UNIX
+endif
+endif
+endif
 endif
 MCCFLAGS-$(CONFIG_SHELL_DEBUG)		+= -DSHELL_DEBUG
+MCCFLAGS-$(CONFIG_CTLSOCK_DEBUG)	+= -DCTLSOCK_DEBUG
 
 ######################################
 ## ctldir (only available on Mini-OS)
@@ -68,9 +82,32 @@ MCCFLAGS-$(CONFIG_SHFS_CACHE_DEBUG)	+= -DSHFS_CACHE_DEBUG
 MCCFLAGS-$(CONFIG_SHFS_CACHE_DISABLE)	+= -DSHFS_CACHE_DISABLE
 MCCFLAGS-$(CONFIG_SHFS_CACHE_IMMEDIATEDROP)	+= -DSHFS_CACHE_IMMEDIATEDROP
 MCCFLAGS-$(CONFIG_SHFS_CACHE_STATS)	+= -DSHFS_CACHE_STATS
+ifeq ($(CONFIG_SHFS_WARMUP),y)
+MCCFLAGS				+= -DSHFS_WARMUP
+MCOBJS					+= shfs_warmup.o
+ifneq ($(CONFIG_SHFS_WARMUP_QDEPTH),)
+MCCFLAGS				+= -DSHFS_WARMUP_QDEPTH=$(CONFIG_SHFS_WARMUP_QDEPTH)
+endif
+ifneq ($(CONFIG_SHFS_WARMUP_RATE),)
+MCCFLAGS				+= -DSHFS_WARMUP_RATE=$(CONFIG_SHFS_WARMUP_RATE)
+endif
+endif
+ifeq ($(CONFIG_SHFS_CSUM),y)
+MCCFLAGS				+= -DSHFS_CSUM
+MCOBJS					+= crc32c.o shfs_csum.o
+ifneq ($(CONFIG_SHFS_SCRUB_QDEPTH),)
+MCCFLAGS				+= -DSHFS_SCRUB_QDEPTH=$(CONFIG_SHFS_SCRUB_QDEPTH)
+endif
+ifneq ($(CONFIG_SHFS_SCRUB_RATE),)
+MCCFLAGS				+= -DSHFS_SCRUB_RATE=$(CONFIG_SHFS_SCRUB_RATE)
+endif
+endif
 ifeq ($(CONFIG_SHFS_STATS),y)
 MCCFLAGS				+= -DSHFS_STATS
 MCOBJS					+= shfs_stats.o
+ifneq ($(CONFIG_SHFS_STATS_MISS_SLOTS),)
+MCCFLAGS				+= -DSHFS_MSTATS_NB_SLOTS=$(CONFIG_SHFS_STATS_MISS_SLOTS)
+endif
 ifeq ($(CONFIG_SHFS_STATS_HTTP),y)
 MCCFLAGS				+= -DSHFS_STATS_HTTP
 #ifeq ($(shell echo ${CONFIG_SHFS_STATS_HTTP_DPCR}\>=2 | bc),"1")
@@ -91,6 +128,12 @@ MCCFLAGS-$(CONFIG_SHFS_CACHE_POOL_MAXALLOC) += -DSHFS_CACHE_POOL_MAXALLOC_THRESH
 endif
 MCCFLAGS				+= -DSHFS_CACHE_POOL_NB_BUFFERS=$(CONFIG_SHFS_CACHE_POOL_NB_BUFFERS)
 MCCFLAGS-$(CONFIG_SHFS_CACHE_GROW)	+= -DSHFS_CACHE_GROW
+ifneq ($(CONFIG_SHFS_CACHE_SUBCHK_SIZE),)
+MCCFLAGS				+= -DSHFS_CACHE_SUBCHK_SIZE=$(CONFIG_SHFS_CACHE_SUBCHK_SIZE)
+endif
+ifneq ($(CONFIG_SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS),)
+MCCFLAGS				+= -DSHFS_CACHE_SUBCHK_POOL_NB_BUFFERS=$(CONFIG_SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS)
+endif
 
 ######################################
 ## HTTP
@@ -99,6 +142,19 @@ MCCFLAGS				+= -DHTTP_SERVER_AGENT="\"MiniCache/$(GITSHA1)\""
 MCCFLAGS-$(CONFIG_HTTP_TESTFILES)	+= -DHTTP_TESTFILES
 MCCFLAGS-$(CONFIG_HTTP_INFO)		+= -DHTTP_INFO
 MCCFLAGS-$(CONFIG_HTTP_URL_CUTARGS)	+= -DHTTP_URL_CUTARGS
+MCCFLAGS-$(CONFIG_HTTP_ACK_COALESCE)	+= -DHTTP_ACK_COALESCE
+MCCFLAGS-$(CONFIG_HTTP_FLUSH_COALESCE)	+= -DHTTP_FLUSH_COALESCE
+ifeq ($(CONFIG_HTTP_INGEST),y)
+MCCFLAGS				+= -DHTTP_INGEST -DSHFS_INGEST
+MCOBJS					+= sha256.o shfs_alloc.o shfs_ingest.o http_ingest.o
+endif
+ifeq ($(CONFIG_HTTP_TLS),y)
+ifeq ($(MBEDTLS_ROOT),)
+$(error CONFIG_HTTP_TLS requires MBEDTLS_ROOT to point to an mbed TLS (>= 3.2) build)
+endif
+MCCFLAGS				+= -DHTTP_TLS -I$(MBEDTLS_ROOT)/include
+MCOBJS					+= http_tls.o
+endif
 MCCFLAGS-$(CONFIG_HTTP_LINK_MEMCPY)	+= -DHTTP_LINK_MEMCPY
 
 MCCFLAGS-$(CONFIG_HTTP_DEBUG)		+= -DHTTP_DEBUG
@@ -110,6 +166,25 @@ MCCFLAGS-$(CONFIG_HTTP_DEBUG_PRINTACCESS) += -DHTTP_DEBUG_PRINTACCESS
 ######################################
 MCCFLAGS-$(CONFIG_TESTSUITE)		+= -DTESTSUITE
 MCOBJS-$(CONFIG_TESTSUITE)		+= testsuite.o
+ifeq ($(CONFIG_TRACE),y)
+MCCFLAGS				+= -DHAVE_TRACE
+MCOBJS					+= trace.o
+ifneq ($(CONFIG_TRACE_RING_NB_EVENTS),)
+MCCFLAGS				+= -DTRACE_RING_NB_EVENTS=$(CONFIG_TRACE_RING_NB_EVENTS)
+endif
+endif
+MCCFLAGS-$(CONFIG_TRACE_DEBUG)		+= -DTRACE_DEBUG
+ifeq ($(CONFIG_LOOPMON),y)
+MCCFLAGS				+= -DHAVE_LOOPMON
+MCOBJS					+= loopmon.o
+ifneq ($(CONFIG_LOOPMON_STALL_THRESHOLD),)
+MCCFLAGS				+= -DLOOPMON_STALL_THRESHOLD_MS=$(CONFIG_LOOPMON_STALL_THRESHOLD)
+endif
+endif
+ifeq ($(CONFIG_MEMACCT),y)
+MCCFLAGS				+= -DHAVE_MEMACCT
+MCOBJS					+= memacct.o
+endif
 
 ######################################
 MCOBJS					+= $(MCOBJS-y)
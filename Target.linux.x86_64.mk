@@ -91,6 +91,10 @@ else
 CONFIG_PTH_THREADS?=n
 CONFIG_SHELL?=n
 CONFIG_NETMAP?=y
+# tap (CONFIG_NETMAP=n): vnet header offloads (checksum, TSO/GRO) and
+# number of queues (>1 requires IFF_MULTI_QUEUE)
+CONFIG_TAPIF_OFFLOAD?=y
+CONFIG_TAPIF_QUEUES?=1
 
 CONFIG_SHFS_CACHE_READAHEAD		?= 8
 CONFIG_SHFS_CACHE_POOL_NB_BUFFERS	?= 8192
@@ -169,6 +173,9 @@ CFLAGS+=-g -D$(TARGET) $(MCCFLAGS) \
 # -ansi
 # -std=c89
 LDFLAGS+=-pthread #-lutil
+ifeq ($(CONFIG_HTTP_TLS),y)
+LDFLAGS+=-L$(MBEDTLS_ROOT)/library -lmbedtls -lmbedx509 -lmbedcrypto
+endif
 ARFLAGS=rs
 
 ifeq ($(CONFIG_PTH_THREADS),y)
@@ -258,6 +265,12 @@ CFLAGS+=-DCONFIG_NETMAP -I$(NETMAP_INCLUDES)
 else
 ARCHFILES+=$(wildcard $(LWIPARCH)/netif/tapif.c)
 CFLAGS+=-DCONFIG_TAPIF
+ifeq ($(CONFIG_TAPIF_OFFLOAD),y)
+CFLAGS+=-DCONFIG_TAPIF_OFFLOAD
+endif
+ifneq ($(CONFIG_TAPIF_QUEUES),)
+CFLAGS+=-DTAPIF_QUEUES=$(CONFIG_TAPIF_QUEUES)
+endif
 endif
 endif
 endif
@@ -81,6 +81,12 @@ CONFIG_SHFS_CACHE_READAHEAD		?= 4
 CONFIG_SHFS_CACHE_POOL_NB_BUFFERS	?= 64
 CONFIG_SHFS_CACHE_GROW			?= y
 
+######################################
+## HTTP
+######################################
+# TLS is not supported (no filesystem for certificates)
+CONFIG_HTTP_TLS			 = n
+
 include Minicache.mk
 
 stubdom		 = y
@@ -0,0 +1,223 @@
+/*
+ * CRC32C (Castagnoli) checksum
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#include "crc32c.h"
+#include "likely.h"
+
+#define CRC32C_POLY 0x82F63B78 /* reflected */
+
+/******************************************************************************
+ * Software implementation (slicing-by-8)
+ ******************************************************************************/
+static uint32_t _crc32c_tbl[8][256];
+static int _crc32c_tbl_ready = 0;
+
+static void _crc32c_init_tbl(void)
+{
+	uint32_t c;
+	unsigned int i, j;
+
+	for (i = 0; i < 256; ++i) {
+		c = i;
+		for (j = 0; j < 8; ++j)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1);
+		_crc32c_tbl[0][i] = c;
+	}
+	for (i = 0; i < 256; ++i) {
+		c = _crc32c_tbl[0][i];
+		for (j = 1; j < 8; ++j) {
+			c = _crc32c_tbl[0][c & 0xFF] ^ (c >> 8);
+			_crc32c_tbl[j][i] = c;
+		}
+	}
+	_crc32c_tbl_ready = 1;
+}
+
+static uint32_t _crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint64_t w;
+
+	if (unlikely(!_crc32c_tbl_ready))
+		_crc32c_init_tbl();
+
+	while (len && ((uintptr_t) p & 7)) {
+		crc = _crc32c_tbl[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		--len;
+	}
+	while (len >= 8) {
+		w = *((const uint64_t *) p) ^ crc; /* Note: little endian only */
+		crc = _crc32c_tbl[7][ w        & 0xFF] ^
+		      _crc32c_tbl[6][(w >>  8) & 0xFF] ^
+		      _crc32c_tbl[5][(w >> 16) & 0xFF] ^
+		      _crc32c_tbl[4][(w >> 24) & 0xFF] ^
+		      _crc32c_tbl[3][(w >> 32) & 0xFF] ^
+		      _crc32c_tbl[2][(w >> 40) & 0xFF] ^
+		      _crc32c_tbl[1][(w >> 48) & 0xFF] ^
+		      _crc32c_tbl[0][ w >> 56        ];
+		p   += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = _crc32c_tbl[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+/******************************************************************************
+ * SSE4.2 implementation
+ ******************************************************************************/
+#if defined __x86_64__ && defined __GNUC__
+#include <cpuid.h>
+#include <nmmintrin.h>
+
+#define CRC32C_HW_LANE_MIN 1024 /* smaller buffers are processed as one stream */
+
+/* x^(2^n) mod P, for n = 0..31 */
+static const uint32_t _crc32c_x2n[32] = {
+	0x40000000, 0x20000000, 0x08000000, 0x00800000,
+	0x00008000, 0x82f63b78, 0x6ea2d55c, 0x18b8ea18,
+	0x510ac59a, 0xb82be955, 0xb8fdb1e7, 0x88e56f72,
+	0x74c360a4, 0xe4172b16, 0x0d65762a, 0x35d73a62,
+	0x28461564, 0xbf455269, 0xe2ea32dc, 0xfe7740e6,
+	0xf946610b, 0x3c204f8f, 0x538586e3, 0x59726915,
+	0x734d5309, 0xbc1ac763, 0x7d0722cc, 0xd289cabe,
+	0xe94ca9bc, 0x05b74f3f, 0xa51e1f42, 0x40000000,
+};
+
+/* a * b mod P (polynomials are bit-reflected) */
+static uint32_t _crc32c_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t) 1 << 31;
+	uint32_t p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : (b >> 1);
+	}
+	return p;
+}
+
+/* operator that appends len zero bytes to a CRC register: x^(8 * len) mod P */
+static uint32_t _crc32c_zeros_op(size_t len)
+{
+	uint32_t p = (uint32_t) 1 << 31; /* x^0 */
+	unsigned int k = 3;
+
+	for (; len; len >>= 1, ++k) {
+		if (len & 1)
+			p = _crc32c_multmodp(_crc32c_x2n[k & 31], p);
+	}
+	return p;
+}
+
+static int _crc32c_hw = -1; /* unknown yet */
+static size_t _crc32c_op_len = 0;
+static uint32_t _crc32c_op;
+
+static int _crc32c_hw_detect(void)
+{
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+	return (c & bit_SSE4_2) ? 1 : 0;
+}
+
+__attribute__((target("sse4.2")))
+static inline uint64_t _crc32c_hw_stream(uint64_t crc, const uint8_t *p, size_t len)
+{
+	for (; len >= 8; p += 8, len -= 8)
+		crc = _mm_crc32_u64(crc, *((const uint64_t *) p));
+	return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint64_t c0, c1, c2;
+	size_t lane, i;
+
+	while (len && ((uintptr_t) p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		--len;
+	}
+
+	/* The crc32 instruction has a latency of 3 cycles but a throughput of
+	 * 1: Three independent streams keep the unit busy. The partial
+	 * checksums are combined by shifting them over the following lanes. */
+	if (len >= 3 * CRC32C_HW_LANE_MIN) {
+		lane = (len / 3) & ~((size_t) 7);
+		if (lane != _crc32c_op_len) {
+			_crc32c_op = _crc32c_zeros_op(lane);
+			_crc32c_op_len = lane;
+		}
+		c0 = crc;
+		c1 = 0;
+		c2 = 0;
+		for (i = 0; i < lane; i += 8) {
+			c0 = _mm_crc32_u64(c0, *((const uint64_t *) (p + i)));
+			c1 = _mm_crc32_u64(c1, *((const uint64_t *) (p + lane + i)));
+			c2 = _mm_crc32_u64(c2, *((const uint64_t *) (p + 2 * lane + i)));
+		}
+		crc = _crc32c_multmodp(_crc32c_op, (uint32_t) c0) ^ (uint32_t) c1;
+		crc = _crc32c_multmodp(_crc32c_op, crc) ^ (uint32_t) c2;
+		p   += 3 * lane;
+		len -= 3 * lane;
+	}
+
+	crc = (uint32_t) _crc32c_hw_stream(crc, p, len);
+	p   += len & ~((size_t) 7);
+	len &= 7;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+#endif /* __x86_64__ && __GNUC__ */
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	crc = ~crc;
+#if defined __x86_64__ && defined __GNUC__
+	if (unlikely(_crc32c_hw < 0))
+		_crc32c_hw = _crc32c_hw_detect();
+	if (likely(_crc32c_hw))
+		return ~_crc32c_sse42(crc, buf, len);
+#endif
+	return ~_crc32c_sw(crc, buf, len);
+}
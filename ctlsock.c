@@ -0,0 +1,737 @@
+/*
+ * Binary control protocol (batched µShell commands)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#if defined linux || defined __OSV__
+#define USE_FOPENCOOKIE
+#endif
+
+#ifdef USE_FOPENCOOKIE
+#define _GNU_SOURCE
+#include <stdio.h>
+#endif
+
+#include <target/sys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef CTLSOCK_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include <lwip/tcp.h>
+#include <lwip/inet.h>
+
+#include "likely.h"
+#include "shell.h"
+#include "ctlsock.h"
+
+#ifdef CTLSOCK_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+#define CTLSOCK_MAX_NB_SESS 8
+#define CTLSOCK_MAX_NB_ARGS 32
+#define CTLSOCK_RXBUFLEN    (2 * CTLSOCK_MAX_REQLEN) /* one batch can be pipelined */
+#define CTLSOCK_TCP_PRIO    TCP_PRIO_MAX
+#define CTLSOCK_UNIX_BACKLOG 8
+#define CTLSOCK_SESSNAME_FMT "ctlsock%u"
+#define CTLSOCK_SESSNAME_MAXLEN 16
+
+#ifndef min
+#define min(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a < __b ? __a : __b; })
+#endif
+
+#ifndef max
+#define max(a, b) \
+    ({ __typeof__ (a) __a = (a); \
+       __typeof__ (b) __b = (b); \
+       __a > __b ? __a : __b; })
+#endif
+
+#ifndef min3
+#define min3(a, b, c) \
+    min(min((a), (b)), (c))
+#endif
+
+enum ctlsock_sess_type {
+	CST_TCP = 0,
+#ifdef CTLSOCK_UNIX
+	CST_UNIX,
+#endif
+};
+
+enum ctlsock_sess_state {
+	CSS_ESTABLISHED = 0,
+	CSS_EOF,        /* peer shut down its sending side: answer the
+	                 * complete requests, close afterwards */
+	CSS_CLOSING,    /* close after the reply was sent */
+	CSS_DEAD        /* close immediately */
+};
+
+struct ctlsock_sess {
+	unsigned int id;
+	char name[CTLSOCK_SESSNAME_MAXLEN];
+	enum ctlsock_sess_type type;
+	enum ctlsock_sess_state state;
+	struct tcp_pcb *tpcb;
+#ifdef CTLSOCK_UNIX
+	int fd;
+#endif
+
+	/* output of commands is written to the reply buffer */
+	FILE *cio;
+#ifdef USE_FOPENCOOKIE
+	cookie_io_functions_t cio_funcs;
+#endif
+
+	/* receive buffer */
+	char rxbuf[CTLSOCK_RXBUFLEN];
+	size_t rx_len;
+
+	/* commands are executed by the session thread: like in the shell,
+	 * they may yield the CPU to the main loop (e.g., sh_slice_yield()) */
+	struct thread *thread;
+
+	/* batch in execution */
+	int in_batch;
+	int exec;         /* batch is handed over to the session thread */
+	uint32_t seq;
+	uint8_t flags;
+	uint16_t nb_cmds;
+	uint16_t nb_done;
+	size_t req_len;   /* length of the request (with header) */
+	size_t req_off;   /* offset of the next command in rxbuf */
+	enum ctlsock_status status;
+
+	/* reply */
+	char txbuf[CTLSOCK_MAX_REPLEN];
+	size_t tx_len;
+	size_t tx_off;    /* bytes handed over to the transport */
+	int trunc;        /* output of current command got truncated */
+};
+
+struct ctlsock {
+	struct tcp_pcb *tpcb;
+#ifdef CTLSOCK_UNIX
+	int lfd;
+	struct sockaddr_un laddr;
+#endif
+	struct ctlsock_sess *sess[CTLSOCK_MAX_NB_SESS];
+	unsigned int nb_sess;
+};
+
+static struct ctlsock *cs = NULL;
+
+static err_t ctlsock_tcp_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err);
+
+int init_ctlsock(uint16_t port, const char *path)
+{
+	unsigned int i;
+	err_t err;
+	int ret;
+
+	cs = malloc(sizeof(*cs));
+	if (!cs) {
+		ret = -ENOMEM;
+		goto err_out;
+	}
+	for (i = 0; i < CTLSOCK_MAX_NB_SESS; ++i)
+		cs->sess[i] = NULL;
+	cs->nb_sess = 0;
+
+	cs->tpcb = NULL;
+	if (port) {
+		cs->tpcb = tcp_new();
+		if (!cs->tpcb) {
+			ret = -ENOMEM;
+			goto err_free_cs;
+		}
+		err = tcp_bind(cs->tpcb, IP_ADDR_ANY, port);
+		if (err != ERR_OK) {
+			tcp_abort(cs->tpcb);
+			ret = -EADDRINUSE;
+			goto err_free_cs;
+		}
+		cs->tpcb = tcp_listen(cs->tpcb);
+		if (!cs->tpcb) {
+			ret = -ENOMEM;
+			goto err_free_cs;
+		}
+		tcp_arg(cs->tpcb, cs);
+		tcp_accept(cs->tpcb, ctlsock_tcp_accept);
+	}
+
+#ifdef CTLSOCK_UNIX
+	cs->lfd = -1;
+	if (path) {
+		if (strlen(path) >= sizeof(cs->laddr.sun_path)) {
+			ret = -ENAMETOOLONG;
+			goto err_close_tcp;
+		}
+		memset(&cs->laddr, 0, sizeof(cs->laddr));
+		cs->laddr.sun_family = AF_UNIX;
+		strcpy(cs->laddr.sun_path, path);
+
+		cs->lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (cs->lfd < 0) {
+			ret = -errno;
+			goto err_close_tcp;
+		}
+		unlink(path); /* stale socket of a previous instance */
+		if (bind(cs->lfd, (struct sockaddr *) &cs->laddr, sizeof(cs->laddr)) < 0 ||
+		    listen(cs->lfd, CTLSOCK_UNIX_BACKLOG) < 0 ||
+		    fcntl(cs->lfd, F_SETFL, fcntl(cs->lfd, F_GETFL) | O_NONBLOCK) < 0) {
+			ret = -errno;
+			goto err_close_lfd;
+		}
+	}
+#else
+	if (path) {
+		ret = -ENOTSUP;
+		goto err_close_tcp;
+	}
+#endif
+	return 0;
+
+#ifdef CTLSOCK_UNIX
+ err_close_lfd:
+	close(cs->lfd);
+#endif
+ err_close_tcp:
+	if (cs->tpcb)
+		tcp_close(cs->tpcb);
+ err_free_cs:
+	free(cs);
+	cs = NULL;
+ err_out:
+	return ret;
+}
+
+/*******************************************************************************
+ * Session handling
+ ******************************************************************************/
+#ifdef USE_FOPENCOOKIE
+static ssize_t ctlsock_cio_write(void *argp, const char *buf, size_t len)
+#else
+static int ctlsock_cio_write(void *argp, const char *buf, int len)
+#endif
+{
+	struct ctlsock_sess *sess = argp;
+	size_t l;
+
+	/* output that does not fit anymore is dropped */
+	l = min((size_t) len, CTLSOCK_MAX_REPLEN - sess->tx_len);
+	if (l < (size_t) len)
+		sess->trunc = 1;
+	memcpy(&sess->txbuf[sess->tx_len], buf, l);
+	sess->tx_len += l;
+	return len;
+}
+
+static void ctlsock_sess_thread(void *argp);
+
+static struct ctlsock_sess *ctlsock_sess_open(enum ctlsock_sess_type type)
+{
+	struct ctlsock_sess *sess;
+	unsigned int i;
+
+	if (cs->nb_sess == CTLSOCK_MAX_NB_SESS)
+		goto err_out;
+	sess = malloc(sizeof(*sess));
+	if (!sess)
+		goto err_out;
+
+	sess->type = type;
+	sess->state = CSS_ESTABLISHED;
+	sess->tpcb = NULL;
+#ifdef CTLSOCK_UNIX
+	sess->fd = -1;
+#endif
+	sess->rx_len = 0;
+	sess->in_batch = 0;
+	sess->exec = 0;
+	sess->tx_len = 0;
+	sess->tx_off = 0;
+	sess->trunc = 0;
+
+#ifdef USE_FOPENCOOKIE
+	sess->cio_funcs.read = NULL;
+	sess->cio_funcs.write = ctlsock_cio_write;
+	sess->cio_funcs.seek = NULL;
+	sess->cio_funcs.close = NULL;
+	sess->cio = fopencookie(sess, "w", sess->cio_funcs);
+#else
+	sess->cio = funopen(sess, NULL, ctlsock_cio_write, NULL, NULL);
+#endif
+	if (!sess->cio)
+		goto err_free_sess;
+
+	for (i = 0; cs->sess[i]; ++i);
+	sess->id = i;
+	snprintf(sess->name, sizeof(sess->name), CTLSOCK_SESSNAME_FMT, sess->id);
+	sess->thread = create_thread(sess->name, ctlsock_sess_thread, sess);
+	if (!sess->thread)
+		goto err_close_cio;
+	cs->sess[i] = sess;
+	cs->nb_sess++;
+	return sess;
+
+ err_close_cio:
+	fclose(sess->cio);
+ err_free_sess:
+	free(sess);
+ err_out:
+	return NULL;
+}
+
+static void ctlsock_sess_close(struct ctlsock_sess *sess)
+{
+	fclose(sess->cio);
+
+	if (sess->type == CST_TCP && sess->tpcb) {
+		tcp_arg(sess->tpcb, NULL);
+		tcp_recv(sess->tpcb, NULL);
+		tcp_err(sess->tpcb, NULL);
+		if (tcp_close(sess->tpcb) != ERR_OK)
+			tcp_abort(sess->tpcb);
+	}
+#ifdef CTLSOCK_UNIX
+	if (sess->type == CST_UNIX)
+		close(sess->fd);
+#endif
+
+	printd("Control session %u closed\n", sess->id);
+	cs->sess[sess->id] = NULL;
+	cs->nb_sess--;
+	free(sess);
+}
+
+void exit_ctlsock(void)
+{
+	unsigned int i;
+	int wait;
+
+	if (!cs)
+		return; /* not started */
+
+	/* wait for the session threads to exit */
+	do {
+		wait = 0;
+		for (i = 0; i < CTLSOCK_MAX_NB_SESS; ++i) {
+			if (cs->sess[i] && cs->sess[i]->thread) {
+				cs->sess[i]->state = CSS_DEAD;
+				wait = 1;
+			}
+		}
+		schedule();
+	} while (wait);
+
+	for (i = 0; i < CTLSOCK_MAX_NB_SESS; ++i)
+		if (cs->sess[i])
+			ctlsock_sess_close(cs->sess[i]);
+	if (cs->tpcb)
+		tcp_close(cs->tpcb);
+#ifdef CTLSOCK_UNIX
+	if (cs->lfd >= 0) {
+		close(cs->lfd);
+		unlink(cs->laddr.sun_path);
+	}
+#endif
+	free(cs);
+	cs = NULL;
+}
+
+/*******************************************************************************
+ * Transports
+ ******************************************************************************/
+static err_t ctlsock_tcp_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
+{
+	struct ctlsock_sess *sess = argp;
+
+	if (!p) {
+		/* FIN: the client might wait for its replies (half-close) */
+		if (sess->state == CSS_ESTABLISHED)
+			sess->state = CSS_EOF;
+		return ERR_OK;
+	}
+	if (err != ERR_OK) {
+		tcp_recved(tpcb, p->tot_len);
+		pbuf_free(p);
+		sess->state = CSS_DEAD;
+		return ERR_OK;
+	}
+	if (p->tot_len > CTLSOCK_RXBUFLEN - sess->rx_len)
+		return ERR_MEM; /* lwIP passes it again later */
+
+	pbuf_copy_partial(p, &sess->rxbuf[sess->rx_len], p->tot_len, 0);
+	sess->rx_len += p->tot_len;
+	tcp_recved(tpcb, p->tot_len);
+	pbuf_free(p);
+	return ERR_OK;
+}
+
+static void ctlsock_tcp_error(void *argp, err_t err)
+{
+	struct ctlsock_sess *sess = argp;
+
+	sess->tpcb = NULL; /* got released by lwIP */
+	sess->state = CSS_DEAD;
+}
+
+static err_t ctlsock_tcp_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
+{
+	struct ctlsock_sess *sess;
+
+	if (err != ERR_OK)
+		return err;
+	sess = ctlsock_sess_open(CST_TCP);
+	if (!sess)
+		return ERR_MEM;
+
+	sess->tpcb = new_tpcb;
+	tcp_arg(sess->tpcb, sess);
+	tcp_recv(sess->tpcb, ctlsock_tcp_recv);
+	tcp_err(sess->tpcb, ctlsock_tcp_error);
+	tcp_setprio(sess->tpcb, CTLSOCK_TCP_PRIO);
+	tcp_nagle_disable(sess->tpcb); /* replies are latency sensitive */
+	printd("Control session %u opened (TCP)\n", sess->id);
+	return ERR_OK;
+}
+
+static void ctlsock_tcp_send(struct ctlsock_sess *sess)
+{
+	struct tcp_pcb *pcb = sess->tpcb;
+	uint16_t slen;
+
+	while (sess->tx_off < sess->tx_len) {
+		slen = (uint16_t) min3(sess->tx_len - sess->tx_off,
+		                       (size_t) tcp_sndbuf(pcb), (size_t) UINT16_MAX);
+		if (!slen)
+			break;
+		if (tcp_write(pcb, &sess->txbuf[sess->tx_off], slen,
+		              TCP_WRITE_FLAG_COPY) != ERR_OK)
+			break; /* retried on next poll */
+		sess->tx_off += slen;
+	}
+	tcp_output(pcb);
+}
+
+#ifdef CTLSOCK_UNIX
+static void ctlsock_unix_accept(void)
+{
+	struct ctlsock_sess *sess;
+	int fd;
+
+	while (cs->nb_sess < CTLSOCK_MAX_NB_SESS) {
+		fd = accept(cs->lfd, NULL, NULL);
+		if (fd < 0)
+			return;
+		sess = ctlsock_sess_open(CST_UNIX);
+		if (!sess) {
+			close(fd);
+			return;
+		}
+		sess->fd = fd;
+		printd("Control session %u opened (UNIX)\n", sess->id);
+	}
+}
+
+static void ctlsock_unix_recv(struct ctlsock_sess *sess)
+{
+	ssize_t n;
+
+	if (sess->rx_len == CTLSOCK_RXBUFLEN)
+		return;
+	n = recv(sess->fd, &sess->rxbuf[sess->rx_len],
+	         CTLSOCK_RXBUFLEN - sess->rx_len, MSG_DONTWAIT);
+	if (n > 0)
+		sess->rx_len += (size_t) n;
+	else if (n == 0)
+		sess->state = CSS_EOF; /* the client might wait for its replies */
+	else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		sess->state = CSS_DEAD;
+}
+
+static void ctlsock_unix_send(struct ctlsock_sess *sess)
+{
+	ssize_t n;
+
+	n = send(sess->fd, &sess->txbuf[sess->tx_off],
+	         sess->tx_len - sess->tx_off, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (n > 0)
+		sess->tx_off += (size_t) n;
+	else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		sess->state = CSS_DEAD;
+}
+
+int ctlsock_fdset(fd_set *rfds)
+{
+	unsigned int i;
+	int maxfd = -1;
+
+	if (!cs)
+		return -1;
+	if (cs->lfd >= 0) {
+		FD_SET(cs->lfd, rfds);
+		maxfd = cs->lfd;
+	}
+	for (i = 0; i < CTLSOCK_MAX_NB_SESS; ++i) {
+		if (cs->sess[i] && cs->sess[i]->type == CST_UNIX) {
+			FD_SET(cs->sess[i]->fd, rfds);
+			maxfd = max(maxfd, cs->sess[i]->fd);
+		}
+	}
+	return maxfd;
+}
+#endif
+
+/*******************************************************************************
+ * Request processing
+ ******************************************************************************/
+/* returns 1 if a batch was started, 0 if the request is incomplete */
+static int ctlsock_batch_begin(struct ctlsock_sess *sess)
+{
+	struct ctlsock_hdr hdr;
+	uint32_t len;
+
+	if (sess->rx_len < sizeof(hdr))
+		return 0;
+	memcpy(&hdr, sess->rxbuf, sizeof(hdr));
+	len = ntohl(hdr.len);
+
+	sess->in_batch = 1;
+	sess->seq = ntohl(hdr.seq);
+	sess->flags = hdr.flags;
+	sess->nb_cmds = ntohs(hdr.nb_cmds);
+	sess->nb_done = 0;
+	sess->req_off = sizeof(hdr);
+	sess->status = CTLSOCK_S_OK;
+	sess->tx_len = sizeof(struct ctlsock_hdr); /* filled in at the end */
+	sess->tx_off = 0;
+
+	if (ntohs(hdr.magic) != CTLSOCK_MAGIC ||
+	    hdr.version != CTLSOCK_VERSION) {
+		sess->status = CTLSOCK_S_BADMSG;
+		goto drop;
+	}
+	if (len > CTLSOCK_MAX_REQLEN - sizeof(hdr)) {
+		sess->status = CTLSOCK_S_TOOBIG;
+		goto drop;
+	}
+	if (sess->rx_len < sizeof(hdr) + len) {
+		sess->in_batch = 0;
+		sess->tx_len = 0;
+		return 0; /* wait for the rest */
+	}
+	sess->req_len = sizeof(hdr) + len;
+	return 1;
+
+ drop:
+	/* the stream cannot be resynchronized */
+	sess->nb_cmds = 0;
+	sess->req_len = sess->rx_len;
+	sess->state = CSS_CLOSING;
+	return 1;
+}
+
+static void ctlsock_batch_exec(struct ctlsock_sess *sess)
+{
+	char *argv[CTLSOCK_MAX_NB_ARGS];
+	struct ctlsock_cmd cmd;
+	struct ctlsock_res res;
+	size_t res_off;
+	char *args, *p;
+	uint16_t len;
+	unsigned int i;
+	int ret;
+
+	/* parse command */
+	if (sess->req_off + sizeof(cmd) > sess->req_len)
+		goto err_badmsg;
+	memcpy(&cmd, &sess->rxbuf[sess->req_off], sizeof(cmd));
+	len = ntohs(cmd.len);
+	args = &sess->rxbuf[sess->req_off + sizeof(cmd)];
+	if (sess->req_off + sizeof(cmd) + len > sess->req_len ||
+	    cmd.argc == 0 || cmd.argc > CTLSOCK_MAX_NB_ARGS ||
+	    len == 0 || args[len - 1] != '\0')
+		goto err_badmsg;
+	for (i = 0, p = args; i < cmd.argc; ++i) {
+		if (p >= args + len)
+			goto err_badmsg;
+		argv[i] = p;
+		p += strlen(p) + 1;
+	}
+	sess->req_off += sizeof(cmd) + len;
+
+	/* execute */
+	if (sess->tx_len + sizeof(res) > CTLSOCK_MAX_REPLEN) {
+		sess->status = CTLSOCK_S_NOSPC;
+		return;
+	}
+	res_off = sess->tx_len;
+	sess->tx_len += sizeof(res);
+	sess->trunc = 0;
+	printd("Control session %u: executing '%s'\n", sess->id, argv[0]);
+	ret = shell_exec(sess->cio, (int) cmd.argc, argv);
+	fflush(sess->cio);
+
+	res.ret = (int32_t) htonl((uint32_t) ret);
+	res.flags = htons(sess->trunc ? CTLSOCK_RF_TRUNC : 0);
+	res._reserved = 0;
+	res.len = htonl((uint32_t) (sess->tx_len - res_off - sizeof(res)));
+	memcpy(&sess->txbuf[res_off], &res, sizeof(res));
+	++sess->nb_done;
+
+	if (ret < 0 && (sess->flags & CTLSOCK_F_STOPONERR))
+		sess->nb_cmds = sess->nb_done; /* skip the rest */
+	return;
+
+ err_badmsg:
+	sess->status = CTLSOCK_S_BADMSG;
+	sess->state = CSS_CLOSING;
+}
+
+static void ctlsock_batch_end(struct ctlsock_sess *sess)
+{
+	struct ctlsock_hdr hdr;
+
+	hdr.magic = htons(CTLSOCK_MAGIC);
+	hdr.version = CTLSOCK_VERSION;
+	hdr.flags = 0;
+	hdr.seq = htonl(sess->seq);
+	hdr.nb_cmds = htons(sess->nb_done);
+	hdr.status = htons((uint16_t) sess->status);
+	hdr.len = htonl((uint32_t) (sess->tx_len - sizeof(hdr)));
+	memcpy(sess->txbuf, &hdr, sizeof(hdr));
+
+	/* release the request from the receive buffer */
+	memmove(sess->rxbuf, &sess->rxbuf[sess->req_len], sess->rx_len - sess->req_len);
+	sess->rx_len -= sess->req_len;
+	sess->in_batch = 0;
+}
+
+/* the session thread */
+static void ctlsock_sess_thread(void *argp)
+{
+	struct ctlsock_sess *sess = argp;
+
+	while (sess->state != CSS_DEAD) {
+		if (!sess->exec) {
+			schedule(); /* wait for the next batch */
+			continue;
+		}
+		while (sess->nb_done < sess->nb_cmds &&
+		       sess->status == CTLSOCK_S_OK &&
+		       sess->state != CSS_DEAD) {
+			ctlsock_batch_exec(sess);
+			schedule(); /* do not disturb serving */
+		}
+		sess->exec = 0;
+	}
+	sess->thread = NULL; /* session can be released now */
+}
+
+static inline void ctlsock_sess_send(struct ctlsock_sess *sess)
+{
+#ifdef CTLSOCK_UNIX
+	if (sess->type == CST_UNIX) {
+		ctlsock_unix_send(sess);
+		return;
+	}
+#endif
+	ctlsock_tcp_send(sess);
+}
+
+void ctlsock_poll(void)
+{
+	struct ctlsock_sess *sess;
+	unsigned int i;
+
+	if (unlikely(!cs))
+		return;
+#ifdef CTLSOCK_UNIX
+	if (cs->lfd >= 0)
+		ctlsock_unix_accept();
+#endif
+
+	for (i = 0; i < CTLSOCK_MAX_NB_SESS; ++i) {
+		sess = cs->sess[i];
+		if (!sess)
+			continue;
+#ifdef CTLSOCK_UNIX
+		if (sess->type == CST_UNIX && sess->state == CSS_ESTABLISHED)
+			ctlsock_unix_recv(sess);
+#endif
+
+		if (sess->exec)
+			continue; /* batch is still executed */
+		if (sess->in_batch)
+			ctlsock_batch_end(sess); /* reply is complete now */
+
+		/* previous reply has to be sent out completely */
+		if (sess->state != CSS_DEAD && sess->tx_off < sess->tx_len)
+			ctlsock_sess_send(sess);
+		if (sess->state == CSS_DEAD ||
+		    (sess->state == CSS_CLOSING && sess->tx_off == sess->tx_len)) {
+			/* the session thread has to exit first */
+			sess->state = CSS_DEAD;
+			if (!sess->thread)
+				ctlsock_sess_close(sess);
+			continue;
+		}
+		if (sess->tx_off < sess->tx_len)
+			continue;
+
+		if (!ctlsock_batch_begin(sess)) {
+			if (sess->state == CSS_EOF)
+				sess->state = CSS_CLOSING; /* no complete request left */
+			continue;
+		}
+		if (sess->nb_cmds) {
+			sess->exec = 1; /* handed over to the session thread */
+			continue;
+		}
+		ctlsock_batch_end(sess);
+		ctlsock_sess_send(sess);
+	}
+}
@@ -0,0 +1,116 @@
+/*
+ * Binary control protocol (batched µShell commands)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef _CTLSOCK_H_
+#define _CTLSOCK_H_
+
+#include <stdint.h>
+#ifdef CTLSOCK_UNIX
+#include <sys/select.h>
+#endif
+
+/*
+ * Low-latency control channel for orchestration: batches of µShell
+ * commands are sent over a dedicated TCP port (all targets) or a UNIX
+ * domain socket (Linux). The commands are executed by a thread of the
+ * session, like shell sessions do, which yields the CPU to the main loop
+ * after each command. Each batch is answered with one reply that carries
+ * return code and output of each command.
+ *
+ * Wire format (integers in network byte order):
+ *  Request: struct ctlsock_hdr, followed by nb_cmds times
+ *           struct ctlsock_cmd + len bytes of argc NUL-terminated arguments
+ *  Reply:   struct ctlsock_hdr (seq of the request, nb_cmds = number of
+ *           executed commands), followed by nb_cmds times
+ *           struct ctlsock_res + len bytes of command output
+ * Batches of a connection are answered in order. A malformed request is
+ * answered with a status code and the connection is closed afterwards.
+ * A client may shut down its sending side after the last request: the
+ * complete requests are still answered before the connection is closed.
+ */
+#define CTLSOCK_MAGIC       0x4d43 /* "MC" */
+#define CTLSOCK_VERSION     1
+#define CTLSOCK_MAX_REQLEN  4096   /* max. length of a request (with header) */
+#define CTLSOCK_MAX_REPLEN  65536  /* max. length of a reply (with headers) */
+
+#define CTLSOCK_F_STOPONERR 0x01   /* request: skip remaining commands when one
+                                    * returns a negative value */
+
+enum ctlsock_status {
+	CTLSOCK_S_OK = 0,
+	CTLSOCK_S_BADMSG,          /* malformed request */
+	CTLSOCK_S_TOOBIG,          /* request exceeds CTLSOCK_MAX_REQLEN */
+	CTLSOCK_S_NOSPC,           /* reply buffer is full: batch was cut */
+};
+
+#define CTLSOCK_RF_TRUNC    0x01   /* result: output was truncated */
+
+struct ctlsock_hdr {
+	uint16_t magic;
+	uint8_t  version;
+	uint8_t  flags;
+	uint32_t seq;              /* chosen by the client */
+	uint16_t nb_cmds;
+	uint16_t status;           /* reply only */
+	uint32_t len;              /* length of data following this header */
+} __attribute__((packed));
+
+struct ctlsock_cmd {
+	uint16_t len;
+	uint8_t  argc;
+	uint8_t  _reserved;
+} __attribute__((packed));
+
+struct ctlsock_res {
+	int32_t  ret;              /* return code of the command (-ENOENT: unknown) */
+	uint16_t flags;
+	uint16_t _reserved;
+	uint32_t len;
+} __attribute__((packed));
+
+/* port 0: no TCP listener, path NULL: no UNIX domain socket */
+int init_ctlsock(uint16_t port, const char *path);
+void exit_ctlsock(void);
+
+/* serves the sessions and hands over complete requests to their
+ * threads; called once per main loop iteration */
+void ctlsock_poll(void);
+#ifdef CTLSOCK_UNIX
+/* adds the sockets to a select() set, returns the highest fd (-1: none) */
+int ctlsock_fdset(fd_set *rfds);
+#endif
+
+#endif /* _CTLSOCK_H_ */
@@ -182,7 +182,25 @@ static inline void hash_clear(hash512_t h, uint8_t hlen)
 #endif
 }
 
-static inline int hash_parse(const char *in, hash512_t h, uint8_t hlen)
+/*
+ * Hex conversion of hash digests
+ *
+ * Digests are parsed from every requested URL, so the conversion is done
+ * 16 (SSE2) or 32 (AVX2) characters at a time when the compiler targets
+ * these instruction sets. The remainder is converted byte by byte.
+ */
+#if !defined __KERNEL__ && (defined __SSE2__ || defined __AVX2__)
+#include <immintrin.h>
+#define HASH_HEX_SIMD
+/* a vector load must not cross into a (potentially unmapped) next page
+ * because the string might end before */
+#define _hash_hex_can_load(p, len) \
+	((((uintptr_t) (p)) & 4095) <= (4096 - (len)))
+#endif
+
+static const char _hash_hex_digits[] = "0123456789abcdef";
+
+static inline int _hash_parse_scalar(const char *in, hash512_t h, uint8_t hlen)
 {
 	uint8_t strlen = hlen * 2;
 	uint8_t i, nu, nl;
@@ -228,10 +246,144 @@ static inline int hash_parse(const char *in, hash512_t h, uint8_t hlen)
 		h[i >> 1] = (nu << 4) | nl;
 	}
 
-	if (in[i] != '\0')
+	return 0;
+}
+
+#ifdef HASH_HEX_SIMD
+/* converts 16 hex characters to 8 bytes, returns 0 on invalid characters */
+static inline int _hash_parse16_sse2(const char *in, uint8_t *out)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *) in);
+	__m128i digit, alpha, lc, nib, w;
+
+	digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+	                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+#ifndef SHFS_HASH_PARSE_CASE_SENSITIVE
+	lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+#else
+	lc = v;
+#endif
+	alpha = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+	                      _mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+		return 0;
+
+	nib = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+	                   _mm_and_si128(alpha, _mm_sub_epi8(lc, _mm_set1_epi8('a' - 10))));
+	/* each 16-bit lane holds (lower nibble << 8) | upper nibble */
+	w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0x00FF)), 4),
+	                 _mm_srli_epi16(nib, 8));
+	_mm_storel_epi64((__m128i *) out, _mm_packus_epi16(w, w));
+	return 1;
+}
+
+/* converts 8 bytes to 16 hex characters */
+static inline void _hash_format8_sse2(const uint8_t *in, char *out)
+{
+	__m128i v = _mm_loadl_epi64((const __m128i *) in);
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i nib;
+
+	nib = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), mask),
+	                        _mm_and_si128(v, mask));
+	nib = _mm_add_epi8(_mm_add_epi8(nib, _mm_set1_epi8('0')),
+	                   _mm_and_si128(_mm_cmpgt_epi8(nib, _mm_set1_epi8(9)),
+	                                 _mm_set1_epi8('a' - '0' - 10)));
+	_mm_storeu_si128((__m128i *) out, nib);
+}
+#endif /* HASH_HEX_SIMD */
+
+#if defined HASH_HEX_SIMD && defined __AVX2__
+/* converts 32 hex characters to 16 bytes, returns 0 on invalid characters */
+static inline int _hash_parse32_avx2(const char *in, uint8_t *out)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *) in);
+	__m256i digit, alpha, lc, nib, w;
+
+	digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+	                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+#ifndef SHFS_HASH_PARSE_CASE_SENSITIVE
+	lc = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+#else
+	lc = v;
+#endif
+	alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)),
+	                         _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lc));
+	if ((uint32_t) _mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != 0xFFFFFFFF)
+		return 0;
+
+	nib = _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+	                      _mm256_and_si256(alpha, _mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10))));
+	w = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nib, _mm256_set1_epi16(0x00FF)), 4),
+	                    _mm256_srli_epi16(nib, 8));
+	/* packing works per 128-bit lane: gather quadwords 0 and 2 */
+	w = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0xD8);
+	_mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(w));
+	return 1;
+}
+
+/* converts 16 bytes to 32 hex characters */
+static inline void _hash_format16_avx2(const uint8_t *in, char *out)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *) in);
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	__m128i lo = _mm_and_si128(v, mask);
+	__m256i nib;
+
+	nib = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(hi, lo)),
+	                              _mm_unpackhi_epi8(hi, lo), 1);
+	nib = _mm256_add_epi8(_mm256_add_epi8(nib, _mm256_set1_epi8('0')),
+	                      _mm256_and_si256(_mm256_cmpgt_epi8(nib, _mm256_set1_epi8(9)),
+	                                       _mm256_set1_epi8('a' - '0' - 10)));
+	_mm256_storeu_si256((__m256i *) out, nib);
+}
+#endif
+
+/* parses a hex string of exactly (2 * hlen) characters */
+static inline int hash_parse(const char *in, hash512_t h, uint8_t hlen)
+{
+	uint8_t i = 0;
+
+#ifdef HASH_HEX_SIMD
+#ifdef __AVX2__
+	for (; (i + 16) <= hlen && _hash_hex_can_load(&in[i << 1], 32); i += 16) {
+		if (!_hash_parse32_avx2(&in[i << 1], &h[i]))
+			return -1;
+	}
+#endif
+	for (; (i + 8) <= hlen && _hash_hex_can_load(&in[i << 1], 16); i += 8) {
+		if (!_hash_parse16_sse2(&in[i << 1], &h[i]))
+			return -1;
+	}
+#endif
+	if (i < hlen &&
+	    _hash_parse_scalar(&in[i << 1], &h[i], hlen - i) < 0)
 		return -1;
 
+	if (in[hlen << 1] != '\0')
+		return -1;
 	return 0;
 }
 
+/* writes (2 * hlen) hex characters and a terminating '\0' to out */
+static inline void hash_format(const hash512_t h, uint8_t hlen, char *out)
+{
+	uint8_t i = 0;
+
+#ifdef HASH_HEX_SIMD
+#ifdef __AVX2__
+	for (; (i + 16) <= hlen; i += 16)
+		_hash_format16_avx2(&h[i], &out[i << 1]);
+#endif
+	for (; (i + 8) <= hlen; i += 8)
+		_hash_format8_sse2(&h[i], &out[i << 1]);
+#endif
+	for (; i < hlen; ++i) {
+		out[(i << 1)]     = _hash_hex_digits[h[i] >> 4];
+		out[(i << 1) + 1] = _hash_hex_digits[h[i] & 0x0F];
+	}
+	out[hlen << 1] = '\0';
+}
+
 #endif /* _HASH_H_ */
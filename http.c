@@ -42,7 +42,14 @@
 #include "http_data.h"
 #include "http_fio.h"
 #include "http_link.h"
+#ifdef HTTP_INGEST
+#include "http_ingest.h"
+#endif
+#ifdef HTTP_TLS
+#include "http_tls.h"
+#endif
 #include "http.h"
+#include "memacct.h"
 
 struct http_srv *hs = NULL;
 
@@ -53,26 +60,110 @@ static err_t httpsess_recv   (void *argp, struct tcp_pcb *tpcb, struct pbuf *p,
 static void  httpsess_error  (void *argp, err_t err);
 static err_t httpsess_poll   (void *argp, struct tcp_pcb *tpcb);
 static err_t httpsess_acknowledge(struct http_sess *hsess, size_t len);
+#ifdef HTTP_INGEST
+static void  httpsess_recv_resume(struct http_sess *hsess);
+#endif
+#ifdef HTTP_TLS
+static err_t httpsess_recv_tls(struct http_sess *hsess, struct pbuf *p);
+#endif
+static int httprecv_req_begin(struct http_parser *parser);
 static int httprecv_req_complete(struct http_parser *parser);
 static int httprecv_hdr_url(struct http_parser *parser, const char *buf, size_t len);
+static int httprecv_hdr_complete(struct http_parser *parser);
+#ifdef HTTP_INGEST
+static int httprecv_body(struct http_parser *parser, const char *buf, size_t len);
+#endif
 
 static http_parser_settings _http_parser_settings = {
-	.on_message_begin = NULL,
+	.on_message_begin = httprecv_req_begin,
 	.on_url = httprecv_hdr_url,
 	.on_status = NULL,
 	.on_header_field = httpparser_recvhdr_field,
 	.on_header_value = httpparser_recvhdr_value,
-	.on_headers_complete = NULL,
+	.on_headers_complete = httprecv_hdr_complete,
+#ifdef HTTP_INGEST
+	.on_body = httprecv_body,
+#else
 	.on_body = NULL,
+#endif
 	.on_message_complete = httprecv_req_complete
 };
 
-int init_http(uint16_t nb_sess, uint32_t nb_reqs)
+static uint16_t http_max_sess_per_ip = 0;
+
+void http_set_max_sess_per_ip(uint16_t max)
+{
+	http_max_sess_per_ip = max;
+}
+
+static int http_listener_open(struct http_listener *hl, const struct http_listener_cfg *cfg)
 {
 	err_t err;
+	int ret;
+
+	hl->cfg = *cfg;
+	if (hl->cfg.keepalive_timeout < 0) {
+		hl->keepalive_timeout = HTTP_KEEPALIVE_TIMEOUT;
+		hl->cfg.keepalive_timeout = (HTTP_KEEPALIVE_TIMEOUT * HTTP_POLL_INTERVAL) / 2;
+	} else {
+		hl->keepalive_timeout = DIV_ROUND_UP(hl->cfg.keepalive_timeout * 2, HTTP_POLL_INTERVAL);
+	}
+	hl->max_nb_sess = (cfg->max_nb_sess && cfg->max_nb_sess < hs->max_nb_sess) ?
+		cfg->max_nb_sess : hs->max_nb_sess;
+	hl->nb_sess = 0;
+	hl->nb_accepted = 0;
+	hl->nb_declined = 0;
+
+	hl->tpcb = tcp_new();
+	if (!hl->tpcb) {
+		ret = -ENOMEM;
+		goto err_out;
+	}
+	err = tcp_bind(hl->tpcb, &hl->cfg.addr, hl->cfg.port);
+	if (err != ERR_OK) {
+		ret = -err;
+		goto err_free_tcp;
+	}
+#if TCP_LISTEN_BACKLOG
+	/* SYN_RCVD connections count against the backlog: a SYN flood cannot
+	 * take more than HTTP_LISTEN_BACKLOG PCBs per listener */
+	hl->tpcb = tcp_listen_with_backlog(hl->tpcb, HTTP_LISTEN_BACKLOG);
+#else
+	hl->tpcb = tcp_listen(hl->tpcb);
+#endif
+	if (!hl->tpcb) {
+		ret = -ENOMEM;
+		goto err_out;
+	}
+	tcp_arg(hl->tpcb, hl);
+	tcp_accept(hl->tpcb, httpsess_accept); /* register session accept */
+	return 0;
+
+ err_free_tcp:
+	tcp_abort(hl->tpcb);
+ err_out:
+	return ret;
+}
+
+int init_http(uint16_t nb_sess, uint32_t nb_reqs,
+              const struct http_listener_cfg *lcfg, unsigned int nb_listeners)
+{
+	struct http_listener_cfg dcfg;
+	uint32_t nb_slots;
+	unsigned int i;
 	int ret = 0;
 
-	hs = target_malloc(CACHELINE_SIZE, sizeof(*hs));
+	if (!lcfg || !nb_listeners) {
+		http_listener_cfg_init(&dcfg, HTTP_LISTEN_PORT);
+		lcfg = &dcfg;
+		nb_listeners = 1;
+	}
+	if (nb_listeners > HTTP_MAX_NB_LISTENERS) {
+		ret = -EINVAL;
+		goto err_out;
+	}
+
+	hs = memacct_malloc(MEMT_HTTP, CACHELINE_SIZE, sizeof(*hs));
 	if (!hs) {
 		ret = -ENOMEM;
 		goto err_out;
@@ -82,39 +173,73 @@ int init_http(uint16_t nb_sess, uint32_t nb_reqs)
 	hs->max_nb_reqs = nb_reqs;
 	hs->nb_reqs = 0;
 
+	/* reservations have to fit into the session pool */
+	hs->rsv_nb_sess = 0;
+	for (i = 0; i < nb_listeners; ++i)
+		hs->rsv_nb_sess += lcfg[i].rsv_nb_sess;
+	if (hs->rsv_nb_sess > hs->max_nb_sess) {
+		ret = -EINVAL;
+		goto err_free_hs;
+	}
+
 	/* allocate session pool */
-	hs->sess_pool = alloc_simple_mempool(hs->max_nb_sess, sizeof(struct http_sess));
+	hs->sess_pool = alloc_simple_mempool(MEMT_HTTP, hs->max_nb_sess, sizeof(struct http_sess));
 	if (!hs->sess_pool) {
 		ret = -ENOMEM;
 		goto err_free_hs;
 	}
 
 	/* allocate request pool */
-	hs->req_pool = alloc_simple_mempool(hs->max_nb_reqs, sizeof(struct http_req));
+	hs->req_pool = alloc_simple_mempool(MEMT_HTTP, hs->max_nb_reqs, sizeof(struct http_req));
 	if (!hs->req_pool) {
 		ret = -ENOMEM;
 		goto err_free_sesspool;
 	}
 
+	/* allocate per client IP session counters: the table is kept
+	 * at most half full, so probe sequences stay short */
+	hs->iplimit = NULL;
+	hs->iplimit_mask = 0;
+	hs->max_sess_per_ip = http_max_sess_per_ip;
+	hs->nb_iplimit_declined = 0;
+	if (hs->max_sess_per_ip) {
+		for (nb_slots = 1; nb_slots < ((uint32_t) hs->max_nb_sess << 1); nb_slots <<= 1);
+		hs->iplimit = memacct_malloc(MEMT_HTTP, CACHELINE_SIZE,
+		                             nb_slots * sizeof(*hs->iplimit));
+		if (!hs->iplimit) {
+			ret = -ENOMEM;
+			goto err_free_reqpool;
+		}
+		memset(hs->iplimit, 0, nb_slots * sizeof(*hs->iplimit));
+		hs->iplimit_mask = nb_slots - 1;
+	}
+
 	/* initialize http link system */
 	ret = httplink_init(hs);
 	if (ret < 0)
-		goto err_free_reqpool;
-
-	/* register TCP listener */
-	hs->tpcb = tcp_new();
-	if (!hs->tpcb) {
-		ret = -ENOMEM;
-		goto err_exit_link;
+		goto err_free_iplimit;
+
+#ifdef HTTP_TLS
+	/* initialize TLS if a listener serves HTTPS */
+	hs->tls = 0;
+	hs->nb_tls_handshakes = 0;
+	hs->nb_tls_errors = 0;
+	for (i = 0; i < nb_listeners; ++i)
+		hs->tls |= lcfg[i].tls;
+	if (hs->tls) {
+		ret = http_tls_init(hs->max_nb_sess);
+		if (ret < 0)
+			goto err_exit_link;
 	}
-	err = tcp_bind(hs->tpcb, IP_ADDR_ANY, HTTP_LISTEN_PORT);
-	if (err != ERR_OK) {
-		ret = -err;
-		goto err_free_tcp;
+#endif
+
+	/* register TCP listeners */
+	for (hs->nb_listeners = 0; hs->nb_listeners < nb_listeners; ++hs->nb_listeners) {
+		ret = http_listener_open(&hs->listener[hs->nb_listeners],
+		                         &lcfg[hs->nb_listeners]);
+		if (ret < 0)
+			goto err_close_listeners;
 	}
-	hs->tpcb = tcp_listen(hs->tpcb);
-	tcp_arg(hs->tpcb, hs);
-	tcp_accept(hs->tpcb, httpsess_accept); /* register session accept */
 
 	/* init session list */
 	hs->hsess_head = NULL;
@@ -122,6 +247,26 @@ int init_http(uint16_t nb_sess, uint32_t nb_reqs)
 
 	/* wait for I/O retry list */
 	dlist_init_head(hs->ioretry_chain);
+#ifdef HTTP_INGEST
+	/* sessions that continue a stopped receive */
+	dlist_init_head(hs->resume_chain);
+#endif
+	/* sessions waiting in keep-alive */
+	dlist_init_head(hs->idle_chain);
+	hs->nb_idle_evicted = 0;
+	hs->nb_rehydrate_defers = 0;
+#ifdef HTTP_ACK_COALESCE
+	/* pending ACK list */
+	dlist_init_head(hs->ack_chain);
+	hs->nb_ack_cbs = 0;
+	hs->nb_ack_runs = 0;
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	/* sessions with unsent output */
+	dlist_init_head(hs->flush_chain);
+	hs->nb_flush_reqs = 0;
+	hs->nb_flush_runs = 0;
+#endif
 
 	printd("HTTP server %p initialized\n", hs);
 #if defined HAVE_SHELL && defined HTTP_INFO
@@ -129,22 +274,33 @@ int init_http(uint16_t nb_sess, uint32_t nb_reqs)
 #endif
 	return 0;
 
- err_free_tcp:
-	tcp_abort(hs->tpcb);
+ err_close_listeners:
+	for (i = 0; i < hs->nb_listeners; ++i)
+		tcp_close(hs->listener[i].tpcb);
+#ifdef HTTP_TLS
+	if (hs->tls)
+		http_tls_exit();
  err_exit_link:
+#endif
 	httplink_exit(hs);
+ err_free_iplimit:
+	if (hs->iplimit)
+		memacct_free(MEMT_HTTP, hs->iplimit,
+		             (hs->iplimit_mask + 1) * sizeof(*hs->iplimit));
  err_free_reqpool:
 	free_mempool(hs->req_pool);
  err_free_sesspool:
 	free_mempool(hs->sess_pool);
  err_free_hs:
-	target_free(hs);
+	memacct_free(MEMT_HTTP, hs, sizeof(*hs));
  err_out:
 	return ret;
 }
 
 void exit_http(void)
 {
+	unsigned int i;
+
 	/* terminate connections that are still open */
 	while(hs->hsess_head) {
 		printd("Closing session %p...\n", hs->hsess_head);
@@ -153,24 +309,50 @@ void exit_http(void)
 	BUG_ON(hs->nb_reqs != 0);
 	BUG_ON(hs->nb_sess != 0);
 
-	tcp_close(hs->tpcb);
+	for (i = 0; i < hs->nb_listeners; ++i)
+		tcp_close(hs->listener[i].tpcb);
+#ifdef HTTP_TLS
+	if (hs->tls)
+		http_tls_exit();
+#endif
 	httplink_exit(hs);
+	if (hs->iplimit)
+		memacct_free(MEMT_HTTP, hs->iplimit,
+		             (hs->iplimit_mask + 1) * sizeof(*hs->iplimit));
 	free_mempool(hs->req_pool);
 	free_mempool(hs->sess_pool);
-	target_free(hs);
+	memacct_free(MEMT_HTTP, hs, sizeof(*hs));
 	hs = NULL;
 }
 
 /*******************************************************************************
  * Session + Request handling
  ******************************************************************************/
+/* The keep-alive timeout of a listener applies as long as at most half of
+ * the session pool is in use. Beyond that, it shrinks with the number of
+ * free sessions, so that idle connections make room faster
+ * Note: A shrunk timeout stays at least one poll interval: httpsess_poll()
+ *       decrements the timer after taking the minimum, so 0 would end up
+ *       as -1 (timeout disabled) */
+static inline int httpsess_keepalive_timeout(struct http_sess *hsess)
+{
+	register uint32_t nb_free = hs->max_nb_sess - hs->nb_sess;
+	register int timeout = hsess->hl->keepalive_timeout;
+
+	if ((nb_free << 1) < hs->max_nb_sess && timeout > 1)
+		timeout = max(1, (int) (((uint32_t) timeout * (nb_free << 1)) / hs->max_nb_sess));
+	return timeout;
+}
+
 #define httpsess_reset_keepalive(hsess) \
 	do { \
-		(hsess)->keepalive_timer = HTTP_KEEPALIVE_TIMEOUT; \
+		(hsess)->keepalive_timer = httpsess_keepalive_timeout((hsess)); \
+		httpsess_register_idle((hsess)); \
 	} while(0)
 #define httpsess_halt_keepalive(hsess) \
 	do { \
 		(hsess)->keepalive_timer = -1; \
+		httpsess_unregister_idle((hsess)); \
 	} while(0)
 
 /* gets called whenever it is worth
@@ -182,6 +364,16 @@ void http_poll_ioretry(void) {
 	if (unlikely(!hs))
 		return; /* no active http server */
 
+#ifdef HTTP_INGEST
+	/* continue receives that were stopped for ingest operations
+	 * Note: a resumed session is registered again by the
+	 *       write completion only, so this loop terminates */
+	while ((hsess = dlist_first_el(hs->resume_chain, struct http_sess))) {
+		dlist_unlink(hsess, hs->resume_chain, resume_chain);
+		httpsess_recv_resume(hsess);
+	}
+#endif
+
 	hsess = dlist_first_el(hs->ioretry_chain, struct http_sess);
 	/* clear head so that a new list is created
 	 * This avoids the the case that within a callback the elements gets
@@ -196,12 +388,67 @@ void http_poll_ioretry(void) {
 		hsess->ioretry_chain.prev = NULL;
 
 		printd("Retrying I/O on session %p\n", hsess);
+		trace_ioretry_run(hsess);
 		httpsess_respond(hsess); /* can register itself to the new list */
 
 		hsess = hsess_next; /* next element */
 	}
 }
 
+#ifdef HTTP_ACK_COALESCE
+/* gets called after each RX burst: ACKs that arrived for a session
+ * within the burst are processed with a single acknowledge run
+ * Note: lwIP still processes every single ACK segment (e.g., for
+ *       duplicate ACK detection), only the application callback
+ *       and the following send logic are coalesced */
+void http_poll_acks(void) {
+	struct http_sess *hsess;
+	size_t len;
+
+	if (unlikely(!hs))
+		return; /* no active http server */
+
+	/* Note: an acknowledge run can close sessions but it never
+	 * processes incoming segments, so no new elements get appended */
+	while ((hsess = dlist_first_el(hs->ack_chain, struct http_sess))) {
+		dlist_unlink(hsess, hs->ack_chain, ack_chain);
+		len = hsess->ack_pending;
+		hsess->ack_pending = 0;
+
+		if (likely(hsess->state == HSS_ESTABLISHED && len)) {
+			++hs->nb_ack_runs;
+			httpsess_acknowledge(hsess, len); /* will continue replying */
+		}
+	}
+}
+#endif
+
+#ifdef HTTP_FLUSH_COALESCE
+/* gets called once at the end of each loop iteration: sessions that
+ * enqueued data during the iteration (block I/O completions, RX burst,
+ * acknowledge runs, I/O retries) are pushed out with one tcp_output()
+ * each, so that the headers share a segment with the body start and
+ * delayed ACKs are piggybacked on the data */
+void http_poll_flush(void) {
+	struct http_sess *hsess;
+
+	if (unlikely(!hs))
+		return; /* no active http server */
+
+	/* Note: tcp_output() does not call back into the server,
+	 * so no new elements get appended while we walk the list */
+	while ((hsess = dlist_first_el(hs->flush_chain, struct http_sess))) {
+		dlist_unlink(hsess, hs->flush_chain, flush_chain);
+
+		if (likely(hsess->state == HSS_ESTABLISHED ||
+		           hsess->state == HSS_CLOSING)) {
+			++hs->nb_flush_runs;
+			tcp_output(hsess->tpcb);
+		}
+	}
+}
+#endif
+
 static inline struct http_req *httpreq_open(struct http_sess *hsess)
 {
 	struct mempool_obj *hrobj;
@@ -216,6 +463,7 @@ static inline struct http_req *httpreq_open(struct http_sess *hsess)
 	hreq->next = NULL;
 
 	hreq->state = HRS_PARSING_HDR;
+	trace_req_state(hreq, HRS_PARSING_HDR);
 	hreq->type = HRT_UNDEF;
 	http_recvhdr_reset(&hreq->request.hdr);
 	hreq->request.url_len = 0;
@@ -246,6 +494,12 @@ static inline void httpreq_close(struct http_req *hreq)
 	/* unlink session from ioretry chain if it was linked before */
 	httpsess_unregister_ioretry(hreq->hsess);
 
+#ifdef HTTP_INGEST
+	/* abort/release volume operation */
+	if (hreq->type == HRT_INGEST)
+		httpreq_ingest_close(hreq);
+#endif
+
 	/* close open file */
 	if (hreq->fd) {
 		switch (hreq->type) {
@@ -267,13 +521,146 @@ static inline void httpreq_close(struct http_req *hreq)
 	printd("Request %p destroyed\n", hreq);
 }
 
+/*******************************************************************************
+ * Per client IP session limit
+ ******************************************************************************/
+static inline uint32_t http_iplimit_hash(uint32_t addr)
+{
+	addr ^= addr >> 16;
+	addr *= 0x45d9f3b;
+	addr ^= addr >> 16;
+	return addr & hs->iplimit_mask;
+}
+
+/* Note: the table cannot run full because there are at most
+ * max_nb_sess addresses with sessions but twice as many slots */
+static inline struct http_iplimit_slot *http_iplimit_lookup(uint32_t addr, int insert)
+{
+	register uint32_t i = http_iplimit_hash(addr);
+
+	for (;;) {
+		if (hs->iplimit[i].addr == addr)
+			return &hs->iplimit[i];
+		if (hs->iplimit[i].addr == 0) {
+			if (!insert)
+				return NULL;
+			hs->iplimit[i].addr = addr;
+			hs->iplimit[i].nb_sess = 0;
+			return &hs->iplimit[i];
+		}
+		i = (i + 1) & hs->iplimit_mask;
+	}
+}
+
+static inline uint16_t http_iplimit_nb_sess(uint32_t addr)
+{
+	struct http_iplimit_slot *slot = http_iplimit_lookup(addr, 0);
+
+	return slot ? slot->nb_sess : 0;
+}
+
+static inline void http_iplimit_get(uint32_t addr)
+{
+	++http_iplimit_lookup(addr, 1)->nb_sess;
+}
+
+static void http_iplimit_put(uint32_t addr)
+{
+	struct http_iplimit_slot *slot = http_iplimit_lookup(addr, 0);
+	register uint32_t i, j, k;
+
+	BUG_ON(!slot || slot->nb_sess == 0);
+	if (--slot->nb_sess)
+		return;
+
+	/* backward shift deletion: entries behind the freed slot are moved
+	 * up unless this would put them before their home slot */
+	i = j = (uint32_t) (slot - hs->iplimit);
+	for (;;) {
+		j = (j + 1) & hs->iplimit_mask;
+		if (hs->iplimit[j].addr == 0)
+			break;
+		k = http_iplimit_hash(hs->iplimit[j].addr);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		hs->iplimit[i] = hs->iplimit[j];
+		i = j;
+	}
+	hs->iplimit[i].addr = 0;
+	hs->iplimit[i].nb_sess = 0;
+}
+
+/* returns 1 if a listener may take a session from the shared pool:
+ * its own reservation is always served, sessions beyond that are only
+ * handed out as long as the reservations of the others stay intact */
+static inline int httpsess_admit(struct http_listener *hl)
+{
+	struct http_listener *ol;
+	uint16_t ursv = 0; /* unused reservations of other listeners */
+	unsigned int i;
+
+	if (hl->nb_sess >= hl->max_nb_sess)
+		return 0;
+	if (hl->nb_sess < hl->cfg.rsv_nb_sess)
+		return 1;
+	for (i = 0; i < hs->nb_listeners; ++i) {
+		ol = &hs->listener[i];
+		if (ol != hl && ol->nb_sess < ol->cfg.rsv_nb_sess)
+			ursv += ol->cfg.rsv_nb_sess - ol->nb_sess;
+	}
+	return (hs->max_nb_sess - hs->nb_sess) > ursv;
+}
+
+/* closes the session that waits longest in keep-alive to make room for a
+ * new one of hl, returns 1 if hl can take a session afterwards */
+static int httpsess_evict_idle(struct http_listener *hl)
+{
+	struct http_sess *hsess;
+	struct http_listener *ol;
+
+	dlist_foreach(hsess, hs->idle_chain, idle_chain) {
+		ol = hsess->hl;
+		if (ol == hl)
+			goto evict;
+		/* other listeners only help when the shared pool is the limit,
+		 * their reserved sessions stay untouched */
+		if (hl->nb_sess < hl->max_nb_sess &&
+		    ol->nb_sess > ol->cfg.rsv_nb_sess)
+			goto evict;
+	}
+	return 0;
+
+ evict:
+	printd("Evicting idle session %p to make room for a new one\n", hsess);
+	++hs->nb_idle_evicted;
+	httpsess_close(hsess, HSC_CLOSE);
+	return httpsess_admit(hl);
+}
+
 static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 {
+	struct http_listener *hl = argp;
 	struct mempool_obj *hsobj;
 	struct http_sess *hsess;
+	uint32_t raddr;
 
+#if TCP_LISTEN_BACKLOG
+	tcp_accepted(hl->tpcb); /* leaves the backlog, also when declined */
+#endif
 	if (err != ERR_OK)
 		goto err_out;
+	raddr = ip4_addr_get_u32(&new_tpcb->remote_ip);
+	if (hs->iplimit &&
+	    http_iplimit_nb_sess(raddr) >= hs->max_sess_per_ip) {
+		++hs->nb_iplimit_declined;
+		err = ERR_MEM;
+		goto err_out;
+	}
+	if (!httpsess_admit(hl) && !httpsess_evict_idle(hl)) {
+		++hl->nb_declined;
+		err = ERR_MEM;
+		goto err_out;
+	}
 	hsobj = mempool_pick(hs->sess_pool);
 	if (!hsobj) {
 		err = ERR_MEM;
@@ -282,14 +669,21 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	hsess = hsobj->data;
 	hsess->pobj = hsobj;
 	hsess->hsrv = hs;
+	hsess->hl = hl;
+	hsess->raddr = raddr;
 	hsess->sent_infly = 0;
-
-	/* setup request queue */
-	hsess->cpreq = httpreq_open(hsess);
-	if (!hsess->cpreq) {
+#ifdef HTTP_TLS
+	hsess->tls = NULL;
+	if (hl->cfg.tls && http_tls_open(hsess) < 0) {
 		err = ERR_MEM;
 		goto err_free_hsess;
 	}
+#endif
+
+	/* setup request queue: the request object for parsing is
+	 * picked when the first request begins */
+	hsess->cpreq = NULL;
+	hsess->keepalive = 1;
 	hsess->rqueue_head = NULL;
 	hsess->rqueue_tail = NULL;
 	hsess->rqueue_len = 0;
@@ -305,7 +699,8 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	tcp_sent(hsess->tpcb, httpsess_sent); /* sent ack callback */
 	tcp_err (hsess->tpcb, httpsess_error); /* err callback */
 	tcp_poll(hsess->tpcb, httpsess_poll, HTTP_POLL_INTERVAL); /* poll callback */
-	tcp_setprio(hsess->tpcb, HTTP_TCP_PRIO);
+	tcp_setprio(hsess->tpcb, (hl->cfg.prio == HTTP_PRIO_LOW) ?
+	            HTTP_LOW_TCP_PRIO : HTTP_TCP_PRIO);
 
 	/* Turn on TCP Keepalive */
 	hsess->tpcb->so_options |= SOF_KEEPALIVE;
@@ -314,10 +709,11 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	hsess->tpcb->keep_cnt = 1;
 
 	/* init parser */
-	hsess->parser.data = (void *) &hsess->cpreq->request.hdr;
 	http_parser_init(&(hsess)->parser, HTTP_REQUEST);
+	hsess->parser.data = NULL;
 
-	/* reset HTTP keep alive */
+	/* reset HTTP keep alive (the session is idle until a request arrives) */
+	dlist_init_el(hsess, idle_chain);
 	httpsess_reset_keepalive((hsess));
 
 	/* register session to session list */
@@ -332,20 +728,40 @@ static err_t httpsess_accept(void *argp, struct tcp_pcb *new_tpcb, err_t err)
 	hs->hsess_tail = hsess;
 
 	dlist_init_el(hsess, ioretry_chain);
+#ifdef HTTP_ACK_COALESCE
+	hsess->ack_pending = 0;
+	dlist_init_el(hsess, ack_chain);
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	dlist_init_el(hsess, flush_chain);
+#endif
+#ifdef HTTP_INGEST
+	hsess->rdefer = 0;
+	hsess->rstop = 0;
+	hsess->rheld = NULL;
+	dlist_init_el(hsess, resume_chain);
+#endif
 
 	hsess->state = HSS_ESTABLISHED;
 	++hs->nb_sess;
-	printd("New HTTP session accepted on server %p "
-		"(currently, there are %"PRIu16"/%"PRIu16" open sessions)\n",
-		hs, hs->nb_sess, hs->max_nb_sess);
+	++hl->nb_sess;
+	++hl->nb_accepted;
+	if (hs->iplimit)
+		http_iplimit_get(raddr);
+	trace_sess_accept(hsess, hs->nb_sess);
+	printd("New HTTP session accepted on server %p, port %"PRIu16" "
+		"(currently, there are %"PRIu16"/%"PRIu16" open sessions, %"PRIu16"/%"PRIu16" on this port)\n",
+		hs, hl->cfg.port, hs->nb_sess, hs->max_nb_sess, hl->nb_sess, hl->max_nb_sess);
 	return 0;
 
+#ifdef HTTP_TLS
  err_free_hsess:
 	mempool_put(hsobj);
+#endif
  err_out:
-	printd("Session establishment declined on server %p "
-		"(currently, there are %"PRIu16"/%"PRIu16" open sessions)\n",
-		hs, hs->nb_sess, hs->max_nb_sess);
+	printd("Session establishment declined on server %p, port %"PRIu16" "
+		"(currently, there are %"PRIu16"/%"PRIu16" open sessions, %"PRIu16"/%"PRIu16" on this port)\n",
+		hs, hl->cfg.port, hs->nb_sess, hs->max_nb_sess, hl->nb_sess, hl->max_nb_sess);
 	return err;
 }
 
@@ -361,6 +777,7 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 	         (type == HSC_CLOSE ? "Closing" : "Killing")),
 	        hsess,
 	        get_caller());
+	trace_sess_close(hsess, type);
 	hsess->state = -99999;
 
 	/* disable tcp connection */
@@ -370,11 +787,22 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 	tcp_sent(hsess->tpcb, NULL);
 	tcp_err(hsess->tpcb,  NULL);
 	tcp_poll(hsess->tpcb, NULL, 0);
+#ifdef HTTP_TLS
+	if (hsess->tls)
+		http_tls_close(hsess, (type == HSC_CLOSE));
+#endif
 
 	/* close unserved requests */
 	if (dlist_is_linked(hsess, hs->ioretry_chain, ioretry_chain))
 		printd(" Session is linked to IORetry list, removing it\n");
 	httpsess_unregister_ioretry(hsess);
+	httpsess_unregister_idle(hsess);
+#ifdef HTTP_ACK_COALESCE
+	httpsess_unregister_ack(hsess);
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	httpsess_unregister_flush(hsess); /* tcp_close() sends out what is left */
+#endif
 
 	for (hreq = hsess->aqueue_head; hreq != NULL; hreq = hreq->next)
 		httpreq_close(hreq);
@@ -382,6 +810,13 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 		httpreq_close(hreq);
 	if (hsess->cpreq)
 		httpreq_close(hsess->cpreq);
+#ifdef HTTP_INGEST
+	httpsess_unregister_resume(hsess);
+	if (hsess->rheld) {
+		pbuf_free(hsess->rheld);
+		hsess->rheld = NULL;
+	}
+#endif
 
 	/* terminate connection */
 	switch (type) {
@@ -411,10 +846,78 @@ static err_t httpsess_close(struct http_sess *hsess, enum http_sess_close type)
 	/* release memory */
 	mempool_put(hsess->pobj);
 	--hs->nb_sess;
+	--hsess->hl->nb_sess;
+	if (hs->iplimit)
+		http_iplimit_put(hsess->raddr);
 
 	return err;
 }
 
+#ifdef HTTP_INGEST
+/* number of bytes the parser can be fed with currently: the body of an
+ * ingest request is parsed only as far as it can be written without
+ * waiting for the volume */
+static inline size_t httpsess_recv_room(struct http_sess *hsess)
+{
+	if (hsess->cpreq && hsess->cpreq->type == HRT_INGEST)
+		return httpreq_ingest_room(hsess->cpreq);
+	/* a body that follows the header within the same
+	 * slice has to fit into a fresh ingest operation */
+	return SHFS_MIN_CHUNKSIZE;
+}
+#endif
+
+/* feeds the parser with p, beginning at byte *off of the chain
+ *  Returns 0 when p was consumed (or the rest is ignored), 1 when parsing
+ *  was stopped because the body of an ingest request cannot be taken
+ *  currently (*off is the position to continue), -1 when the session has
+ *  to be closed (parsing error, protocol upgrade) */
+static int httpsess_recv_parse(struct http_sess *hsess, struct pbuf *p, uint16_t *off)
+{
+	struct pbuf *q;
+	uint16_t qoff = *off;
+	size_t flen;
+	size_t plen;
+
+	for (q = p; q != NULL; q = q->next) {
+		if (qoff >= q->len) {
+			qoff -= q->len; /* parsed already */
+			continue;
+		}
+		while (qoff < q->len) {
+			flen = q->len - qoff;
+#ifdef HTTP_INGEST
+			flen = min(flen, httpsess_recv_room(hsess));
+			if (flen == 0)
+				return 1;
+#endif
+			plen = http_parser_execute(&hsess->parser, &_http_parser_settings,
+			                           (const char *) q->payload + qoff, flen);
+			qoff += plen;
+			*off += plen;
+			if (unlikely(hsess->parser.upgrade)) {
+				/* protocol upgrade requested */
+				printd("Unsupported HTTP protocol upgrade requested: Dropping connection...\n");
+				return -1;
+			}
+			if (unlikely(plen != flen)) {
+				if (!hsess->cpreq && !hsess->keepalive) {
+					/* parsing was stopped because no request object
+					 * was left for a pipelined request: serve the
+					 * requests that we have, ignore further data */
+					return 0;
+				}
+				/* less data was parsed: this happens only when
+				 * there was a parsing error */
+				printd("HTTP protocol parsing error: Dropping connection...\n");
+				return -1;
+			}
+		}
+		qoff = 0;
+	}
+	return 0;
+}
+
 static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
 {
 	/* lwIP pbuf handling depending on return value:
@@ -424,9 +927,10 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 	 *   sender about the received data */
 	struct http_sess *hsess = argp;
 	struct http_req *cpreq;
-	struct pbuf *q;
 	unsigned int prev_rqueue_len;
-	size_t plen;
+	uint16_t off = 0;
+	size_t rdefer = 0;
+	int held = 0;
 	err_t ret = ERR_OK;
 
 	if (unlikely(!p || err != ERR_OK)) {
@@ -438,6 +942,10 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		}
 		return httpsess_close(hsess, HSC_ABORT);
 	}
+#ifdef HTTP_TLS
+	if (hsess->tls)
+		return httpsess_recv_tls(hsess, p);
+#endif
 
 	if (unlikely(hsess->retry_replychain)) {
 		/* We end up here when we were not able to start the reply chain
@@ -445,6 +953,9 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		 *  Hence, we need to ignore it because it has been already
 		 *  processed by the parser */
 		printd("Try to start reply chain again...\n");
+#ifdef HTTP_INGEST
+		rdefer = hsess->rdefer; /* pbuf was parsed already */
+#endif
 		ret = httpsess_respond(hsess);
 		if (ret == ERR_MEM) {
 			printd("Replying failed: Out of memory\n");
@@ -456,14 +967,26 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		goto out;
 	}
 
+#ifdef HTTP_INGEST
+	if (unlikely(hsess->rheld)) {
+		/* parsing is stopped: the data is queued behind the held
+		 * back one and parsed when the ingest operation has room */
+		if ((uint32_t) hsess->rheld->tot_len + p->tot_len > 0xFFFF)
+			return ERR_MEM; /* tot_len would overflow, passed again by lwIP */
+		pbuf_cat(hsess->rheld, p);
+		return ERR_OK;
+	}
+	hsess->rdefer = 0;
+#endif
 	cpreq = hsess->cpreq;
-	if (unlikely(!cpreq || hsess->state != HSS_ESTABLISHED)) {
-		/* We don't have an object allocated for parsing the requests or
-		 * we are about to close the connection, thus ignoring all further
+	if (unlikely((!cpreq && !hsess->keepalive) ||
+	             hsess->state != HSS_ESTABLISHED)) {
+		/* The last request was received already or we are about
+		 * to close the connection, thus ignoring all further
 		 * incoming data
 		 *  This can only happen after the first request was processed
 		 *  and there are two reasons for this:
-		 *  1) We couldn't allocate such an object previously
+		 *  1) We couldn't allocate a request object previously
 		 *  2) User requested connection close
 		 *  However, we will ignore all further incoming data
 		 *
@@ -472,30 +995,43 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 		printd("Ignoring unrelated data (p=%p, len=%d)\n", p, p->tot_len);
 		goto out;
 	}
+	if (!cpreq && unlikely(mempool_free_count(hs->req_pool) == 0)) {
+		/* Idle session: the next request needs a request object
+		 * (picked by httprecv_req_begin()). Since there is none
+		 * available currently, the pbuf is held back by lwIP and
+		 * passed again later */
+		printd("No request object available: Holding back received data\n");
+		++hs->nb_rehydrate_defers;
+		ret = ERR_MEM;
+		goto out;
+	}
 
-	switch (cpreq->state) {
+	switch (cpreq ? cpreq->state : HRS_PARSING_HDR) {
 	case HRS_PARSING_HDR:
 	case HRS_PARSING_MSG:
 		/* feed parser */
 		prev_rqueue_len = hsess->rqueue_len;
 		httpsess_halt_keepalive(hsess);
-		for (q = p; q != NULL; q = q->next) {
-			plen = http_parser_execute(&hsess->parser, &_http_parser_settings,
-			                           q->payload, q->len);
-			if (unlikely(hsess->parser.upgrade)) {
-				/* protocol upgrade requested */
-				printd("Unsupported HTTP protocol upgrade requested: Dropping connection...\n");
-				ret = httpsess_close(hsess, HSC_CLOSE);
-				goto out;
-			}
-			if (unlikely(plen != q->len)) {
-				/* less data was parsed: this happens only when
-				 * there was a parsing error */
-				printd("HTTP protocol parsing error: Dropping connection...\n");
-				ret = httpsess_close(hsess, HSC_CLOSE);
-				goto out;
-			}
+		held = httpsess_recv_parse(hsess, p, &off);
+#ifdef HTTP_INGEST
+		rdefer = hsess->rdefer;
+#endif
+		if (unlikely(held < 0)) {
+			held = 0;
+			ret = httpsess_close(hsess, HSC_CLOSE);
+			goto out;
 		}
+#ifdef HTTP_INGEST
+		if (held) {
+			/* the body cannot be taken currently: the rest is
+			 * kept without being credited to the TCP window */
+			printd("Ingest operation is busy: Stop parsing at %"PRIu16"/%"PRIu16"\n",
+			       off, p->tot_len);
+			hsess->rheld = p;
+			hsess->rheld_off = off;
+			hsess->rstop = 1;
+		}
+#endif
 
 		printd("prev_rqueue_len == %u, hsess->rqueue_len = %u\n",
 		        prev_rqueue_len, hsess->rqueue_len);
@@ -508,6 +1044,12 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 				 * We will retry it later by holding the current
 				 * pbuf back in the stack */
 				printd("Replying failed: Out of memory\n");
+				if (held) {
+					/* pbuf is ours already: retry from the I/O retry loop */
+					httpsess_register_ioretry(hsess);
+					ret = ERR_OK;
+					goto out;
+				}
 				hsess->retry_replychain = 1;
 				goto out;
 			}
@@ -521,13 +1063,161 @@ static err_t httpsess_recv(void *argp, struct tcp_pcb *tpcb, struct pbuf *p, err
 	}
 
  out:
+	if (unlikely(held)) {
+		/* Note: the held back part is credited when it got parsed */
+		if (ret != ERR_ABRT)
+			tcp_recved(tpcb, off - rdefer);
+		return ret;
+	}
 	if (likely(ret != ERR_MEM)) {
-		tcp_recved(tpcb, p->tot_len);
+		/* Note: held back body bytes are credited after they got written */
+		tcp_recved(tpcb, p->tot_len - rdefer);
 		pbuf_free(p);
 	}
 	return ret;
 }
 
+#ifdef HTTP_INGEST
+/* continues receiving after parsing was stopped for the body of an
+ * ingest request (called from the I/O retry loop) */
+static void httpsess_recv_resume(struct http_sess *hsess)
+{
+	struct pbuf *p = hsess->rheld;
+	uint16_t start = hsess->rheld_off;
+	uint16_t off = start;
+	unsigned int prev_rqueue_len;
+	int held;
+	err_t ret;
+
+	if (hsess->state != HSS_ESTABLISHED) {
+		/* session is about to close: ignore further data */
+		hsess->rstop = 0;
+		if (p) {
+			hsess->rheld = NULL;
+			tcp_recved(hsess->tpcb, p->tot_len - start);
+			pbuf_free(p);
+		}
+		return;
+	}
+	if (httpsess_recv_room(hsess) == 0)
+		return; /* still busy, gets registered again on write completion */
+
+	hsess->rstop = 0;
+	prev_rqueue_len = hsess->rqueue_len;
+#ifdef HTTP_TLS
+	if (hsess->tls) {
+		/* undecrypted records are still queued in the TLS layer */
+		httpsess_recv_tls(hsess, NULL);
+		return;
+	}
+#endif
+	hsess->rheld = NULL;
+	hsess->rdefer = 0;
+	held = httpsess_recv_parse(hsess, p, &off);
+	if (unlikely(held < 0)) {
+		pbuf_free(p);
+		httpsess_close(hsess, HSC_CLOSE);
+		return;
+	}
+	if (held) {
+		tcp_recved(hsess->tpcb, off - start - hsess->rdefer);
+		hsess->rheld = p;
+		hsess->rheld_off = off;
+		hsess->rstop = 1;
+	} else {
+		tcp_recved(hsess->tpcb, p->tot_len - start - hsess->rdefer);
+		pbuf_free(p);
+	}
+	if (prev_rqueue_len == 0 && hsess->rqueue_len) {
+		/* new request came in: start reply chain */
+		printd("Starting reply chain...\n");
+		ret = httpsess_respond(hsess);
+		if (ret == ERR_MEM) {
+			printd("Replying failed: Out of memory\n");
+			httpsess_register_ioretry(hsess);
+		}
+	}
+}
+#endif
+
+#ifdef HTTP_TLS
+/* Received ciphertext is queued and consumed by the TLS layer, the parser
+ * is fed from a bounce buffer with the decrypted data. Because the data
+ * is taken over, it cannot be held back in lwIP: a reply chain that could
+ * not be started is retried from the I/O retry loop.
+ * p can be NULL: a handshake that waited for send buffer space continues */
+static err_t httpsess_recv_tls(struct http_sess *hsess, struct pbuf *p)
+{
+	static char buf[HTTP_TLS_RXBUF_LEN];
+	unsigned int prev_rqueue_len;
+	size_t room = sizeof(buf);
+	ssize_t rlen;
+	size_t plen;
+	err_t ret = ERR_OK;
+
+	if (p && http_tls_rx(hsess, p) < 0) {
+		printd("TLS receive queue is full: Holding back received data\n");
+		return ERR_MEM; /* passed again by lwIP */
+	}
+
+	prev_rqueue_len = hsess->rqueue_len;
+	while (hsess->state == HSS_ESTABLISHED &&
+	       (hsess->cpreq || hsess->keepalive)) {
+#ifdef HTTP_INGEST
+		room = min(sizeof(buf), httpsess_recv_room(hsess));
+		if (room == 0) {
+			/* the body cannot be taken currently: records stay
+			 * queued (not credited) until the operation has room */
+			hsess->rstop = 1;
+			break;
+		}
+#endif
+		rlen = http_tls_read(hsess, buf, room);
+		if (rlen == 0)
+			break; /* more records required */
+		if (rlen < 0) {
+			printd("TLS session %s: Dropping connection...\n",
+			       rlen == -ECONNRESET ? "closed by peer" : "error");
+			return httpsess_close(hsess, (rlen == -ECONNRESET) ?
+			                      HSC_CLOSE : HSC_ABORT);
+		}
+
+		httpsess_halt_keepalive(hsess);
+		plen = http_parser_execute(&hsess->parser, &_http_parser_settings,
+		                           buf, (size_t) rlen);
+		if (unlikely(hsess->parser.upgrade)) {
+			/* protocol upgrade requested */
+			printd("Unsupported HTTP protocol upgrade requested: Dropping connection...\n");
+			return httpsess_close(hsess, HSC_CLOSE);
+		}
+		if (unlikely(plen != (size_t) rlen)) {
+			if (!hsess->cpreq && !hsess->keepalive && hsess->rqueue_len) {
+				/* no request object left for a pipelined
+				 * request: serve the requests that we have */
+				break;
+			}
+			/* parsing error or an idle session did not get
+			 * a request object (decrypted data cannot be held back) */
+			printd("HTTP protocol parsing error: Dropping connection...\n");
+			return httpsess_close(hsess, HSC_CLOSE);
+		}
+	}
+	httpsess_flush(hsess); /* handshake messages */
+
+	if (prev_rqueue_len == 0 && hsess->rqueue_len) {
+		/* new request came in: start reply chain */
+		printd("Starting reply chain...\n");
+		ret = httpsess_respond(hsess);
+		if (ret == ERR_MEM) {
+			printd("Replying failed: Out of memory\n");
+			httpsess_register_ioretry(hsess);
+			ret = ERR_OK;
+		}
+	}
+	return ret;
+}
+#endif
+
 static void httpsess_error(void *argp, err_t err)
 {
 	struct http_sess *hsess = argp;
@@ -550,8 +1240,12 @@ static err_t httpsess_poll(void *argp, struct tcp_pcb *tpcb)
 			hsess->state = HSS_CLOSING;
 		}
 	}
-	if (hsess->keepalive_timer > 0)
+	if (hsess->keepalive_timer > 0) {
+		/* follow up the pool usage while the session is idle */
+		hsess->keepalive_timer = min(hsess->keepalive_timer,
+		                             httpsess_keepalive_timeout(hsess));
 		--hsess->keepalive_timer;
+	}
 	return ERR_OK;
 }
 
@@ -571,12 +1265,31 @@ err_t httpsess_write(struct http_sess *hsess, const void* buf, size_t *len, uint
 	struct tcp_pcb *pcb = hsess->tpcb;
 	register size_t l, s;
 	uint16_t slen;
+#ifdef HTTP_TLS
+	size_t tlen;
+#endif
 	err_t err;
 
 	s = 0;
 	l = *len;
 	err = ERR_OK;
 
+	/* pacing: the session continues when data got acknowledged */
+	if (hsess->hl->cfg.pace) {
+		if (hsess->sent_infly >= hsess->hl->cfg.pace)
+			goto out;
+		l = min(l, hsess->hl->cfg.pace - hsess->sent_infly);
+	}
+#ifdef HTTP_TLS
+	if (hsess->tls) {
+		/* records are copied to the send buffer, apiflags do not apply */
+		tlen = l;
+		err = http_tls_write(hsess, buf, &tlen);
+		s = tlen;
+		goto out;
+	}
+#endif
+
  try_next:
 	slen = (uint16_t) min3(l, tcp_sndbuf(pcb), UINT16_MAX);
 	if (!slen)
@@ -621,14 +1334,33 @@ err_t httpsess_write(struct http_sess *hsess, const void* buf, size_t *len, uint
 static err_t httpsess_sent(void *argp, struct tcp_pcb *tpcb, uint16_t len)
 {
 	struct http_sess *hsess = argp;
+	size_t alen = len;
 
 	printd("ACK for session %p\n", hsess);
 
-	hsess->sent_infly -= len;
+#ifdef HTTP_TLS
+	if (hsess->tls) {
+		/* acknowledged records are converted to plaintext bytes */
+		alen = http_tls_acked(hsess, len);
+		if (unlikely(!hsess->tls->handshake_done) &&
+		    hsess->state == HSS_ESTABLISHED)
+			return httpsess_recv_tls(hsess, NULL); /* continue handshake */
+	}
+#endif
+	hsess->sent_infly -= alen;
 	switch (hsess->state) {
 	case HSS_ESTABLISHED:
-		if (len)
-			return httpsess_acknowledge(hsess, len); /* will continue replying */
+#ifdef HTTP_ACK_COALESCE
+		/* processed by http_poll_acks() at the end of the RX burst */
+		++hs->nb_ack_cbs;
+		if (alen) {
+			hsess->ack_pending += alen;
+			httpsess_register_ack(hsess);
+		}
+#else
+		if (alen)
+			return httpsess_acknowledge(hsess, alen); /* will continue replying */
+#endif
 		break;
 
 	case HSS_CLOSING:
@@ -686,6 +1418,58 @@ static int httprecv_hdr_url(struct http_parser *parser, const char *buf, size_t
 	return 0;
 }
 
+static int httprecv_hdr_complete(struct http_parser *parser)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+	struct http_req *hreq = hsess->cpreq;
+
+	/* finalize request lines by adding terminating '\0' */
+	http_recvhdr_terminate(&hreq->request.hdr);
+	hreq->request.url[hreq->request.url_len++] = '\0';
+
+#ifdef HTTP_INGEST
+	/* volume modifications stream the message body */
+	if (parser->method == HTTP_PUT || parser->method == HTTP_DELETE)
+		httpreq_ingest_open(hreq, parser);
+#endif
+	return 0;
+}
+
+#ifdef HTTP_INGEST
+static int httprecv_body(struct http_parser *parser, const char *buf, size_t len)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+	struct http_req *hreq = hsess->cpreq;
+
+	if (hreq->type == HRT_INGEST)
+		hsess->rdefer += httpreq_ingest_body(hreq, buf, len);
+	return 0;
+}
+#endif
+
+static int httprecv_req_begin(struct http_parser *parser)
+{
+	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
+
+	if (hsess->cpreq)
+		return 0;
+
+	printd("New request begins: Picking request object...\n");
+	hsess->cpreq = httpreq_open(hsess);
+	if (unlikely(!hsess->cpreq)) {
+		/* this can only happen with pipelined requests because
+		 * httpsess_recv() checks for a free object beforehand
+		 * Note: the parser stops here */
+		printd("Could not allocate a new request object: "
+		       "Connection will close after serving is finished\n");
+		hsess->keepalive = 0;
+		return -1;
+	}
+	/* header lines of the request go to the new object */
+	hsess->parser.data = (void *) &hsess->cpreq->request.hdr;
+	return 0;
+}
+
 static int httprecv_req_complete(struct http_parser *parser)
 {
 	struct http_sess *hsess = container_of(parser, struct http_sess, parser);
@@ -708,18 +1492,11 @@ static int httprecv_req_complete(struct http_parser *parser)
 	++hsess->rqueue_len;
 
 	/* Because keepalive is only 0 when parsing is completed or client
-	 * requested it, we try here to allocate a new request object if this
-	 * was not the last message */
+	 * requested it, we accept a next message if this was not the last one.
+	 * Its request object is picked not before it begins: a session that
+	 * waits in keep-alive does not hold one */
 	hsess->keepalive = http_should_keep_alive(&hsess->parser);
-	if (hsess->keepalive) {
-		hsess->cpreq = httpreq_open(hsess);
-		if (!hsess->cpreq) {
-			/* Could not allocate next object: close connection */
-			printd("Could not allocate a new request object: "
-			        "Connection will close after serving is finished\n");
-			hsess->keepalive = 0;
-		}
-	}
+	hsess->parser.data = NULL;
 
 	/* copy data */
 	hreq->request.keepalive = hsess->keepalive;
@@ -727,11 +1504,11 @@ static int httprecv_req_complete(struct http_parser *parser)
 	hreq->request.http_minor = parser->http_minor;
 	hreq->request.http_errno = parser->http_errno;
 	hreq->request.method = parser->method;
-
-	/* finalize request lines by adding terminating '\0' */
-	http_recvhdr_terminate(&hreq->request.hdr);
-	hreq->request.url[hreq->request.url_len++] = '\0';
-	hreq->state = HRS_PREPARING_HDR;
+#ifdef HTTP_INGEST
+	if (hreq->type == HRT_INGEST)
+		httpreq_ingest_complete(hreq);
+#endif
+	httpreq_set_state(hreq, HRS_PREPARING_HDR);
 
 	return 0;
 }
@@ -753,6 +1530,14 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 	char strsbuf[64];
 	char strlbuf[128];
 
+#ifdef HTTP_INGEST
+	if (hreq->type == HRT_INGEST) {
+		/* PUT/DELETE: header is built when the operation is done */
+		httpreq_ingest_build_hdr(hreq);
+		return;
+	}
+#endif
+
 	/* check request method (GET, POST, ...) */
 	if (hreq->request.method != HTTP_GET) {
 		printd("Invalid/unsupported request method: %u HTTP/%hu.%hu\n",
@@ -786,6 +1571,10 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 		*(hreq->request.url_argp) = '\0';
 #endif
 
+	/* volume is still being mounted (e.g., during boot) */
+	if (unlikely(shfs_mount_pending))
+		goto err503_hdr;
+
 #ifdef HTTP_TESTFILES
 	if ((hreq->request.url[url_offset] == HTTPURL_ARGS_INDICATOR) &&
 	    (hash_parse(&hreq->request.url[url_offset + 1], h, shfs_vol.hlen) == 0)) {
@@ -833,7 +1622,7 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 	for (i = 0; i < SHFS_STATS_HTTP_DPCR; ++i)
 		hreq->stats.dpc_threshold[i] = SHFS_STATS_HTTP_DPC_THRESHOLD(hreq->f.fsize, i);
 #endif
-	hreq->state = HRS_FINALIZING_HDR;
+	httpreq_set_state(hreq, HRS_FINALIZING_HDR);
 	return;
 
 	/**
@@ -930,10 +1719,29 @@ static inline void httpreq_prepare_hdr(struct http_req *hreq)
 	hreq->rlen = _http_err501p_len;
 	goto err_out;
 
+ err503_hdr:
+	/* 503 Service unavailable */
+	hreq->response.code = 503;
+	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines,
+			      HTTP_SHDR_503(hreq->request.http_major, hreq->request.http_minor));
+	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_HTML);
+	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_NOCACHE);
+	/* Content length */
+	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+			       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
+			       _http_err503p_len);
+	http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+			       "%s: %u\r\n", _http_dhdr[HTTP_DHDR_RETRY],
+			       HTTP_MOUNT_RETRY_AFTER);
+	hreq->type = HRT_SMSG;
+	hreq->smsg = _http_err503p;
+	hreq->rlen = _http_err503p_len;
+	goto err_out;
+
  err_out:
 	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
 	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
-	hreq->state = HRS_FINALIZING_HDR;
+	httpreq_set_state(hreq, HRS_FINALIZING_HDR);
 	return;
 }
 
@@ -943,6 +1751,13 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 	size_t nb_dlines = 0;
 	int ret;
 
+#ifdef HTTP_INGEST
+	if (hreq->type == HRT_INGEST) {
+		httpreq_ingest_build_hdr(hreq); /* might need to be re-called */
+		return;
+	}
+#endif
+
 	/* For now, just remote links utilize this phase for connecting to 
 	 * upstream server. All other reponses are already build
 	 * Because of this it might be possible that this function needs
@@ -960,7 +1775,7 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 	}
 
 	/* we are done -> switch to next phase */
-	hreq->state = HRS_FINALIZING_HDR;
+	httpreq_set_state(hreq, HRS_FINALIZING_HDR);
 	return;
 
  err503_hdr:
@@ -982,7 +1797,7 @@ static inline void httpreq_build_hdr(struct http_req *hreq)
 	hreq->rlen = _http_err503p_len;
 	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
 	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
-	hreq->state = HRS_FINALIZING_HDR;
+	httpreq_set_state(hreq, HRS_FINALIZING_HDR);
 	return;
 }
 
@@ -1158,7 +1973,7 @@ err_t httpsess_respond(struct http_sess *hsess)
 		goto case_BUILDING_HDR;
 
 	case_BUILDING_HDR:
-		hreq->state = HRS_BUILDING_HDR;
+		httpreq_set_state(hreq, HRS_BUILDING_HDR);
 	case HRS_BUILDING_HDR:
 		httpreq_build_hdr(hreq); /* might need to be re-called */
 		if (hreq->state == HRS_FINALIZING_HDR) {
@@ -1168,13 +1983,13 @@ err_t httpsess_respond(struct http_sess *hsess)
 		break;
 
 	case_FINALIZING_HDR: /* atomic -> direct state transition */
-		hreq->state = HRS_FINALIZING_HDR;
+		httpreq_set_state(hreq, HRS_FINALIZING_HDR);
 	case HRS_FINALIZING_HDR:
 		httpreq_finalize_hdr(hreq);
 		goto case_HRS_RESPONDING_HDR;
 
 	case_HRS_RESPONDING_HDR:
-		hreq->state = HRS_RESPONDING_HDR;
+		httpreq_set_state(hreq, HRS_RESPONDING_HDR);
 		hsess->sent = 0;
 	case HRS_RESPONDING_HDR:
 		/* send out header */
@@ -1193,7 +2008,7 @@ err_t httpsess_respond(struct http_sess *hsess)
 		break;
 
 	case_HRS_RESPONDING_MSG:
-		hreq->state = HRS_RESPONDING_MSG;
+		httpreq_set_state(hreq, HRS_RESPONDING_MSG);
 		hsess->sent = 0;
 	case HRS_RESPONDING_MSG:
 		switch(hreq->type) {
@@ -1222,14 +2037,17 @@ err_t httpsess_respond(struct http_sess *hsess)
 				goto err_close; /* drop connection because of an unrecoverable error */
 
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP && defined SHFS_STATS_HTTP_DPC
-			while (unlikely(hsess->sent >= hreq->stats.dpc_threshold[hreq->stats.dpc_i]))
+			while (unlikely(hsess->sent >= hreq->stats.dpc_threshold[hreq->stats.dpc_i])) {
 				++hreq->stats.el_stats->p[hreq->stats.dpc_i++];
+				hreq->stats.el_stats->lupd = shfs_stats_clock;
+			}
 #endif
 
 			if (unlikely(hsess->sent == hreq->rlen)) {
 				/* we are done */
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP
 				++hreq->stats.el_stats->c; /* successfully completed request */
+				hreq->stats.el_stats->lupd = shfs_stats_clock;
 #endif
 				goto case_HRS_RESPONDING_EOM;
 			}
@@ -1249,7 +2067,7 @@ err_t httpsess_respond(struct http_sess *hsess)
 		break;
 
 	case_HRS_RESPONDING_EOM:
-		hreq->state = HRS_RESPONDING_EOM;
+		httpreq_set_state(hreq, HRS_RESPONDING_EOM);
 		hsess->sent = 0;
 	case HRS_RESPONDING_EOM:
 		err = httpsess_write_sbuf(hsess, &hsess->sent,
@@ -1432,6 +2250,8 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	struct http_sess *hsess;
 	struct http_req *hreq;
 #endif
+	struct http_listener *hl;
+	unsigned int i;
 	uint16_t nb_sess, max_nb_sess;
 	uint32_t nb_reqs, max_nb_reqs;
 	uint16_t nb_links, max_nb_links;
@@ -1467,8 +2287,22 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	ps_links = mempool_size(hs->link_pool);
 
 	/* thread switching might happen from here on */
-	fprintf(cio, " Listen port:                           %8"PRIu16"\n", HTTP_LISTEN_PORT);
 	fprintf(cio, " Number of sessions:                   %4"PRIu16"/%4"PRIu16" (%5"PRIu64" B per session, pool size: %6"PRIu64" KiB)\n", nb_sess,  max_nb_sess, (uint64_t) sizeof(struct http_sess), ps_sess / 1024);
+	for (i = 0; i < hs->nb_listeners; ++i) {
+		hl = &hs->listener[i];
+		fprintf(cio, " Listener %u: %3u.%3u.%3u.%3u:%-5"PRIu16"   %4"PRIu16"/%4"PRIu16" (reserved: %"PRIu16", keep-alive: %d s, pace: %"PRIu32" B%s%s)\n",
+		        i,
+		        ip4_addr1(&hl->cfg.addr), ip4_addr2(&hl->cfg.addr),
+		        ip4_addr3(&hl->cfg.addr), ip4_addr4(&hl->cfg.addr),
+		        hl->cfg.port,
+		        hl->nb_sess, hl->max_nb_sess, hl->cfg.rsv_nb_sess,
+		        hl->cfg.keepalive_timeout,
+		        hl->cfg.pace,
+		        (hl->cfg.prio == HTTP_PRIO_LOW) ? ", low priority" : "",
+		        hl->cfg.tls ? ", TLS" : "");
+		fprintf(cio, "  Accepted / declined sessions:    %12"PRIu64"/%"PRIu64"\n",
+		        hl->nb_accepted, hl->nb_declined);
+	}
 	fprintf(cio, " Number of requests:                   %4"PRIu32"/%4"PRIu32" (%5"PRIu64" B per request, pool size: %6"PRIu64" KiB)\n", nb_reqs,  max_nb_reqs, (uint64_t) sizeof(struct http_req), ps_reqs / 1024);
 	fprintf(cio, " Number of active uplinks:             %4"PRIu16"/%4"PRIu16" (%5"PRIu64" B per uplink,  pool size: %6"PRIu64" KiB)\n", nb_links, max_nb_links, (uint64_t) sizeof(struct http_req_link_origin), ps_links / 1024);
 	if (fio_nb_buffers) {
@@ -1482,6 +2316,24 @@ int shcmd_http_info(FILE *cio, int argc, char *argv[])
 	fprintf(cio, " (Warning: low buffer space!)");
 #endif
 	fprintf(cio, "\n");
+	fprintf(cio, " Evicted idle sessions:             %12"PRIu64"\n", hs->nb_idle_evicted);
+	fprintf(cio, " Requests deferred for a req. object: %10"PRIu64"\n", hs->nb_rehydrate_defers);
+	if (hs->iplimit)
+		fprintf(cio, " Declined by client IP limit (%4"PRIu16"): %8"PRIu64"\n",
+		        hs->max_sess_per_ip, hs->nb_iplimit_declined);
+#ifdef HTTP_TLS
+	if (hs->tls)
+		fprintf(cio, " TLS handshakes / errors:           %12"PRIu64"/%"PRIu64"\n",
+		        hs->nb_tls_handshakes, hs->nb_tls_errors);
+#endif
+#ifdef HTTP_ACK_COALESCE
+	fprintf(cio, " ACK callbacks / acknowledge runs:  %12"PRIu64"/%"PRIu64"\n",
+	        hs->nb_ack_cbs, hs->nb_ack_runs);
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	fprintf(cio, " Flush requests / TCP output runs:  %12"PRIu64"/%"PRIu64"\n",
+	        hs->nb_flush_reqs, hs->nb_flush_runs);
+#endif
 	fprintf(cio, " HTTP parser version:                     %2hu.%hu.%hu\n",
 	        (pver >> 16) & 255, /* major */
 	        (pver >> 8) & 255, /* minor */
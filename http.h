@@ -39,11 +39,79 @@
 
 #include <stdio.h>
 #include <inttypes.h>
+#include <lwip/ip_addr.h>
 
-int init_http(uint16_t nb_sess, uint32_t nb_reqs);
+#define HTTP_MAX_NB_LISTENERS 4
+
+enum http_prio {
+	HTTP_PRIO_DEFAULT = 0,
+	HTTP_PRIO_LOW /* first to be dropped by lwIP under memory pressure,
+	               * served chunks are the first candidates for cache eviction */
+};
+
+/*
+ * Listener configuration
+ *
+ * All listeners share the session and request pools of the server.
+ * rsv_nb_sess sessions of the pool are reserved to a listener: other
+ * listeners cannot take them even if they are idle.
+ */
+struct http_listener_cfg {
+	ip4_addr_t addr;          /* 0.0.0.0 = any */
+	uint16_t port;
+	uint16_t max_nb_sess;     /* 0 = limited by the session pool only */
+	uint16_t rsv_nb_sess;     /* reserved sessions */
+	int keepalive_timeout;    /* = x sec; -1 = server default */
+	uint32_t pace;            /* max. unacknowledged bytes per session; 0 = no limit */
+	enum http_prio prio;
+	int tls;                  /* HTTPS (requires HTTP_TLS) */
+};
+
+static inline void http_listener_cfg_init(struct http_listener_cfg *cfg, uint16_t port)
+{
+	IP4_ADDR(&cfg->addr, 0, 0, 0, 0);
+	cfg->port = port;
+	cfg->max_nb_sess = 0;
+	cfg->rsv_nb_sess = 0;
+	cfg->keepalive_timeout = -1;
+	cfg->pace = 0;
+	cfg->prio = HTTP_PRIO_DEFAULT;
+	cfg->tls = 0;
+}
+
+/* lcfg can be NULL: a single listener is opened on port 80 */
+int init_http(uint16_t nb_sess, uint32_t nb_reqs,
+              const struct http_listener_cfg *lcfg, unsigned int nb_listeners);
 void exit_http(void);
 
 void http_poll_ioretry(void);
+#ifdef HTTP_ACK_COALESCE
+void http_poll_acks(void);
+#else
+#define http_poll_acks() do {} while (0)
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+void http_poll_flush(void);
+#else
+#define http_poll_flush() do {} while (0)
+#endif
+
+/* limits the number of sessions of a single client IP (0 = no limit);
+ * has to be called before init_http() */
+void http_set_max_sess_per_ip(uint16_t max);
+
+#ifdef HTTP_INGEST
+#define HTTP_INGEST_TOKEN_MAXLEN 64
+
+/* enables PUT/DELETE for requests authorized with this bearer token */
+int http_ingest_set_token(const char *token);
+#endif
+
+#ifdef HTTP_TLS
+/* sets certificate chain and private key (PEM or DER files) of the
+ * TLS listeners; has to be called before init_http() */
+int http_tls_set_cert(const char *crt_path, const char *key_path);
+#endif
 
 #ifdef HTTP_INFO
 int shcmd_http_info(FILE *cio, int argc, char *argv[]);
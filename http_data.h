@@ -84,6 +84,25 @@ static const char __http_shdr34[] = "Accept-ranges: bytes\r\n";
 static const char __http_shdr35[] = "Transfer-encoding: chunked\r\n";
 static const char __http_shdr36[] = "User-Agent: "HTTP_SERVER_AGENT"\r\n";
 static const char __http_shdr37[] = "Cache-control: no-store, no-cache, must-revalidate, pre-check=0, post-check=0, max-age=0\r\n";
+static const char __http_shdr38[] = "HTTP/0.9 201\r\n";
+static const char __http_shdr39[] = "HTTP/0.9 204\r\n";
+static const char __http_shdr40[] = "HTTP/0.9 401\r\n";
+static const char __http_shdr41[] = "HTTP/0.9 409\r\n";
+static const char __http_shdr42[] = "HTTP/0.9 411\r\n";
+static const char __http_shdr43[] = "HTTP/0.9 507\r\n";
+static const char __http_shdr44[] = "HTTP/1.0 201 Created\r\n";
+static const char __http_shdr45[] = "HTTP/1.0 204 No content\r\n";
+static const char __http_shdr46[] = "HTTP/1.0 401 Unauthorized\r\n";
+static const char __http_shdr47[] = "HTTP/1.0 409 Conflict\r\n";
+static const char __http_shdr48[] = "HTTP/1.0 411 Length required\r\n";
+static const char __http_shdr49[] = "HTTP/1.0 507 Insufficient storage\r\n";
+static const char __http_shdr50[] = "HTTP/1.1 201 Created\r\n";
+static const char __http_shdr51[] = "HTTP/1.1 204 No content\r\n";
+static const char __http_shdr52[] = "HTTP/1.1 401 Unauthorized\r\n";
+static const char __http_shdr53[] = "HTTP/1.1 409 Conflict\r\n";
+static const char __http_shdr54[] = "HTTP/1.1 411 Length required\r\n";
+static const char __http_shdr55[] = "HTTP/1.1 507 Insufficient storage\r\n";
+static const char __http_shdr56[] = "WWW-Authenticate: Bearer\r\n";
 
 static const char * const _http_shdr[] = {
 	__http_shdr00, __http_shdr01, __http_shdr02, __http_shdr03, __http_shdr04,
@@ -93,7 +112,11 @@ static const char * const _http_shdr[] = {
 	__http_shdr20, __http_shdr21, __http_shdr22, __http_shdr23, __http_shdr24,
 	__http_shdr25, __http_shdr26, __http_shdr27, __http_shdr28, __http_shdr29,
 	__http_shdr30, __http_shdr31, __http_shdr32, __http_shdr33, __http_shdr34,
-	__http_shdr35, __http_shdr36, __http_shdr37
+	__http_shdr35, __http_shdr36, __http_shdr37, __http_shdr38, __http_shdr39,
+	__http_shdr40, __http_shdr41, __http_shdr42, __http_shdr43, __http_shdr44,
+	__http_shdr45, __http_shdr46, __http_shdr47, __http_shdr48, __http_shdr49,
+	__http_shdr50, __http_shdr51, __http_shdr52, __http_shdr53, __http_shdr54,
+	__http_shdr55, __http_shdr56
 };
 static const size_t _http_shdr_len[] = {
 	sizeof(__http_shdr00) - 1, sizeof(__http_shdr01) - 1,
@@ -114,7 +137,17 @@ static const size_t _http_shdr_len[] = {
 	sizeof(__http_shdr30) - 1, sizeof(__http_shdr31) - 1,
 	sizeof(__http_shdr32) - 1, sizeof(__http_shdr33) - 1,
 	sizeof(__http_shdr34) - 1, sizeof(__http_shdr35) - 1,
-	sizeof(__http_shdr36) - 1, sizeof(__http_shdr37) - 1
+	sizeof(__http_shdr36) - 1, sizeof(__http_shdr37) - 1,
+	sizeof(__http_shdr38) - 1, sizeof(__http_shdr39) - 1,
+	sizeof(__http_shdr40) - 1, sizeof(__http_shdr41) - 1,
+	sizeof(__http_shdr42) - 1, sizeof(__http_shdr43) - 1,
+	sizeof(__http_shdr44) - 1, sizeof(__http_shdr45) - 1,
+	sizeof(__http_shdr46) - 1, sizeof(__http_shdr47) - 1,
+	sizeof(__http_shdr48) - 1, sizeof(__http_shdr49) - 1,
+	sizeof(__http_shdr50) - 1, sizeof(__http_shdr51) - 1,
+	sizeof(__http_shdr52) - 1, sizeof(__http_shdr53) - 1,
+	sizeof(__http_shdr54) - 1, sizeof(__http_shdr55) - 1,
+	sizeof(__http_shdr56) - 1
 };
 
 /* Indexes into _http_shdr */
@@ -156,6 +189,25 @@ static const size_t _http_shdr_len[] = {
 #define HTTP_SHDR_ENC_CHUNKED    35 /* Transfer-Encoding: chunked */
 #define HTTP_SHDR_USERAGENT      36 /* User agent */
 #define HTTP_SHDR_NOSTORE        37 /* No store */
+#define HTTP09_SHDR_201          38 /* 201 Created (HTTP/0.9) */
+#define HTTP09_SHDR_204          39 /* 204 No content (HTTP/0.9) */
+#define HTTP09_SHDR_401          40 /* 401 Unauthorized (HTTP/0.9) */
+#define HTTP09_SHDR_409          41 /* 409 Conflict (HTTP/0.9) */
+#define HTTP09_SHDR_411          42 /* 411 Length required (HTTP/0.9) */
+#define HTTP09_SHDR_507          43 /* 507 Insufficient storage (HTTP/0.9) */
+#define HTTP10_SHDR_201          44 /* 201 Created (HTTP/1.0) */
+#define HTTP10_SHDR_204          45 /* 204 No content (HTTP/1.0) */
+#define HTTP10_SHDR_401          46 /* 401 Unauthorized (HTTP/1.0) */
+#define HTTP10_SHDR_409          47 /* 409 Conflict (HTTP/1.0) */
+#define HTTP10_SHDR_411          48 /* 411 Length required (HTTP/1.0) */
+#define HTTP10_SHDR_507          49 /* 507 Insufficient storage (HTTP/1.0) */
+#define HTTP11_SHDR_201          50 /* 201 Created (HTTP/1.1) */
+#define HTTP11_SHDR_204          51 /* 204 No content (HTTP/1.1) */
+#define HTTP11_SHDR_401          52 /* 401 Unauthorized (HTTP/1.1) */
+#define HTTP11_SHDR_409          53 /* 409 Conflict (HTTP/1.1) */
+#define HTTP11_SHDR_411          54 /* 411 Length required (HTTP/1.1) */
+#define HTTP11_SHDR_507          55 /* 507 Insufficient storage (HTTP/1.1) */
+#define HTTP_SHDR_AUTH_BEARER    56 /* WWW-Authenticate: Bearer */
 
 #define HTTP_SHDR_DEFAULT_TYPE   HTTP_SHDR_PLAIN
 
@@ -178,6 +230,18 @@ static const size_t _http_shdr_len[] = {
 	(((major) < 1) ? HTTP09_SHDR_501 : (((minor) < 1) ? HTTP10_SHDR_501 : HTTP11_SHDR_501))
 #define HTTP_SHDR_503(major, minor) \
 	(((major) < 1) ? HTTP09_SHDR_503 : (((minor) < 1) ? HTTP10_SHDR_503 : HTTP11_SHDR_503))
+#define HTTP_SHDR_201(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_201 : (((minor) < 1) ? HTTP10_SHDR_201 : HTTP11_SHDR_201))
+#define HTTP_SHDR_204(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_204 : (((minor) < 1) ? HTTP10_SHDR_204 : HTTP11_SHDR_204))
+#define HTTP_SHDR_401(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_401 : (((minor) < 1) ? HTTP10_SHDR_401 : HTTP11_SHDR_401))
+#define HTTP_SHDR_409(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_409 : (((minor) < 1) ? HTTP10_SHDR_409 : HTTP11_SHDR_409))
+#define HTTP_SHDR_411(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_411 : (((minor) < 1) ? HTTP10_SHDR_411 : HTTP11_SHDR_411))
+#define HTTP_SHDR_507(major, minor) \
+	(((major) < 1) ? HTTP09_SHDR_507 : (((minor) < 1) ? HTTP10_SHDR_507 : HTTP11_SHDR_507))
 
 static const char __http_dhdr00[] = "Content-type";
 static const char __http_dhdr01[] = "Content-length";
@@ -186,10 +250,11 @@ static const char __http_dhdr03[] = "Retry-after";
 static const char __http_dhdr04[] = "Location";
 static const char __http_dhdr05[] = "Host";
 static const char __http_dhdr06[] = "Icy-metadata";
+static const char __http_dhdr07[] = "Authorization";
 
 static const char * const _http_dhdr[] = {
 	__http_dhdr00, __http_dhdr01, __http_dhdr02, __http_dhdr03,
-	__http_dhdr04, __http_dhdr05, __http_dhdr06
+	__http_dhdr04, __http_dhdr05, __http_dhdr06, __http_dhdr07
 };
 
 #define HTTP_DHDR_MIME            0 /* content-type */
@@ -199,6 +264,7 @@ static const char * const _http_dhdr[] = {
 #define HTTP_DHDR_LOCATION        4 /* location */
 #define HTTP_DHDR_HOST            5 /* host */
 #define HTTP_DHDR_ICYMETADATA     6 /* Icy-metadata */
+#define HTTP_DHDR_AUTH            7 /* authorization */
 
 static const char _http_err404p[] = \
 	"<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML 2.0//EN\">\r\n"
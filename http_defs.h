@@ -46,6 +46,7 @@
 #include "http_parser.h"
 #include "http_data.h"
 #include "http_hdr.h"
+#include "http.h"
 
 #include "mempool.h"
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP
@@ -57,6 +58,10 @@
 #include "shfs_cache.h"
 #include "shfs_fio.h"
 #include "shfs_tools.h"
+#ifdef HTTP_INGEST
+#include "shfs_ingest.h"
+#endif
+#include "trace.h"
 
 #ifdef HTTP_DEBUG
 #define ENABLE_DEBUG
@@ -65,6 +70,7 @@
 
 #define HTTP_LISTEN_PORT          80
 #define HTTP_TCP_PRIO             TCP_PRIO_MAX
+#define HTTP_LOW_TCP_PRIO         TCP_PRIO_NORMAL /* listeners with HTTP_PRIO_LOW */
 #define HTTP_MAXNB_LINKS          4 /* nb of simultaneous links to an origin server */
 #define HTTP_LINK_TCP_PRIO        TCP_PRIO_MAX
 
@@ -72,6 +78,8 @@
 #define HTTP_KEEPALIVE_TIMEOUT     3 /* = x * HTTP_POLL_INTERVAL */
 #define HTTP_TCPKEEPALIVE_TIMEOUT 90 /* = x sec */
 #define HTTP_TCPKEEPALIVE_IDLE    30 /* = x sec */
+#define HTTP_MOUNT_RETRY_AFTER     1 /* = x sec; 503 while the volume is mounted */
+#define HTTP_LISTEN_BACKLOG       64 /* max. nb of connections per listener that wait for being accepted */
 
 #define HTTP_LINK_CONNECT_TIMEOUT   3 /* = x sec */
 #define HTTP_LINK_RESPONSE_TIMEOUT 10 /* = x sec */
@@ -134,8 +142,41 @@ enum http_sess_close {
 	HSC_KILL /* do not touch the tcp_pcb any more */
 };
 
-struct http_srv {
+struct http_listener {
 	struct tcp_pcb *tpcb;
+	struct http_listener_cfg cfg;
+
+	uint16_t nb_sess;
+	uint16_t max_nb_sess;
+	int keepalive_timeout; /* = x * HTTP_POLL_INTERVAL */
+	uint64_t nb_accepted;
+	uint64_t nb_declined; /* by session limit or reservations of others */
+};
+
+/* open addressing table that counts sessions per client IP */
+struct http_iplimit_slot {
+	uint32_t addr; /* 0 = free slot */
+	uint16_t nb_sess;
+};
+
+struct http_srv {
+	struct http_listener listener[HTTP_MAX_NB_LISTENERS];
+	unsigned int nb_listeners;
+	uint16_t rsv_nb_sess; /* sum of all reservations */
+
+	struct http_iplimit_slot *iplimit; /* NULL = no per client IP limit */
+	uint32_t iplimit_mask;
+	uint16_t max_sess_per_ip;
+	uint64_t nb_iplimit_declined;
+	struct dlist_head idle_chain; /* sessions waiting in keep-alive, oldest first */
+	uint64_t nb_idle_evicted;
+	uint64_t nb_rehydrate_defers; /* requests held back for a request object */
+#ifdef HTTP_TLS
+	int tls;              /* TLS is initialized (a listener serves HTTPS) */
+	uint64_t nb_tls_handshakes;
+	uint64_t nb_tls_errors;
+#endif
+
 	struct mempool *sess_pool;
 	struct mempool *req_pool;
 	struct mempool *link_pool;
@@ -152,6 +193,19 @@ struct http_srv {
 
 	struct dlist_head links;
 	struct dlist_head ioretry_chain;
+#ifdef HTTP_INGEST
+	struct dlist_head resume_chain; /* sessions that continue a stopped receive */
+#endif
+#ifdef HTTP_ACK_COALESCE
+	struct dlist_head ack_chain; /* sessions with pending ACKs */
+	uint64_t nb_ack_cbs; /* number of lwIP sent callbacks */
+	uint64_t nb_ack_runs; /* number of acknowledge runs */
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	struct dlist_head flush_chain; /* sessions with unsent output */
+	uint64_t nb_flush_reqs; /* number of requested flushes */
+	uint64_t nb_flush_runs; /* number of tcp_output() calls */
+#endif
 };
 
 extern struct http_srv *hs;
@@ -168,7 +222,9 @@ struct http_sess {
 
 	struct mempool_obj *pobj;
 	struct http_srv *hsrv;
+	struct http_listener *hl; /* listener that accepted the session */
 	struct tcp_pcb *tpcb;
+	uint32_t raddr;       /* client IP (for per client IP limit) */
 	enum http_sess_state state;
 	size_t sent_infly;
 	size_t sent;
@@ -178,7 +234,7 @@ struct http_sess {
 	int keepalive;
 	int keepalive_timer; /* -1 timeout disabled, 0 timeout expired */
 
-	struct http_req *cpreq; /* current request that is parsed */
+	struct http_req *cpreq; /* current request that is parsed (NULL between requests) */
 	struct http_req *rqueue_head; /* request serve queue of parsed requests */
 	struct http_req *rqueue_tail;
 	struct http_req *aqueue_head; /* acknowledge queue (requests that are done with sending out but not yet acknowledged) */
@@ -189,6 +245,26 @@ struct http_sess {
 	                       * within recv because of ERR_MEM */
 	int _in_respond;      /* diables recursive httpsess_respond calls DELETEME */
 	dlist_el(ioretry_chain);
+	dlist_el(idle_chain);
+#ifdef HTTP_ACK_COALESCE
+	size_t ack_pending;   /* acknowledged bytes not processed yet */
+	dlist_el(ack_chain);
+#endif
+#ifdef HTTP_FLUSH_COALESCE
+	dlist_el(flush_chain);
+#endif
+#ifdef HTTP_INGEST
+	size_t rdefer;        /* received bytes of current pbuf that are credited
+	                       * to the TCP window after they are written to disk */
+	int rstop;            /* parsing was stopped: the ingest operation of the
+	                       * current request cannot take more body bytes */
+	struct pbuf *rheld;   /* received data that is not parsed yet (not credited) */
+	uint16_t rheld_off;   /* parsed bytes of rheld */
+	dlist_el(resume_chain);
+#endif
+#ifdef HTTP_TLS
+	struct http_tls *tls; /* NULL: plain HTTP */
+#endif
 
 	//struct http_srv *hs;
 };
@@ -214,6 +290,9 @@ enum http_req_type {
 	HRT_FIOMSG,    /* dynamic message body (file from shfs) */
 	HRT_LINKMSG,   /* dynamic message body (uplink described by shfs) */
 	HRT_NOMSG,     /* just response header, no body */
+#ifdef HTTP_INGEST
+	HRT_INGEST,    /* PUT/DELETE on volume (response built after completion) */
+#endif
 };
 
 struct http_req_fio_state { /* defined in http_fio.h */
@@ -244,6 +323,16 @@ struct http_req_link_state {
 	dlist_el(clients);
 };
 
+#ifdef HTTP_INGEST
+struct http_req_ingest_state { /* defined in http_ingest.h */
+	struct shfs_ingest *si;
+	uint16_t code; /* response code, 0 while operation is in progress */
+	int ret; /* result of the volume operation */
+	size_t withheld; /* received bytes not yet credited to the TCP window */
+	char msg[(2 * sizeof(hash512_t)) + 3]; /* response body */
+};
+#endif
+
 struct http_req {
 	struct mempool_obj *pobj;
 	struct http_sess *hsess;
@@ -284,6 +373,9 @@ struct http_req {
 	union {
 		struct http_req_fio_state  f;
 		struct http_req_link_state l;
+#ifdef HTTP_INGEST
+		struct http_req_ingest_state i;
+#endif
 	};
 
 #if defined SHFS_STATS && defined SHFS_STATS_HTTP
@@ -305,6 +397,7 @@ struct http_req {
 			dlist_append((hsess), \
 			             hs->ioretry_chain, \
 			             ioretry_chain); \
+			trace_ioretry_wait((hsess)); \
 		} \
 	} while(0)
 
@@ -319,7 +412,114 @@ struct http_req {
 		} \
 	} while(0)
 
+#ifdef HTTP_INGEST
+#define httpsess_register_resume(hsess) \
+	do { \
+		if (!dlist_is_linked((hsess), \
+		                     hs->resume_chain, \
+		                     resume_chain)) \
+			dlist_append((hsess), \
+			             hs->resume_chain, \
+			             resume_chain); \
+	} while(0)
+
+#define httpsess_unregister_resume(hsess) \
+	do { \
+		if (unlikely(dlist_is_linked((hsess), \
+		                             hs->resume_chain, \
+		                             resume_chain))) { \
+			dlist_unlink((hsess), \
+			             hs->resume_chain, \
+			             resume_chain); \
+		} \
+	} while(0)
+#endif
+
+#ifdef HTTP_ACK_COALESCE
+#define httpsess_register_ack(hsess) \
+	do { \
+		if (!dlist_is_linked((hsess), \
+		                     hs->ack_chain, \
+		                     ack_chain)) \
+			dlist_append((hsess), \
+			             hs->ack_chain, \
+			             ack_chain); \
+	} while(0)
+
+#define httpsess_unregister_ack(hsess) \
+	do { \
+		if (unlikely(dlist_is_linked((hsess), \
+		                             hs->ack_chain, \
+		                             ack_chain))) { \
+			dlist_unlink((hsess), \
+			             hs->ack_chain, \
+			             ack_chain); \
+		} \
+	} while(0)
+#endif
+
+#define httpsess_register_idle(hsess) \
+	do { \
+		if (dlist_is_linked((hsess), \
+		                    hs->idle_chain, \
+		                    idle_chain)) \
+			dlist_relink_tail((hsess), \
+			                  hs->idle_chain, \
+			                  idle_chain); \
+		else \
+			dlist_append((hsess), \
+			             hs->idle_chain, \
+			             idle_chain); \
+	} while(0)
+
+#define httpsess_unregister_idle(hsess) \
+	do { \
+		if (dlist_is_linked((hsess), \
+		                    hs->idle_chain, \
+		                    idle_chain)) { \
+			dlist_unlink((hsess), \
+			             hs->idle_chain, \
+			             idle_chain); \
+		} \
+	} while(0)
+
+#define httpreq_set_state(hreq, s) \
+	do { \
+		if ((hreq)->state != (s)) \
+			trace_req_state((hreq), (s)); \
+		(hreq)->state = (s); \
+	} while(0)
+
+#ifdef HTTP_FLUSH_COALESCE
+#define httpsess_register_flush(hsess) \
+	do { \
+		++hs->nb_flush_reqs; \
+		if (!dlist_is_linked((hsess), \
+		                     hs->flush_chain, \
+		                     flush_chain)) \
+			dlist_append((hsess), \
+			             hs->flush_chain, \
+			             flush_chain); \
+	} while(0)
+
+#define httpsess_unregister_flush(hsess) \
+	do { \
+		if (dlist_is_linked((hsess), \
+		                    hs->flush_chain, \
+		                    flush_chain)) { \
+			dlist_unlink((hsess), \
+			             hs->flush_chain, \
+			             flush_chain); \
+		} \
+	} while(0)
+
+/* enqueued data is sent out by http_poll_flush() at the end of the
+ * loop iteration: all responses (and pending ACKs) of a session that
+ * were produced within one iteration leave with a single tcp_output() */
+#define httpsess_flush(hsess) httpsess_register_flush((hsess))
+#else
 #define httpsess_flush(hsess) tcp_output((hsess)->tpcb)
+#endif
 
 err_t httpsess_write(struct http_sess *hsess, const void* buf, size_t *len, uint8_t apiflags);
 err_t httpsess_respond(struct http_sess *hsess);
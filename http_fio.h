@@ -48,19 +48,22 @@ void httpreq_fio_aiocb(SHFS_AIO_TOKEN *t, void *cookie, void *argp);
 #define httpreq_fio_nextidx(fstate, idx) \
         ((idx + 1) % (hreq)->f.cce_max_nb)
 
-static inline int httpreq_fio_aioreq(struct http_req *hreq, chk_t addr, unsigned int cce_idx)
+/* requests a buffer that covers [off, off + len) of a chunk:
+ * small ranges are served from a sub-chunk buffer */
+static inline int httpreq_fio_aioreq(struct http_req *hreq, chk_t addr, size_t off, size_t len,
+				     unsigned int cce_idx)
 {
 	/* called whenever an async I/O is completed */
 	int ret;
 
 	BUG_ON(hreq->f.cce_t);
 
-	ret = shfs_cache_aread(addr,
-	                       httpreq_fio_aiocb,
-	                       hreq,
-	                       NULL,
-	                       &(hreq->f.cce[cce_idx]),
-			       &(hreq->f.cce_t));
+	ret = shfs_cache_aread_range(addr, (uint32_t) off, (uint32_t) len,
+	                             httpreq_fio_aiocb,
+	                             hreq,
+	                             NULL,
+	                             &(hreq->f.cce[cce_idx]),
+	                             &(hreq->f.cce_t));
 	if (ret < 0)
 		printd("failed to perform request for chunk %"PRIchk" [cce_idx=%u]: %d\n", addr, cce_idx, ret);
 	else
@@ -68,6 +71,19 @@ static inline int httpreq_fio_aioreq(struct http_req *hreq, chk_t addr, unsigned
 	return ret;
 }
 
+#ifdef HTTP_FLUSH_COALESCE
+/* While the first body chunk is still read from disk, only the response
+ * header is enqueued: it is held back so that it leaves together with
+ * the beginning of the body once the chunk got loaded */
+#define httpreq_fio_flush(hreq, roff) \
+	do { \
+		if ((roff) != 0) \
+			httpsess_flush((hreq)->hsess); \
+	} while(0)
+#else
+#define httpreq_fio_flush(hreq, roff) httpsess_flush((hreq)->hsess)
+#endif
+
 static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
 {
 	register size_t roff, foff;
@@ -92,9 +108,12 @@ static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
  next:
 	err = ERR_OK;
 
+	chk_off = shfs_volchkoff_foff(hreq->fd, foff);
+	left = min(shfs_vol.chunksize - chk_off, hreq->rlen - roff);
+
 	/* is the chunk already requested? */
 	if (unlikely(!hreq->f.cce[idx])) {
-		ret = httpreq_fio_aioreq(hreq, cur_chk, idx);
+		ret = httpreq_fio_aioreq(hreq, cur_chk, chk_off, left, idx);
 		if (unlikely(ret == -EAGAIN)) {
 			/* Retry I/O later because we are out of memory currently */
 			printd("[idx=%u] could not perform I/O: append session to I/O retry chain...\n", idx, ret);
@@ -114,8 +133,8 @@ static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
 			 * we need to wait. httpsess_response
 			 * will be recalled from within callback */
 			printd("[idx=%u] chunk %"PRIchk" is not ready yet but request was sent\n", idx, cur_chk);
-			httpsess_flush(hreq->hsess); /* enforce sending of enqueued packets:
-			                                we have no new data for now */
+			httpreq_fio_flush(hreq, roff); /* enforce sending of enqueued packets:
+			                                  we have no new data for now */
 			err = ERR_OK;
 			goto out; /* we need to wait for completion */
 		}
@@ -130,8 +149,8 @@ static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
 	/* is the chunk to process ready now? */
 	if (unlikely(!shfs_aio_is_done(hreq->f.cce_t))) {
 		printd("[idx=%u] current chunk %"PRIchk" is not ready yet\n", idx, cur_chk);
-		httpsess_flush(hreq->hsess); /* enforce sending of enqueued packets:
-		                                we have no new data for now */
+		httpreq_fio_flush(hreq, roff); /* enforce sending of enqueued packets:
+		                                  we have no new data for now */
 		goto out; /* we need to wait for completion */
 	}
 	/* is the chunk to process valid? (it might be invalid due to I/O erros) */
@@ -141,11 +160,9 @@ static inline err_t httpreq_write_fio(struct http_req *hreq, size_t *sent)
 		goto out;
 	}
 
-	chk_off = shfs_volchkoff_foff(hreq->fd, foff);
-	left = min(shfs_vol.chunksize - chk_off, hreq->rlen - roff);
 	slen = left;
 	err  = httpsess_write(hreq->hsess,
-	                      ((uint8_t *) (hreq->f.cce[idx]->buffer)) + chk_off,
+	                      shfs_cache_data(hreq->f.cce[idx], chk_off),
 	                      &slen, TCP_WRITE_FLAG_MORE);
 	*sent += slen;
 	if (unlikely(err != ERR_OK || !slen)) {
@@ -304,6 +321,15 @@ static inline int httpreq_fio_build_hdr(struct http_req *hreq)
 	goto out;
 }
 
+/* chunks served to low priority listeners do not displace other cache content */
+#define httpreq_fio_release(hreq, cce) \
+	do { \
+		if ((hreq)->hsess->hl->cfg.prio == HTTP_PRIO_LOW) \
+			shfs_cache_release_cold((cce)); \
+		else \
+			shfs_cache_release((cce)); \
+	} while (0)
+
 static inline void httpreq_fio_close(struct http_req *hreq)
 {
 	register unsigned i;
@@ -312,7 +338,7 @@ static inline void httpreq_fio_close(struct http_req *hreq)
 		if (i == hreq->f.cce_idx && hreq->f.cce[i]) {
 			shfs_cache_release_ioabort(hreq->f.cce[i], hreq->f.cce_t);
 		} else if (hreq->f.cce[i]) {
-			shfs_cache_release(hreq->f.cce[i]);
+			httpreq_fio_release(hreq, hreq->f.cce[i]);
 			hreq->f.cce[i] = NULL;
 		}
 	}
@@ -344,7 +370,7 @@ static inline void httpreq_ack_fio(struct http_req *hreq, size_t acked)
 			cce = hreq->f.cce[idx];
 			BUG_ON(cce->addr != start_chk + i);
 			hreq->f.cce[idx] = NULL;
-			shfs_cache_release(cce); /* calls notify_retry */
+			httpreq_fio_release(hreq, cce); /* calls notify_retry */
 		}
 		hreq->f.cce_idx_ack = idx;
 	}
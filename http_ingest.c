@@ -0,0 +1,429 @@
+/*
+ * HTTP ingestion (PUT/DELETE) into SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <string.h>
+#include <errno.h>
+
+#include "http_ingest.h"
+#include "http.h"
+
+static char http_ingest_token[HTTP_INGEST_TOKEN_MAXLEN + 1];
+static size_t http_ingest_token_len = 0; /* 0: ingestion disabled */
+
+int http_ingest_set_token(const char *token)
+{
+	size_t len = strlen(token);
+
+	if (len == 0 || len > HTTP_INGEST_TOKEN_MAXLEN)
+		return -EINVAL;
+
+	memset(http_ingest_token, 0, sizeof(http_ingest_token));
+	memcpy(http_ingest_token, token, len);
+	http_ingest_token_len = len;
+	return 0;
+}
+
+/* compares the bearer token in constant time */
+static int _httpreq_ingest_authorized(struct http_req *hreq)
+{
+	const char *v;
+	size_t vlen;
+	size_t i;
+	int diff;
+	int l;
+
+	l = http_recvhdr_findfield(&hreq->request.hdr, _http_dhdr[HTTP_DHDR_AUTH]);
+	if (l < 0)
+		return 0;
+	v = hreq->request.hdr.line[l].value.b;
+	if (strncasecmp(v, "Bearer ", 7) != 0)
+		return 0;
+	v += 7;
+	while (*v == ' ')
+		++v;
+
+	vlen = strlen(v);
+	diff = (vlen != http_ingest_token_len);
+	for (i = 0; i < HTTP_INGEST_TOKEN_MAXLEN; ++i)
+		diff |= ((i < vlen) ? v[i] : 0) ^ http_ingest_token[i];
+	return (diff == 0);
+}
+
+static void _httpreq_ingest_seterr(struct http_req *hreq, uint16_t code, int err)
+{
+	hreq->i.code = code;
+	snprintf(hreq->i.msg, sizeof(hreq->i.msg), "%s\r\n", strerror(err));
+}
+
+static uint16_t _httpreq_ingest_errcode(int err)
+{
+	switch (err) {
+	case EINVAL:
+	case EBADMSG:
+	case ENAMETOOLONG:
+		return 400;
+	case ENOENT:
+		return 404;
+	case EEXIST:
+	case EBUSY:
+		return 409;
+	case ENOTSUP:
+		return 501;
+	case ENODEV:
+	case EROFS:
+	case ENOMEM:
+	case EAGAIN:
+		return 503;
+	case ENOSPC:
+		return 507;
+	default:
+		return 500;
+	}
+}
+
+/* credits held back bytes to the TCP window */
+static inline void _httpreq_ingest_credit(struct http_req *hreq, size_t len)
+{
+	len = min(len, hreq->i.withheld);
+	if (len) {
+		hreq->i.withheld -= len;
+		tcp_recved(hreq->hsess->tpcb, len);
+	}
+}
+
+/* Chunks that are larger than the held back share of the window cannot be
+ * filled while all of their bytes are withheld: the bytes of the partially
+ * filled chunk buffer are credited when no written chunk is outstanding */
+static inline void _httpreq_ingest_unstall(struct http_req *hreq)
+{
+	struct shfs_ingest *si = hreq->i.si;
+
+	if (hreq->i.withheld >= HTTP_INGEST_MAX_WITHHELD &&
+	    si->nb_infly == 0 && si->nb_ready == 0)
+		_httpreq_ingest_credit(hreq, hreq->i.withheld);
+}
+
+static void _httpreq_ingest_wcb(struct shfs_ingest *si, size_t len, void *argp)
+{
+	struct http_req *hreq = (struct http_req *) argp;
+	struct http_sess *hsess = hreq->hsess;
+
+	_httpreq_ingest_credit(hreq, len);
+	_httpreq_ingest_unstall(hreq);
+
+	/* buffers are free again: continue parsing the body */
+	if (hsess->rstop)
+		httpsess_register_resume(hsess);
+}
+
+static void _httpreq_ingest_dcb(struct shfs_ingest *si, int ret, void *argp)
+{
+	struct http_req *hreq = (struct http_req *) argp;
+	struct http_sess *hsess = hreq->hsess;
+
+	printd("Ingest operation of request %p done: %d\n", hreq, ret);
+	_httpreq_ingest_credit(hreq, hreq->i.withheld);
+
+	hreq->i.ret = ret;
+	if (ret == 0) {
+		if (hreq->request.method == HTTP_PUT) {
+			hreq->i.code = 201;
+			hash_unparse(si->hash, shfs_vol.hlen, hreq->i.msg);
+			strcat(hreq->i.msg, "\r\n");
+		} else {
+			hreq->i.code = 204;
+			hreq->i.msg[0] = '\0';
+		}
+	} else if (ret == -EEXIST && shfs_vol.hfunc == SHFUNC_SHA) {
+		/* same contents are already stored */
+		hreq->i.code = 200;
+		hash_unparse(si->hash, shfs_vol.hlen, hreq->i.msg);
+		strcat(hreq->i.msg, "\r\n");
+	} else {
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(-ret), -ret);
+	}
+
+	/* wake up request if it is waiting for the completion */
+	if (hreq->state == HRS_BUILDING_HDR && !hsess->_in_respond &&
+	    hsess->state == HSS_ESTABLISHED)
+		httpsess_register_ioretry(hsess);
+}
+
+/* splits the URL into name and (optional) hash digest:
+ *  /<name>, /<name>?<hash>, or /?<hash> */
+static int _httpreq_ingest_parse_url(struct http_req *hreq, char **name,
+                                     hash512_t h, int *has_hash)
+{
+	char *url = hreq->request.url;
+	char *argp = hreq->request.url_argp;
+
+	if (hreq->request.url_overflow)
+		return -ENAMETOOLONG;
+	while (*url == '/')
+		++url;
+
+	*has_hash = 0;
+	if (argp) {
+		if (strlen(argp + 1) != (2 * shfs_vol.hlen) ||
+		    hash_parse(argp + 1, h, shfs_vol.hlen) < 0)
+			return -EINVAL;
+		*has_hash = 1;
+		*argp = '\0'; /* terminates name */
+	}
+	if (strlen(url) > sizeof(((struct shfs_hentry *) 0)->name))
+		return -ENAMETOOLONG;
+	*name = url;
+	return 0;
+}
+
+void httpreq_ingest_open(struct http_req *hreq, struct http_parser *parser)
+{
+	char mime[sizeof(((struct shfs_hentry *) 0)->f_attr.mime) + 1];
+	hash512_t h;
+	int has_hash;
+	char *name;
+#ifdef SHFS_OPENBYNAME
+	SHFS_FD fd;
+#endif
+	int ret;
+	int l;
+
+	hreq->type = HRT_INGEST;
+	hreq->i.si = NULL;
+	hreq->i.code = 0;
+	hreq->i.ret = 0;
+	hreq->i.withheld = 0;
+	hreq->i.msg[0] = '\0';
+	hreq->request.method = parser->method;
+
+	if (!http_ingest_token_len) {
+		printd("Ingestion is disabled\n");
+		_httpreq_ingest_seterr(hreq, 501, ENOTSUP);
+		return;
+	}
+	if (!_httpreq_ingest_authorized(hreq)) {
+		printd("Ingest request %p is not authorized\n", hreq);
+		_httpreq_ingest_seterr(hreq, 401, EACCES);
+		return;
+	}
+	if (parser->method == HTTP_DELETE)
+		return; /* removal is started when the request is served */
+
+	if ((parser->flags & F_CHUNKED) || parser->content_length == ULLONG_MAX) {
+		_httpreq_ingest_seterr(hreq, 411, EINVAL);
+		return;
+	}
+	ret = _httpreq_ingest_parse_url(hreq, &name, h, &has_hash);
+	if (ret < 0) {
+		_httpreq_ingest_seterr(hreq, 400, -ret);
+		return;
+	}
+#ifdef SHFS_OPENBYNAME
+	if (name[0] != '\0') {
+		fd = shfs_fio_open(name);
+		if (fd || errno == EBUSY) {
+			if (fd)
+				shfs_fio_close(fd);
+			_httpreq_ingest_seterr(hreq, 409, EEXIST);
+			return;
+		}
+	}
+#endif
+
+	mime[0] = '\0';
+	l = http_recvhdr_findfield(&hreq->request.hdr, _http_dhdr[HTTP_DHDR_MIME]);
+	if (l >= 0) {
+		strncpy(mime, hreq->request.hdr.line[l].value.b, sizeof(mime) - 1);
+		mime[sizeof(mime) - 1] = '\0';
+	}
+
+	hreq->i.si = shfs_ingest_open(parser->content_length, name, mime,
+	                              has_hash ? h : NULL,
+	                              _httpreq_ingest_wcb, hreq);
+	if (!hreq->i.si) {
+		printd("Could not start ingestion of %"PRIu64" bytes: %s\n",
+		       parser->content_length, strerror(errno));
+		if (errno == EBUSY)
+			errno = EAGAIN; /* too many operations in progress */
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(errno), errno);
+		return;
+	}
+	printd("Ingesting %"PRIu64" bytes as '%s' (request %p)\n",
+	       parser->content_length, name, hreq);
+}
+
+size_t httpreq_ingest_room(struct http_req *hreq)
+{
+	size_t room;
+
+	if (hreq->i.code || !hreq->i.si)
+		return SIZE_MAX; /* body is discarded */
+
+	room = shfs_ingest_room(hreq->i.si);
+#ifdef HTTP_TLS
+	if (hreq->hsess->tls)
+		return room; /* window is credited when records are decrypted */
+#endif
+	return min(room, HTTP_INGEST_MAX_WITHHELD - hreq->i.withheld);
+}
+
+size_t httpreq_ingest_body(struct http_req *hreq, const char *buf, size_t len)
+{
+	int ret;
+
+	if (hreq->i.code || !hreq->i.si)
+		return 0; /* operation failed already: discard body */
+
+	/* Note: the parser is fed with at most httpreq_ingest_room() bytes */
+	ret = shfs_ingest_write(hreq->i.si, buf, len);
+	if (unlikely(ret < 0)) {
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(-ret), -ret);
+		return 0;
+	}
+
+	/* hold back the TCP window until the data is on the volume */
+#ifdef HTTP_TLS
+	if (hreq->hsess->tls)
+		return 0; /* window is credited when records are decrypted */
+#endif
+	hreq->i.withheld += len;
+	_httpreq_ingest_unstall(hreq);
+	return len;
+}
+
+void httpreq_ingest_complete(struct http_req *hreq)
+{
+	int ret;
+
+	if (hreq->i.code || !hreq->i.si)
+		return;
+
+	ret = shfs_ingest_commit(hreq->i.si, _httpreq_ingest_dcb);
+	if (ret < 0)
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(-ret), -ret);
+}
+
+static void _httpreq_ingest_remove(struct http_req *hreq)
+{
+	char *path = hreq->request.url;
+	hash512_t h;
+	SHFS_FD fd;
+
+	while (*path == '/')
+		++path;
+	fd = shfs_fio_open(path);
+	if (!fd) {
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(errno), errno);
+		return;
+	}
+	shfs_fio_hash(fd, h);
+	shfs_fio_close(fd);
+
+	/* Note: dcb might be called within this call */
+	hreq->i.si = shfs_ingest_remove(h, _httpreq_ingest_dcb, hreq);
+	if (!hreq->i.si)
+		_httpreq_ingest_seterr(hreq, _httpreq_ingest_errcode(errno), errno);
+}
+
+void httpreq_ingest_build_hdr(struct http_req *hreq)
+{
+	size_t nb_slines = 0;
+	size_t nb_dlines = 0;
+	uint8_t major = hreq->request.http_major;
+	uint8_t minor = hreq->request.http_minor;
+	int shdr;
+
+	if (!hreq->i.code && !hreq->i.si && hreq->request.method == HTTP_DELETE)
+		_httpreq_ingest_remove(hreq);
+	if (!hreq->i.code)
+		return; /* stay in current phase because we are not done yet */
+
+	switch (hreq->i.code) {
+	case 200: shdr = HTTP_SHDR_200(major, minor); break;
+	case 201: shdr = HTTP_SHDR_201(major, minor); break;
+	case 204: shdr = HTTP_SHDR_204(major, minor); break;
+	case 400: shdr = HTTP_SHDR_400(major, minor); break;
+	case 401: shdr = HTTP_SHDR_401(major, minor); break;
+	case 404: shdr = HTTP_SHDR_404(major, minor); break;
+	case 409: shdr = HTTP_SHDR_409(major, minor); break;
+	case 411: shdr = HTTP_SHDR_411(major, minor); break;
+	case 501: shdr = HTTP_SHDR_501(major, minor); break;
+	case 503: shdr = HTTP_SHDR_503(major, minor); break;
+	case 507: shdr = HTTP_SHDR_507(major, minor); break;
+	default:
+		hreq->i.code = 500;
+		shdr = HTTP_SHDR_500(major, minor);
+		break;
+	}
+
+	/* the operation is done: release it and respond with a static message */
+	httpreq_ingest_close(hreq);
+	hreq->response.code = hreq->i.code;
+	hreq->smsg = hreq->i.msg;
+	hreq->rlen = strlen(hreq->i.msg);
+	hreq->type = hreq->rlen ? HRT_SMSG : HRT_NOMSG;
+
+	http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, shdr);
+	if (hreq->response.code == 401)
+		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_AUTH_BEARER);
+	if (hreq->response.code != 204) {
+		http_sendhdr_add_shdr(&hreq->response.hdr, &nb_slines, HTTP_SHDR_PLAIN);
+		/* Content length */
+		http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+		                       "%s: %"PRIu64"\r\n", _http_dhdr[HTTP_DHDR_SIZE],
+		                       hreq->rlen);
+	}
+	if (hreq->response.code == 503)
+		http_sendhdr_add_dline(&hreq->response.hdr, &nb_dlines,
+		                       "%s: %u\r\n", _http_dhdr[HTTP_DHDR_RETRY],
+		                       2);
+	http_sendhdr_set_nbslines(&hreq->response.hdr, nb_slines);
+	http_sendhdr_set_nbdlines(&hreq->response.hdr, nb_dlines);
+	httpreq_set_state(hreq, HRS_FINALIZING_HDR);
+}
+
+void httpreq_ingest_close(struct http_req *hreq)
+{
+	if (hreq->i.si) {
+		/* an uncommitted store is aborted, a committed one completes
+		 * in background */
+		shfs_ingest_close(hreq->i.si);
+		hreq->i.si = NULL;
+	}
+	if (hreq->i.withheld && hreq->hsess->state == HSS_ESTABLISHED)
+		_httpreq_ingest_credit(hreq, hreq->i.withheld);
+}
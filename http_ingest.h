@@ -0,0 +1,62 @@
+/*
+ * HTTP ingestion (PUT/DELETE) into SHFS volumes
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef _HTTP_INGEST_H_
+#define _HTTP_INGEST_H_
+
+#include "http_defs.h"
+#include "http_hdr.h"
+
+/* upper bound of received body bytes of a request that are held back from
+ * the TCP window until they were written to the volume */
+#define HTTP_INGEST_MAX_WITHHELD ((size_t) ((TCP_WND) >> 1))
+
+/* called when the request header was received (PUT/DELETE only) */
+void httpreq_ingest_open(struct http_req *hreq, struct http_parser *parser);
+/* returns the number of body bytes that can be taken currently (SIZE_MAX:
+ * no limit), the parser is not fed with more: the session is registered to
+ * the I/O retry chain when there is room again */
+size_t httpreq_ingest_room(struct http_req *hreq);
+/* returns the number of bytes that are credited to the TCP window later */
+size_t httpreq_ingest_body(struct http_req *hreq, const char *buf, size_t len);
+/* called when the request was received completely */
+void httpreq_ingest_complete(struct http_req *hreq);
+/* builds the response header as soon as the operation is done,
+ * the request stays in its current phase until then */
+void httpreq_ingest_build_hdr(struct http_req *hreq);
+void httpreq_ingest_close(struct http_req *hreq);
+
+#endif /* _HTTP_INGEST_H_ */
@@ -55,7 +55,7 @@ typedef int (*http_cb) (http_parser*);
 
 int httplink_init(struct http_srv *hs)
 {
-  hs->link_pool = alloc_simple_mempool(HTTP_MAXNB_LINKS, sizeof(struct http_req_link_origin));
+  hs->link_pool = alloc_simple_mempool(MEMT_LINK, HTTP_MAXNB_LINKS, sizeof(struct http_req_link_origin));
   if (!hs->link_pool)
     return -ENOMEM;
 
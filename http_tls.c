@@ -0,0 +1,521 @@
+/*
+ * HTTP over TLS (server side)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <psa/crypto.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/platform.h>
+
+#include "http_tls.h"
+#include "http.h"
+#include "mempool.h"
+#include "memacct.h"
+
+#ifndef HTTP_TLS_PATH_MAXLEN
+#define HTTP_TLS_PATH_MAXLEN 255
+#endif
+
+static char http_tls_crt_path[HTTP_TLS_PATH_MAXLEN + 1];
+static char http_tls_key_path[HTTP_TLS_PATH_MAXLEN + 1];
+
+static struct {
+	mbedtls_ssl_config conf;
+	mbedtls_x509_crt crt;
+	mbedtls_pk_context pk;
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context ctr_drbg;
+	mbedtls_ssl_ticket_context ticket;
+	struct mempool *pool;
+} htls;
+
+/* TLS 1.3 only: AES-GCM and ChaCha20-Poly1305 (AES-NI/ARMv8 crypto
+ * extensions are used when they are enabled in the mbed TLS build) */
+static const int http_tls_ciphersuites[] = {
+	MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+	MBEDTLS_TLS1_3_CHACHA20_POLY1305_SHA256,
+	MBEDTLS_TLS1_3_AES_256_GCM_SHA384,
+	0
+};
+
+#if defined HAVE_MEMACCT && defined MBEDTLS_PLATFORM_MEMORY
+/*
+ * Allocations of mbed TLS are accounted to MEMT_TLS. Because free()
+ * does not pass the size, it is stored in front of each block.
+ */
+#define HTTP_TLS_ALLOC_HDRLEN 16 /* keeps the alignment of malloc() */
+
+static void *http_tls_calloc(size_t n, size_t size)
+{
+	uint8_t *ptr;
+	size_t len;
+
+	if (size && n > (SIZE_MAX - HTTP_TLS_ALLOC_HDRLEN) / size)
+		return NULL;
+	len = n * size;
+	ptr = memacct_malloc(MEMT_TLS, HTTP_TLS_ALLOC_HDRLEN,
+	                     len + HTTP_TLS_ALLOC_HDRLEN);
+	if (!ptr)
+		return NULL;
+	*((size_t *) ptr) = len;
+	ptr += HTTP_TLS_ALLOC_HDRLEN;
+	memset(ptr, 0, len);
+	return ptr;
+}
+
+static void http_tls_free(void *ptr)
+{
+	uint8_t *p;
+
+	if (!ptr)
+		return;
+	p = (uint8_t *) ptr - HTTP_TLS_ALLOC_HDRLEN;
+	memacct_free(MEMT_TLS, p, *((size_t *) p) + HTTP_TLS_ALLOC_HDRLEN);
+}
+#endif
+
+int http_tls_set_cert(const char *crt_path, const char *key_path)
+{
+	if (strlen(crt_path) > HTTP_TLS_PATH_MAXLEN ||
+	    strlen(key_path) > HTTP_TLS_PATH_MAXLEN)
+		return -ENAMETOOLONG;
+	if (crt_path[0] == '\0' || key_path[0] == '\0')
+		return -EINVAL;
+
+	strcpy(http_tls_crt_path, crt_path);
+	strcpy(http_tls_key_path, key_path);
+	return 0;
+}
+
+int http_tls_init(uint16_t nb_sess)
+{
+	static const char pers[] = "minicache-http-tls";
+	int ret;
+
+	if (http_tls_crt_path[0] == '\0') {
+		printk("TLS: No certificate and key were specified\n");
+		ret = -EINVAL;
+		goto err_out;
+	}
+
+#if defined HAVE_MEMACCT && defined MBEDTLS_PLATFORM_MEMORY
+	/* has to be set before anything got allocated */
+	mbedtls_platform_set_calloc_free(http_tls_calloc, http_tls_free);
+#endif
+	mbedtls_ssl_config_init(&htls.conf);
+	mbedtls_x509_crt_init(&htls.crt);
+	mbedtls_pk_init(&htls.pk);
+	mbedtls_entropy_init(&htls.entropy);
+	mbedtls_ctr_drbg_init(&htls.ctr_drbg);
+	mbedtls_ssl_ticket_init(&htls.ticket);
+
+	if (psa_crypto_init() != PSA_SUCCESS) {
+		ret = -EIO;
+		goto err_free_ctx;
+	}
+	ret = mbedtls_ctr_drbg_seed(&htls.ctr_drbg, mbedtls_entropy_func, &htls.entropy,
+	                            (const unsigned char *) pers, sizeof(pers) - 1);
+	if (ret != 0) {
+		ret = -EIO;
+		goto err_free_ctx;
+	}
+
+	ret = mbedtls_x509_crt_parse_file(&htls.crt, http_tls_crt_path);
+	if (ret != 0) {
+		printk("TLS: Could not load certificate %s (-0x%04x)\n",
+		       http_tls_crt_path, (unsigned int) -ret);
+		ret = -EINVAL;
+		goto err_free_ctx;
+	}
+	ret = mbedtls_pk_parse_keyfile(&htls.pk, http_tls_key_path, NULL,
+	                               mbedtls_ctr_drbg_random, &htls.ctr_drbg);
+	if (ret != 0) {
+		printk("TLS: Could not load private key %s (-0x%04x)\n",
+		       http_tls_key_path, (unsigned int) -ret);
+		ret = -EINVAL;
+		goto err_free_ctx;
+	}
+
+	ret = mbedtls_ssl_config_defaults(&htls.conf, MBEDTLS_SSL_IS_SERVER,
+	                                  MBEDTLS_SSL_TRANSPORT_STREAM,
+	                                  MBEDTLS_SSL_PRESET_DEFAULT);
+	if (ret != 0) {
+		ret = -EINVAL;
+		goto err_free_ctx;
+	}
+	mbedtls_ssl_conf_min_tls_version(&htls.conf, MBEDTLS_SSL_VERSION_TLS1_3);
+	mbedtls_ssl_conf_max_tls_version(&htls.conf, MBEDTLS_SSL_VERSION_TLS1_3);
+	mbedtls_ssl_conf_ciphersuites(&htls.conf, http_tls_ciphersuites);
+	mbedtls_ssl_conf_rng(&htls.conf, mbedtls_ctr_drbg_random, &htls.ctr_drbg);
+	ret = mbedtls_ssl_conf_own_cert(&htls.conf, &htls.crt, &htls.pk);
+	if (ret != 0) {
+		ret = -EINVAL;
+		goto err_free_ctx;
+	}
+
+	/* session resumption: the server keeps no state per client,
+	 * tickets are encrypted with a key that rotates with their lifetime */
+	ret = mbedtls_ssl_ticket_setup(&htls.ticket, mbedtls_ctr_drbg_random, &htls.ctr_drbg,
+	                               MBEDTLS_CIPHER_AES_256_GCM, HTTP_TLS_TICKET_LIFETIME);
+	if (ret != 0) {
+		ret = -EIO;
+		goto err_free_ctx;
+	}
+	mbedtls_ssl_conf_session_tickets_cb(&htls.conf, mbedtls_ssl_ticket_write,
+	                                    mbedtls_ssl_ticket_parse, &htls.ticket);
+	mbedtls_ssl_conf_tls13_key_exchange_modes(&htls.conf,
+	                                          MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_ALL);
+
+	htls.pool = alloc_simple_mempool(MEMT_HTTP, nb_sess, sizeof(struct http_tls));
+	if (!htls.pool) {
+		ret = -ENOMEM;
+		goto err_free_ctx;
+	}
+	return 0;
+
+ err_free_ctx:
+	mbedtls_ssl_ticket_free(&htls.ticket);
+	mbedtls_ctr_drbg_free(&htls.ctr_drbg);
+	mbedtls_entropy_free(&htls.entropy);
+	mbedtls_pk_free(&htls.pk);
+	mbedtls_x509_crt_free(&htls.crt);
+	mbedtls_ssl_config_free(&htls.conf);
+ err_out:
+	return ret;
+}
+
+void http_tls_exit(void)
+{
+	free_mempool(htls.pool);
+	mbedtls_ssl_ticket_free(&htls.ticket);
+	mbedtls_ctr_drbg_free(&htls.ctr_drbg);
+	mbedtls_entropy_free(&htls.entropy);
+	mbedtls_pk_free(&htls.pk);
+	mbedtls_x509_crt_free(&htls.crt);
+	mbedtls_ssl_config_free(&htls.conf);
+}
+
+/*******************************************************************************
+ * Transmit queue
+ ******************************************************************************/
+#define http_tls_txq_tail(t) \
+	(&(t)->txq[((t)->txq_head + (t)->txq_len - 1) % HTTP_TLS_TXQ_LEN])
+
+static inline void http_tls_txq_push(struct http_tls *t, uint32_t plain)
+{
+	struct http_tls_txrec *e;
+
+	e = &t->txq[(t->txq_head + t->txq_len) % HTTP_TLS_TXQ_LEN];
+	e->plain = plain;
+	e->cipher = 0;
+	++t->txq_len;
+}
+
+/* accounts bytes that were handed over to TCP */
+static inline void http_tls_txq_add(struct http_tls *t, uint32_t cipher)
+{
+	if (!t->txq_open &&
+	    (t->txq_len == 0 || http_tls_txq_tail(t)->plain != 0)) {
+		/* handshake messages or an alert */
+		if (t->txq_len < HTTP_TLS_TXQ_LEN)
+			http_tls_txq_push(t, 0);
+		/* otherwise, they are accounted to the last record */
+	}
+	http_tls_txq_tail(t)->cipher += cipher;
+}
+
+size_t http_tls_acked(struct http_sess *hsess, size_t len)
+{
+	struct http_tls *t = hsess->tls;
+	struct http_tls_txrec *e;
+	size_t plain = 0;
+	size_t left;
+
+	while (len && t->txq_len) {
+		e = &t->txq[t->txq_head];
+		left = e->cipher - t->txq_acked;
+		if (len < left || (t->txq_open && t->txq_len == 1)) {
+			/* record is not completely acknowledged yet
+			 * (or not even completely enqueued) */
+			t->txq_acked += min(len, left);
+			break;
+		}
+		len -= left;
+		plain += e->plain;
+		t->txq_acked = 0;
+		t->txq_head = (t->txq_head + 1) % HTTP_TLS_TXQ_LEN;
+		--t->txq_len;
+	}
+	return plain;
+}
+
+/*******************************************************************************
+ * mbed TLS I/O callbacks
+ ******************************************************************************/
+static int http_tls_bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+	struct http_tls *t = ctx;
+	struct tcp_pcb *pcb = t->hsess->tpcb;
+	uint16_t slen;
+	err_t err;
+
+	/* Note: mbed TLS reuses its output buffer, data has to be copied */
+	slen = (uint16_t) min3(len, tcp_sndbuf(pcb), UINT16_MAX);
+	if (!slen)
+		return MBEDTLS_ERR_SSL_WANT_WRITE;
+	err = tcp_write(pcb, buf, slen, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+	if (err == ERR_MEM)
+		return MBEDTLS_ERR_SSL_WANT_WRITE;
+	if (err != ERR_OK)
+		return MBEDTLS_ERR_NET_SEND_FAILED;
+
+	http_tls_txq_add(t, slen);
+	return (int) slen;
+}
+
+static int http_tls_bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+	struct http_tls *t = ctx;
+	struct pbuf *q;
+	uint16_t n;
+
+	if (!t->rxq)
+		return MBEDTLS_ERR_SSL_WANT_READ;
+
+	n = pbuf_copy_partial(t->rxq, buf,
+	                      (uint16_t) min(len, (size_t) (t->rxq->tot_len - t->rx_off)),
+	                      t->rx_off);
+	t->rx_off += n;
+
+	/* release consumed pbufs of the chain */
+	while (t->rxq && t->rx_off >= t->rxq->len) {
+		q = t->rxq;
+		t->rxq = q->next;
+		t->rx_off -= q->len;
+		q->next = NULL;
+		q->tot_len = q->len;
+		pbuf_free(q);
+	}
+	tcp_recved(t->hsess->tpcb, n);
+	return (int) n;
+}
+
+/*******************************************************************************
+ * Session handling
+ ******************************************************************************/
+int http_tls_open(struct http_sess *hsess)
+{
+	struct mempool_obj *tobj;
+	struct http_tls *t;
+	int ret;
+
+	tobj = mempool_pick(htls.pool);
+	if (!tobj) {
+		ret = -ENOMEM;
+		goto err_out;
+	}
+	t = tobj->data;
+	t->pobj = tobj;
+	t->hsess = hsess;
+	t->ssl_ready = 0;
+	t->handshake_done = 0;
+	t->rxq = NULL;
+	t->rx_off = 0;
+	t->wpending = 0;
+	t->txq_head = 0;
+	t->txq_len = 0;
+	t->txq_open = 0;
+	t->txq_acked = 0;
+
+	/* Note: record buffers are allocated by http_tls_setup() when the
+	 * client sent its first data (ClientHello), not for idle connections */
+	mbedtls_ssl_init(&t->ssl);
+
+	hsess->tls = t;
+	return 0;
+
+ err_out:
+	return ret;
+}
+
+static int http_tls_setup(struct http_tls *t)
+{
+	int ret;
+
+	ret = mbedtls_ssl_setup(&t->ssl, &htls.conf);
+	if (ret != 0)
+		return -ENOMEM; /* record buffers are allocated here */
+	mbedtls_ssl_set_bio(&t->ssl, t, http_tls_bio_send, http_tls_bio_recv, NULL);
+	t->ssl_ready = 1;
+	return 0;
+}
+
+void http_tls_close(struct http_sess *hsess, int notify)
+{
+	struct http_tls *t = hsess->tls;
+
+	if (notify && t->handshake_done)
+		mbedtls_ssl_close_notify(&t->ssl); /* best effort */
+	mbedtls_ssl_free(&t->ssl);
+	if (t->rxq)
+		pbuf_free(t->rxq);
+	mempool_put(t->pobj);
+	hsess->tls = NULL;
+}
+
+int http_tls_rx(struct http_sess *hsess, struct pbuf *p)
+{
+	struct http_tls *t = hsess->tls;
+
+	if (!t->rxq) {
+		t->rxq = p;
+		return 0;
+	}
+	if ((uint32_t) t->rxq->tot_len + p->tot_len > UINT16_MAX)
+		return -EAGAIN; /* tot_len would overflow */
+	pbuf_cat(t->rxq, p);
+	return 0;
+}
+
+ssize_t http_tls_read(struct http_sess *hsess, void *buf, size_t len)
+{
+	struct http_tls *t = hsess->tls;
+	int ret;
+
+	if (unlikely(!t->handshake_done)) {
+		if (!t->ssl_ready) {
+			if (!t->rxq)
+				return 0; /* wait for the ClientHello */
+			ret = http_tls_setup(t);
+			if (ret < 0) {
+				printd("TLS setup failed on session %p: %d\n",
+				       hsess, ret);
+				++hs->nb_tls_errors;
+				return ret;
+			}
+		}
+		ret = mbedtls_ssl_handshake(&t->ssl);
+		if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+		    ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+			return 0;
+		if (ret != 0) {
+			printd("TLS handshake failed on session %p: -0x%04x\n",
+			       hsess, (unsigned int) -ret);
+			++hs->nb_tls_errors;
+			return -EPROTO;
+		}
+		t->handshake_done = 1;
+		++hs->nb_tls_handshakes;
+	}
+
+	ret = mbedtls_ssl_read(&t->ssl, buf, len);
+	if (ret > 0)
+		return (ssize_t) ret;
+	if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+	    ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+		return 0;
+	if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+		return -ECONNRESET;
+	printd("TLS read failed on session %p: -0x%04x\n",
+	       hsess, (unsigned int) -ret);
+	++hs->nb_tls_errors;
+	return -EPROTO;
+}
+
+err_t http_tls_write(struct http_sess *hsess, const void *buf, size_t *len)
+{
+	struct http_tls *t = hsess->tls;
+	struct tcp_pcb *pcb = hsess->tpcb;
+	size_t l, s, room;
+	int exp, maxpl;
+	int ret;
+	err_t err = ERR_OK;
+
+	exp = mbedtls_ssl_get_record_expansion(&t->ssl);
+	maxpl = mbedtls_ssl_get_max_out_record_payload(&t->ssl);
+	if (unlikely(exp < 0 || maxpl <= 0)) {
+		*len = 0;
+		return ERR_ABRT;
+	}
+
+	s = 0;
+	while (s < *len) {
+		if (t->wpending) {
+			/* a record was encrypted already but TCP did not take it
+			 * completely: mbed TLS requires the same write call again */
+			l = t->wpending;
+			BUG_ON(*len - s < l);
+		} else {
+			/* new record: it has to fit into the send buffer */
+			room = tcp_sndbuf(pcb);
+			if (room <= (size_t) exp ||
+			    t->txq_len == HTTP_TLS_TXQ_LEN) {
+				err = ERR_MEM;
+				break;
+			}
+			l = min3(*len - s, (size_t) maxpl, room - (size_t) exp);
+			http_tls_txq_push(t, (uint32_t) l);
+			t->txq_open = 1;
+		}
+
+		ret = mbedtls_ssl_write(&t->ssl, (const unsigned char *) buf + s, l);
+		if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+			t->wpending = l;
+			err = ERR_MEM;
+			break;
+		}
+		if (unlikely(ret < 0)) {
+			printd("TLS write failed on session %p: -0x%04x\n",
+			       hsess, (unsigned int) -ret);
+			++hs->nb_tls_errors;
+			err = ERR_ABRT;
+			break;
+		}
+		t->wpending = 0;
+		t->txq_open = 0;
+		s += (size_t) ret;
+	}
+
+	*len = s;
+	return err;
+}
@@ -0,0 +1,97 @@
+/*
+ * HTTP over TLS (server side)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef _HTTP_TLS_H_
+#define _HTTP_TLS_H_
+
+#include <mbedtls/ssl.h>
+
+#include "http_defs.h"
+
+#define HTTP_TLS_TXQ_LEN          64 /* max. nb of records in flight per session */
+#define HTTP_TLS_RXBUF_LEN      4096 /* plaintext bounce buffer for the parser */
+#define HTTP_TLS_TICKET_LIFETIME 86400 /* = x sec; session resumption tickets */
+
+/*
+ * TCP acknowledges ciphertext but the response state machine counts
+ * plaintext: each entry of the transmit queue maps a record (or
+ * handshake messages, plain = 0) to its bytes on the wire
+ */
+struct http_tls_txrec {
+	uint32_t plain;
+	uint32_t cipher;
+};
+
+struct http_tls {
+	struct mempool_obj *pobj;
+	struct http_sess *hsess;
+	mbedtls_ssl_context ssl;
+	int ssl_ready;          /* ssl got set up (record buffers allocated) */
+	int handshake_done;
+
+	struct pbuf *rxq;       /* received ciphertext, not yet consumed */
+	uint16_t rx_off;        /* consumed bytes of rxq */
+
+	size_t wpending;        /* plaintext length of a record that was encrypted
+	                         * but not handed over to TCP completely */
+	struct http_tls_txrec txq[HTTP_TLS_TXQ_LEN];
+	unsigned int txq_head;
+	unsigned int txq_len;
+	int txq_open;           /* tail entry is the record currently written */
+	size_t txq_acked;       /* acknowledged bytes of the head entry */
+};
+
+int http_tls_init(uint16_t nb_sess);
+void http_tls_exit(void);
+
+int http_tls_open(struct http_sess *hsess);
+/* notify: send a close_notify alert (the connection is closed gracefully) */
+void http_tls_close(struct http_sess *hsess, int notify);
+
+/* queues received ciphertext; returns -EAGAIN when the queue is full,
+ * p is taken over otherwise */
+int http_tls_rx(struct http_sess *hsess, struct pbuf *p);
+/* runs the handshake and decrypts queued records
+ * returns the number of plaintext bytes, 0 if more data is required,
+ * or a negative error code (the connection has to be closed) */
+ssize_t http_tls_read(struct http_sess *hsess, void *buf, size_t len);
+/* encrypts and enqueues *len bytes to TCP (like tcp_write);
+ * *len is set to the number of taken plaintext bytes */
+err_t http_tls_write(struct http_sess *hsess, const void *buf, size_t *len);
+/* converts acknowledged ciphertext bytes to acknowledged plaintext bytes */
+size_t http_tls_acked(struct http_sess *hsess, size_t len);
+
+#endif /* _HTTP_TLS_H_ */
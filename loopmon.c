@@ -0,0 +1,231 @@
+/*
+ * Event loop lag and stall monitor
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "loopmon.h"
+#include "shell.h"
+
+static const char *_lmp_name[LMP_NB] = {
+	[LMP_WAIT]    = "wait",
+	[LMP_BLKDEV]  = "blkdev",
+	[LMP_IORETRY] = "ioretry",
+	[LMP_NETIF]   = "netif",
+	[LMP_TIMERS]  = "timers",
+};
+
+struct loopmon lm;
+
+static void _loopmon_reset(void)
+{
+	memset(&lm.iter, 0, sizeof(lm.iter));
+	memset(&lm.busy, 0, sizeof(lm.busy));
+	memset(&lm.phase, 0, sizeof(lm.phase));
+	memset(&lm.stall, 0, sizeof(lm.stall));
+	lm.nb_stalls = 0;
+	lm.nb_rx = 0;
+	lm.nb_rx_exhausted = 0;
+}
+
+void init_loopmon(int wait_is_idle)
+{
+	memset(&lm, 0, sizeof(lm));
+	lm.wait_is_idle = wait_is_idle;
+	lm.stall_threshold = LOOPMON_STALL_THRESHOLD_MS * 1000000ull;
+	lm.t_iter = target_now_ns();
+	lm.t_phase = lm.t_iter;
+}
+
+void _loopmon_stall(uint64_t now, uint64_t busy)
+{
+	struct loopmon_stall *s = &lm.stall[lm.nb_stalls % LOOPMON_NB_STALLS];
+	enum loopmon_phase p, pmax = LMP_BLKDEV;
+
+	for (p = 0; p < LMP_NB; ++p) {
+		if (p == LMP_WAIT && lm.wait_idle)
+			continue;
+		if (lm.phase_t[p] > lm.phase_t[pmax])
+			pmax = p;
+	}
+
+	s->ts = now;
+	s->busy = busy;
+	s->phase = pmax;
+	s->phase_t = lm.phase_t[pmax];
+	strcpy(s->culprit, lm.cmd_hint);
+	++lm.nb_stalls;
+}
+
+/* returns upper bound (us) of the bucket that contains the q-th percentile */
+static uint64_t _loopmon_hist_pct(struct loopmon_hist *h, unsigned int q)
+{
+	uint64_t thr, sum = 0;
+	unsigned int b;
+
+	if (!h->count)
+		return 0;
+	thr = (h->count * q + 99) / 100;
+	for (b = 0; b < LOOPMON_NB_BUCKETS - 1; ++b) {
+		sum += h->b[b];
+		if (sum >= thr)
+			break;
+	}
+	return (uint64_t) 1 << b;
+}
+
+static void _loopmon_print_summary(FILE *cio, const char *name,
+				   struct loopmon_hist *h)
+{
+	fprintf(cio, " %-10s %12"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+		name, h->count,
+		h->count ? (h->sum / h->count) / 1000 : 0,
+		_loopmon_hist_pct(h, 50),
+		_loopmon_hist_pct(h, 99),
+		h->max / 1000);
+}
+
+static void _loopmon_print_hist(FILE *cio, const char *name,
+				struct loopmon_hist *h)
+{
+	unsigned int b;
+
+	fprintf(cio, "%s:\n", name);
+	for (b = 0; b < LOOPMON_NB_BUCKETS; ++b) {
+		if (!h->b[b])
+			continue;
+		if (b == LOOPMON_NB_BUCKETS - 1)
+			fprintf(cio, "    >=%10"PRIu64" us: %12"PRIu64"\n",
+				(uint64_t) 1 << (b - 1), h->b[b]);
+		else
+			fprintf(cio, "     <%10"PRIu64" us: %12"PRIu64"\n",
+				(uint64_t) 1 << b, h->b[b]);
+	}
+}
+
+static int shcmd_loop_stats(FILE *cio, int argc, char *argv[])
+{
+	struct loopmon_stall *s;
+	uint64_t now;
+	uint64_t i, first;
+	enum loopmon_phase p;
+	long thr;
+
+	if (argc == 1) {
+		fprintf(cio, "Stall threshold: %"PRIu64" ms, stalls: %"PRIu64"\n",
+			lm.stall_threshold / 1000000, lm.nb_stalls);
+		fprintf(cio, " %-10s %12s %10s %10s %10s %10s\n",
+			"", "count", "avg(us)", "p50(us)", "p99(us)", "max(us)");
+		_loopmon_print_summary(cio, "iteration", &lm.iter);
+		_loopmon_print_summary(cio, "busy", &lm.busy);
+		for (p = 0; p < LMP_NB; ++p)
+			_loopmon_print_summary(cio, _lmp_name[p], &lm.phase[p]);
+		fprintf(cio, "RX frames: %"PRIu64", RX budget used up: %"PRIu64" iterations\n",
+			lm.nb_rx, lm.nb_rx_exhausted);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "-h") == 0 && argc == 2) {
+		_loopmon_print_hist(cio, "iteration", &lm.iter);
+		_loopmon_print_hist(cio, "busy", &lm.busy);
+		for (p = 0; p < LMP_NB; ++p)
+			_loopmon_print_hist(cio, _lmp_name[p], &lm.phase[p]);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "-s") == 0 && argc == 2) {
+		now = target_now_ns();
+		first = (lm.nb_stalls > LOOPMON_NB_STALLS) ?
+			(lm.nb_stalls - LOOPMON_NB_STALLS) : 0;
+		for (i = first; i < lm.nb_stalls; ++i) {
+			s = &lm.stall[i % LOOPMON_NB_STALLS];
+			fprintf(cio, "%8"PRIu64".%03"PRIu64"s ago: busy %"PRIu64" us, "
+				"longest phase: %s (%"PRIu64" us)",
+				(now - s->ts) / 1000000000,
+				((now - s->ts) / 1000000) % 1000,
+				s->busy / 1000,
+				_lmp_name[s->phase], s->phase_t / 1000);
+			if (s->culprit[0] != '\0')
+				fprintf(cio, ", shell command: %s", s->culprit);
+			fprintf(cio, "\n");
+		}
+		return 0;
+	}
+
+	if (strcmp(argv[1], "-t") == 0 && argc == 3) {
+		thr = atol(argv[2]);
+		if (thr <= 0) {
+			fprintf(cio, "Invalid threshold: %s\n", argv[2]);
+			return -1;
+		}
+		lm.stall_threshold = (uint64_t) thr * 1000000ull;
+		return 0;
+	}
+
+	if (strcmp(argv[1], "-r") == 0 && argc == 2) {
+		_loopmon_reset();
+		return 0;
+	}
+
+	fprintf(cio, "Usage: %s [-h|-s|-r|-t [MS]]\n", argv[0]);
+	fprintf(cio, "  -h       Print duration histograms\n");
+	fprintf(cio, "  -s       List most recent stalls\n");
+	fprintf(cio, "  -r       Reset counters\n");
+	fprintf(cio, "  -t [MS]  Set stall threshold\n");
+	return -1;
+}
+
+#ifdef HAVE_CTLDIR
+int register_loopmon_tools(struct ctldir *cd)
+#else
+int register_loopmon_tools(void)
+#endif
+{
+#ifdef HAVE_CTLDIR
+	/* ctldir entries (ignore errors) */
+	if (cd)
+		ctldir_register_shcmd(cd, "loop-stats", shcmd_loop_stats);
+#endif
+#ifdef HAVE_SHELL
+	/* shell commands (ignore errors) */
+	shell_register_cmd("loop-stats", shcmd_loop_stats);
+#endif
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Event loop lag and stall monitor
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _LOOPMON_H_
+#define _LOOPMON_H_
+
+#include <target/sys.h>
+#include <stdint.h>
+#include <string.h>
+#include "likely.h"
+#ifdef HAVE_CTLDIR
+#include <target/ctldir.h>
+#endif
+
+/*
+ * Measures the duration of each main loop iteration and of each of its
+ * phases. Durations are accounted to log2 histograms (in us). An iteration
+ * whose busy time (iteration time without idle waiting) exceeds the stall
+ * threshold is recorded together with its longest phase and, if a shell
+ * command was executed meanwhile, the command name as culprit.
+ * Shell commands run in their own threads while the main loop waits: an
+ * iteration during which a command ran does not count LMP_WAIT as idle.
+ */
+enum loopmon_phase {
+	LMP_WAIT = 0, /* select()/schedule(): idle time or other threads */
+	LMP_BLKDEV,   /* block device polling, AIO callbacks */
+	LMP_IORETRY,  /* HTTP I/O retries, control requests */
+	LMP_NETIF,    /* network polling, lwIP callbacks */
+	LMP_TIMERS,   /* lwIP timers */
+	LMP_NB
+};
+
+#define LOOPMON_NB_BUCKETS 24 /* [0] < 1us, [i] < 2^i us, last: rest */
+#define LOOPMON_NB_STALLS  16 /* most recent stalls that are kept */
+#define LOOPMON_CULPRIT_LEN 16
+
+#ifndef LOOPMON_STALL_THRESHOLD_MS
+#define LOOPMON_STALL_THRESHOLD_MS 10
+#endif
+
+struct loopmon_hist {
+	uint64_t count;
+	uint64_t sum; /* ns */
+	uint64_t max; /* ns */
+	uint64_t b[LOOPMON_NB_BUCKETS];
+};
+
+struct loopmon_stall {
+	uint64_t ts; /* ns */
+	uint64_t busy; /* ns */
+	uint64_t phase_t; /* ns */
+	enum loopmon_phase phase; /* longest phase */
+	char culprit[LOOPMON_CULPRIT_LEN];
+};
+
+struct loopmon {
+	uint64_t t_iter; /* start of current iteration */
+	uint64_t t_phase; /* start of current phase */
+	uint64_t phase_t[LMP_NB]; /* phase durations of current iteration */
+	int wait_is_idle; /* LMP_WAIT is idle time (select with timeout) */
+	int wait_idle; /* LMP_WAIT of the current iteration was idle */
+	uint64_t stall_threshold; /* ns */
+
+	int cmd_running; /* a shell command is executed currently */
+	int cmd_ran; /* a shell command ran during this iteration */
+	char cmd_hint[LOOPMON_CULPRIT_LEN]; /* last shell command that was
+					     * executed during this iteration */
+
+	struct loopmon_hist iter;
+	struct loopmon_hist busy;
+	struct loopmon_hist phase[LMP_NB];
+
+	uint64_t nb_stalls;
+	struct loopmon_stall stall[LOOPMON_NB_STALLS];
+
+	uint64_t nb_rx; /* frames taken from the netif */
+	uint64_t nb_rx_exhausted; /* iterations that used up the RX budget */
+};
+
+extern struct loopmon lm;
+
+void init_loopmon(int wait_is_idle);
+void _loopmon_stall(uint64_t now, uint64_t busy);
+
+static inline void _loopmon_hist_add(struct loopmon_hist *h, uint64_t d)
+{
+	uint64_t us = d / 1000;
+	unsigned int b;
+
+	b = us ? (64 - __builtin_clzll(us)) : 0;
+	if (unlikely(b >= LOOPMON_NB_BUCKETS))
+		b = LOOPMON_NB_BUCKETS - 1;
+	++h->b[b];
+	++h->count;
+	h->sum += d;
+	if (unlikely(d > h->max))
+		h->max = d;
+}
+
+static inline void loopmon_iter_begin(void)
+{
+	lm.t_iter = target_now_ns();
+	lm.t_phase = lm.t_iter;
+}
+
+/* ends the current phase and starts the next one */
+static inline void loopmon_phase_end(enum loopmon_phase p)
+{
+	uint64_t now = target_now_ns();
+
+	lm.phase_t[p] = now - lm.t_phase;
+	_loopmon_hist_add(&lm.phase[p], lm.phase_t[p]);
+	lm.t_phase = now;
+}
+
+static inline void loopmon_iter_end(void)
+{
+	uint64_t d = lm.t_phase - lm.t_iter;
+	uint64_t busy = d;
+
+	lm.wait_idle = lm.wait_is_idle && !lm.cmd_ran;
+	if (lm.wait_idle)
+		busy -= lm.phase_t[LMP_WAIT];
+	_loopmon_hist_add(&lm.iter, d);
+	_loopmon_hist_add(&lm.busy, busy);
+	if (unlikely(busy >= lm.stall_threshold))
+		_loopmon_stall(lm.t_phase, busy);
+	if (!lm.cmd_running)
+		lm.cmd_hint[0] = '\0';
+	lm.cmd_ran = lm.cmd_running;
+}
+
+/* accounts the result of a budgeted netif poll */
+static inline void loopmon_rx(unsigned int done, unsigned int budget)
+{
+	lm.nb_rx += done;
+	if (budget && done >= budget)
+		++lm.nb_rx_exhausted;
+}
+
+/* called by the shell around command execution */
+static inline void loopmon_cmd_enter(const char *cmd)
+{
+	strncpy(lm.cmd_hint, cmd, LOOPMON_CULPRIT_LEN - 1);
+	lm.cmd_hint[LOOPMON_CULPRIT_LEN - 1] = '\0';
+	lm.cmd_running = 1;
+	lm.cmd_ran = 1;
+}
+
+static inline void loopmon_cmd_leave(void)
+{
+	lm.cmd_running = 0;
+	lm.cmd_ran = 1;
+}
+
+/**
+ * Registers loopmon tools to micro shell + ctldir (if *cd is not NULL)
+ */
+#ifdef HAVE_CTLDIR
+int register_loopmon_tools(struct ctldir *cd);
+#else
+int register_loopmon_tools(void);
+#endif
+
+#endif /* _LOOPMON_H_ */
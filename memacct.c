@@ -0,0 +1,266 @@
+/*
+ * Per-subsystem memory accounting
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "memacct.h"
+#include "mempool.h"
+#include "shell.h"
+
+#ifdef HAVE_LWIP
+#include <lwip/stats.h>
+#endif
+
+static const char *_memt_name[MEMT_MAX] = {
+	[MEMT_OTHER]      = "other",
+	[MEMT_SHFS]       = "shfs",
+	[MEMT_HTCACHE]    = "htcache",
+	[MEMT_CHUNKCACHE] = "chunkcache",
+	[MEMT_STATS]      = "stats",
+	[MEMT_HTTP]       = "http",
+	[MEMT_LINK]       = "link",
+	[MEMT_BLKDEV]     = "blkdev",
+	[MEMT_TRACE]      = "trace",
+	[MEMT_TLS]        = "tls",
+};
+
+struct memacct_ctr memacct[MEMT_MAX];
+
+static struct {
+	dlist_head(pools);
+} _memacct_pools;
+
+void memacct_register_pool(struct mempool *p)
+{
+	dlist_append(p, _memacct_pools.pools, plst);
+}
+
+void memacct_unregister_pool(struct mempool *p)
+{
+	dlist_unlink(p, _memacct_pools.pools, plst);
+}
+
+static void _memacct_reset(void)
+{
+	struct mempool *p;
+	int i;
+
+	for (i = 0; i < MEMT_MAX; ++i) {
+		memacct[i].peak = memacct[i].cur;
+		memacct[i].nb_fails = 0;
+	}
+	dlist_foreach(p, _memacct_pools.pools, plst) {
+		p->min_free_objs = p->nb_free_objs;
+		p->nb_fails = 0;
+		memset(p->occ_hist, 0, sizeof(p->occ_hist));
+	}
+}
+
+#if defined HAVE_LWIP && LWIP_STATS && MEMP_STATS
+static const char *_memp_name[] = {
+#define LWIP_MEMPOOL(name,num,size,desc) desc,
+#include <lwip/memp_std.h>
+};
+#endif
+
+static void _memacct_print_lwip(FILE *cio, int mr)
+{
+#if defined HAVE_LWIP && LWIP_STATS
+#if MEM_STATS
+	if (mr) {
+		fprintf(cio, "lwip.mem.avail: %"PRIu64"\n", (uint64_t) lwip_stats.mem.avail);
+		fprintf(cio, "lwip.mem.used: %"PRIu64"\n", (uint64_t) lwip_stats.mem.used);
+		fprintf(cio, "lwip.mem.max: %"PRIu64"\n", (uint64_t) lwip_stats.mem.max);
+		fprintf(cio, "lwip.mem.err: %"PRIu64"\n", (uint64_t) lwip_stats.mem.err);
+	} else {
+		fprintf(cio, "%-16s %12"PRIu64" %12"PRIu64" %12"PRIu64" %10"PRIu64"\n",
+			"lwip heap",
+			(uint64_t) lwip_stats.mem.avail,
+			(uint64_t) lwip_stats.mem.used,
+			(uint64_t) lwip_stats.mem.max,
+			(uint64_t) lwip_stats.mem.err);
+	}
+#endif
+#if MEMP_STATS
+	do {
+		int i;
+
+		for (i = 0; i < MEMP_MAX; ++i) {
+			if (mr) {
+				fprintf(cio, "lwip.memp.%s.avail: %"PRIu64"\n", _memp_name[i], (uint64_t) lwip_stats.memp[i].avail);
+				fprintf(cio, "lwip.memp.%s.used: %"PRIu64"\n", _memp_name[i], (uint64_t) lwip_stats.memp[i].used);
+				fprintf(cio, "lwip.memp.%s.max: %"PRIu64"\n", _memp_name[i], (uint64_t) lwip_stats.memp[i].max);
+				fprintf(cio, "lwip.memp.%s.err: %"PRIu64"\n", _memp_name[i], (uint64_t) lwip_stats.memp[i].err);
+			} else {
+				fprintf(cio, "%-16s %12"PRIu64" %12"PRIu64" %12"PRIu64" %10"PRIu64"\n",
+					_memp_name[i],
+					(uint64_t) lwip_stats.memp[i].avail,
+					(uint64_t) lwip_stats.memp[i].used,
+					(uint64_t) lwip_stats.memp[i].max,
+					(uint64_t) lwip_stats.memp[i].err);
+			}
+		}
+	} while (0);
+#endif
+#else
+	if (!mr)
+		fprintf(cio, "lwIP statistics are not available\n");
+#endif
+}
+
+static void _memacct_print_pools(FILE *cio, int mr)
+{
+	struct mempool *p;
+	unsigned int n = 0;
+	int i;
+
+	if (!mr) {
+		fprintf(cio, "%-3s %-10s %8s %10s %10s %10s %12s %10s  %s\n",
+			"#", "tag", "objsize", "objs", "used", "peak", "size", "fails",
+			"occupancy on pick (x/8 buckets)");
+	}
+	dlist_foreach(p, _memacct_pools.pools, plst) {
+		if (mr) {
+			fprintf(cio, "memacct.pool%u.tag: %s\n", n, _memt_name[p->tag]);
+			fprintf(cio, "memacct.pool%u.objs: %"PRIu32"\n", n, p->nb_objs);
+			fprintf(cio, "memacct.pool%u.used: %"PRIu32"\n", n, p->nb_objs - p->nb_free_objs);
+			fprintf(cio, "memacct.pool%u.peak: %"PRIu32"\n", n, p->nb_objs - p->min_free_objs);
+			fprintf(cio, "memacct.pool%u.fails: %"PRIu64"\n", n, p->nb_fails);
+			for (i = 0; i < MEMPOOL_OCC_NB_BUCKETS; ++i)
+				fprintf(cio, "memacct.pool%u.occ%d: %"PRIu64"\n", n, i, p->occ_hist[i]);
+		} else {
+			fprintf(cio, "%-3u %-10s %8"PRIu64" %10"PRIu32" %10"PRIu32" %10"PRIu32" %12"PRIu64" %10"PRIu64" ",
+				n, _memt_name[p->tag],
+				(uint64_t) p->obj_size,
+				p->nb_objs,
+				p->nb_objs - p->nb_free_objs,
+				p->nb_objs - p->min_free_objs,
+				(uint64_t) p->pool_size,
+				p->nb_fails);
+			for (i = 0; i < MEMPOOL_OCC_NB_BUCKETS; ++i)
+				fprintf(cio, " %"PRIu64, p->occ_hist[i]);
+			fprintf(cio, "\n");
+		}
+		++n;
+	}
+}
+
+static int shcmd_mem_stats(FILE *cio, int argc, char *argv[])
+{
+	uint64_t total = 0;
+	int show_pools = 0, show_lwip = 0, mr = 0;
+	int i;
+
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-p") == 0) {
+			show_pools = 1;
+		} else if (strcmp(argv[i], "-l") == 0) {
+			show_lwip = 1;
+		} else if (strcmp(argv[i], "-m") == 0) {
+			mr = 1;
+		} else if (strcmp(argv[i], "-r") == 0) {
+			_memacct_reset();
+			return 0;
+		} else {
+			fprintf(cio, "Usage: %s [-p] [-l] [-m]|[-r]\n", argv[0]);
+			fprintf(cio, "  -p  show memory pools and their occupancy\n");
+			fprintf(cio, "  -l  show lwIP memory pools\n");
+			fprintf(cio, "  -m  machine-readable output\n");
+			fprintf(cio, "  -r  reset peaks and failure counters\n");
+			return -1;
+		}
+	}
+
+	if (!mr)
+		fprintf(cio, "%-16s %12s %12s %12s %12s %10s\n",
+			"subsystem", "current", "peak", "allocs", "frees", "fails");
+	for (i = 0; i < MEMT_MAX; ++i) {
+		if (mr) {
+			fprintf(cio, "memacct.%s.cur: %"PRIu64"\n", _memt_name[i], memacct[i].cur);
+			fprintf(cio, "memacct.%s.peak: %"PRIu64"\n", _memt_name[i], memacct[i].peak);
+			fprintf(cio, "memacct.%s.allocs: %"PRIu64"\n", _memt_name[i], memacct[i].nb_allocs);
+			fprintf(cio, "memacct.%s.frees: %"PRIu64"\n", _memt_name[i], memacct[i].nb_frees);
+			fprintf(cio, "memacct.%s.fails: %"PRIu64"\n", _memt_name[i], memacct[i].nb_fails);
+		} else {
+			fprintf(cio, "%-16s %12"PRIu64" %12"PRIu64" %12"PRIu64" %12"PRIu64" %10"PRIu64"\n",
+				_memt_name[i],
+				memacct[i].cur,
+				memacct[i].peak,
+				memacct[i].nb_allocs,
+				memacct[i].nb_frees,
+				memacct[i].nb_fails);
+		}
+		total += memacct[i].cur;
+	}
+	if (!mr)
+		fprintf(cio, "%-16s %12"PRIu64"\n", "total", total);
+
+	if (show_pools) {
+		if (!mr)
+			fprintf(cio, "\n");
+		_memacct_print_pools(cio, mr);
+	}
+	if (show_lwip) {
+		if (!mr)
+			fprintf(cio, "\n%-16s %12s %12s %12s %10s\n",
+				"lwip pool", "avail", "used", "max", "fails");
+		_memacct_print_lwip(cio, mr);
+	}
+	return 0;
+}
+
+#ifdef HAVE_CTLDIR
+int register_memacct_tools(struct ctldir *cd)
+#else
+int register_memacct_tools(void)
+#endif
+{
+#ifdef HAVE_CTLDIR
+	/* ctldir entries (ignore errors) */
+	if (cd)
+		ctldir_register_shcmd(cd, "mem-stats", shcmd_mem_stats);
+#endif
+#ifdef HAVE_SHELL
+	/* shell commands (ignore errors) */
+	shell_register_cmd("mem-stats", shcmd_mem_stats);
+#endif
+	return 0;
+}
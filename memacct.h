@@ -0,0 +1,146 @@
+/*
+ * Per-subsystem memory accounting
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _MEMACCT_H_
+#define _MEMACCT_H_
+
+#include <target/sys.h>
+#include "likely.h"
+#ifdef HAVE_CTLDIR
+#include <target/ctldir.h>
+#endif
+
+/*
+ * Tagged memory accounting
+ *
+ * Allocations of subsystems are accounted to a tag: current and peak
+ * usage as well as allocation failures are counted. Heap allocations have
+ * to be done with memacct_malloc()/memacct_free() for this (the size has to
+ * be passed on free again), memory pools carry the tag passed on creation.
+ * Without HAVE_MEMACCT, the accounting is compiled out.
+ */
+enum memacct_tag {
+	MEMT_OTHER = 0,
+	MEMT_SHFS,       /* volume metadata, AIO tokens, I/O buffers */
+	MEMT_HTCACHE,    /* hash table chunk cache */
+	MEMT_CHUNKCACHE, /* chunk cache */
+	MEMT_STATS,      /* element statistics */
+	MEMT_HTTP,       /* HTTP server, session and request pools */
+	MEMT_LINK,       /* link origin buffers */
+	MEMT_BLKDEV,     /* block device request pools */
+	MEMT_TRACE,      /* trace rings */
+	MEMT_TLS,        /* mbed TLS contexts and record buffers */
+	MEMT_MAX
+};
+
+struct memacct_ctr {
+	uint64_t cur;       /* bytes */
+	uint64_t peak;      /* bytes */
+	uint64_t nb_allocs;
+	uint64_t nb_frees;
+	uint64_t nb_fails;
+};
+
+#ifdef HAVE_MEMACCT
+extern struct memacct_ctr memacct[MEMT_MAX];
+
+static inline void memacct_add(enum memacct_tag tag, size_t size)
+{
+	struct memacct_ctr *c = &memacct[tag];
+
+	c->cur += size;
+	if (c->cur > c->peak)
+		c->peak = c->cur;
+	++c->nb_allocs;
+}
+
+static inline void memacct_sub(enum memacct_tag tag, size_t size)
+{
+	struct memacct_ctr *c = &memacct[tag];
+
+	c->cur -= size;
+	++c->nb_frees;
+}
+
+#define memacct_fail(tag) \
+	do { ++memacct[(tag)].nb_fails; } while (0)
+
+static inline void *memacct_malloc(enum memacct_tag tag, size_t align, size_t size)
+{
+	void *ptr;
+
+	ptr = target_malloc(align, size);
+	if (unlikely(!ptr))
+		memacct_fail(tag);
+	else
+		memacct_add(tag, size);
+	return ptr;
+}
+
+static inline void memacct_free(enum memacct_tag tag, void *ptr, size_t size)
+{
+	if (ptr) {
+		memacct_sub(tag, size);
+		target_free(ptr);
+	}
+}
+
+/* registry of memory pools, used by mempool allocator */
+struct mempool;
+void memacct_register_pool(struct mempool *p);
+void memacct_unregister_pool(struct mempool *p);
+
+/**
+ * Registers mem-stats command to micro shell + ctldir (if *cd is not NULL)
+ */
+#ifdef HAVE_CTLDIR
+int register_memacct_tools(struct ctldir *cd);
+#else
+int register_memacct_tools(void);
+#endif
+#else /* HAVE_MEMACCT */
+#define memacct_add(tag, size) \
+	do {} while (0)
+#define memacct_sub(tag, size) \
+	do {} while (0)
+#define memacct_fail(tag) \
+	do {} while (0)
+#define memacct_malloc(tag, align, size) \
+	target_malloc((align), (size))
+#define memacct_free(tag, ptr, size) \
+	target_free((ptr))
+#endif /* HAVE_MEMACCT */
+
+#endif /* _MEMACCT_H_ */
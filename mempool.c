@@ -36,6 +36,7 @@
 
 #include <target/sys.h>
 #include <errno.h>
+#include <string.h>
 
 #include "mempool.h"
 
@@ -62,7 +63,7 @@ static inline size_t align_up(size_t size, size_t align)
   return (size + align - 1) & ~(align - 1);
 }
 
-struct mempool *alloc_enhanced_mempool(uint32_t nb_objs,
+struct mempool *alloc_enhanced_mempool(enum memacct_tag tag, uint32_t nb_objs,
 					 size_t obj_size, size_t obj_data_align, size_t obj_headroom, size_t obj_tailroom, size_t obj_private_len, int sep_obj_data,
 					 void (*obj_init_func)(struct mempool_obj *, void *), void *obj_init_func_argp,
 					 void (*obj_pick_func)(struct mempool_obj *, void *), void *obj_pick_func_argp,
@@ -124,7 +125,7 @@ struct mempool *alloc_enhanced_mempool(uint32_t nb_objs,
         goto error;
     }
     p->obj_data_area = target_malloc(obj_data_align, data_size);
-    if (!p) {
+    if (!p->obj_data_area) {
         errno = ENOMEM;
         goto error_free_p;
     }
@@ -153,7 +154,15 @@ struct mempool *alloc_enhanced_mempool(uint32_t nb_objs,
   p->obj_pick_func_argp = obj_pick_func_argp;
   p->obj_put_func       = obj_put_func;
   p->obj_put_func_argp  = obj_put_func_argp;
+  p->tag                = tag;
   dlist_init_head(p->free_objs);
+#ifdef HAVE_MEMACCT
+  p->min_free_objs      = nb_objs;
+  p->nb_fails           = 0;
+  memset(p->occ_hist, 0, sizeof(p->occ_hist));
+  memacct_add(tag, p->pool_size);
+  memacct_register_pool(p);
+#endif
 
   printd("pool @ %p, len: %"PRIu64":\n"
          "  nb_objs:             %"PRIu32"\n"
@@ -221,10 +230,11 @@ struct mempool *alloc_enhanced_mempool(uint32_t nb_objs,
  error_free_p:
   target_free(p);
  error:
+  memacct_fail(tag);
   return NULL;
 }
 
-struct mempool *alloc_enhanced_mempool2(size_t pool_size,
+struct mempool *alloc_enhanced_mempool2(enum memacct_tag tag, size_t pool_size,
 					 size_t obj_size, size_t obj_data_align, size_t obj_headroom, size_t obj_tailroom, size_t obj_private_len, int sep_obj_data,
 					 void (*obj_init_func)(struct mempool_obj *, void *), void *obj_init_func_argp,
 					 void (*obj_pick_func)(struct mempool_obj *, void *), void *obj_pick_func_argp,
@@ -261,7 +271,7 @@ struct mempool *alloc_enhanced_mempool2(size_t pool_size,
     nb_objs      = pool_size / (o_size + sizeof(void *));
   }
 
-  return alloc_enhanced_mempool(nb_objs, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_private_len, sep_obj_data,
+  return alloc_enhanced_mempool(tag, nb_objs, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_private_len, sep_obj_data,
 				obj_init_func, obj_init_func_argp, obj_pick_func, obj_pick_func_argp, obj_put_func, obj_put_func_argp);
 }
 
@@ -269,6 +279,10 @@ void free_mempool(struct mempool *p)
 {
   if (p) {
 	BUG_ON(p->nb_free_objs != p->nb_objs); /* some objects of this pool may be still in use */
+#ifdef HAVE_MEMACCT
+	memacct_unregister_pool(p);
+	memacct_sub(p->tag, p->pool_size);
+#endif
 	if (p->obj_data_area)
 	  target_free(p->obj_data_area);
 	target_free(p);
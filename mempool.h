@@ -42,6 +42,7 @@
 
 #include "dlist.h"
 #include "likely.h"
+#include "memacct.h"
 
 /*
  * MEMPOOL OBJECT: MEMORY LAYOUT
@@ -110,6 +111,8 @@ struct mempool_obj {
  *          |         ...          |
  *          v                      v
  */
+#define MEMPOOL_OCC_NB_BUCKETS 8
+
 struct mempool {
   dlist_head(free_objs);
   void (*obj_pick_func)(struct mempool_obj *, void *);
@@ -123,8 +126,40 @@ struct mempool {
   uint32_t nb_free_objs;
   size_t pool_size;
   void *obj_data_area; /* points to data allocation when sep_obj_data = 1 */
+  enum memacct_tag tag;
+#ifdef HAVE_MEMACCT
+  uint32_t min_free_objs; /* low watermark of nb_free_objs */
+  uint64_t nb_fails;      /* failed picks */
+  uint64_t occ_hist[MEMPOOL_OCC_NB_BUCKETS]; /* occupancy on picks */
+  dlist_el(plst);         /* element of memacct's pool list */
+#endif
 };
 
+#ifdef HAVE_MEMACCT
+/* pool occupancy (objects in use after a pick) is sampled on every pick
+ * into MEMPOOL_OCC_NB_BUCKETS equally sized buckets */
+static inline void mempool_acct_pick(struct mempool *p)
+{
+  uint32_t used = p->nb_objs - p->nb_free_objs;
+
+  if (p->nb_free_objs < p->min_free_objs)
+	p->min_free_objs = p->nb_free_objs;
+  if (likely(used))
+	++p->occ_hist[((uint64_t) (used - 1) * MEMPOOL_OCC_NB_BUCKETS) / p->nb_objs];
+}
+
+#define mempool_acct_fail(p)						\
+  do {									\
+    ++(p)->nb_fails;							\
+    memacct_fail((p)->tag);						\
+  } while (0)
+#else
+#define mempool_acct_pick(p)						\
+  do {} while (0)
+#define mempool_acct_fail(p)						\
+  do {} while (0)
+#endif
+
 /*
  * Callback obj_init_func will be called while objects are initialized for this memory pool
  *  void obj_init_func(struct mempool_obj *obj, void *argp)
@@ -134,29 +169,30 @@ struct mempool {
  *  void obj_put_func(struct mempool_obj *obj, void *argp)
  * split_obj_data (bool) defines if object data shall be splitted from meta data allocation.
  *  Depending on the object data alignments, this might be more memory space efficient
+ * The pool memory is accounted to the subsystem tag (see memacct.h)
  */
-struct mempool *alloc_enhanced_mempool(uint32_t nb_objs,
+struct mempool *alloc_enhanced_mempool(enum memacct_tag tag, uint32_t nb_objs,
   size_t obj_size, size_t obj_data_align, size_t obj_headroom, size_t obj_tailroom, size_t obj_private_len, int sep_obj_data,
   void (*obj_init_func)(struct mempool_obj *, void *), void *obj_init_func_argp,
   void (*obj_pick_func)(struct mempool_obj *, void *), void *obj_pick_func_argp,
   void (*obj_put_func)(struct mempool_obj *, void *), void *obj_put_func_argp);
-#define alloc_mempool(nb_objs, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_pick_func, obj_pick_func_argp, obj_private_len) \
-  alloc_enhanced_mempool((nb_objs), (obj_size), (obj_data_align), (obj_headroom), (obj_tailroom), (obj_private_len), 0, NULL, NULL, (obj_pick_func), (obj_pick_func_argp), NULL, NULL)
-#define alloc_simple_mempool(nb_objs, obj_size) \
-  alloc_enhanced_mempool((nb_objs), (obj_size), 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL)
+#define alloc_mempool(tag, nb_objs, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_pick_func, obj_pick_func_argp, obj_private_len) \
+  alloc_enhanced_mempool((tag), (nb_objs), (obj_size), (obj_data_align), (obj_headroom), (obj_tailroom), (obj_private_len), 0, NULL, NULL, (obj_pick_func), (obj_pick_func_argp), NULL, NULL)
+#define alloc_simple_mempool(tag, nb_objs, obj_size) \
+  alloc_enhanced_mempool((tag), (nb_objs), (obj_size), 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL)
 
 /* mempool allocation variant where final pool memory size can be specified
  * is specified instead by number of objects
  * Note: the actual allocation size might still less or slightly more because of alignments */
-struct mempool *alloc_enhanced_mempool2(size_t pool_size,
+struct mempool *alloc_enhanced_mempool2(enum memacct_tag tag, size_t pool_size,
   size_t obj_size, size_t obj_data_align, size_t obj_headroom, size_t obj_tailroom, size_t obj_private_len, int sep_obj_data,
   void (*obj_init_func)(struct mempool_obj *, void *), void *obj_init_func_argp,
   void (*obj_pick_func)(struct mempool_obj *, void *), void *obj_pick_func_argp,
   void (*obj_put_func)(struct mempool_obj *, void *), void *obj_put_func_argp);
-#define alloc_mempool2(pool_size, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_pick_func, obj_pick_func_argp, obj_private_len) \
-  alloc_enhanced_mempool2((pool_size), (obj_size), (obj_data_align), (obj_headroom), (obj_tailroom), (obj_private_len), 0, NULL, NULL, (obj_pick_func), (obj_pick_func_argp), NULL, NULL)
-#define alloc_simple_mempool2(pool_size, obj_size) \
-  alloc_enhanced_mempool2((pool_size), (obj_size), 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL)
+#define alloc_mempool2(tag, pool_size, obj_size, obj_data_align, obj_headroom, obj_tailroom, obj_pick_func, obj_pick_func_argp, obj_private_len) \
+  alloc_enhanced_mempool2((tag), (pool_size), (obj_size), (obj_data_align), (obj_headroom), (obj_tailroom), (obj_private_len), 0, NULL, NULL, (obj_pick_func), (obj_pick_func_argp), NULL, NULL)
+#define alloc_simple_mempool2(tag, pool_size, obj_size) \
+  alloc_enhanced_mempool2((tag), (pool_size), (obj_size), 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL)
 
 void free_mempool(struct mempool *p);
 
@@ -173,8 +209,11 @@ void free_mempool(struct mempool *p);
 /*
  * Pick an object from a memory pool
  * Returns NULL on failure
+ * mempool_trypick() does not account a failure: it is meant for callers
+ * that fall back to another source (e.g., eviction) and call
+ * mempool_acct_fail() only when that one failed as well
  */
-static inline struct mempool_obj *mempool_pick(struct mempool *p)
+static inline struct mempool_obj *mempool_trypick(struct mempool *p)
 {
   struct mempool_obj *obj;
 
@@ -185,6 +224,7 @@ static inline struct mempool_obj *mempool_pick(struct mempool *p)
   obj = dlist_first_el(p->free_objs, struct mempool_obj);
   dlist_unlink(obj, p->free_objs, flst);
   p->nb_free_objs--;
+  mempool_acct_pick(p);
 
   /* initialize object */
   mempool_reset_obj(obj);
@@ -195,6 +235,16 @@ static inline struct mempool_obj *mempool_pick(struct mempool *p)
   return obj;
 }
 
+static inline struct mempool_obj *mempool_pick(struct mempool *p)
+{
+  struct mempool_obj *obj;
+
+  obj = mempool_trypick(p);
+  if (unlikely(!obj))
+	mempool_acct_fail(p);
+  return obj;
+}
+
 /*
  * Returns 0 on success, -1 on failure
  */
@@ -202,9 +252,12 @@ static inline int mempool_pick_multiple(struct mempool *p, struct mempool_obj *o
 {
   uint32_t i;
 
-  if (p->nb_free_objs < count)
+  if (p->nb_free_objs < count) {
+	mempool_acct_fail(p);
 	return -1;
+  }
   p->nb_free_objs -= count;
+  mempool_acct_pick(p);
 
   for (i=0; i<count; i++) {
         /* get object from free list */
@@ -66,8 +66,20 @@
 #include "shell.h"
 #include "shell_extras.h"
 #endif
+#ifdef HAVE_CTLSOCK
+#include "ctlsock.h"
+#endif
 #include "shfs.h"
 #include "shfs_tools.h"
+#ifdef SHFS_WARMUP
+#include "shfs_warmup.h"
+#endif
+#ifdef SHFS_CSUM
+#include "shfs_csum.h"
+#endif
+#ifdef SHFS_INGEST
+#include "shfs_ingest.h"
+#endif
 #ifdef HAVE_CTLDIR
 #include <target/ctldir.h>
 #endif
@@ -77,6 +89,29 @@
 #ifdef TESTSUITE
 #include "testsuite.h"
 #endif
+#ifdef HAVE_TRACE
+#include "trace.h"
+#endif
+#ifdef HAVE_MEMACCT
+#include "memacct.h"
+#endif
+#ifdef HAVE_LOOPMON
+#include "loopmon.h"
+#else
+#define loopmon_iter_begin() do {} while (0)
+#define loopmon_phase_end(p) do {} while (0)
+#define loopmon_iter_end() do {} while (0)
+#define loopmon_rx(done, budget) ((void) (done), (void) (budget))
+#endif
+
+#ifndef CONFIG_RX_BUDGET
+#define CONFIG_RX_BUDGET 64
+#endif
+#ifndef target_netif_poll_budget
+/* netif without budget support: drains its queue on each poll */
+#define target_netif_poll_budget(netif, budget) \
+	({ target_netif_poll((netif)); 0U; })
+#endif
 
 #include "debug.h"
 
@@ -269,6 +304,14 @@ struct mcargs {
     ip4_addr_t      dns1;
 #endif
     unsigned int    nb_http_sess;
+    unsigned int    nb_http_reqs;
+    struct http_listener_cfg http_listener[HTTP_MAX_NB_LISTENERS];
+    unsigned int    nb_http_listeners;
+    unsigned int    rx_budget;
+#ifdef HAVE_CTLSOCK
+    uint16_t        ctl_port;   /* 0 = disabled */
+    const char     *ctl_path;   /* NULL = disabled */
+#endif
 
     int             bd_detect;
     unsigned int    nb_bds;
@@ -383,6 +426,53 @@ static int parse_args_setval_int(int *out, const char *buf)
 	return 0;
 }
 
+/* [IPv4:]port[/max[/reserved[/keepalive[/pace[/flag[+flag]]]]]] */
+static int parse_args_setval_listener(struct http_listener_cfg *out, const char *buf)
+{
+	int port, max = 0, rsv = 0, ka = -1, pace = 0;
+	char flags[16];
+	const char *p;
+	char *tok;
+	int n;
+
+	http_listener_cfg_init(out, 0);
+	p = strchr(buf, ':');
+	if (p) {
+		if (parse_args_setval_ipv4(&out->addr, buf) < 0)
+			return -1;
+		buf = p + 1;
+	}
+
+	n = sscanf(buf, "%d/%d/%d/%d/%d/%15s", &port, &max, &rsv, &ka, &pace, flags);
+	if (n < 1)
+		return -1;
+	if ((port < 1 || port > 65535) ||
+	    (max < 0 || max > CONFIG_LWIP_NUM_TCPCON) ||
+	    (rsv < 0 || (max && rsv > max)) ||
+	    (ka < -1) ||
+	    (pace < 0))
+		return -1;
+	if (n == 6) {
+		for (tok = strtok(flags, "+"); tok; tok = strtok(NULL, "+")) {
+			if (strcmp(tok, "low") == 0)
+				out->prio = HTTP_PRIO_LOW;
+#ifdef HTTP_TLS
+			else if (strcmp(tok, "tls") == 0)
+				out->tls = 1;
+#endif
+			else if (strcmp(tok, "default") != 0)
+				return -1;
+		}
+	}
+
+	out->port = (uint16_t) port;
+	out->max_nb_sess = (uint16_t) max;
+	out->rsv_nb_sess = (uint16_t) rsv;
+	out->keepalive_timeout = ka;
+	out->pace = (uint32_t) pace;
+	return 0;
+}
+
 static int parse_args(int argc, char *argv[])
 {
     char *presnip;
@@ -390,6 +480,7 @@ static int parse_args(int argc, char *argv[])
     int opt;
     int ret;
     int ival;
+    unsigned int i, rsv;
     blkdev_id_t ibd;
 
     /* default arguments */
@@ -412,17 +503,29 @@ static int parse_args(int argc, char *argv[])
     args.startup_delay = 0;
     args.no_ctldir = 0;
     args.nb_http_sess = CONFIG_LWIP_NUM_TCPCON;
+    args.nb_http_reqs = 0; /* twice the number of connections */
+    args.nb_http_listeners = 0; /* default listener on port 80 */
+    args.rx_budget = CONFIG_RX_BUDGET;
 #if (!MEMP_MEM_MALLOC) && ((CONFIG_LWIP_NUM_TCPCON) < (MEMP_NUM_TCP_PCB))
     #error "MEMP_NUM_TCP_PCB has to be a least CONFIG_LWIP_NUM_TCPCON"
 #endif
     args.nb_sarp_entries = 0;
     while ((opt = getopt(argc, argv,
-                         "s:i:g:b:hc:a:"
+                         "s:i:g:b:hc:a:r:l:p:q:"
 #if LWIP_DNS
                          "d:e:"
 #endif
 #ifdef SHFS_STATS
                          "x:"
+#endif
+#ifdef HTTP_INGEST
+                         "w:"
+#endif
+#ifdef HTTP_TLS
+                         "t:"
+#endif
+#ifdef HAVE_CTLSOCK
+                         "k:"
 #endif
                           )) != -1) {
          switch(opt) {
@@ -535,12 +638,107 @@ static int parse_args(int argc, char *argv[])
 	      }
 	      args.nb_http_sess = ival;
               break;
+         case 'l': /* HTTP listener */
+	      if (args.nb_http_listeners == HTTP_MAX_NB_LISTENERS) {
+		   printk("At most %d HTTP listeners can be specified\n",
+		          HTTP_MAX_NB_LISTENERS);
+		   return -1;
+	      }
+	      ret = parse_args_setval_listener(&args.http_listener[args.nb_http_listeners], optarg);
+	      if (ret < 0) {
+		   printk("invalid HTTP listener specified (e.g., 192.168.0.2:8080/64/8/15/65536/low)\n");
+		   return -1;
+	      }
+	      args.nb_http_listeners++;
+              break;
+         case 'p': /* max. number of http connections per client IP */
+	      ret = parse_args_setval_int(&ival, optarg);
+	      if (ret < 0 || ival < 0 || ival > CONFIG_LWIP_NUM_TCPCON) {
+		      printk("invalid number of connections per client IP specified\n");
+	           return -1;
+	      }
+	      http_set_max_sess_per_ip((uint16_t) ival);
+              break;
+         case 'q': /* number of http requests */
+	      ret = parse_args_setval_int(&ival, optarg);
+	      if (ret < 0 || ival < 1) {
+		      printk("invalid number of HTTP requests specified\n");
+	           return -1;
+	      }
+	      args.nb_http_reqs = ival;
+              break;
+         case 'r': /* RX budget per main loop iteration */
+	      ret = parse_args_setval_int(&ival, optarg);
+	      if (ret < 0 || ival < 0) {
+		      printk("invalid RX budget specified\n");
+	           return -1;
+	      }
+	      args.rx_budget = (unsigned int) ival;
+              break;
+#ifdef HTTP_INGEST
+         case 'w': /* token for PUT/DELETE */
+	      if (http_ingest_set_token(optarg) < 0) {
+		      printk("invalid ingest token (at most %u characters)\n",
+		             HTTP_INGEST_TOKEN_MAXLEN);
+	           return -1;
+	      }
+              break;
+#endif
+#ifdef HAVE_CTLSOCK
+         case 'k': /* control channel: TCP port or UNIX domain socket */
+	      if (optarg[0] >= '0' && optarg[0] <= '9') {
+		   ret = parse_args_setval_int(&ival, optarg);
+		   if (ret < 0 || ival < 1 || ival > 65535) {
+			printk("invalid control port specified\n");
+			return -1;
+		   }
+		   args.ctl_port = (uint16_t) ival;
+#ifdef CTLSOCK_UNIX
+	      } else {
+		   args.ctl_path = optarg;
+#else
+	      } else {
+		   printk("control sockets are only supported on Linux\n");
+		   return -1;
+#endif
+	      }
+              break;
+#endif
+#ifdef HTTP_TLS
+         case 't': /* certificate and private key for TLS listeners */
+	      ret = parse_args_setval_cut(',', &presnip, &postsnip, optarg);
+	      if (ret < 0) {
+		   if (ret == -ENOMEM)
+			printk("TLS certificate parsing error: Out of memory\n");
+		   else
+			printk("invalid TLS certificate specified (e.g., cert.pem,key.pem)\n");
+	           return -1;
+              }
+	      ret = http_tls_set_cert(presnip, postsnip);
+	      free(postsnip);
+	      free(presnip);
+	      if (ret < 0) {
+	           printk("invalid TLS certificate specified: %s\n", strerror(-ret));
+	           return -1;
+	      }
+              break;
+#endif
 
          default:
 	      return -1;
          }
      }
 
+     /* session reservations of the listeners have to fit into the pool */
+     rsv = 0;
+     for (i = 0; i < args.nb_http_listeners; ++i)
+	  rsv += args.http_listener[i].rsv_nb_sess;
+     if (rsv > args.nb_http_sess) {
+	  printk("HTTP listeners reserve %u sessions but only %u connections are available\n",
+	         rsv, args.nb_http_sess);
+	  return -1;
+     }
+
      return 0;
 }
 
@@ -596,6 +794,161 @@ void app_shutdown(unsigned reason)
     }
 }
 
+/**
+ * BOOT REPORT
+ * Points in time (since entering main()) at which the boot phases
+ * completed; printed as one line of key=value pairs (in usecs) so that
+ * it can be parsed by fleet tooling
+ */
+enum boot_phase {
+    BP_LWIP_INIT = 0,  /* lwIP initialized */
+    BP_NETIF_UP,       /* network interface is up */
+    BP_HTTP_LISTEN,    /* HTTP server accepts connections */
+    BP_BD_DETECT,      /* block devices detected */
+    BP_MOUNT_START,    /* volume config read, hash table reads issued */
+    BP_LOOP_START,     /* processing loop entered */
+    BP_MOUNT_DONE,     /* volume mounted (or mount failed) */
+    BP_NB_PHASES
+};
+
+static const char * const boot_phase_name[BP_NB_PHASES] = {
+    "lwip_init",
+    "netif_up",
+    "http_listen",
+    "bd_detect",
+    "mount_start",
+    "loop_start",
+    "mount_done",
+};
+
+static struct {
+    uint64_t t0;
+    uint64_t ts[BP_NB_PHASES]; /* UINT64_MAX: phase not reached */
+    int mount_ret;
+} boot;
+
+static inline void boot_init(void)
+{
+    unsigned int i;
+
+    boot.t0 = target_now_ns();
+    for (i = 0; i < BP_NB_PHASES; ++i)
+	boot.ts[i] = UINT64_MAX;
+    boot.mount_ret = -ENODEV;
+}
+
+#define boot_mark(phase) \
+    do { boot.ts[(phase)] = target_now_ns() - boot.t0; } while (0)
+
+static size_t boot_report(char *s, size_t slen)
+{
+    size_t l = 0;
+    unsigned int i;
+
+    l += snprintf(s + l, slen - l, "boot-report");
+    for (i = 0; i < BP_NB_PHASES && l < slen; ++i) {
+	if (boot.ts[i] == UINT64_MAX)
+	    continue;
+	l += snprintf(s + l, slen - l, " %s=%"PRIu64,
+		      boot_phase_name[i], boot.ts[i] / 1000);
+    }
+    if (l < slen && boot.ts[BP_MOUNT_DONE] != UINT64_MAX)
+	l += snprintf(s + l, slen - l, " mount_ret=%d", boot.mount_ret);
+    return l;
+}
+
+#ifdef HAVE_SHELL
+static int shcmd_boot_report(FILE *cio, int argc, char *argv[])
+{
+    char buf[256];
+
+    boot_report(buf, sizeof(buf));
+    fprintf(cio, "%s\n", buf);
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_AUTOMOUNT
+/* completes the background mount of the cache volume */
+static void boot_mount_poll(void)
+{
+    char buf[256];
+    int ret;
+
+    ret = mount_shfs_poll();
+    if (ret > 0)
+	return; /* hash table is still loading */
+
+    boot_mark(BP_MOUNT_DONE);
+    boot.mount_ret = ret;
+    if (ret < 0)
+	printk("Warning: Could not find or mount a cache filesystem\n");
+    else
+	printk("Cache filesystem mounted\n");
+    boot_report(buf, sizeof(buf));
+    printk("%s\n", buf);
+}
+#endif
+
+/**
+ * SUSPEND/RESUME
+ * The memory state (cache, hash table, stats, TCP sessions) is preserved
+ * across a suspend (e.g., live migration), only devices are detached.
+ * The measured downtime is printed in usecs as key=value pairs like the
+ * boot report
+ */
+#define SUSPEND_QUIESCE_TIMEOUT 2000 /* ms to wait for in-flight I/O */
+
+static void suspend_resume(struct netif *netif)
+{
+    struct timeval tv_down, tv_up;
+    uint64_t ts_quiesce, ts_resume;
+    int ret;
+
+    printk("System is going to suspend now\n");
+    gettimeofday(&tv_down, NULL);
+    ts_quiesce = target_now_ns();
+
+    /* stop receiving: TCP sessions stay open and recover
+     * by retransmissions after resume */
+    netif_set_down(netif);
+    ret = shfs_suspend(SUSPEND_QUIESCE_TIMEOUT);
+    if (ret < 0) {
+	printk("Warning: Could not quiesce cache filesystem: %s; suspend aborted\n",
+	       strerror(-ret));
+	netif_set_up(netif);
+	return;
+    }
+#ifdef SHFS_STATS
+    shfs_stats_export_suspend();
+#endif
+    ts_quiesce = target_now_ns() - ts_quiesce;
+
+    target_suspend();
+
+    ts_resume = target_now_ns();
+    ret = shfs_resume();
+    if (ret < 0)
+	printk("Warning: Cache filesystem could not be re-attached: %s\n"
+	       "         Cached objects are served only, please remount\n",
+	       strerror(-ret));
+#ifdef SHFS_STATS
+    if (shfs_stats_export_resume() < 0)
+	printk("Warning: Could not re-attach stats device\n");
+#endif
+    netif_set_up(netif); /* announces our address (gratuitous ARP) */
+    if (args.dhclient)
+	dhcp_start(netif);
+    ts_resume = target_now_ns() - ts_resume;
+    gettimeofday(&tv_up, NULL);
+
+    printk("System woke up from suspend\n");
+    printk("suspend-report downtime=%"PRIi64" quiesce=%"PRIu64" resume=%"PRIu64" shfs_ret=%d\n",
+	   (int64_t) (tv_up.tv_sec - tv_down.tv_sec) * 1000000
+	   + (tv_up.tv_usec - tv_down.tv_usec), /* wall clock: survives migration */
+	   ts_quiesce / 1000, ts_resume / 1000, ret);
+}
+
 /**
  * MAIN
  */
@@ -611,6 +964,7 @@ int main(int argc, char *argv[])
     unsigned int i;
 #if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV && defined CAN_POLL_NETDEV
     int poll_netif_fd;
+    int poll_maxfd;
     fd_set poll_rfdset;
     fd_set poll_wfdset;
     struct timeval poll_to;
@@ -621,6 +975,7 @@ int main(int argc, char *argv[])
     uint64_t ts_to;
 #endif
 #ifdef CONFIG_LWIP_NOTHREADS
+    unsigned int rx_done;
     uint64_t ts_tcp = 0;
     uint64_t ts_etharp = 0;
     uint64_t ts_ipreass = 0;
@@ -650,6 +1005,7 @@ int main(int argc, char *argv[])
     target_init();
 
     TT_START(tt_boot);
+    boot_init();
     init_debug();
 
     /* -----------------------------------
@@ -692,6 +1048,15 @@ int main(int argc, char *argv[])
 	    printk("\n");
     }
 
+    /* -----------------------------------
+     * trace rings
+     * ----------------------------------- */
+#ifdef HAVE_TRACE
+    ret = init_trace(TRACE_RING_NB_EVENTS);
+    if (ret < 0)
+	    printk("Warning: Could not allocate trace rings: %s\n", strerror(-ret));
+#endif
+
     /* -----------------------------------
      * control dir - phase 1/2
      * ----------------------------------- */
@@ -717,6 +1082,7 @@ int main(int argc, char *argv[])
     tcpip_init(NULL, NULL);
 #endif
     TT_END(tt_lwipinit);
+    boot_mark(BP_LWIP_INIT);
 
     /* -----------------------------------
      * network interface initialization
@@ -783,6 +1149,7 @@ int main(int argc, char *argv[])
     }
     netif_set_default(&netif);
     netif_set_up(&netif);
+    boot_mark(BP_NETIF_UP);
 #if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV && defined CAN_POLL_NETDEV
     poll_netif_fd = target_netif_fd(&netif);
 #endif
@@ -805,32 +1172,10 @@ int main(int argc, char *argv[])
     }
 
     /* -----------------------------------
-     * detect available block devices
-     * ----------------------------------- */
-#ifdef CAN_DETECT_BLKDEVS
-    if (args.bd_detect) {
-	    printk("Detecting block devices...\n");
-	    TT_START(tt_bddetect);
-	    args.nb_bds = detect_blkdevs(args.bd_id, sizeof(args.bd_id));
-	    TT_END(tt_bddetect);
-    }
-#endif
-
-    /* -----------------------------------
-     * filesystem initialization & automount
+     * filesystem initialization
      * ----------------------------------- */
     printk("Loading SHFS...\n");
     init_shfs();
-#ifdef CONFIG_AUTOMOUNT
-    if (args.nb_bds) {
-	    printk("Automount cache filesystem...\n");
-	    TT_START(tt_automount);
-	    ret = mount_shfs(args.bd_id, args.nb_bds);
-	    TT_END(tt_automount);
-	    if (ret < 0)
-		    printk("Warning: Could not find or mount a cache filesystem\n");
-    }
-#endif
 
     /* -----------------------------------
      * service initialization
@@ -844,23 +1189,51 @@ int main(int argc, char *argv[])
     register_shell_extras();
 #endif
 #endif
-    printk("Starting HTTP server (max number of connections: %u)...\n",
-           args.nb_http_sess);
+    if (!args.nb_http_reqs)
+	args.nb_http_reqs = args.nb_http_sess << 1; /* ensures that all connections
+						      * can be used simultaneously */
+    printk("Starting HTTP server (max number of connections: %u, requests: %u, listeners: %u)...\n",
+           args.nb_http_sess, args.nb_http_reqs,
+           args.nb_http_listeners ? args.nb_http_listeners : 1);
     init_http(args.nb_http_sess,
-              args.nb_http_sess << 1); /* nb reqs have to be at least double to
-					* ensure all connections can be used simultaneously */
+              args.nb_http_reqs, /* idle connections do not hold a request */
+              args.http_listener, args.nb_http_listeners);
+    boot_mark(BP_HTTP_LISTEN);
+#ifdef HAVE_CTLSOCK
+    if (args.ctl_port || args.ctl_path) {
+	printk("Starting control channel...\n");
+	ret = init_ctlsock(args.ctl_port, args.ctl_path);
+	if (ret < 0)
+	    printk("Warning: Could not start control channel: %s\n", strerror(-ret));
+    }
+#endif
 
     /* add custom commands to the shell */
 #ifdef HAVE_SHELL
     shell_register_cmd("halt", shcmd_halt);
     shell_register_cmd("reboot", shcmd_reboot);
     shell_register_cmd("suspend", shcmd_suspend);
+    shell_register_cmd("boot-report", shcmd_boot_report);
 #ifdef HAVE_CTLDIR
     register_shfs_tools(cd); /* Note: cd might be NULL */
 #else
     register_shfs_tools();
 #endif
 #endif
+#ifdef SHFS_WARMUP
+#ifdef HAVE_CTLDIR
+    register_shfs_warmup_tools(cd); /* Note: cd might be NULL */
+#else
+    register_shfs_warmup_tools();
+#endif
+#endif
+#ifdef SHFS_CSUM
+#ifdef HAVE_CTLDIR
+    register_shfs_csum_tools(cd); /* Note: cd might be NULL */
+#else
+    register_shfs_csum_tools();
+#endif
+#endif
 
 #ifdef SHFS_STATS
     /* -----------------------------------
@@ -893,6 +1266,44 @@ int main(int argc, char *argv[])
 #else
     register_testsuite();
 #endif
+#endif
+
+    /* -----------------------------------
+     * event loop monitor
+     * ----------------------------------- */
+#ifdef HAVE_LOOPMON
+#if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV && defined CAN_POLL_NETDEV
+    init_loopmon(1); /* select() waits for events, unless shell commands ran */
+#else
+    init_loopmon(0); /* schedule() runs other threads */
+#endif
+#ifdef HAVE_CTLDIR
+    register_loopmon_tools(cd); /* Note: cd might be NULL */
+#else
+    register_loopmon_tools();
+#endif
+#endif
+
+    /* -----------------------------------
+     * trace commands
+     * ----------------------------------- */
+#ifdef HAVE_TRACE
+#ifdef HAVE_CTLDIR
+    register_trace_tools(cd); /* Note: cd might be NULL */
+#else
+    register_trace_tools();
+#endif
+#endif
+
+    /* -----------------------------------
+     * memory accounting
+     * ----------------------------------- */
+#ifdef HAVE_MEMACCT
+#ifdef HAVE_CTLDIR
+    register_memacct_tools(cd); /* Note: cd might be NULL */
+#else
+    register_memacct_tools();
+#endif
 #endif
 
     /* -----------------------------------
@@ -911,6 +1322,40 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    /* -----------------------------------
+     * detect available block devices
+     * ----------------------------------- */
+#ifdef CAN_DETECT_BLKDEVS
+    if (args.bd_detect) {
+	    printk("Detecting block devices...\n");
+	    TT_START(tt_bddetect);
+	    args.nb_bds = detect_blkdevs(args.bd_id, sizeof(args.bd_id));
+	    TT_END(tt_bddetect);
+	    boot_mark(BP_BD_DETECT);
+    }
+#endif
+
+    /* -----------------------------------
+     * automount (background)
+     * Network and services are up already: the hash table is loaded
+     * while the processing loop runs, requests are answered with
+     * 503 until the volume is mounted
+     * ----------------------------------- */
+#ifdef CONFIG_AUTOMOUNT
+    if (args.nb_bds) {
+	    printk("Automount cache filesystem (background)...\n");
+	    TT_START(tt_automount);
+	    ret = mount_shfs_start(args.bd_id, args.nb_bds);
+	    TT_END(tt_automount);
+	    boot_mark(BP_MOUNT_START);
+	    if (ret < 0) {
+		    printk("Warning: Could not find or mount a cache filesystem\n");
+		    boot_mark(BP_MOUNT_DONE);
+		    boot.mount_ret = ret;
+	    }
+    }
+#endif
+
     /* -----------------------------------
      * Initialize select/poll
      * ----------------------------------- */
@@ -924,6 +1369,7 @@ int main(int argc, char *argv[])
      * Boot banner/time trace output
      * ----------------------------------- */
     printk("*** MiniCache is up and running ***\n");
+    boot_mark(BP_LOOP_START);
 #ifdef TRACE_BOOTTIME
     TT_END(tt_boot);
     TT_PRINT("boot time since invoking main", tt_boot);
@@ -935,7 +1381,7 @@ int main(int argc, char *argv[])
     if (args.nb_bds) {
 	    tt_automount -= shfs_tt_vbdopen;
 	    TT_PRINT("vbd open", shfs_tt_vbdopen);
-	    TT_PRINT("file system mount time", tt_automount);
+	    TT_PRINT("file system mount start", tt_automount);
     }
 #endif
 #ifdef SHFS_STATS
@@ -956,9 +1402,14 @@ int main(int argc, char *argv[])
      * Processing loop
      * ----------------------------------- */
     while(likely(!shall_shutdown)) {
+	loopmon_iter_begin();
 #if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV && defined CAN_POLL_NETDEV
 	/* select with ignoring return reason */
 	FD_SET(poll_netif_fd, &poll_rfdset);
+	poll_maxfd = poll_netif_fd;
+#ifdef CTLSOCK_UNIX
+	poll_maxfd = max(poll_maxfd, ctlsock_fdset(&poll_rfdset));
+#endif
 #if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
 	if (likely(ts_to)) {
 		poll_to.tv_sec = ts_to / 1000;
@@ -967,14 +1418,14 @@ int main(int argc, char *argv[])
 		poll_to.tv_sec  = 0;
 		poll_to.tv_usec = 0;
 #endif
-		if (shfs_mounted) {
+		if (shfs_blkdevs_count()) {
 			/* poll network and block devices */
 			shfs_blkdevs_fdset(&poll_rfdset);
-			select(max(shfs_vol.members_maxfd, poll_netif_fd) + 1,
+			select(max(shfs_vol.members_maxfd, poll_maxfd) + 1,
 			       &poll_rfdset, &poll_wfdset, NULL, &poll_to);
 			} else {
 				/* poll network only */
-			select(poll_netif_fd + 1, &poll_rfdset, NULL, NULL, &poll_to);
+			select(poll_maxfd + 1, &poll_rfdset, NULL, NULL, &poll_to);
 		}
 #if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
 	}
@@ -982,17 +1433,50 @@ int main(int argc, char *argv[])
 #else
 	schedule(); /* yield CPU */
 #endif
+	loopmon_phase_end(LMP_WAIT);
+
+#ifdef SHFS_STATS
+	/* update coarse clock for statistics */
+	shfs_stats_tick();
+#endif
 
 	/* poll block devices */
 	shfs_poll_blkdevs();
+#ifdef CONFIG_AUTOMOUNT
+	if (unlikely(shfs_mount_pending))
+		boot_mount_poll();
+#endif
+#ifdef SHFS_WARMUP
+	/* issue background cache fills */
+	shfs_warmup_poll();
+#endif
+#ifdef SHFS_CSUM
+	/* background volume scrubbing */
+	shfs_scrub_poll();
+#endif
+#ifdef SHFS_INGEST
+	/* resubmit store writes that did not fit into the request queue */
+	shfs_ingest_poll();
+#endif
+	loopmon_phase_end(LMP_BLKDEV);
 
 	/* poll IO retry chain of HTTP */
 	http_poll_ioretry();
+#ifdef HAVE_CTLSOCK
+	/* execute pending control requests */
+	ctlsock_poll();
+#endif
+	loopmon_phase_end(LMP_IORETRY);
 
 #ifdef CONFIG_LWIP_NOTHREADS
-        /* NIC handling loop (single threaded lwip) */
-	target_netif_poll(&netif);
+        /* NIC handling loop (single threaded lwip): bounded by the RX
+         * budget so that block I/O completions are polled in between */
+	rx_done = target_netif_poll_budget(&netif, args.rx_budget);
+	loopmon_rx(rx_done, args.rx_budget);
 #endif /* CONFIG_LWIP_NOTHREADS */
+	/* process ACKs that were coalesced during the RX burst */
+	http_poll_acks();
+	loopmon_phase_end(LMP_NETIF);
 
 #if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT
         ts_now  = NSEC_TO_MSEC(target_now_ns());
@@ -1020,19 +1504,17 @@ int main(int argc, char *argv[])
 #if defined CONFIG_LWIP_NOTHREADS || defined CONFIG_MINDER_PRINT || defined CONFIG_DEBUG_PRINT
         ts_to = ts_till - ts_now;
 #endif
+#if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV && defined CAN_POLL_NETDEV && defined CONFIG_LWIP_NOTHREADS
+	if (args.rx_budget && rx_done >= args.rx_budget)
+		ts_to = 0; /* frames are pending: do not wait */
+#endif
+	/* send out what got enqueued during this iteration */
+	http_poll_flush();
+	loopmon_phase_end(LMP_TIMERS);
+	loopmon_iter_end();
 
         if (unlikely(shall_suspend)) {
-            printk("System is going to suspend now\n");
-            netif_set_down(&netif);
-            netif_remove(&netif);
-
-            target_suspend();
-
-            printk("System woke up from suspend\n");
-            netif_set_default(&netif);
-            netif_set_up(&netif);
-            if (args.dhclient)
-                dhcp_start(&netif);
+            suspend_resume(&netif);
             shall_suspend = 0;
         }
     }
@@ -1052,6 +1534,9 @@ int main(int argc, char *argv[])
 #endif
     printk("Stopping HTTP server...\n");
     exit_http();
+#ifdef HAVE_CTLSOCK
+    exit_ctlsock();
+#endif
 #ifdef HAVE_SHELL
     printk("Stopping shell...\n");
     exit_shell();
@@ -1062,6 +1547,9 @@ int main(int argc, char *argv[])
     printk("Stopping networking...\n");
     netif_set_down(&netif);
     netif_remove(&netif);
+#ifdef HAVE_TRACE
+    exit_trace();
+#endif
  out:
     if (shall_reboot)
         target_reboot();
@@ -0,0 +1,111 @@
+#!/usr/bin/python
+
+#
+# MiniCache Tools
+#
+# Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+#
+#
+# Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the copyright holder nor the names of its
+#    contributors may be used to endorse or promote products derived from
+#    this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+# THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+#
+
+import sys
+import struct
+
+# binary export header (see shfs_stats_data.h)
+HDR_MAGIC = "MCSTATS\0"
+HDR_FMT = "<8sHHHBBB3xIIIQQII"
+HDR_LEN = struct.calcsize(HDR_FMT)
+HDR_VERSION = 1
+
+F_DELTA = 0x01
+F_HTTP = 0x02
+RF_LOADED = 0x01
+
+def usage():
+    sys.stderr.write("Usage: %s [EXPORTFILE]\n" % sys.argv[0])
+    sys.stderr.write("Decodes a binary stats export (default: from stdin)\n")
+    exit(1)
+
+##---------------------------------------------------------------
+## MAIN
+##---------------------------------------------------------------
+if len(sys.argv) > 2:
+    usage()
+try:
+    if len(sys.argv) == 2:
+        f = open(sys.argv[1], "rb")
+    else:
+        f = sys.stdin
+    buf = f.read(HDR_LEN)
+except (OSError, IOError) as e:
+    sys.stderr.write("Could not read '%s': %s\n" % (sys.argv[1], e.strerror))
+    exit(1)
+
+if len(buf) < HDR_LEN or buf[0:8] != HDR_MAGIC:
+    sys.stderr.write("Input is not a stats export\n")
+    exit(1)
+(magic, version, hdr_len, rec_len, hlen, flags, nb_dpc,
+ data_off, ts, since, seq, nb_recs, invalid, errors) = struct.unpack(HDR_FMT, buf)
+if version != HDR_VERSION:
+    sys.stderr.write("Unsupported export version %d\n" % version)
+    exit(1)
+
+# record layout
+rfmt = "<%dsBIQQ" % hlen
+cols = ["hash", "loaded", "laccess", "hits", "miss"]
+if flags & F_HTTP:
+    rfmt += "Q"
+    cols.append("completed")
+    for i in range(nb_dpc):
+        rfmt += "Q"
+        cols.append("%d%%" % ((i * 100) / (nb_dpc - 1)))
+rfmt += "III"
+cols.extend(["req1m", "req5m", "req15m"])
+if struct.calcsize(rfmt) != rec_len:
+    sys.stderr.write("Record length mismatch (%d != %d)\n" % (struct.calcsize(rfmt), rec_len))
+    exit(1)
+
+sys.stdout.write("# seq=%d ts=%d%s invalid=%d errors=%d records=%d\n" %
+                 (seq, ts, (" delta-since=%d" % since) if flags & F_DELTA else "",
+                  invalid, errors, nb_recs))
+sys.stdout.write(";".join(cols) + "\n")
+
+f.read(data_off - HDR_LEN) # skip to first record
+for n in range(nb_recs):
+    buf = f.read(rec_len)
+    if len(buf) < rec_len:
+        sys.stderr.write("Export is truncated (%d of %d records)\n" % (n, nb_recs))
+        exit(1)
+    rec = list(struct.unpack(rfmt, buf))
+    rec[0] = rec[0].encode("hex")
+    rec[1] = 1 if rec[1] & RF_LOADED else 0
+    sys.stdout.write(";".join([str(v) for v in rec]) + "\n")
+exit(0)
@@ -40,6 +40,7 @@ import os
 import sys
 import stat
 import fcntl
+import struct
 import subprocess
 
 CMDA_CTLTRIGGER="ctltrigger" # expected to be in $PATH
@@ -47,6 +48,11 @@ CMDB_CTLTRIGGER="../ctltrigger/ctltrigger" # alternatively
 BLKFLSBUF = 0x00001261 # from <linux/fs.h>
 BYTESPERREAD = 512
 
+# binary export header (see shfs_stats_data.h)
+HDR_MAGIC = "MCSTATS\0"
+HDR_FMT = "<8sHHHBBB3xIIIQQII"
+HDR_LEN = struct.calcsize(HDR_FMT)
+
 def ctltrigger(domid, action, args=[], scope="minicache"):
     pargs = [CMDA_CTLTRIGGER, domid, scope, action]
     pargs.extend(args)
@@ -72,7 +78,9 @@ def ctltrigger(domid, action, args=[], scope="minicache"):
     return(int(pout))
 
 def usage():
-    sys.stderr.write("Usage: %s [DOMID] [STATSDEV]\n" % sys.argv[0])
+    sys.stderr.write("Usage: %s [-d] [DOMID] [STATSDEV]\n" % sys.argv[0])
+    sys.stderr.write("  -d  delta export: only elements changed since last export\n")
+    sys.stderr.write("The binary export is written to stdout, see decode-stats.py\n")
     exit(1)
 
 ##---------------------------------------------------------------
@@ -80,27 +88,32 @@ def usage():
 ##---------------------------------------------------------------
 
 # check arguments
-if len(sys.argv) < 3:
+args = sys.argv[1:]
+eargs = []
+if len(args) > 0 and args[0] == "-d":
+    eargs = ["-d"]
+    args = args[1:]
+if len(args) < 2:
     usage()
 
 # try to open device
 try:
-    sdev = os.open(sys.argv[2], os.O_RDONLY)
+    sdev = os.open(args[1], os.O_RDONLY)
 except (OSError, IOError) as e:
-    sys.stderr.write("Could not open '%s': %s\n" % (sys.argv[2], e.strerror))
+    sys.stderr.write("Could not open '%s': %s\n" % (args[1], e.strerror))
     usage()
 
 # ensure that sdev is a file or block device
 sdev_info = os.fstat(sdev)
 sdev_isblk = stat.S_ISBLK(sdev_info.st_mode)
 if not sdev_isblk and not stat.S_ISREG(sdev_info.st_mode):
-    sys.stderr.write("Could not open '%s': %s\n" % (sys.argv[2], "Is not a regular file or block device"))
+    sys.stderr.write("Could not open '%s': %s\n" % (args[1], "Is not a regular file or block device"))
     usage()
 
 # trigger stats export
-rc = ctltrigger(domid=sys.argv[1], action="export-stats")
+rc = ctltrigger(domid=args[0], action="export-stats", args=eargs)
 if rc != 0:
-    sys.stderr.write("Could not trigger action 'export-stats' on Domain %s\n" % sys.argv[1])
+    sys.stderr.write("Could not trigger action 'export-stats' on Domain %s\n" % args[0])
     exit(1)
 
 # discard OS's buffer caches for block devices
@@ -109,25 +122,29 @@ if sdev_isblk:
         #fcntl.ioctl(sdev, BLKFLSBUF, 0)
         open('/proc/sys/vm/drop_caches','w').write("1\n")
     except (OSError, IOError) as e:
-        sys.stderr.write("Could not reset cache for '%s': %s\n" % (sys.argv[2], e.strerror))
+        sys.stderr.write("Could not reset cache for '%s': %s\n" % (args[1], e.strerror))
         exit(1)
 
-# read sdev content and print it to stdout
-# (read until '\0')
+# read header and records, copy them to stdout
 try:
-    while True:
-        blen = BYTESPERREAD
-        buf  = os.read(sdev, BYTESPERREAD)
-        blen = len(buf)
-        for i, c in enumerate(buf):
-            if c[0] == '\0':
-                blen = i
-                break
-        sys.stdout.write(buf[:blen])
-        if blen < BYTESPERREAD:
+    buf = os.read(sdev, BYTESPERREAD)
+    if len(buf) < HDR_LEN or buf[0:8] != HDR_MAGIC:
+        sys.stderr.write("No statistics found on '%s'\n" % args[1])
+        exit(1)
+    hdr = struct.unpack(HDR_FMT, buf[:HDR_LEN])
+    (data_off, rec_len, nb_recs) = (hdr[7], hdr[3], hdr[11])
+    left = data_off + (rec_len * nb_recs) - len(buf)
+    sys.stdout.write(buf)
+    while left > 0:
+        buf = os.read(sdev, min(left, BYTESPERREAD * 128))
+        if len(buf) == 0:
             break
+        sys.stdout.write(buf)
+        left -= len(buf)
+    if left > 0:
+        sys.stderr.write("Statistics on '%s' are truncated\n" % args[1])
 except (OSError, IOError) as e:
-    sys.stderr.write("Read error on '%s': %s\n" % (sys.argv[2], e.strerror))
+    sys.stderr.write("Read error on '%s': %s\n" % (args[1], e.strerror))
     sys.stderr.write("Statistics are most likely incomplete\n")
 
 # exit
@@ -0,0 +1,152 @@
+/*
+ * SHA-256 message digest
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#include <string.h>
+
+#include "sha256.h"
+
+static const uint32_t _sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _sha256_block(struct sha256_ctx *ctx, const uint8_t *p)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h;
+	uint32_t t1, t2;
+	register unsigned int i;
+
+	for (i = 0; i < 16; ++i)
+		w[i] = ((uint32_t) p[4 * i]     << 24) |
+		       ((uint32_t) p[4 * i + 1] << 16) |
+		       ((uint32_t) p[4 * i + 2] <<  8) |
+		       ((uint32_t) p[4 * i + 3]);
+	for (i = 16; i < 64; ++i)
+		w[i] = w[i - 16] + w[i - 7] +
+		       (ROR32(w[i - 15],  7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >>  3)) +
+		       (ROR32(w[i -  2], 17) ^ ROR32(w[i -  2], 19) ^ (w[i -  2] >> 10));
+
+	a = ctx->s[0]; b = ctx->s[1]; c = ctx->s[2]; d = ctx->s[3];
+	e = ctx->s[4]; f = ctx->s[5]; g = ctx->s[6]; h = ctx->s[7];
+	for (i = 0; i < 64; ++i) {
+		t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+		     ((e & f) ^ (~e & g)) + _sha256_k[i] + w[i];
+		t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+		     ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	ctx->s[0] += a; ctx->s[1] += b; ctx->s[2] += c; ctx->s[3] += d;
+	ctx->s[4] += e; ctx->s[5] += f; ctx->s[6] += g; ctx->s[7] += h;
+}
+
+void sha256_init(struct sha256_ctx *ctx)
+{
+	ctx->s[0] = 0x6a09e667;
+	ctx->s[1] = 0xbb67ae85;
+	ctx->s[2] = 0x3c6ef372;
+	ctx->s[3] = 0xa54ff53a;
+	ctx->s[4] = 0x510e527f;
+	ctx->s[5] = 0x9b05688c;
+	ctx->s[6] = 0x1f83d9ab;
+	ctx->s[7] = 0x5be0cd19;
+	ctx->len = 0;
+}
+
+void sha256_update(struct sha256_ctx *ctx, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	size_t fill = (size_t) (ctx->len % SHA256_BLOCK_LEN);
+	size_t n;
+
+	ctx->len += len;
+
+	/* complete a partial block first */
+	if (fill) {
+		n = SHA256_BLOCK_LEN - fill;
+		if (len < n) {
+			memcpy(ctx->b + fill, p, len);
+			return;
+		}
+		memcpy(ctx->b + fill, p, n);
+		_sha256_block(ctx, ctx->b);
+		p   += n;
+		len -= n;
+	}
+
+	/* full blocks are processed from the input directly */
+	while (len >= SHA256_BLOCK_LEN) {
+		_sha256_block(ctx, p);
+		p   += SHA256_BLOCK_LEN;
+		len -= SHA256_BLOCK_LEN;
+	}
+	if (len)
+		memcpy(ctx->b, p, len);
+}
+
+void sha256_final(struct sha256_ctx *ctx, uint8_t *out)
+{
+	uint64_t bits = ctx->len << 3;
+	size_t fill = (size_t) (ctx->len % SHA256_BLOCK_LEN);
+	register unsigned int i;
+
+	/* padding: 0x80, zeros, 64-bit message length (big endian) */
+	ctx->b[fill++] = 0x80;
+	if (fill > SHA256_BLOCK_LEN - 8) {
+		memset(ctx->b + fill, 0, SHA256_BLOCK_LEN - fill);
+		_sha256_block(ctx, ctx->b);
+		fill = 0;
+	}
+	memset(ctx->b + fill, 0, SHA256_BLOCK_LEN - 8 - fill);
+	for (i = 0; i < 8; ++i)
+		ctx->b[SHA256_BLOCK_LEN - 1 - i] = (uint8_t) (bits >> (8 * i));
+	_sha256_block(ctx, ctx->b);
+
+	for (i = 0; i < 8; ++i) {
+		out[4 * i]     = (uint8_t) (ctx->s[i] >> 24);
+		out[4 * i + 1] = (uint8_t) (ctx->s[i] >> 16);
+		out[4 * i + 2] = (uint8_t) (ctx->s[i] >>  8);
+		out[4 * i + 3] = (uint8_t) (ctx->s[i]);
+	}
+}
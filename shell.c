@@ -63,6 +63,9 @@ typedef int err_t;
 #endif
 
 #include "shell.h"
+#ifdef HAVE_LOOPMON
+#include "loopmon.h"
+#endif
 
 #define MAX_NB_CMDS 64
 #define MAX_NB_ARGS 96
@@ -406,6 +409,28 @@ void shell_unregister_cmd(const char *cmd)
     }
 }
 
+int shell_exec(FILE *cio, int argc, char *argv[])
+{
+    int32_t cmdi;
+    int ret;
+
+    BUG_ON(sh == NULL);
+    BUG_ON(argc < 1);
+
+    cmdi = shell_get_cmd_index(argv[0]);
+    if (cmdi < 0)
+        return -ENOENT;
+
+#ifdef HAVE_LOOPMON
+    loopmon_cmd_enter(argv[0]);
+#endif
+    ret = sh->cmd_func[cmdi](cio, argc, argv);
+#ifdef HAVE_LOOPMON
+    loopmon_cmd_leave();
+#endif
+    return ret;
+}
+
 static void sh_telnet_negotiation(FILE *cio, uint8_t cmd, uint8_t arg, struct shell_sess *sess)
 {
 	printd("Negotiation commands are unsupported for now, ignoring...\n");
@@ -417,7 +442,6 @@ static int sh_exec(FILE *cio, char *argb, size_t argb_len)
     int argc;
     int ret;
     size_t i;
-    int32_t cmdi;
     int prev_was_whitespace;
 
     /* parse argument line (fillup argv) */
@@ -454,14 +478,12 @@ static int sh_exec(FILE *cio, char *argb, size_t argb_len)
         return 0; /* nothing was typed */
     }
 
-    cmdi = shell_get_cmd_index(argv[0]);
-    if (cmdi < 0) {
+    ret = shell_exec(cio, argc, argv);
+    if (ret == -ENOENT && shell_get_cmd_index(argv[0]) < 0) {
         printd("%s: command not found\n", argv[0]);
         fprintf(cio, "%s: command not found\n", argv[0]);
         return 0;
     }
-
-    ret = sh->cmd_func[cmdi](cio, argc, argv);
     if (ret < 0)
         fprintf(cio, "%s: command returned %d\n", argv[0], ret);
     printd("%s: command returned %d\n", argv[0], ret);
@@ -37,17 +37,68 @@
 #ifndef _SHELL_H_
 #define _SHELL_H_
 
+#include <target/sys.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdint.h>
 
 typedef int (*shfunc_ptr_t)(FILE *cio, int argc, char *argv[]);
 
 #define SH_CLOSE INT_MAX
 
+/*
+ * Cooperative execution of long-running commands
+ *
+ * Commands that walk large tables call sh_slice_yield() once per element:
+ * when the time slice is used up, pending output is flushed to the session
+ * and the CPU is yielded to the main loop before the command continues.
+ * The caller has to make sure that the walked state stays valid across a
+ * yield (e.g., by holding shfs_mount_lock).
+ */
+#ifndef SH_SLICE_US
+#define SH_SLICE_US 500 /* time slice of a command before yielding */
+#endif
+#define SH_SLICE_CHECK_MASK 15 /* read the clock every 16 calls only */
+
+struct sh_slice {
+	FILE *cio;
+	uint64_t end;
+	unsigned int cnt;
+	unsigned int nb_yields;
+};
+
+static inline void sh_slice_init(struct sh_slice *s, FILE *cio)
+{
+	s->cio = cio;
+	s->end = target_now_ns() + (SH_SLICE_US * 1000);
+	s->cnt = 0;
+	s->nb_yields = 0;
+}
+
+/* returns 1 if the CPU was yielded */
+static inline int sh_slice_yield(struct sh_slice *s)
+{
+	if ((++s->cnt & SH_SLICE_CHECK_MASK) != 0)
+		return 0;
+	if (target_now_ns() < s->end)
+		return 0;
+
+	if (s->cio)
+		fflush(s->cio);
+	schedule();
+	++s->nb_yields;
+	s->end = target_now_ns() + (SH_SLICE_US * 1000);
+	return 1;
+}
+
 int init_shell(unsigned int en_lsess, unsigned int nb_rsess);
 void exit_shell(void);
 
 int shell_register_cmd(const char *cmd, shfunc_ptr_t func);
 void shell_unregister_cmd(const char *cmd);
 
+/* executes a registered command (argv[0]), output goes to cio;
+ * returns the return code of the command or -ENOENT */
+int shell_exec(FILE *cio, int argc, char *argv[]);
+
 #endif /* _SHELL_H_ */
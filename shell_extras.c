@@ -272,6 +272,9 @@ static int shcmd_ifconfig(FILE *cio, int argc, char *argv[])
 #if LWIP_CHECKSUM_PARTIAL
 		fprintf(cio, "CSO ");
 #endif
+#if defined CONFIG_TAPIF && defined CONFIG_TAPIF_OFFLOAD
+		fprintf(cio, "GSO CSO ");
+#endif
 #ifdef  CONFIG_NETFRONT_PERSISTENT_GRANTS
 		fprintf(cio, "PGNTS ");
 #endif
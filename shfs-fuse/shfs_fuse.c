@@ -0,0 +1,600 @@
+/*
+ * FUSE frontend for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#define FUSE_USE_VERSION 31
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <fuse.h>
+
+#include "shfs.h"
+#include "shfs_btable.h"
+#include "shfs_fio.h"
+#include "hash.h"
+#include "likely.h"
+
+#define SHFS_FUSE_MAX_READ (1024 * 1024) /* 1 MiB */
+#define SHFS_FUSE_MAX_DEVS 32
+
+#define SHFS_FUSE_DIR_HASH "by-hash"
+#define SHFS_FUSE_DIR_NAME "by-name"
+
+/*
+ * All SHFS code is single-threaded and cooperative. FUSE requests are
+ * served by multiple worker threads that share one big lock instead:
+ * schedule() (see target/sys.h) releases the lock while a thread is
+ * waiting for its I/O so that other requests (e.g., cache hits) can
+ * be served in the meantime.
+ */
+static pthread_mutex_t shfs_fuse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void shfs_fuse_yield(void)
+{
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	sched_yield();
+	pthread_mutex_lock(&shfs_fuse_lock);
+}
+
+/*
+ * Name index
+ * shfs_btable_lookup_byname() walks the whole hash table. Because
+ * the volume is mounted read-only, a sorted index is built once
+ * on mount instead.
+ */
+struct shfs_fuse_name {
+	char name[sizeof(((struct shfs_hentry *) 0)->name) + 1];
+	struct shfs_bentry *bentry;
+	unsigned int idx; /* position in hash table (first one wins) */
+};
+
+static struct {
+	blkdev_id_t bd_id[SHFS_FUSE_MAX_DEVS];
+	unsigned int nb_bds;
+	int nocache;
+	int direct_io;
+	int help;
+	int ret; /* exit code, set when mounting failed */
+
+	struct shfs_fuse_name *names;
+	unsigned int nb_names;
+} sf;
+
+static int shfs_fuse_name_cmp(const void *a, const void *b)
+{
+	const struct shfs_fuse_name *na = a;
+	const struct shfs_fuse_name *nb = b;
+	int ret;
+
+	ret = strcmp(na->name, nb->name);
+	if (ret != 0)
+		return ret;
+	return (na->idx > nb->idx) - (na->idx < nb->idx);
+}
+
+static int shfs_fuse_build_names(void)
+{
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	unsigned int i, j, n;
+
+	sf.names = malloc(sizeof(*sf.names) * shfs_vol.htable_nb_entries);
+	if (!sf.names)
+		return -ENOMEM;
+
+	i = 0;
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		hentry = bentry->hentry;
+		if (SHFS_HENTRY_ISLINK(hentry))
+			continue;
+		strncpy(sf.names[i].name, hentry->name, sizeof(sf.names[i].name) - 1);
+		sf.names[i].name[sizeof(hentry->name)] = '\0';
+		if (sf.names[i].name[0] == '\0' ||
+		    strchr(sf.names[i].name, '/') ||
+		    strcmp(sf.names[i].name, ".") == 0 ||
+		    strcmp(sf.names[i].name, "..") == 0)
+			continue; /* cannot be represented as file name */
+		sf.names[i].bentry = bentry;
+		sf.names[i].idx = i;
+		++i;
+	}
+
+	/* sort and drop duplicates: keep the first one of the hash table
+	 * (same result as shfs_btable_lookup_byname()) */
+	qsort(sf.names, i, sizeof(*sf.names), shfs_fuse_name_cmp);
+	for (n = 0, j = 0; j < i; ++j) {
+		if (n > 0 && strcmp(sf.names[n - 1].name, sf.names[j].name) == 0)
+			continue;
+		if (n != j)
+			sf.names[n] = sf.names[j];
+		++n;
+	}
+	sf.nb_names = n;
+	return 0;
+}
+
+static struct shfs_bentry *shfs_fuse_lookup_name(const char *name)
+{
+	unsigned int lo, hi, mid;
+	int cmp;
+
+	/* binary search, names are unique */
+	lo = 0;
+	hi = sf.nb_names;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(sf.names[mid].name, name);
+		if (cmp == 0)
+			return sf.names[mid].bentry;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/*
+ * Path resolution
+ */
+enum shfs_fuse_ptype {
+	SFP_ROOT = 0,
+	SFP_HASHDIR,
+	SFP_NAMEDIR,
+	SFP_OBJ,
+};
+
+static int shfs_fuse_resolve(const char *path, struct shfs_bentry **out)
+{
+	struct shfs_bentry *bentry;
+	hash512_t h;
+	size_t plen;
+
+	if (unlikely(!shfs_mounted))
+		return -EIO; /* mounting failed, we are about to exit */
+	if (path[0] != '/')
+		return -ENOENT;
+	++path;
+	if (path[0] == '\0')
+		return SFP_ROOT;
+
+	plen = sizeof(SHFS_FUSE_DIR_HASH) - 1;
+	if (strncmp(path, SHFS_FUSE_DIR_HASH, plen) == 0 &&
+	    (path[plen] == '\0' || path[plen] == '/')) {
+		path += plen;
+		if (path[0] == '\0')
+			return SFP_HASHDIR;
+		++path;
+		if (strlen(path) != (2 * shfs_vol.hlen) ||
+		    hash_parse(path, h, shfs_vol.hlen) < 0)
+			return -ENOENT;
+		bentry = shfs_btable_lookup(shfs_vol.bt, h);
+		goto found;
+	}
+
+	plen = sizeof(SHFS_FUSE_DIR_NAME) - 1;
+	if (strncmp(path, SHFS_FUSE_DIR_NAME, plen) == 0 &&
+	    (path[plen] == '\0' || path[plen] == '/')) {
+		path += plen;
+		if (path[0] == '\0')
+			return SFP_NAMEDIR;
+		++path;
+		bentry = shfs_fuse_lookup_name(path);
+		goto found;
+	}
+	return -ENOENT;
+
+ found:
+	if (!bentry || SHFS_HENTRY_ISLINK(bentry->hentry))
+		return -ENOENT;
+	*out = bentry;
+	return SFP_OBJ;
+}
+
+/*
+ * FUSE operations
+ */
+static int shfs_fuse_mount(void)
+{
+	int ret;
+
+	ret = init_shfs();
+	if (ret < 0) {
+		fprintf(stderr, "Could not initialize SHFS: %s\n", strerror(-ret));
+		goto err_out;
+	}
+	ret = mount_shfs(sf.bd_id, sf.nb_bds);
+	if (ret < 0) {
+		fprintf(stderr, "Could not mount SHFS volume: %s\n", strerror(-ret));
+		goto err_exit_shfs;
+	}
+	ret = shfs_fuse_build_names();
+	if (ret < 0) {
+		fprintf(stderr, "Could not build name index: %s\n", strerror(-ret));
+		goto err_umount_shfs;
+	}
+	return 0;
+
+ err_umount_shfs:
+	umount_shfs(1);
+ err_exit_shfs:
+	exit_shfs();
+ err_out:
+	return ret;
+}
+
+static void *shfs_fuse_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+	/*
+	 * The volume is mounted here and not in main(): fuse_main()
+	 * daemonizes by forking, and the POSIX AIO helper threads that the
+	 * block device layer starts would not survive the fork.
+	 */
+	pthread_mutex_lock(&shfs_fuse_lock);
+	if (shfs_fuse_mount() < 0) {
+		sf.ret = 1;
+		fuse_exit(fuse_get_context()->fuse);
+	}
+	pthread_mutex_unlock(&shfs_fuse_lock);
+
+	/* the volume is immutable while mounted: let the kernel cache everything */
+	cfg->entry_timeout = 3600.0;
+	cfg->attr_timeout = 3600.0;
+	cfg->negative_timeout = 3600.0;
+	cfg->kernel_cache = !sf.direct_io;
+	cfg->direct_io = sf.direct_io;
+
+	conn->max_read = SHFS_FUSE_MAX_READ;
+	/* libfuse negotiates the maximum number of pages per request
+	 * based on max_write, even for read-only file systems */
+	conn->max_write = SHFS_FUSE_MAX_READ;
+	if (conn->max_readahead > SHFS_FUSE_MAX_READ)
+		conn->max_readahead = SHFS_FUSE_MAX_READ;
+	return NULL;
+}
+
+static void shfs_fuse_destroy(void *private_data)
+{
+	pthread_mutex_lock(&shfs_fuse_lock);
+	if (shfs_mounted) {
+		umount_shfs(1);
+		free(sf.names);
+		sf.names = NULL;
+		sf.nb_names = 0;
+		exit_shfs();
+	}
+	pthread_mutex_unlock(&shfs_fuse_lock);
+}
+
+static int shfs_fuse_getattr(const char *path, struct stat *st,
+			     struct fuse_file_info *fi)
+{
+	struct shfs_bentry *bentry = NULL;
+	struct shfs_hentry *hentry;
+	int ret;
+
+	pthread_mutex_lock(&shfs_fuse_lock);
+	ret = shfs_fuse_resolve(path, &bentry);
+	if (ret < 0)
+		goto out;
+
+	memset(st, 0, sizeof(*st));
+	st->st_blksize = shfs_vol.chunksize;
+	switch (ret) {
+	case SFP_ROOT:
+		st->st_mode = S_IFDIR | 0555;
+		st->st_nlink = 4;
+		break;
+	case SFP_HASHDIR:
+	case SFP_NAMEDIR:
+		st->st_mode = S_IFDIR | 0555;
+		st->st_nlink = 2;
+		break;
+	default: /* SFP_OBJ */
+		hentry = bentry->hentry;
+		st->st_mode = S_IFREG | 0444;
+		st->st_nlink = 1;
+		st->st_size = hentry->f_attr.len;
+		st->st_blocks = DIV_ROUND_UP(hentry->f_attr.len, 512);
+		st->st_mtime = hentry->ts_creation;
+		st->st_ctime = hentry->ts_creation;
+		st->st_atime = hentry->ts_creation;
+		break;
+	}
+	ret = 0;
+
+ out:
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return ret;
+}
+
+static int shfs_fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+			     off_t offset, struct fuse_file_info *fi,
+			     enum fuse_readdir_flags flags)
+{
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	struct htable_el *el;
+	char str[(2 * sizeof(hash512_t)) + 1];
+	unsigned int i;
+	int ret;
+
+	pthread_mutex_lock(&shfs_fuse_lock);
+	ret = shfs_fuse_resolve(path, &bentry);
+	if (ret < 0)
+		goto out;
+
+	filler(buf, ".", NULL, 0, 0);
+	filler(buf, "..", NULL, 0, 0);
+	switch (ret) {
+	case SFP_ROOT:
+		filler(buf, SHFS_FUSE_DIR_HASH, NULL, 0, 0);
+		filler(buf, SHFS_FUSE_DIR_NAME, NULL, 0, 0);
+		break;
+	case SFP_HASHDIR:
+		foreach_htable_el(shfs_vol.bt, el) {
+			bentry = el->private;
+			hentry = bentry->hentry;
+			if (SHFS_HENTRY_ISLINK(hentry))
+				continue;
+			hash_format(hentry->hash, shfs_vol.hlen, str);
+			if (filler(buf, str, NULL, 0, 0))
+				break;
+		}
+		break;
+	case SFP_NAMEDIR:
+		for (i = 0; i < sf.nb_names; ++i)
+			if (filler(buf, sf.names[i].name, NULL, 0, 0))
+				break;
+		break;
+	default:
+		ret = -ENOTDIR;
+		goto out;
+	}
+	ret = 0;
+
+ out:
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return ret;
+}
+
+static int shfs_fuse_open(const char *path, struct fuse_file_info *fi)
+{
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	SHFS_FD f;
+	int ret;
+
+	if ((fi->flags & O_ACCMODE) != O_RDONLY)
+		return -EROFS;
+
+	pthread_mutex_lock(&shfs_fuse_lock);
+	ret = shfs_fuse_resolve(path, &bentry);
+	if (ret < 0)
+		goto out;
+	if (ret != SFP_OBJ) {
+		ret = -EISDIR;
+		goto out;
+	}
+
+	hentry = bentry->hentry;
+	f = shfs_fio_openh(hentry->hash);
+	if (!f) {
+		ret = -errno;
+		goto out;
+	}
+	fi->fh = (uint64_t)(uintptr_t) f;
+	fi->keep_cache = !sf.direct_io;
+	ret = 0;
+
+ out:
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return ret;
+}
+
+static int shfs_fuse_read(const char *path, char *buf, size_t size, off_t offset,
+			  struct fuse_file_info *fi)
+{
+	SHFS_FD f = (SHFS_FD)(uintptr_t) fi->fh;
+	uint64_t fsize;
+	int ret;
+
+	pthread_mutex_lock(&shfs_fuse_lock);
+	shfs_fio_size(f, &fsize);
+	if (unlikely(offset < 0 || (uint64_t) offset >= fsize)) {
+		ret = 0;
+		goto out;
+	}
+	if ((uint64_t) size > fsize - (uint64_t) offset)
+		size = (size_t) (fsize - (uint64_t) offset);
+
+	if (sf.nocache)
+		ret = shfs_fio_read(f, (uint64_t) offset, buf, size);
+	else
+		ret = shfs_fio_cache_read(f, (uint64_t) offset, buf, size);
+	if (ret >= 0)
+		ret = (int) size;
+
+ out:
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return ret;
+}
+
+static int shfs_fuse_release(const char *path, struct fuse_file_info *fi)
+{
+	pthread_mutex_lock(&shfs_fuse_lock);
+	shfs_fio_close((SHFS_FD)(uintptr_t) fi->fh);
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return 0;
+}
+
+static int shfs_fuse_statfs(const char *path, struct statvfs *st)
+{
+	pthread_mutex_lock(&shfs_fuse_lock);
+	if (unlikely(!shfs_mounted)) {
+		pthread_mutex_unlock(&shfs_fuse_lock);
+		return -EIO;
+	}
+	memset(st, 0, sizeof(*st));
+	st->f_bsize = shfs_vol.chunksize;
+	st->f_frsize = shfs_vol.chunksize;
+	st->f_blocks = shfs_vol.volsize;
+	st->f_files = shfs_vol.htable_nb_entries;
+	st->f_namemax = sizeof(((struct shfs_hentry *) 0)->name);
+	st->f_flag = ST_RDONLY;
+	pthread_mutex_unlock(&shfs_fuse_lock);
+	return 0;
+}
+
+static const struct fuse_operations shfs_fuse_ops = {
+	.init		= shfs_fuse_init,
+	.destroy	= shfs_fuse_destroy,
+	.getattr	= shfs_fuse_getattr,
+	.readdir	= shfs_fuse_readdir,
+	.open		= shfs_fuse_open,
+	.read		= shfs_fuse_read,
+	.release	= shfs_fuse_release,
+	.statfs		= shfs_fuse_statfs,
+};
+
+/*
+ * Command line
+ * All non-option arguments except the last one (mountpoint)
+ * are SHFS volume members.
+ */
+enum {
+	SF_KEY_HELP,
+	SF_KEY_NOCACHE,
+	SF_KEY_DIRECTIO,
+};
+
+static const struct fuse_opt shfs_fuse_opts[] = {
+	FUSE_OPT_KEY("-h",		SF_KEY_HELP),
+	FUSE_OPT_KEY("--help",		SF_KEY_HELP),
+	FUSE_OPT_KEY("--nocache",	SF_KEY_NOCACHE),
+	FUSE_OPT_KEY("--direct-io",	SF_KEY_DIRECTIO),
+	FUSE_OPT_END
+};
+
+static char *shfs_fuse_nonopts[SHFS_FUSE_MAX_DEVS + 1];
+static unsigned int shfs_fuse_nb_nonopts;
+
+static void shfs_fuse_usage(const char *argv0)
+{
+	printf("Usage: %s [OPTION]... [DEVICE]... [MOUNTPOINT]\n", argv0);
+	printf("Mounts an SHFS volume read-only via FUSE.\n\n");
+	printf("  --nocache        Bypass the SHFS chunk cache\n");
+	printf("  --direct-io      Bypass the kernel page cache\n");
+	printf("  -h, --help       Displays this help and exits\n");
+	printf("\nFUSE options:\n");
+}
+
+static int shfs_fuse_opt_proc(void *data, const char *arg, int key,
+			      struct fuse_args *outargs)
+{
+	switch (key) {
+	case FUSE_OPT_KEY_NONOPT:
+		if (shfs_fuse_nb_nonopts >= SHFS_FUSE_MAX_DEVS + 1) {
+			fprintf(stderr, "Too many devices specified\n");
+			return -1;
+		}
+		shfs_fuse_nonopts[shfs_fuse_nb_nonopts++] = (char *) arg;
+		return 0;
+	case SF_KEY_NOCACHE:
+		sf.nocache = 1;
+		return 0;
+	case SF_KEY_DIRECTIO:
+		sf.direct_io = 1;
+		return 0;
+	case SF_KEY_HELP:
+		sf.help = 1;
+		return 1; /* keep it: fuse_main() prints the FUSE options */
+	default:
+		return 1;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	unsigned int i;
+	int ret;
+
+	if (fuse_opt_parse(&args, NULL, shfs_fuse_opts, shfs_fuse_opt_proc) < 0) {
+		ret = 1;
+		goto out;
+	}
+	if (sf.help) {
+		shfs_fuse_usage(args.argv[0]);
+		ret = fuse_main(args.argc, args.argv, &shfs_fuse_ops, NULL);
+		goto out;
+	}
+	if (shfs_fuse_nb_nonopts < 2) {
+		fprintf(stderr, "Please specify at least one device and a mountpoint\n");
+		ret = 1;
+		goto out;
+	}
+
+	sf.nb_bds = shfs_fuse_nb_nonopts - 1;
+	for (i = 0; i < sf.nb_bds; ++i) {
+		if (blkdev_id_parse(shfs_fuse_nonopts[i], &sf.bd_id[i]) < 0) {
+			fprintf(stderr, "Invalid device: %s\n", shfs_fuse_nonopts[i]);
+			ret = 1;
+			goto out;
+		}
+	}
+	fuse_opt_add_arg(&args, shfs_fuse_nonopts[sf.nb_bds]);
+	/* volume is immutable: serve it read-only */
+	fuse_opt_add_arg(&args, "-oro");
+
+	/* the volume gets mounted by shfs_fuse_init() */
+	ret = fuse_main(args.argc, args.argv, &shfs_fuse_ops, NULL);
+	if (sf.ret)
+		ret = sf.ret;
+
+ out:
+	fuse_opt_free_args(&args);
+	return ret;
+}
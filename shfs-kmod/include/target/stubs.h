@@ -69,7 +69,7 @@ static inline int sem_stub(uint64_t s) { return 1; }
 #define down(s) sem_stub((uint64_t) s)
 #define trydown(s) sem_stub((uint64_t) s)
 
-#define alloc_mempool(a, b, c, d, e, f, g, h) ((void *) 0xdeadbeaf)
+#define alloc_mempool(a, b, c, d, e, f, g, h, i) ((void *) 0xdeadbeaf)
 #define shfs_alloc_cache() 1
 #define shfs_free_cache()
 #define free_mempool(a)
@@ -0,0 +1 @@
+../crc32c.c
\ No newline at end of file
@@ -53,6 +53,7 @@
 #include "shfs_alloc.h"
 #include "http_parser.h"
 #include "shfs_check.h"
+#include "crc32c.h"
 
 #ifndef INET_ADDRLEN
 #define INET_ADDRLEN 4
@@ -529,10 +530,15 @@ static void load_vol_hconf(void)
 	shfs_vol.hfunc                        = hdr_config->hfunc;
 	shfs_vol.hlen                         = hdr_config->hlen;
 	shfs_vol.allocator                    = hdr_config->allocator;
+	shfs_vol.csum_ref                     = hdr_config->csum_ref;
+	shfs_vol.csum_type                    = hdr_config->csum_type;
+	shfs_vol.csum_len                     = SHFS_CSUM_SIZE_CHUNKS(shfs_vol.volsize, shfs_vol.chunksize);
 
 	/* brief configuration check */
 	if (shfs_vol.htable_len == 0)
 		dief("Malformed SHFS configuration\n");
+	if (shfs_vol.csum_ref && shfs_vol.csum_type != SCSUM_CRC32C)
+		dief("Unsupported chunk checksum type\n");
 
 	free(chk1);
 }
@@ -597,6 +603,43 @@ static void load_vol_htable(void)
 	}
 }
 
+/**
+ * This function loads the chunk checksum table into memory
+ * (if the volume has one)
+ */
+static void load_vol_csums(void)
+{
+	chk_t c;
+	int ret;
+
+	shfs_vol.csum_tbl = NULL;
+	shfs_vol.csum_chunk_state = NULL;
+	if (!shfs_vol.csum_ref)
+		return;
+
+	dprintf(D_L0, "Reading chunk checksum table...\n");
+	shfs_vol.csum_tbl = malloc(CHUNKS_TO_BYTES(shfs_vol.csum_len, shfs_vol.chunksize));
+	shfs_vol.csum_chunk_state = calloc(1, sizeof(int) * shfs_vol.csum_len);
+	if (!shfs_vol.csum_tbl || !shfs_vol.csum_chunk_state)
+		die();
+	for (c = 0; c < shfs_vol.csum_len; ++c) {
+		ret = sync_read_chunk(&shfs_vol.s, shfs_vol.csum_ref + c, 1,
+		                      (uint8_t *) shfs_vol.csum_tbl
+		                      + CHUNKS_TO_BYTES(c, shfs_vol.chunksize));
+		if (ret < 0)
+			dief("An error occured while reading the checksum table from the volume\n");
+	}
+}
+
+/* stores the checksum of a volume chunk (in-memory, written back on umount) */
+static inline void csum_set(chk_t addr, const void *buf)
+{
+	if (!shfs_vol.csum_tbl)
+		return;
+	shfs_vol.csum_tbl[addr] = SHFS_CSUM_VALUE(crc32c(0, buf, shfs_vol.chunksize));
+	shfs_vol.csum_chunk_state[SHFS_CSUM_CHUNK_NO(addr, shfs_vol.chunksize)] |= CCS_MODIFIED;
+}
+
 /**
  * Initialize allocator
  */
@@ -625,6 +668,12 @@ static void load_vol_alist(void)
 		if (ret < 0)
 			dief("Could not register an allocator entry for backup hash table: %s\n", strerror(errno));
 	}
+	if (shfs_vol.csum_ref) {
+		dprintf(D_L0, "Registering checksum region to allocator...\n");
+		ret = shfs_alist_register(shfs_vol.al, shfs_vol.csum_ref, shfs_vol.csum_len);
+		if (ret < 0)
+			dief("Could not register an allocator entry for checksum table: %s\n", strerror(errno));
+	}
 
 	dprintf(D_L0, "Registering containers to allocator...\n");
 	foreach_htable_el(shfs_vol.bt, el) {
@@ -658,6 +707,9 @@ void mount_shfs(char *path[], unsigned int count)
 	/* load htable (uses shfs_sync_read_chunk) */
 	load_vol_htable();
 
+	/* load chunk checksums */
+	load_vol_csums();
+
 	/* load and initialize allocator */
 	load_vol_alist();
 }
@@ -670,6 +722,21 @@ void umount_shfs(void) {
   int ret;
 
   shfs_free_alist(shfs_vol.al);
+  /* checksums are written first: a hash table entry must not
+   * reference chunks whose checksums are not on the disk yet */
+  for(i = 0; i < shfs_vol.csum_len && shfs_vol.csum_tbl; ++i) {
+    if (shfs_vol.csum_chunk_state[i] & CCS_MODIFIED) {
+      ret = sync_write_chunk(&shfs_vol.s, shfs_vol.csum_ref + i,
+                             1,
+                             (uint8_t *) shfs_vol.csum_tbl
+                             + CHUNKS_TO_BYTES(i, shfs_vol.chunksize));
+      if (ret < 0)
+	dief("An error occured while writing back the checksum table to the volume!\n"
+	     "The filesystem might be in a corrupted state right now\n");
+    }
+  }
+  free(shfs_vol.csum_tbl);
+  free(shfs_vol.csum_chunk_state);
   for(i = 0; i < shfs_vol.htable_len; ++i) {
     if (shfs_vol.htable_chunk_cache_state[i] & CCS_MODIFIED) {
       /* write buffer back to disk since it has been modified */
@@ -956,6 +1023,7 @@ static int actn_addfile(struct token *j)
 			ret = -1;
 			goto err_free_tmp_chk;
 		}
+		csum_set(cchk + c, tmp_chk);
 		if (cancel) {
 			ret = -2;
 			goto err_free_tmp_chk;
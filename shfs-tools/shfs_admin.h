@@ -106,6 +106,13 @@ struct vol_info {
 	/* allocator */
 	uint8_t allocator;
 	struct shfs_alist *al;
+
+	/* chunk checksums */
+	chk_t csum_ref; /* 0 => volume has no checksums */
+	chk_t csum_len;
+	uint8_t csum_type;
+	uint32_t *csum_tbl;
+	int *csum_chunk_state;
 };
 
 /* chunk_cache_states */
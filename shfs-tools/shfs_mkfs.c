@@ -52,7 +52,7 @@ int force = 0;
 /******************************************************************************
  * ARGUMENT PARSING                                                           *
  ******************************************************************************/
-const char *short_opts = "h?vVfn:s:cb:e:xF:l:";
+const char *short_opts = "h?vVfn:s:cb:e:xF:l:k";
 
 static struct option long_opts[] = {
 	{"help",		no_argument,		NULL,	'h'},
@@ -67,6 +67,7 @@ static struct option long_opts[] = {
 	{"erase",		no_argument,		NULL,	'x'},
 	{"hash-function",	required_argument,	NULL,	'F'},
 	{"hash-length",		required_argument,	NULL,	'l'},
+	{"checksums",		no_argument,		NULL,	'k'},
 	{NULL, 0, NULL, 0} /* end of list */
 };
 
@@ -102,6 +103,10 @@ static void print_usage(char *argv0)
 	printf("                                    sha (default), crc, md5, haval, manual\n");
 	printf("  -l, --hash-length [BYTES]        sets the the hash digest length in bytes\n");
 	printf("                                    at least 1 (8 Bits), at most 64 (512 Bits)\n");
+	printf("\n");
+	printf(" Data integrity:\n");
+	printf("  -k, --checksums                  reserves an area for CRC32C checksums of each\n");
+	printf("                                    chunk (filled by shfs_admin on adding files)\n");
 }
 
 static inline void release_args(struct args *args)
@@ -145,6 +150,7 @@ static int parse_args(int argc, char **argv, struct args *args)
 	args->entries_per_bucket = 8;
 	args->fullerase = 0;
 	args->combined_striping = 0;
+	args->checksums = 0;
 
 	args->hashfunc = SHFUNC_SHA;
 	args->hashlen = 0; /* set to default after parsing */
@@ -209,6 +215,9 @@ static int parse_args(int argc, char **argv, struct args *args)
 		case 'c': /* combined striping */
 			args->combined_striping = 1;
 			break;
+		case 'k': /* chunk checksums */
+			args->checksums = 1;
+			break;
 		case 'F': /* hash function */
 			if        (strcmp("sha", optarg) == 0) {
 				args->hashfunc = SHFUNC_SHA;
@@ -343,6 +352,7 @@ static void mkfs(struct storage *s, struct args *args)
 	struct shfs_hdr_common *hdr_common;
 	struct shfs_hdr_config *hdr_config;
 	chk_t htable_size;
+	chk_t csum_size;
 	uint64_t mdata_size;
 	uint64_t chunksize;
 	uint64_t member_dsize;
@@ -411,6 +421,15 @@ static void mkfs(struct storage *s, struct args *args)
 	hdr_config->htable_bucket_count = args->bucket_count;
 	hdr_config->htable_entries_per_bucket = args->entries_per_bucket;
 	hdr_config->allocator = args->allocator;
+	if (args->checksums) {
+		/* checksum area follows the hash table */
+		hdr_config->csum_ref = hdr_config->htable_ref
+			+ SHFS_HTABLE_SIZE_CHUNKS(hdr_config, chunksize);
+		hdr_config->csum_type = SCSUM_CRC32C;
+	} else {
+		hdr_config->csum_ref = 0; /* disable chunk checksums */
+		hdr_config->csum_type = SCSUM_NONE;
+	}
 
 	/*
 	 * Check device size
@@ -489,6 +508,14 @@ static void mkfs(struct storage *s, struct args *args)
 			if (ret < 0)
 				die();
 		}
+
+		if (hdr_config->csum_ref) {
+			csum_size = SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize);
+			printf("\rErasing checksum area...\n");
+			ret = sync_erase_chunk(s, hdr_config->csum_ref, csum_size);
+			if (ret < 0)
+				die();
+		}
 	}
 
 	/*
@@ -553,6 +580,7 @@ int main(int argc, char **argv)
 	printvar(args.hashlen, "%"PRIu32);
 	printvar(args.bucket_count, "%"PRIu32);
 	printvar(args.entries_per_bucket, "%"PRIu32);
+	printvar(args.checksums, "%d");
 
 	/*
 	 * MAIN
@@ -56,6 +56,8 @@ struct args {
 	uint8_t  hashlen;
 	uint32_t bucket_count;
 	uint32_t entries_per_bucket;
+
+	int checksums;
 };
 
 #endif /* _SHFS_MKFS_ */
@@ -251,6 +251,7 @@ void print_shfs_hdr_summary(struct shfs_hdr_common *hdr_common,
 	uint64_t htable_size;
 	chk_t    htable_size_chks;
 	uint32_t htable_total_entries;
+	chk_t    csum_size_chks;
 	uint8_t  m;
 	char str_uuid[37];
 	char str_date[20];
@@ -260,6 +261,7 @@ void print_shfs_hdr_summary(struct shfs_hdr_common *hdr_common,
 	htable_total_entries = SHFS_HTABLE_NB_ENTRIES(hdr_config);
 	htable_size_chks     = SHFS_HTABLE_SIZE_CHUNKS(hdr_config, chunksize);
 	htable_size          = CHUNKS_TO_BYTES(htable_size_chks, chunksize);
+	csum_size_chks       = SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize);
 
 	printf("SHFS version:      %2x.%02x\n",
 	       hdr_common->version[0],
@@ -291,6 +293,12 @@ void print_shfs_hdr_summary(struct shfs_hdr_common *hdr_common,
 	       htable_size_chks, htable_size / 1024,
 	       hdr_config->htable_bak_ref ? "2nd copy enabled" : "No copy");
 	printf("Entry size:         %"PRIu64" Bytes (raw: %zu Bytes)\n", hentry_size, sizeof(struct shfs_hentry));
+	if (hdr_config->csum_ref)
+		printf("Chunk checksums:    %s, %"PRIu64" chunks (%"PRIu64" KiB)\n",
+		       (hdr_config->csum_type == SCSUM_CRC32C ? "CRC32C" : "Unknown"),
+		       csum_size_chks, CHUNKS_TO_BYTES(csum_size_chks, chunksize) / 1024);
+	else
+		printf("Chunk checksums:    Disabled\n");
 	printf("Metadata total:     %"PRIu64" chunks\n", metadata_size(hdr_common, hdr_config));
 	printf("Available space:    %"PRIu64" chunks\n", avail_space(hdr_common, hdr_config));
 
@@ -344,6 +352,8 @@ chk_t metadata_size(struct shfs_hdr_common *hdr_common,
 	ret += htable_size_chks; /* hash table chunks */
 	if (hdr_config->htable_bak_ref)
 		ret += htable_size_chks; /* backup hash table */
+	if (hdr_config->csum_ref)
+		ret += SHFS_CSUM_SIZE_CHUNKS(hdr_common->vol_size, chunksize); /* chunk checksums */
 	return ret;
 }
 
@@ -129,13 +129,7 @@ chk_t metadata_size(struct shfs_hdr_common *hdr_common,
                     struct shfs_hdr_config *hdr_config);
 chk_t avail_space(struct shfs_hdr_common *hdr_common,
                   struct shfs_hdr_config *hdr_config);
-static inline void hash_unparse(hash512_t h, uint8_t hlen, char *out)
-{
-	uint8_t i;
-
-	for (i = 0; i < hlen; i++)
-		snprintf(out + (2*i), 3, "%02x", h[i]);
-}
+#define hash_unparse(h, hlen, out) hash_format((h), (hlen), (out))
 
 static inline size_t strftimestamp_s(char *s, size_t slen, const char *fmt, uint64_t ts_sec)
 {
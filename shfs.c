@@ -52,10 +52,20 @@ int shfs_errno;
 #include "shfs_check.h"
 #include "shfs_defs.h"
 #include "shfs_btable.h"
+#include "memacct.h"
 #ifdef SHFS_STATS
 #include "shfs_stats_data.h"
 #include "shfs_stats.h"
 #endif
+#if !defined __KERNEL__ && defined SHFS_WARMUP
+#include "shfs_warmup.h"
+#endif
+#ifdef SHFS_INGEST
+#include "shfs_alloc.h"
+#endif
+#ifdef SHFS_CSUM
+#include "shfs_csum.h"
+#endif
 
 #ifdef SHFS_DEBUG
 #define ENABLE_DEBUG
@@ -80,6 +90,7 @@ TT_DECLARE(shfs_tt_vbdopen);
 
 
 int shfs_mounted = 0;
+int shfs_mount_pending = 0;
 unsigned int shfs_nb_open = 0;
 sem_t shfs_mount_lock;
 struct vol_info shfs_vol;
@@ -197,7 +208,17 @@ static int load_vol_cconf(blkdev_id_t bd_id[], unsigned int count)
 		blkdev_id_unparse(bd_id[i], str_id, sizeof(str_id));
 		printd("Search for SHFS label on device %s...\n", str_id);
 #endif
+#ifdef SHFS_INGEST
+		/* writable members are required for storing files */
+		detected_member[nb_detected_members].writable = 1;
+		bd = shfs_checkopen_blkdev(bd_id[i], chk0, O_RDWR);
+		if (!bd) {
+			detected_member[nb_detected_members].writable = 0;
+			bd = shfs_checkopen_blkdev(bd_id[i], chk0, O_RDONLY);
+		}
+#else
 		bd = shfs_checkopen_blkdev(bd_id[i], chk0, O_RDONLY);
+#endif
 		if (!bd) {
 			continue; /* try next device */
 		}
@@ -258,6 +279,9 @@ static int load_vol_cconf(blkdev_id_t bd_id[], unsigned int count)
 #endif
 				shfs_vol.member[shfs_vol.nb_members].bd = detected_member[m].bd;
 				uuid_copy(shfs_vol.member[shfs_vol.nb_members].uuid, detected_member[m].uuid);
+#ifdef SHFS_INGEST
+				shfs_vol.member[shfs_vol.nb_members].writable = detected_member[m].writable;
+#endif
 #if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV
 				shfs_vol.members_maxfd = max(shfs_vol.members_maxfd,
 							     blkdev_get_fd(detected_member[m].bd));
@@ -274,6 +298,13 @@ static int load_vol_cconf(blkdev_id_t bd_id[], unsigned int count)
 		ret = -ENOENT;
 		goto err_close_bds;
 	}
+#ifdef SHFS_INGEST
+	shfs_vol.writable = 1;
+	for (i = 0; i < shfs_vol.nb_members; ++i) {
+		if (!shfs_vol.member[i].writable)
+			shfs_vol.writable = 0;
+	}
+#endif
 
 	/* chunk and stripe size -> retrieve a device sector factor for each device and
 	 * also the alignment requirements for io buffers */
@@ -381,6 +412,15 @@ static int load_vol_hconf(void)
 	shfs_vol.htable_nb_entries_per_chunk  = SHFS_HENTRIES_PER_CHUNK(shfs_vol.chunksize);
 	shfs_vol.htable_len                   = SHFS_HTABLE_SIZE_CHUNKS(hdr_config, shfs_vol.chunksize);
 	shfs_vol.hlen = hdr_config->hlen;
+#ifdef SHFS_INGEST
+	shfs_vol.hfunc = hdr_config->hfunc;
+	shfs_vol.allocator = hdr_config->allocator;
+#endif
+#ifdef SHFS_CSUM
+	shfs_vol.csum_ref  = hdr_config->csum_ref;
+	shfs_vol.csum_type = hdr_config->csum_type;
+	shfs_vol.csum_len  = SHFS_CSUM_SIZE_CHUNKS(shfs_vol.volsize, shfs_vol.chunksize);
+#endif
 	ret = 0;
 
 	/* brief configuration check */
@@ -424,12 +464,16 @@ static void _load_vol_htable_cb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
 		aiot->done = 1;
 }
 
-static int load_vol_htable(void)
+static struct _load_vol_htable_aiot htable_aiot; /* hash table reads of a mount */
+
+/**
+ * Issues the reads of the hash table; the caller has to poll the block
+ * devices until htable_aiot.done is set and call load_vol_htable_finish()
+ * This function also allocates htable_chunk_cache and btable
+ */
+static int load_vol_htable_start(void)
 {
-	struct _load_vol_htable_aiot aiot;
 	SHFS_AIO_TOKEN *aioret;
-	struct shfs_hentry *hentry;
-	struct shfs_bentry *bentry;
 	void *chk_buf;
 	unsigned int i;
 	chk_t c;
@@ -437,7 +481,7 @@ static int load_vol_htable(void)
 
 	printd("Allocating chunk cache reference table (size: %lu B)...\n",
 	        sizeof(void *) * shfs_vol.htable_len);
-	shfs_vol.htable_chunk_cache = target_malloc(CACHELINE_SIZE, sizeof(void *) * shfs_vol.htable_len);
+	shfs_vol.htable_chunk_cache = memacct_malloc(MEMT_HTCACHE, CACHELINE_SIZE, sizeof(void *) * shfs_vol.htable_len);
 	if (!shfs_vol.htable_chunk_cache) {
 		ret = -ENOMEM;
 		goto err_out;
@@ -445,25 +489,26 @@ static int load_vol_htable(void)
 	memset(shfs_vol.htable_chunk_cache, 0, sizeof(void *) * shfs_vol.htable_len);
 
 	/* read hash table from device */
-	aiot.done = 0;
-	aiot.left = shfs_vol.htable_len;
-	aiot.ret = 0;
+	htable_aiot.done = 0;
+	htable_aiot.left = shfs_vol.htable_len;
+	htable_aiot.ret = 0;
 	for (c = 0; c < shfs_vol.htable_len; ++c) {
 		/* allocate buffer and register it to htable chunk cache */
 		printd("Allocate buffer for chunk %"PRIchk" of htable (size: %lu B, align: %"PRIu32")\n",
 		        c, shfs_vol.chunksize, shfs_vol.ioalign);
-		chk_buf = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
+		chk_buf = memacct_malloc(MEMT_HTCACHE, shfs_vol.ioalign, shfs_vol.chunksize);
 		if (!chk_buf) {
 			printd("Could not alloc chunk %"PRIchk"\n", c);
+			htable_aiot.left -= (shfs_vol.htable_len - c);
 			ret = -ENOMEM;
-			goto err_free_chunkcache;
+			goto err_cancel_aio;
 		}
 		shfs_vol.htable_chunk_cache[c] = chk_buf;
 
 	repeat_aio:
 		printd("Setup async read for chunk %"PRIchk"\n", c);
 		aioret = shfs_aread_chunk(shfs_vol.htable_ref + c, 1, chk_buf,
-		                          _load_vol_htable_cb, &aiot, NULL);
+		                          _load_vol_htable_cb, &htable_aiot, NULL);
 		if (!aioret && (errno == EAGAIN || errno == EBUSY)) {
 			printd("Device is busy: Retrying...\n");
 			shfs_aio_submit();
@@ -472,27 +517,53 @@ static int load_vol_htable(void)
 		}
 		if (!aioret) {
 			printd("Could not setup async read: %s\n", strerror(errno));
-			aiot.left -= (shfs_vol.htable_len - c);
+			htable_aiot.left -= (shfs_vol.htable_len - c);
+			ret = -EIO;
 			goto err_cancel_aio;
 		}
 	}
 	shfs_aio_submit();
 
-	/* allocate bucket table */
+	/* allocate bucket table while the reads are in flight */
 	printd("Allocating btable...\n");
 	shfs_vol.bt = shfs_alloc_btable(shfs_vol.htable_nb_buckets,
 	                                shfs_vol.htable_nb_entries_per_bucket,
 	                                shfs_vol.hlen);
 	if (!shfs_vol.bt) {
 		ret = -ENOMEM;
-		goto err_free_chunkcache;
+		goto err_wait_aio;
 	}
+	return 0;
 
-	/* wait for I/O completion */
-	printd("Waiting for I/O completion...\n");
-	while (!aiot.done)
+ err_cancel_aio:
+	shfs_aio_submit();
+ err_wait_aio:
+	while (htable_aiot.left)
 		shfs_poll_blkdevs();
-	if (aiot.ret < 0) {
+	for (i = 0; i < shfs_vol.htable_len; ++i) {
+		if (shfs_vol.htable_chunk_cache[i])
+			memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache[i], shfs_vol.chunksize);
+	}
+	memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache, sizeof(void *) * shfs_vol.htable_len);
+ err_out:
+	return ret;
+}
+
+/**
+ * Feeds the bucket table with the loaded hash table
+ * Note: All reads issued by load_vol_htable_start() have to be completed
+ */
+static int load_vol_htable_finish(void)
+{
+	struct shfs_hentry *hentry;
+	struct shfs_bentry *bentry;
+	void *chk_buf;
+	unsigned int i;
+	chk_t c;
+	int ret;
+
+	BUG_ON(!htable_aiot.done);
+	if (htable_aiot.ret < 0) {
 		printd("There was an I/O error: Aborting...\n");
 		ret = -EIO;
 		goto err_free_btable;
@@ -514,12 +585,15 @@ static int load_vol_htable(void)
 		bentry->hentry_htoffset = SHFS_HTABLE_ENTRY_OFFSET(i, shfs_vol.htable_nb_entries_per_chunk);
 		bentry->refcount = 0;
 		bentry->update = 0;
+#ifdef SHFS_CSUM
+		bentry->quarantine = 0;
+#endif
 #ifdef __KERNEL__
 		bentry->ino = i + LINUX_FIRST_INO_N;
 #endif
 		init_SEMAPHORE(&bentry->updatelock, 1);
 #ifdef SHFS_STATS
-		memset(&bentry->hstats, 0, sizeof(bentry->hstats));
+		bentry->stats_idx = i;
 #endif
 		if (SHFS_HENTRY_ISDEFAULT(hentry))
 			shfs_vol.def_bentry = bentry;
@@ -527,63 +601,220 @@ static int load_vol_htable(void)
 
 	return 0;
 
- err_cancel_aio:
-	if (aiot.left) {
-		while (!trydown(&aiot.done))
-			shfs_poll_blkdevs();
-	}
-	ret = -EIO;
-	goto err_free_chunkcache;
-
  err_free_btable:
 	shfs_free_btable(shfs_vol.bt);
- err_free_chunkcache:
 	for (i = 0; i < shfs_vol.htable_len; ++i) {
 		if (shfs_vol.htable_chunk_cache[i])
-			target_free(shfs_vol.htable_chunk_cache[i]);
+			memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache[i], shfs_vol.chunksize);
 	}
-	target_free(shfs_vol.htable_chunk_cache);
- err_out:
+	memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache, sizeof(void *) * shfs_vol.htable_len);
 	return ret;
 }
 
-#ifndef __KERNEL__
-static void _aiotoken_pool_objinit(struct mempool_obj *, void *);
+#ifdef SHFS_CSUM
+static struct _load_vol_htable_aiot csum_aiot; /* checksum table reads of a mount */
+static chk_t csum_next; /* next chunk of the checksum table to read */
+
+/**
+ * Issues reads of the checksum table until the device queue is full,
+ * so that a background mount never waits for the device
+ */
+static void load_vol_csums_issue(void)
+{
+	SHFS_AIO_TOKEN *aioret;
+
+	if (!shfs_vol.csum_tbl || csum_next == shfs_vol.csum_len)
+		return;
+
+	while (csum_next < shfs_vol.csum_len) {
+		aioret = shfs_aread_chunk(shfs_vol.csum_ref + csum_next, 1,
+		                          (uint8_t *) shfs_vol.csum_tbl
+		                          + CHUNKS_TO_BYTES(csum_next, shfs_vol.chunksize),
+		                          _load_vol_htable_cb, &csum_aiot, NULL);
+		if (!aioret && (errno == EAGAIN || errno == EBUSY))
+			break; /* retried on next call */
+		if (!aioret) {
+			csum_aiot.ret = -errno;
+			csum_aiot.left -= (shfs_vol.csum_len - csum_next);
+			csum_next = shfs_vol.csum_len;
+			if (!csum_aiot.left)
+				csum_aiot.done = 1;
+			break;
+		}
+		++csum_next;
+	}
+	shfs_aio_submit();
+}
+
+/**
+ * Allocates the chunk checksum table and starts loading it; the caller
+ * has to call load_vol_csums_issue() and poll the block devices until
+ * csum_aiot.done is set, and call load_vol_csums_finish() afterwards
+ * Without it (no checksum area or out of memory), chunks are not verified
+ * Note: load_vol_hconf() and local_vol_cconf() has to called before
+ */
+static void load_vol_csums_start(void)
+{
+	shfs_vol.csum_tbl = NULL;
+	memset(&shfs_csum_stats, 0, sizeof(shfs_csum_stats));
+	csum_aiot.done = 1;
+	csum_aiot.left = 0;
+	csum_aiot.ret = 0;
+	csum_next = 0;
+	if (!shfs_vol.csum_ref)
+		return;
+	if (shfs_vol.csum_type != SCSUM_CRC32C) {
+		printd("Unsupported chunk checksum type: %"PRIu8"\n", shfs_vol.csum_type);
+		return;
+	}
+
+	printd("Allocating chunk checksum table (size: %"PRIu64" B)...\n",
+	       CHUNKS_TO_BYTES(shfs_vol.csum_len, shfs_vol.chunksize));
+	shfs_vol.csum_tbl = memacct_malloc(MEMT_SHFS, shfs_vol.ioalign,
+	                                   CHUNKS_TO_BYTES(shfs_vol.csum_len, shfs_vol.chunksize));
+	if (!shfs_vol.csum_tbl) {
+		printd("Could not allocate chunk checksum table: Chunks are not verified\n");
+		return;
+	}
+
+	csum_aiot.done = 0;
+	csum_aiot.left = shfs_vol.csum_len;
+	load_vol_csums_issue();
+}
+
+static void load_vol_csums_finish(void)
+{
+	BUG_ON(!csum_aiot.done);
+	if (csum_aiot.ret < 0) {
+		printd("Could not read chunk checksum table: Chunks are not verified\n");
+		memacct_free(MEMT_SHFS, shfs_vol.csum_tbl,
+		             CHUNKS_TO_BYTES(shfs_vol.csum_len, shfs_vol.chunksize));
+		shfs_vol.csum_tbl = NULL;
+	}
+}
+
+static void free_vol_csums(void)
+{
+	if (!shfs_vol.csum_tbl)
+		return;
+	memacct_free(MEMT_SHFS, shfs_vol.csum_tbl,
+	             CHUNKS_TO_BYTES(shfs_vol.csum_len, shfs_vol.chunksize));
+	shfs_vol.csum_tbl = NULL;
+}
 #endif
 
+#ifdef SHFS_INGEST
 /**
- * Mount a SHFS volume
- * The volume is searched on the given list of block devices
+ * Builds the allocation list of used volume areas from the hash table
+ * (same as shfs-tools do). Without it, the volume is handled read-only
  */
-int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
+static void load_vol_alist(void)
 {
-	unsigned int i;
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
 	int ret;
 
-	down(&shfs_mount_lock);
+	shfs_vol.al = NULL;
+	if (!shfs_vol.writable) {
+		printd("Volume members are read-only\n");
+		return;
+	}
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum_ref && !shfs_vol.csum_tbl) {
+		/* stored chunks would not get valid checksums */
+		printd("Chunk checksum table is not available: Volume is handled read-only\n");
+		return;
+	}
+#endif
 
-	if (count == 0) {
-		ret = -EINVAL;
-		goto err_out;
+	shfs_vol.al = shfs_alloc_alist(shfs_vol.volsize, shfs_vol.allocator);
+	if (!shfs_vol.al) {
+		printd("Could not create allocation list: %s\n", strerror(errno));
+		return;
 	}
-	if (shfs_mounted) {
-		ret = -EALREADY;
-		goto err_out;
+
+	/* label and configuration chunk, hash table and its backup */
+	ret = shfs_alist_register(shfs_vol.al, 0, 2);
+	if (ret < 0)
+		goto err_free_alist;
+	ret = shfs_alist_register(shfs_vol.al, shfs_vol.htable_ref, shfs_vol.htable_len);
+	if (ret < 0)
+		goto err_free_alist;
+	if (shfs_vol.htable_bak_ref) {
+		ret = shfs_alist_register(shfs_vol.al, shfs_vol.htable_bak_ref, shfs_vol.htable_len);
+		if (ret < 0)
+			goto err_free_alist;
+	}
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum_ref) {
+		ret = shfs_alist_register(shfs_vol.al, shfs_vol.csum_ref, shfs_vol.csum_len);
+		if (ret < 0)
+			goto err_free_alist;
 	}
-	shfs_mounted = 0;
+#endif
+
+	/* file containers */
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		hentry = bentry->hentry;
+		if (SHFS_HENTRY_ISLINK(hentry))
+			continue;
+		ret = shfs_alist_register(shfs_vol.al,
+		                          hentry->f_attr.chunk,
+		                          DIV_ROUND_UP(hentry->f_attr.offset + hentry->f_attr.len,
+		                                       shfs_vol.chunksize));
+		if (ret < 0)
+			goto err_free_alist;
+	}
+	return;
+
+ err_free_alist:
+	printd("Could not create allocation list: %d\n", ret);
+	shfs_free_alist(shfs_vol.al);
+	shfs_vol.al = NULL;
+}
+#endif
+
+#ifndef __KERNEL__
+static void _aiotoken_pool_objinit(struct mempool_obj *, void *);
+#endif
+
+/*
+ * Mounting is split into two phases so that the hash table can be loaded
+ * in the background (e.g., while the network comes up during boot):
+ * _mount_shfs_begin() opens the members, reads the volume configuration
+ * and issues the hash and checksum table reads; after their completion,
+ * _mount_shfs_finish() builds up the in-memory structures
+ * While a mount is pending, chunk I/O is possible but the volume is not
+ * visible as mounted
+ * Note: shfs_mount_lock has to be held by the caller
+ */
+static int _mount_shfs_begin(blkdev_id_t bd_id[], unsigned int count)
+{
+	unsigned int i;
+	int ret;
+
+	if (count == 0)
+		return -EINVAL;
+	if (shfs_mounted || shfs_mount_pending)
+		return -EALREADY;
 
 	/* load common volume information and open devices */
 	printd("Loading common volume information...\n");
 	ret = load_vol_cconf(bd_id, count);
 	if (ret < 0)
-		goto err_out;
+		return ret;
+	shfs_vol.detached = 0;
 
 	/* a memory pool required for async I/O requests (even on cache) */
-	shfs_vol.aiotoken_pool = alloc_mempool(NB_AIOTOKEN, sizeof(struct _shfs_aio_token),
+	shfs_vol.aiotoken_pool = alloc_mempool(MEMT_SHFS, NB_AIOTOKEN, sizeof(struct _shfs_aio_token),
 	                                       0, 0, 0, _aiotoken_pool_objinit, NULL, 0);
-	if (!shfs_vol.aiotoken_pool)
+	if (!shfs_vol.aiotoken_pool) {
+		ret = -ENOMEM;
 		goto err_close_members;
-	shfs_mounted = 1; /* required by next function calls */
+	}
+	shfs_mount_pending = 1; /* required by next function calls */
 
 	/* load hash conf (uses shfs_sync_read_chunk) */
 	printd("Loading volume configuration...\n");
@@ -591,18 +822,53 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 	if (ret < 0)
 		goto err_free_aiotoken_pool;
 
-	/* load htable (uses shfs_sync_read_chunk)
-	 * This function also allocates htable_chunk_cache,
-	 * htable_chunk_cache_state and btable */
+	/* issue htable reads
+	 * This function also allocates htable_chunk_cache and btable */
 	printd("Loading volume hash table...\n");
-	ret = load_vol_htable();
+	ret = load_vol_htable_start();
 	if (ret < 0)
-		goto err_close_members;
+		goto err_free_aiotoken_pool;
+#ifdef SHFS_CSUM
+	/* the checksum table is loaded alongside */
+	printd("Loading chunk checksums...\n");
+	load_vol_csums_start();
+#endif
+	return 0;
+
+ err_free_aiotoken_pool:
+	shfs_mount_pending = 0;
+	free_mempool(shfs_vol.aiotoken_pool);
+ err_close_members:
+	for(i = 0; i < shfs_vol.nb_members; ++i)
+		close_blkdev(shfs_vol.member[i].bd);
+	shfs_vol.nb_members = 0;
+	return ret;
+}
+
+static int _mount_shfs_finish(void)
+{
+	unsigned int i;
+	int ret;
+
+	BUG_ON(!shfs_mount_pending);
+
+#ifdef SHFS_CSUM
+	load_vol_csums_finish();
+#endif
+	ret = load_vol_htable_finish();
+	if (ret < 0)
+		goto err_free_aiotoken_pool;
+#ifdef SHFS_INGEST
+	load_vol_alist();
+	shfs_vol.nb_ingest = 0;
+#endif
 
 	printd("Allocating remount chunk buffer...\n");
-	shfs_vol.remount_chunk_buffer = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
-	if (!shfs_vol.remount_chunk_buffer)
+	shfs_vol.remount_chunk_buffer = memacct_malloc(MEMT_SHFS, shfs_vol.ioalign, shfs_vol.chunksize);
+	if (!shfs_vol.remount_chunk_buffer) {
+		ret = -ENOMEM;
 		goto err_free_htable;
+	}
 
 	/* chunk buffer cache for I/O */
 	printd("Allocating chunk cache...\n");
@@ -612,17 +878,19 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
 
 #ifdef SHFS_STATS
 	printd("Initializing statistics...\n");
-	ret = shfs_init_mstats(shfs_vol.htable_nb_buckets,
-	                       shfs_vol.htable_nb_entries_per_bucket,
-	                       shfs_vol.hlen);
-	if (!ret < 0) {
-		shfs_mounted = 0;
+	ret = shfs_init_hstats(shfs_vol.htable_nb_entries);
+	if (ret < 0)
+		goto  err_free_chunkcache;
+	ret = shfs_init_mstats(SHFS_MSTATS_NB_SLOTS);
+	if (ret < 0) {
+		shfs_free_hstats();
 		goto  err_free_chunkcache;
 	}
 #endif
 
 	shfs_nb_open = 0;
-	up(&shfs_mount_lock);
+	shfs_mount_pending = 0;
+	shfs_mounted = 1;
 	printd("SHFS volume mounted\n");
 	return 0;
 
@@ -631,21 +899,97 @@ int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
  err_free_chunkcache:
 	shfs_free_cache();
  err_free_remount_buffer:
-	target_free(shfs_vol.remount_chunk_buffer);
+	memacct_free(MEMT_SHFS, shfs_vol.remount_chunk_buffer, shfs_vol.chunksize);
  err_free_htable:
 	for (i = 0; i < shfs_vol.htable_len; ++i) {
 		if (shfs_vol.htable_chunk_cache[i])
-			target_free(shfs_vol.htable_chunk_cache[i]);
+			memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache[i], shfs_vol.chunksize);
 	}
-	target_free(shfs_vol.htable_chunk_cache);
+	memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache, sizeof(void *) * shfs_vol.htable_len);
 	shfs_free_btable(shfs_vol.bt);
+#ifdef SHFS_INGEST
+	shfs_free_alist(shfs_vol.al);
+#endif
  err_free_aiotoken_pool:
+#ifdef SHFS_CSUM
+	free_vol_csums();
+#endif
+	shfs_mount_pending = 0;
 	free_mempool(shfs_vol.aiotoken_pool);
- err_close_members:
 	for(i = 0; i < shfs_vol.nb_members; ++i)
 		close_blkdev(shfs_vol.member[i].bd);
-	shfs_mounted = 0;
- err_out:
+	shfs_vol.nb_members = 0;
+	return ret;
+}
+
+/* returns 1 while reads of a pending mount are outstanding
+ * Note: shfs_mount_lock has to be held by the caller */
+static int _mount_shfs_io_pending(void)
+{
+#ifdef SHFS_CSUM
+	load_vol_csums_issue();
+	if (!csum_aiot.done)
+		return 1;
+#endif
+	return !htable_aiot.done;
+}
+
+/**
+ * Mount a SHFS volume
+ * The volume is searched on the given list of block devices
+ */
+int mount_shfs(blkdev_id_t bd_id[], unsigned int count)
+{
+	int ret;
+
+	down(&shfs_mount_lock);
+	ret = _mount_shfs_begin(bd_id, count);
+	if (ret < 0)
+		goto out;
+
+	/* wait for I/O completion */
+	printd("Waiting for I/O completion...\n");
+	while (_mount_shfs_io_pending())
+		shfs_poll_blkdevs();
+	ret = _mount_shfs_finish();
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+/**
+ * Mount a SHFS volume in the background
+ * Only the volume configuration is read synchronously. The caller has to
+ * poll the block devices (shfs_poll_blkdevs()) and call
+ * mount_shfs_poll() until it returns a value <= 0
+ */
+int mount_shfs_start(blkdev_id_t bd_id[], unsigned int count)
+{
+	int ret;
+
+	down(&shfs_mount_lock);
+	ret = _mount_shfs_begin(bd_id, count);
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+/**
+ * Completes a mount that was started with mount_shfs_start()
+ * Returns 1 while the hash and checksum tables are still being loaded, 0 when the
+ * volume got mounted, and a negative error code when it failed
+ */
+int mount_shfs_poll(void)
+{
+	int ret;
+
+	if (!shfs_mount_pending)
+		return shfs_mounted ? 0 : -ENODEV;
+	if (!trydown(&shfs_mount_lock))
+		return 1; /* retried on next call */
+	if (_mount_shfs_io_pending())
+		ret = 1;
+	else
+		ret = _mount_shfs_finish();
 	up(&shfs_mount_lock);
 	return ret;
 }
@@ -660,8 +1004,20 @@ int umount_shfs(int force) {
 	unsigned int i;
 
 	down(&shfs_mount_lock);
+	if (shfs_mount_pending) {
+		/* complete a background mount first */
+		while (_mount_shfs_io_pending())
+			shfs_poll_blkdevs();
+		_mount_shfs_finish();
+	}
 	if (shfs_mounted) {
 #ifndef __KERNEL__
+#ifdef SHFS_WARMUP
+		shfs_warmup_stop(); /* releases its open file and cache buffers */
+#endif
+#ifdef SHFS_CSUM
+		shfs_scrub_stop(); /* waits for its reads */
+#endif
 		if (shfs_nb_open ||
 		    mempool_free_count(shfs_vol.aiotoken_pool) < MAX_REQUESTS ||
 		    shfs_cache_ref_count()) {
@@ -692,25 +1048,157 @@ int umount_shfs(int force) {
 #endif
 
 		shfs_mounted = 0;
-		target_free(shfs_vol.remount_chunk_buffer);
+		memacct_free(MEMT_SHFS, shfs_vol.remount_chunk_buffer, shfs_vol.chunksize);
 		for (i = 0; i < shfs_vol.htable_len; ++i) {
 			if (shfs_vol.htable_chunk_cache[i])
-				target_free(shfs_vol.htable_chunk_cache[i]);
+				memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache[i], shfs_vol.chunksize);
 		}
-		target_free(shfs_vol.htable_chunk_cache);
+		memacct_free(MEMT_HTCACHE, shfs_vol.htable_chunk_cache, sizeof(void *) * shfs_vol.htable_len);
 		shfs_free_btable(shfs_vol.bt);
+#ifdef SHFS_INGEST
+		shfs_free_alist(shfs_vol.al);
+		shfs_vol.al = NULL;
+#endif
+#ifdef SHFS_CSUM
+		free_vol_csums();
+#endif
 		free_mempool(shfs_vol.aiotoken_pool);
 		for(i = 0; i < shfs_vol.nb_members; ++i)
 			close_blkdev(shfs_vol.member[i].bd); /* might call schedule() */
 		shfs_vol.nb_members = 0;
 #ifdef SHFS_STATS
 		shfs_free_mstats();
+		shfs_free_hstats();
 #endif
 	}
 	up(&shfs_mount_lock);
 	return 0;
 }
 
+#ifndef __KERNEL__
+static inline int shfs_members_idle(void)
+{
+	register unsigned int i;
+
+	for (i = 0; i < shfs_vol.nb_members; ++i) {
+		if (blkdev_avail_req(shfs_vol.member[i].bd) != MAX_REQUESTS)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Prepares the volume for a suspend of the VM (e.g., live migration):
+ * in-flight I/O is completed and the member devices are detached.
+ * The in-memory state (hash table, chunk cache, statistics) is kept, so
+ * the cache is still hot after shfs_resume()
+ * Note: This function has to be called from the main loop: I/O completion
+ *  callbacks are processed but nobody else issues new requests meanwhile
+ */
+int shfs_suspend(unsigned int timeout_ms)
+{
+	uint64_t tend;
+	unsigned int i;
+	int ret = 0;
+
+	down(&shfs_mount_lock);
+	if ((!shfs_mounted && !shfs_mount_pending) || shfs_vol.detached)
+		goto out; /* nothing to do */
+
+	/* quiesce: wait for in-flight requests */
+	tend = target_now_ns() + ((uint64_t) timeout_ms * 1000000);
+	shfs_aio_submit();
+	while (!shfs_members_idle()) {
+		if (target_now_ns() >= tend) {
+			printd("Timeout while waiting for in-flight I/O\n");
+			ret = -EBUSY;
+			goto out;
+		}
+		shfs_poll_blkdevs();
+	}
+
+	for (i = 0; i < shfs_vol.nb_members; ++i) {
+		ret = blkdev_suspend(shfs_vol.member[i].bd);
+		if (ret < 0)
+			goto err_resume_members;
+	}
+	shfs_vol.detached = 1;
+	printd("SHFS volume detached\n");
+	goto out;
+
+ err_resume_members:
+	while (i--)
+		blkdev_resume(shfs_vol.member[i].bd);
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+/**
+ * Re-attaches the member devices after a suspend and checks that they
+ * still carry the volume members that were mounted before
+ * On errors, the volume stays detached (cached chunks are still served,
+ * I/O requests fail with ENODEV) and has to be unmounted
+ */
+int shfs_resume(void)
+{
+	struct shfs_hdr_common *hdr_common;
+	struct blkdev *bd;
+	void *chk0;
+	unsigned int i;
+	int ret = 0;
+
+	down(&shfs_mount_lock);
+	if (!shfs_vol.detached)
+		goto out;
+
+	chk0 = target_malloc(4096, 4096);
+	if (!chk0) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < shfs_vol.nb_members; ++i) {
+		bd = shfs_vol.member[i].bd;
+		ret = blkdev_resume(bd);
+		if (ret < 0) {
+			printd("Could not re-attach member %u: %d\n", i, ret);
+			goto out_free_chk0;
+		}
+
+		/* revalidate label */
+		ret = blkdev_sync_read(bd, 0, 4096 / blkdev_ssize(bd), chk0);
+		if (ret < 0) {
+			printd("Could not read label of member %u: %d\n", i, ret);
+			goto out_free_chk0;
+		}
+		hdr_common = (void *)((uint8_t *) chk0 + BOOT_AREA_LENGTH);
+		if (shfs_detect_hdr0(chk0) < 0 ||
+		    uuid_compare(hdr_common->vol_uuid, shfs_vol.uuid) != 0 ||
+		    uuid_compare(hdr_common->member_uuid, shfs_vol.member[i].uuid) != 0) {
+			printd("Member %u does not belong to the mounted volume anymore\n", i);
+			ret = -ENODEV;
+			goto out_free_chk0;
+		}
+#if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV
+		if (i == 0)
+			shfs_vol.members_maxfd = blkdev_get_fd(bd);
+		else
+			shfs_vol.members_maxfd = max(shfs_vol.members_maxfd,
+			                             blkdev_get_fd(bd));
+#endif
+	}
+	shfs_vol.detached = 0;
+	printd("SHFS volume re-attached\n");
+
+ out_free_chk0:
+	target_free(chk0);
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+#endif /* __KERNEL__ */
+
 /**
  * This function re-reads the hash table from the device
  * Since semaphores are used to sync with opened files,
@@ -719,7 +1207,7 @@ int umount_shfs(int force) {
  */
 static int reload_vol_htable(void) {
 #ifdef SHFS_STATS
-	struct shfs_el_stats *el_stats;
+	struct shfs_el_stats el_stats;
 #endif
 	struct shfs_bentry *bentry;
 	struct shfs_hentry *chentry;
@@ -771,25 +1259,23 @@ static int reload_vol_htable(void) {
 #ifdef SHFS_STATS
 					if (!chash_is_zero) {
 						/* move current stats to miss table */
-						el_stats = shfs_stats_from_mstats(chentry->hash);
-						if (likely(el_stats != NULL))
-							memcpy(el_stats, &bentry->hstats, sizeof(*el_stats));
+						shfs_stats_collect(bentry, &el_stats);
+						shfs_stats_mstats_store(chentry->hash, &el_stats);
 
 						/* reset stats of element */
-						memset(&bentry->hstats, 0, sizeof(*el_stats));
+						shfs_stats_set(bentry, NULL);
 		       			} else {
 						/* load stats from miss table */
-						el_stats = shfs_stats_from_mstats(nhentry->hash);
-						if (likely(el_stats != NULL))
-							memcpy(&bentry->hstats, el_stats, sizeof(*el_stats));
-						else
-							memset(&bentry->hstats, 0, sizeof(*el_stats));
+						shfs_stats_set(bentry, shfs_stats_mstats_lookup(nhentry->hash));
 
 						/* delete entry from miss stats */
 						shfs_stats_mstats_drop(nhentry->hash);
 					}
 #endif
 					memcpy(chentry, nhentry, sizeof(*chentry));
+#ifdef SHFS_CSUM
+					bentry->quarantine = 0;
+#endif
 
 					shfs_flush_cache();
 
@@ -821,6 +1307,9 @@ static int reload_vol_htable(void) {
 				down(&bentry->updatelock); /* wait until this file is closed */
 
 				memcpy(chentry, nhentry, sizeof(*chentry));
+#ifdef SHFS_CSUM
+				bentry->quarantine = 0;
+#endif
 
 				shfs_flush_cache(); /* to ensure re-reading this file */
 
@@ -842,6 +1331,32 @@ static int reload_vol_htable(void) {
 	return ret;
 }
 
+#ifdef SHFS_CSUM
+/**
+ * This function re-reads the chunk checksum table from the device
+ * Note: Has to be done before the hash table is reloaded, so that
+ *  checksums of new objects are known before these become visible
+ */
+static int reload_vol_csums(void) {
+	void *nchk_buf = shfs_vol.remount_chunk_buffer;
+	chk_t c;
+	int ret;
+
+	if (!shfs_vol.csum_tbl)
+		return 0;
+
+	printd("Re-reading chunk checksum table...\n");
+	for (c = 0; c < shfs_vol.csum_len; ++c) {
+		ret = shfs_read_chunk(shfs_vol.csum_ref + c, 1, nchk_buf); /* calls schedule() */
+		if (ret < 0)
+			return -EIO;
+		shfs_memcpy((uint8_t *) shfs_vol.csum_tbl + CHUNKS_TO_BYTES(c, shfs_vol.chunksize),
+		            nchk_buf, shfs_vol.chunksize);
+	}
+	return 0;
+}
+#endif
+
 /**
  * This function re-reads the hash table from the device
  * Since semaphores are used to sync with opened files,
@@ -859,7 +1374,24 @@ int remount_shfs(void) {
 
 	/* TODO: Re-read chunk0 and check if volume UUID still matches */
 
+#ifdef SHFS_INGEST
+	/* the allocation list would not cover reservations of
+	 * ongoing store operations after reloading */
+	if (shfs_vol.nb_ingest) {
+		ret = -EBUSY;
+		goto out;
+	}
+#endif
+#ifdef SHFS_CSUM
+	ret = reload_vol_csums();
+	if (ret < 0)
+		goto out;
+#endif
 	ret = reload_vol_htable();
+#ifdef SHFS_INGEST
+	shfs_free_alist(shfs_vol.al);
+	load_vol_alist();
+#endif
  out:
 	up(&shfs_mount_lock);
 	return ret;
@@ -914,7 +1446,7 @@ SHFS_AIO_TOKEN *shfs_aio_chunk(chk_t start, chk_t len, int write, void *buffer,
 	strp_t strp;
 
 
-	if (!shfs_mounted) {
+	if ((!shfs_mounted && !shfs_mount_pending) || shfs_vol.detached) {
 		errno = ENODEV;
 		goto err_out;
 	}
@@ -979,3 +1511,93 @@ SHFS_AIO_TOKEN *shfs_aio_chunk(chk_t start, chk_t len, int write, void *buffer,
  err_out:
 	return NULL;
 }
+
+SHFS_AIO_TOKEN *shfs_aio_subchunk(chk_t chk, uint32_t off, uint32_t len, int write, void *buffer,
+                                  shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp)
+{
+	int ret;
+	uint32_t first, last, s;
+	uint32_t s_off, s_len;
+	sector_t start_sec, ssize;
+	unsigned int m;
+	uint8_t *ptr = buffer;
+	SHFS_AIO_TOKEN *t;
+	strp_t start_s;
+	strp_t strp;
+
+	if ((!shfs_mounted && !shfs_mount_pending) || shfs_vol.detached) {
+		errno = ENODEV;
+		goto err_out;
+	}
+	if (unlikely(len == 0 || off + len > shfs_vol.chunksize ||
+		     (off | len) & (shfs_vol.ioalign - 1))) {
+		errno = EINVAL;
+		goto err_out;
+	}
+
+	switch (shfs_vol.stripemode) {
+	case SHFS_SM_COMBINED:
+		start_s = (strp_t) chk * (strp_t) shfs_vol.nb_members;
+		break;
+	case SHFS_SM_INDEPENDENT:
+	default:
+		start_s = (strp_t) chk + (strp_t) (shfs_vol.nb_members - 1);
+		break;
+	}
+	/* stripes of the chunk that are touched by the range
+	 * Note: each of them is located on a different member */
+	first = off / shfs_vol.stripesize;
+	last = (off + len - 1) / shfs_vol.stripesize;
+
+	/* check if each touched member has a request object available */
+	for (s = first; s <= last; ++s) {
+		m = (start_s + s) % shfs_vol.nb_members;
+		if (blkdev_avail_req(shfs_vol.member[m].bd) < 1) {
+			errno = EAGAIN;
+			goto err_out;
+		}
+	}
+
+	/* pick token */
+	t = shfs_aio_pick_token();
+	if (!t) {
+		errno = EAGAIN;
+		goto err_out;
+	}
+	t->cb = cb;
+	t->cb_argp = cb_argp;
+	t->cb_cookie = cb_cookie;
+
+	/* setup requests */
+	for (s = first; s <= last; ++s) {
+		strp = start_s + s;
+		m = strp % shfs_vol.nb_members;
+		ssize = shfs_vol.stripesize / shfs_vol.member[m].sfactor;
+		s_off = (s == first) ? (off % shfs_vol.stripesize) : 0;
+		s_len = min(shfs_vol.stripesize - s_off,
+			    (off + len) - (s * shfs_vol.stripesize + s_off));
+		start_sec = (strp / shfs_vol.nb_members) * shfs_vol.member[m].sfactor
+			    + (s_off / ssize);
+
+		printd("Request: member=%u, start=%"PRIsctr"s, len=%"PRIsctr"s, dataptr=@%p\n",
+		        m, start_sec, (sector_t) (s_len / ssize), ptr);
+		ret = blkdev_async_io(shfs_vol.member[m].bd, start_sec, s_len / ssize,
+		                      write, ptr, _shfs_aio_cb, t);
+		if (unlikely(ret < 0)) {
+			t->cb = NULL; /* erase callback */
+			printd("Error while setting up async I/O request for member %u: %d. "
+				"Cancelling request...\n", m, ret);
+			shfs_aio_wait(t);
+			errno = -ret;
+			goto err_free_token;
+		}
+		++t->infly;
+		ptr += s_len;
+	}
+	return t;
+
+ err_free_token:
+	shfs_aio_put_token(t);
+ err_out:
+	return NULL;
+}
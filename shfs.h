@@ -73,11 +73,15 @@
 #define LINUX_FIRST_INO_N 10
 
 struct shfs_cache;
+struct shfs_alist;
 
 struct vol_member {
 	struct blkdev *bd;
 	uuid_t uuid;
 	sector_t sfactor;
+#ifdef SHFS_INGEST
+	int writable;
+#endif
 };
 
 struct vol_info {
@@ -95,6 +99,7 @@ struct vol_info {
 #if defined CONFIG_SELECT_POLL && defined CAN_POLL_BLKDEV
 	int members_maxfd; /* biggest fd number of mounted members (required for select()) */
 #endif
+	int detached; /* members are detached (suspend), no I/O possible */
 
 	struct htable *bt; /* SHFS bucket entry table */
 	void **htable_chunk_cache;
@@ -110,27 +115,51 @@ struct vol_info {
 
 	struct shfs_bentry *def_bentry;
 
+#ifdef SHFS_INGEST
+	uint8_t hfunc;
+	uint8_t allocator;
+	int writable; /* all members were opened for writing */
+	struct shfs_alist *al; /* allocation list of volume areas (NULL: read-only) */
+	unsigned int nb_ingest; /* store/remove operations in progress */
+#endif
+
+#ifdef SHFS_CSUM
+	chk_t csum_ref; /* 0: volume has no checksum area */
+	chk_t csum_len;
+	uint8_t csum_type;
+	uint32_t *csum_tbl; /* chunk checksums (NULL: not verified) */
+#endif
+
 	struct mempool *aiotoken_pool; /* token for async I/O */
 	struct shfs_cache *chunkcache; /* chunkcache */
 
 #ifdef SHFS_STATS
 	struct shfs_mstats mstats;
+	struct shfs_el_stats *hstats[SHFS_STATS_NB_SHARDS];
 #endif
 };
 
 extern struct vol_info shfs_vol;
 extern sem_t shfs_mount_lock;
 extern int shfs_mounted;
+extern int shfs_mount_pending; /* background mount is loading the hash table */
 extern unsigned int shfs_nb_open;
 
 int init_shfs(void);
 int mount_shfs(blkdev_id_t bd_id[], unsigned int count);
+int mount_shfs_start(blkdev_id_t bd_id[], unsigned int count);
+int mount_shfs_poll(void);
 int remount_shfs(void);
 int umount_shfs(int force);
+#ifndef __KERNEL__
+int shfs_suspend(unsigned int timeout_ms);
+int shfs_resume(void);
+#endif
 void exit_shfs(void);
 
 #define shfs_blkdevs_count() \
-	((shfs_mounted) ? shfs_vol.nb_members : 0)
+	(((shfs_mounted || shfs_mount_pending) && !shfs_vol.detached) ? \
+	 shfs_vol.nb_members : 0)
 
 static inline void shfs_poll_blkdevs(void) {
 	register unsigned int i;
@@ -203,6 +232,15 @@ SHFS_AIO_TOKEN *shfs_aio_chunk(chk_t start, chk_t len, int write, void *buffer,
 #define shfs_awrite_chunk(start, len, buffer, cb, cb_cookie, cb_argp) \
 	shfs_aio_chunk((start), (len), 1, (buffer), (cb), (cb_cookie), (cb_argp))
 
+/*
+ * Like shfs_aio_chunk() but operates on a byte range of a single chunk only
+ * Note: off and len have to be multiples of shfs_vol.ioalign
+ */
+SHFS_AIO_TOKEN *shfs_aio_subchunk(chk_t chk, uint32_t off, uint32_t len, int write, void *buffer,
+                                  shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp);
+#define shfs_aread_subchunk(chk, off, len, buffer, cb, cb_cookie, cb_argp) \
+	shfs_aio_subchunk((chk), (off), (len), 0, (buffer), (cb), (cb_cookie), (cb_argp))
+
 static inline void shfs_aio_submit(void) {
 #ifndef __KERNEL__
 	register unsigned int i;
@@ -0,0 +1,250 @@
+/*
+ * Volume area allocator for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#include <target/sys.h>
+#include <errno.h>
+
+#include "shfs_alloc.h"
+#include "memacct.h"
+
+struct shfs_alist *shfs_alloc_alist(chk_t area_size, uint8_t allocator)
+{
+	struct shfs_alist *alist;
+
+	if (allocator != SALLOC_FIRSTFIT &&
+	    allocator != SALLOC_BESTFIT) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	alist = memacct_malloc(MEMT_SHFS, sizeof(void *), sizeof(*alist));
+	if (!alist) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	alist->head = NULL;
+	alist->tail = NULL;
+	alist->count = 0;
+	alist->end = area_size;
+	alist->allocator = allocator;
+	return alist;
+}
+
+void shfs_free_alist(struct shfs_alist *al)
+{
+	struct shfs_aentry *cur;
+	struct shfs_aentry *next;
+
+	if (al) {
+		cur = al->head;
+		while (cur) {
+			next = cur->next;
+			memacct_free(MEMT_SHFS, cur, sizeof(*cur));
+			cur = next;
+		}
+
+		memacct_free(MEMT_SHFS, al, sizeof(*al));
+	}
+}
+
+int shfs_alist_register(struct shfs_alist *al, chk_t start, chk_t len)
+{
+	struct shfs_aentry *e;
+	struct shfs_aentry *prev;
+	struct shfs_aentry *next;
+	struct shfs_aentry *new;
+
+	new = memacct_malloc(MEMT_SHFS, sizeof(void *), sizeof(*new));
+	if (!new)
+		return -ENOMEM;
+	new->start = start;
+	new->end = (start + len);
+
+	if (!al->head) {
+		/* list is empty */
+		al->head = new;
+		al->tail = new;
+		new->prev = NULL;
+		new->next = NULL;
+	} else {
+		/* search for predecessor which has start <= new->start  */
+		prev = NULL;
+		next = NULL;
+		for (e = al->head; e != NULL; e = e->next) {
+			if (e->start <= start) {
+				prev = e;
+				continue;
+			} else {
+				next = e;
+				break;
+			}
+		}
+
+		new->prev = prev;
+		new->next = next;
+		if (prev)
+			prev->next = new;
+		else
+			al->head = new;
+		if (next)
+			next->prev = new;
+		else
+			al->tail = new;
+	}
+
+	al->count++;
+	return 0;
+}
+
+int shfs_alist_unregister(struct shfs_alist *al, chk_t start, chk_t len)
+{
+	struct shfs_aentry *e;
+	chk_t end = (start + len);
+
+	/* search for element in the list and remove it if found */
+	for (e = al->head; e != NULL; e = e->next) {
+		if (e->start == start &&
+		    e->end == end) {
+			if (e->prev)
+				e->prev->next = e->next;
+			else
+				al->head = e->next;
+			if (e->next)
+				e->next->prev = e->prev;
+			else
+				al->tail = e->prev;
+			memacct_free(MEMT_SHFS, e, sizeof(*e));
+			al->count--;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Iterates over the free space segments of the list:
+ *  *e has to be initialized with al->head, the segment
+ *  [*free_start, *free_end) is returned. Returns 0 when
+ *  there are no further segments
+ */
+static inline int _shfs_alist_next_free(struct shfs_alist *al, struct shfs_aentry **e,
+					chk_t *free_start, chk_t *free_end)
+{
+	struct shfs_aentry *cur = *e;
+
+	if (!cur)
+		return 0;
+
+	/* find actual start and end of a free space segment */
+	*free_start = cur->end;
+	while (cur->next &&
+	       cur->next->start <= *free_start) {
+		if (cur->next->end > *free_start)
+			*free_start = cur->next->end;
+		cur = cur->next;
+	}
+
+	if (cur->next)
+		*free_end = cur->next->start;
+	else
+		*free_end = al->end;
+	*e = cur->next;
+	return 1;
+}
+
+static chk_t _shfs_alist_find_ff(struct shfs_alist *al, chk_t len)
+{
+	struct shfs_aentry *e = al->head;
+	chk_t free_start, free_end;
+
+	while (_shfs_alist_next_free(al, &e, &free_start, &free_end)) {
+		/* free_start and free_end points now to a free space segment */
+		if (free_end > free_start &&
+		    free_end - free_start >= len)
+			return free_start;
+	}
+
+	return 0;
+}
+
+static chk_t _shfs_alist_find_bf(struct shfs_alist *al, chk_t len)
+{
+	struct shfs_aentry *e = al->head;
+	chk_t free_start, free_end;
+	chk_t best = 0;
+	chk_t best_len = 0;
+
+	while (_shfs_alist_next_free(al, &e, &free_start, &free_end)) {
+		/* pick the smallest segment that fits */
+		if (free_end > free_start &&
+		    free_end - free_start >= len &&
+		    (!best || free_end - free_start < best_len)) {
+			best = free_start;
+			best_len = free_end - free_start;
+			if (best_len == len)
+				break; /* perfect fit */
+		}
+	}
+
+	return best;
+}
+
+chk_t shfs_alist_find_free(struct shfs_alist *al, chk_t len)
+{
+	switch (al->allocator) {
+	case SALLOC_FIRSTFIT:
+		return _shfs_alist_find_ff(al, len);
+	case SALLOC_BESTFIT:
+		return _shfs_alist_find_bf(al, len);
+	default:
+		break;
+	}
+	return 0;
+}
+
+chk_t shfs_alist_free_chunks(struct shfs_alist *al)
+{
+	struct shfs_aentry *e = al->head;
+	chk_t free_start, free_end;
+	chk_t total = 0;
+
+	while (_shfs_alist_next_free(al, &e, &free_start, &free_end)) {
+		if (free_end > free_start)
+			total += free_end - free_start;
+	}
+	return total;
+}
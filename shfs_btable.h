@@ -72,9 +72,12 @@ struct shfs_bentry {
 	uint32_t refcount;
 	sem_t updatelock; /* lock is helt as long the file is opened */
 	int update; /* is set when a entry update is ongoing */
+#ifdef SHFS_CSUM
+	int quarantine; /* contents failed checksum verification */
+#endif
 
 #ifdef SHFS_STATS
-	struct shfs_el_stats hstats;
+	uint32_t stats_idx; /* index to element stats (see shfs_stats_data.h) */
 #endif /* SHFS_STATS */
 
 	void *cookie; /* shfs_fio: upper layer software can attach cookies to open files */
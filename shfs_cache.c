@@ -37,6 +37,11 @@
 
 #include "shfs_cache.h"
 #include "likely.h"
+#include "trace.h"
+#include "memacct.h"
+#ifdef SHFS_CSUM
+#include "shfs_csum.h"
+#endif
 
 #if (defined SHFS_CACHE_DEBUG || defined SHFS_DEBUG)
 #define ENABLE_DEBUG
@@ -61,11 +66,13 @@
 	((size_t) 0)
 #endif /* __MINIOS__ */
 
-static void _cce_pobj_init(struct mempool_obj *pobj, void *unused)
+static void _cce_pobj_init(struct mempool_obj *pobj, void *len)
 {
     struct shfs_cache_entry *cce = pobj->private;
 
     cce->pobj = pobj;
+    cce->off = 0;
+    cce->len = (uint32_t) (uintptr_t) len;
     cce->refcount = 0;
     cce->buffer = pobj->data;
     cce->invalid = 1; /* buffer is not ready yet */
@@ -124,11 +131,48 @@ int shfs_alloc_cache(void)
     htlen   = 1 << shfs_htcollison_order();
 
     cc_size = sizeof(*cc) + (htlen * sizeof(struct shfs_cache_htel));
-    cc = target_malloc(MIN_ALIGN, cc_size);
+    cc = memacct_malloc(MEMT_CHUNKCACHE, MIN_ALIGN, cc_size);
     if (!cc) {
 	    ret = -ENOMEM;
 	    goto err_out;
     }
+
+    /* sub-chunk buffers: sector groups have to be multiples of the
+     * I/O alignment and a chunk has to consist of several of them
+     * Note: they are allocated first, so that a pool that covers the
+     * left memory (SHFS_CACHE_POOL_MAXALLOC) still keeps its threshold */
+    cc->spool = NULL;
+    cc->subchk_size = 0;
+    cc->subchk_shift = 0;
+#if (SHFS_CACHE_SUBCHK_SIZE > 0) && (SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS > 0)
+    if ((SHFS_CACHE_SUBCHK_SIZE % shfs_vol.ioalign) == 0 &&
+	(shfs_vol.chunksize % SHFS_CACHE_SUBCHK_SIZE) == 0 &&
+#ifdef SHFS_CSUM
+	/* checksums cover whole chunks: sub-chunk fills could not be
+	 * verified, so they are not used while the table is loaded */
+	!shfs_vol.csum_tbl &&
+#endif
+	shfs_vol.chunksize > SHFS_CACHE_SUBCHK_SIZE) {
+	    cc->spool = alloc_enhanced_mempool(MEMT_CHUNKCACHE, SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS,
+					       SHFS_CACHE_SUBCHK_SIZE,
+					       shfs_vol.ioalign,
+					       0,
+					       0,
+					       sizeof(struct shfs_cache_entry),
+					       1,
+					       NULL, NULL,
+					       _cce_pobj_init, (void *) (uintptr_t) SHFS_CACHE_SUBCHK_SIZE,
+					       NULL, NULL);
+	    if (!cc->spool) {
+		    printd("Could not allocate sub-chunk cache pool\n");
+		    ret = -ENOMEM;
+		    goto err_free_spool;
+	    }
+	    cc->subchk_size = SHFS_CACHE_SUBCHK_SIZE;
+	    cc->subchk_shift = log2(SHFS_CACHE_SUBCHK_SIZE);
+    }
+#endif
+
 #if defined SHFS_CACHE_GROW && !defined SHFS_CACHE_POOL_MAXALLOC
     if (SHFS_CACHE_POOL_NB_BUFFERS) {
 #endif
@@ -140,7 +184,7 @@ int shfs_alloc_cache(void)
 															  * it seems that the page allocator on arm still returns 
 															  * memory even if the allocation failed! -> crash on pool access */
 #endif
-      cc->pool = alloc_enhanced_mempool2(pool_size,
+      cc->pool = alloc_enhanced_mempool2(MEMT_CHUNKCACHE, pool_size,
 					 shfs_vol.chunksize,
 					 shfs_vol.ioalign,
 					 0,
@@ -148,10 +192,10 @@ int shfs_alloc_cache(void)
 					 sizeof(struct shfs_cache_entry),
 					 1,
 					 NULL, NULL,
-					 _cce_pobj_init, NULL,
+					 _cce_pobj_init, (void *) (uintptr_t) shfs_vol.chunksize,
 					 NULL, NULL);
 #else
-    cc->pool = alloc_enhanced_mempool(SHFS_CACHE_POOL_NB_BUFFERS,
+    cc->pool = alloc_enhanced_mempool(MEMT_CHUNKCACHE, SHFS_CACHE_POOL_NB_BUFFERS,
 				      shfs_vol.chunksize,
 				      shfs_vol.ioalign,
 				      0,
@@ -159,49 +203,74 @@ int shfs_alloc_cache(void)
 				      sizeof(struct shfs_cache_entry),
 				      1,
 				      NULL, NULL,
-				      _cce_pobj_init, NULL,
+				      _cce_pobj_init, (void *) (uintptr_t) shfs_vol.chunksize,
 				      NULL, NULL);
 #endif /* SHFS_CACHE_POOL_MAXALLOC */
     if (!cc->pool) {
 	    printd("Could not allocate cache pool\n");
 	    ret = -ENOMEM;
-	    goto err_free_cc;
+	    goto err_free_spool;
     }
 #if defined SHFS_CACHE_GROW && !defined SHFS_CACHE_POOL_MAXALLOC
     } else {
 	    cc->pool = NULL;
     }
 #endif
+
     dlist_init_head(cc->alist);
+    dlist_init_head(cc->salist);
     for (i = 0; i < htlen; ++i)
 	    dlist_init_head(cc->htable[i].clist);
     cc->htlen = htlen;
     cc->htmask = htlen - 1;
     cc->nb_entries = 0;
+    cc->nb_sentries = 0;
     cc->nb_ref_entries = 0;
 
     shfs_vol.chunkcache = cc;
     shfs_cache_stats_reset();
     return 0;
 
- err_free_cc:
-    target_free(cc);
+ err_free_spool:
+    if (cc->spool)
+	    free_mempool(cc->spool);
+    memacct_free(MEMT_CHUNKCACHE, cc, cc_size);
  err_out:
     return ret;
 }
 
-#define shfs_cache_htindex(addr) \
-	(((uint32_t) (addr)) & (shfs_vol.chunkcache->htmask))
+/* Note: sub-chunk entries of a chunk are spread over the table */
+#define shfs_cache_htindex(addr, off) \
+	((((uint32_t) (addr)) + ((off) >> shfs_vol.chunkcache->subchk_shift)) \
+	 & (shfs_vol.chunkcache->htmask))
+
+#define shfs_cache_is_sub(cce) \
+	((cce)->len != shfs_vol.chunksize)
+
+/* available list of an entry type */
+#define shfs_cache_alist(sub) \
+	(*((sub) ? &shfs_vol.chunkcache->salist : &shfs_vol.chunkcache->alist))
 
-static inline struct shfs_cache_entry *shfs_cache_pick_cce(void) {
+static inline struct shfs_cache_entry *shfs_cache_pick_cce(int sub) {
     struct mempool_obj *cce_obj;
 #ifdef SHFS_CACHE_GROW
     struct shfs_cache_entry *cce;
     void *buf;
+#endif
+
+    /* Note: failures are accounted by the callers when eviction failed, too */
+    if (sub) {
+	cce_obj = mempool_trypick(shfs_vol.chunkcache->spool);
+	if (!cce_obj)
+	    return NULL;
+	++shfs_vol.chunkcache->nb_sentries;
+	return (struct shfs_cache_entry *) cce_obj->private;
+    }
 
+#ifdef SHFS_CACHE_GROW
     if (shfs_vol.chunkcache->pool) {
 #endif
-    cce_obj = mempool_pick(shfs_vol.chunkcache->pool);
+    cce_obj = mempool_trypick(shfs_vol.chunkcache->pool);
     if (cce_obj) {
 	/* got a new buffer */
 	++shfs_vol.chunkcache->nb_entries;
@@ -215,16 +284,18 @@ static inline struct shfs_cache_entry *shfs_cache_pick_cce(void) {
 	return NULL;
 #endif
     /* try to malloc a buffer from heap */
-    buf = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
+    buf = memacct_malloc(MEMT_CHUNKCACHE, shfs_vol.ioalign, shfs_vol.chunksize);
     if (!buf) {
 	return NULL;
     }
-    cce = target_malloc(MIN_ALIGN, sizeof(*cce));
+    cce = memacct_malloc(MEMT_CHUNKCACHE, MIN_ALIGN, sizeof(*cce));
     if (!cce) {
-	target_free(buf);
+	memacct_free(MEMT_CHUNKCACHE, buf, shfs_vol.chunksize);
 	return NULL;
     }
     cce->pobj = NULL;
+    cce->off = 0;
+    cce->len = shfs_vol.chunksize;
     cce->refcount = 0;
     cce->buffer = buf;
     cce->invalid = 1; /* buffer is not ready yet */
@@ -238,32 +309,42 @@ static inline struct shfs_cache_entry *shfs_cache_pick_cce(void) {
 #endif
 }
 
-#ifdef SHFS_CACHE_GROW
+/* accounts a failed pick: neither a free nor an evictable entry was found */
+static inline void shfs_cache_pick_fail(int sub) {
+    struct mempool *p = sub ? shfs_vol.chunkcache->spool : shfs_vol.chunkcache->pool;
+
+    if (p)
+	mempool_acct_fail(p);
+}
+
 static inline void shfs_cache_put_cce(struct shfs_cache_entry *cce) {
+	if (shfs_cache_is_sub(cce)) {
+		mempool_put(cce->pobj);
+		--shfs_vol.chunkcache->nb_sentries;
+		return;
+	}
+#ifdef SHFS_CACHE_GROW
 	if (!cce->pobj) {
-		target_free(cce->buffer);
-		target_free(cce);
+		memacct_free(MEMT_CHUNKCACHE, cce->buffer, shfs_vol.chunksize);
+		memacct_free(MEMT_CHUNKCACHE, cce, sizeof(*cce));
 	} else {
 		mempool_put(cce->pobj);
 	}
-	--shfs_vol.chunkcache->nb_entries;
-}
 #else
-#define shfs_cache_put_cce(cce) \
-	do { \
-		mempool_put((cce)->pobj); \
-		--shfs_vol.chunkcache->nb_entries; \
-	} while(0)
+	mempool_put(cce->pobj);
 #endif
+	--shfs_vol.chunkcache->nb_entries;
+}
 
-static inline struct shfs_cache_entry *shfs_cache_find(chk_t addr)
+/* looks up a chunk entry (off = 0, len = chunksize) or a sub-chunk entry */
+static inline struct shfs_cache_entry *shfs_cache_find(chk_t addr, uint32_t off, uint32_t len)
 {
     struct shfs_cache_entry *cce;
     register uint32_t i;
 
-    i = shfs_cache_htindex(addr);
+    i = shfs_cache_htindex(addr, off);
     dlist_foreach(cce, shfs_vol.chunkcache->htable[i].clist, clist) {
-        if (cce->addr == addr) {
+        if (cce->addr == addr && cce->off == off && cce->len == len) {
 	    /* re-link element to the head of the list for faster successive lookups */
 	    dlist_relink_head(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 
@@ -285,21 +366,22 @@ static inline void shfs_cache_unlink(struct shfs_cache_entry *cce)
 
 #ifndef SHFS_CACHE_DISABLE
     /* unlink element from hash table collision list */
-    i = shfs_cache_htindex(cce->addr);
+    i = shfs_cache_htindex(cce->addr, cce->off);
     dlist_unlink(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 #endif /* SHFS_CACHE_DISABLE */
 
     /* unlink element from available list */
-    dlist_unlink(cce, shfs_vol.chunkcache->alist, alist);
+    dlist_unlink(cce, shfs_cache_alist(shfs_cache_is_sub(cce)), alist);
 }
 
-/* put unreferenced buffers back to the pool */
-static inline void shfs_cache_flush_alist(void)
+/* put up to max unreferenced buffers of an available list back to the pool */
+static inline uint32_t _shfs_cache_flush_alist(int sub, uint32_t max)
 {
     struct shfs_cache_entry *cce;
+    uint32_t n = 0;
 
-    printd("Flushing cache...\n");
-    while ((cce = dlist_first_el(shfs_vol.chunkcache->alist, struct shfs_cache_entry)) != NULL) {
+    while (n < max &&
+	   (cce = dlist_first_el(shfs_cache_alist(sub), struct shfs_cache_entry)) != NULL) {
 	    if (cce->t) {
 		    printd("I/O of chunk buffer %llu is not done yet, "
 		            "waiting for completion...\n", cce->addr);
@@ -318,20 +400,79 @@ static inline void shfs_cache_flush_alist(void)
 	    printd("Releasing chunk buffer %llu...\n", cce->addr);
 	    shfs_cache_unlink(cce); /* unlinks element from alist and clist */
 	    shfs_cache_put_cce(cce);
+	    ++n;
     }
+    return n;
+}
+
+static inline uint32_t shfs_cache_flush_alist(uint32_t max)
+{
+    uint32_t n;
+
+    printd("Flushing cache...\n");
+    n = _shfs_cache_flush_alist(1, max);
+    if (n < max)
+	n += _shfs_cache_flush_alist(0, max - n);
+    return n;
 }
 
 void shfs_flush_cache(void)
 {
-    shfs_cache_flush_alist();
+    shfs_cache_flush_alist(UINT32_MAX);
+}
+
+uint32_t shfs_flush_cache_n(uint32_t max)
+{
+    return shfs_cache_flush_alist(max);
+}
+
+static inline uint32_t _shfs_cache_invalidate_alist(int sub, chk_t start, chk_t end)
+{
+    struct shfs_cache_entry *cce;
+    struct shfs_cache_entry *cce_next;
+    uint32_t n = 0;
+
+    cce = dlist_first_el(shfs_cache_alist(sub), struct shfs_cache_entry);
+    while (cce) {
+	    cce_next = dlist_next_el(cce, alist);
+	    if (cce->addr >= start && cce->addr < end) {
+		    if (cce->t) {
+			    /* see _shfs_cache_flush_alist() */
+			    cce->refcount = 1;
+			    while (cce->t)
+				    shfs_poll_blkdevs();
+			    cce->refcount = 0;
+			    cce_next = dlist_next_el(cce, alist);
+		    }
+
+		    printd("Invalidating chunk buffer %llu...\n", cce->addr);
+		    shfs_cache_unlink(cce);
+		    shfs_cache_put_cce(cce);
+		    ++n;
+	    }
+	    cce = cce_next;
+    }
+    return n;
+}
+
+uint32_t shfs_cache_invalidate(chk_t start, chk_t len)
+{
+    uint32_t n;
+
+    n  = _shfs_cache_invalidate_alist(1, start, start + len);
+    n += _shfs_cache_invalidate_alist(0, start, start + len);
+    return n;
 }
 
 void shfs_free_cache(void)
 {
-    shfs_cache_flush_alist();
+    shfs_cache_flush_alist(UINT32_MAX);
+    if (shfs_vol.chunkcache->spool)
+	free_mempool(shfs_vol.chunkcache->spool);
     free_mempool(shfs_vol.chunkcache->pool); /* will fail with an assertion
                                               * if objects were not put back to the pool already */
-    target_free(shfs_vol.chunkcache);
+    memacct_free(MEMT_CHUNKCACHE, shfs_vol.chunkcache,
+		 sizeof(*shfs_vol.chunkcache) + (shfs_vol.chunkcache->htlen * sizeof(struct shfs_cache_htel)));
     shfs_vol.chunkcache = NULL;
 }
 
@@ -346,8 +487,22 @@ static void _cce_aiocb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
 
     ret = shfs_aio_finalize(t);
     cce->t = NULL;
+#ifdef SHFS_CSUM
+    /* verify chunks before they get served
+     * Note: there are no sub-chunk entries while checksums are loaded */
+    if (likely(ret >= 0) && shfs_vol.csum_tbl) {
+	if (unlikely(shfs_csum_verify(cce->addr, cce->buffer) < 0)) {
+	    shfs_csum_stat_inc(failed);
+	    shfs_csum_quarantine(cce->addr);
+	    ret = -EIO;
+	} else {
+	    shfs_csum_stat_inc(verified);
+	}
+    }
+#endif
     cce->invalid = (ret < 0) ? 1 : 0;
     printd("Cache I/O at chunk %"PRIchk" returned: %d\n", cce->addr, ret);
+    trace_aio_done(cce->addr, ret);
 
     if (cce->invalid)
 	shfs_cache_stat_inc(ioerr);
@@ -387,33 +542,36 @@ static void _cce_aiocb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
     }
 }
 
-static inline struct shfs_cache_entry *shfs_cache_add(chk_t addr)
+static inline struct shfs_cache_entry *shfs_cache_add(chk_t addr, uint32_t off, uint32_t len)
 {
     struct shfs_cache_entry *cce;
     register uint32_t i;
+    int sub = (len != shfs_vol.chunksize);
 
-    cce = shfs_cache_pick_cce();
+    cce = shfs_cache_pick_cce(sub);
     if (cce) {
 	/* got a new buffer: append it to alist */
-	dlist_append(cce, shfs_vol.chunkcache->alist, alist);
+	dlist_append(cce, shfs_cache_alist(sub), alist);
     } else {
 #ifndef SHFS_CACHE_DISABLE
 	/* try to pick a buffer (that has completed I/O) from the available list */
-	dlist_foreach(cce, shfs_vol.chunkcache->alist, alist) {
+	dlist_foreach(cce, shfs_cache_alist(sub), alist) {
 		if (cce->t == NULL)
 			goto found;
 	}
 	/* we are out of buffers */
+	shfs_cache_pick_fail(sub);
 	errno = EAGAIN;
 	return NULL;
 
     found:
 	shfs_cache_stat_inc(evict);
+	trace_cache_evict(cce->addr);
 	/* unlink from hash table */
-	i = shfs_cache_htindex(cce->addr);
+	i = shfs_cache_htindex(cce->addr, cce->off);
 	dlist_unlink(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 	/* move entry to the tail of alist */
-	dlist_relink_tail(cce, shfs_vol.chunkcache->alist, alist);
+	dlist_relink_tail(cce, shfs_cache_alist(sub), alist);
 #else /* SHFS_CACHE_DISABLE */
 	errno = EAGAIN;
 	return NULL;
@@ -421,18 +579,24 @@ static inline struct shfs_cache_entry *shfs_cache_add(chk_t addr)
     }
 
     cce->addr = addr;
-    cce->t = shfs_aread_chunk(addr, 1, cce->buffer,
-                              _cce_aiocb, cce, NULL);
+    cce->off = off;
+    if (sub)
+	cce->t = shfs_aread_subchunk(addr, off, len, cce->buffer,
+				     _cce_aiocb, cce, NULL);
+    else
+	cce->t = shfs_aread_chunk(addr, 1, cce->buffer,
+				  _cce_aiocb, cce, NULL);
     if (unlikely(!cce->t)) {
-	    dlist_unlink(cce, shfs_vol.chunkcache->alist, alist);
+	    dlist_unlink(cce, shfs_cache_alist(sub), alist);
 	    shfs_cache_put_cce(cce);
 	    printd("Could not initiate I/O request for chunk %"PRIchk": %d\n", addr, errno);
 	    return NULL;
     }
+    trace_aio_submit(addr);
 
 #ifndef SHFS_CACHE_DISABLE
     /* link element to hash table */
-    i = shfs_cache_htindex(addr);
+    i = shfs_cache_htindex(addr, off);
     dlist_append(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 #endif /* SHFS_CACHE_DISABLE */
 
@@ -450,9 +614,9 @@ static inline void shfs_cache_readahead(chk_t addr)
 
 		if (unlikely((addri) >= shfs_vol.volsize))
 			return; /* end of volume */
-		cce = shfs_cache_find(addri);
+		cce = shfs_cache_find(addri, 0, shfs_vol.chunksize);
 		if (!cce) {
-			cce = shfs_cache_add(addri);
+			cce = shfs_cache_add(addri, 0, shfs_vol.chunksize);
 			if (!cce) {
 				printd("Read-ahead chunk %"PRIchk" (%u/%u): Failed: Out of buffers\n", (addri), i, SHFS_CACHE_READAHEAD);
 				shfs_cache_stat_inc(memerr);
@@ -472,10 +636,13 @@ static inline void shfs_cache_readahead(chk_t addr)
 }
 #endif
 
-int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
+static inline int _shfs_cache_aread(chk_t addr, uint32_t off, uint32_t len,
+				    shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp,
+				    struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
 {
     struct shfs_cache_entry *cce;
     SHFS_AIO_TOKEN *t;
+    int sub = (len != shfs_vol.chunksize);
     int ret;
 
     ASSERT(cce_out != NULL);
@@ -493,13 +660,14 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
 
     /* check if we cached already this request */
 #ifndef SHFS_CACHE_DISABLE
-    cce = shfs_cache_find(addr);
+    cce = shfs_cache_find(addr, off, len);
     if (!cce) {
         shfs_cache_stat_inc(miss);
+        trace_cache_miss(addr);
 #endif /* SHFS_CACHE_DISABLE */
         /* no -> initiate a new I/O request */
-        printd("Try to add chunk %"PRIchk" to cache\n", addr);
-	cce = shfs_cache_add(addr);
+        printd("Try to add chunk %"PRIchk" (%"PRIu32"-%"PRIu32") to cache\n", addr, off, off + len);
+	cce = shfs_cache_add(addr, off, len);
 	if (!cce) {
 	    ret = -errno;
 	    goto err_out;
@@ -510,7 +678,7 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
 
     /* increase refcount */
     if (cce->refcount == 0) {
-	dlist_unlink(cce, shfs_vol.chunkcache->alist, alist);
+	dlist_unlink(cce, shfs_cache_alist(sub), alist);
 	++shfs_vol.chunkcache->nb_ref_entries;
     }
     ++cce->refcount;
@@ -518,7 +686,8 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
 #ifndef SHFS_CACHE_DISABLE
 #if (SHFS_CACHE_READAHEAD > 0)
     /* try to read ahead next addresses */
-    shfs_cache_readahead(addr);
+    if (!sub)
+	shfs_cache_readahead(addr);
 #endif
 #endif /* SHFS_CACHE_DISABLE */
     shfs_aio_submit();
@@ -530,6 +699,7 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
         *t_out = NULL;
         *cce_out = cce;
         shfs_cache_stat_inc(hit);
+        trace_cache_hit(addr);
         return 0;
     }
 #endif /* SHFS_CACHE_DISABLE */
@@ -561,6 +731,7 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
     *t_out = t;
     *cce_out = cce;
     shfs_cache_stat_inc(hitwait);
+    trace_cache_hitwait(addr);
     return 1;
 
  err_dec_refcount:
@@ -568,7 +739,7 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
     --cce->refcount;
     if (cce->refcount == 0) {
 	--shfs_vol.chunkcache->nb_ref_entries;
-	dlist_append(cce, shfs_vol.chunkcache->alist, alist);
+	dlist_append(cce, shfs_cache_alist(sub), alist);
     }
 #else /* SHFS_CACHE_DISABLE */
     shfs_cache_put_cce(cce);
@@ -580,6 +751,36 @@ int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_arg
     return ret;
 }
 
+int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
+{
+    return _shfs_cache_aread(addr, 0, shfs_vol.chunksize,
+			     cb, cb_cookie, cb_argp, cce_out, t_out);
+}
+
+int shfs_cache_aread_range(chk_t addr, uint32_t off, uint32_t len,
+			   shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp,
+			   struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out)
+{
+#ifndef SHFS_CACHE_DISABLE
+    register uint32_t ssize;
+    register uint32_t goff;
+
+    if (likely(shfs_mounted) && (ssize = shfs_vol.chunkcache->subchk_size)) {
+	goff = off & ~(ssize - 1);
+
+	/* range within a single sector group and no chunk entry to serve it? */
+	if (len && (off + len) <= (goff + ssize) &&
+	    !shfs_cache_find(addr, 0, shfs_vol.chunksize)) {
+	    shfs_cache_stat_inc(sub);
+	    return _shfs_cache_aread(addr, goff, ssize,
+				     cb, cb_cookie, cb_argp, cce_out, t_out);
+	}
+    }
+#endif /* SHFS_CACHE_DISABLE */
+    return _shfs_cache_aread(addr, 0, shfs_vol.chunksize,
+			     cb, cb_cookie, cb_argp, cce_out, t_out);
+}
+
 int shfs_cache_eblank(struct shfs_cache_entry **cce_out)
 {
     struct shfs_cache_entry *cce;
@@ -593,20 +794,22 @@ int shfs_cache_eblank(struct shfs_cache_entry **cce_out)
         goto err_out;
     }
 
-    cce = shfs_cache_pick_cce();
+    cce = shfs_cache_pick_cce(0);
     if (!cce) {
 	/* try to pick a buffer (that has completed I/O) from the available list */
-	dlist_foreach(cce, shfs_vol.chunkcache->alist, alist) {
+	dlist_foreach(cce, shfs_cache_alist(0), alist) {
 		if (cce->t == NULL)
 			goto found;
 	}
 	/* we are out of buffers */
+	shfs_cache_pick_fail(0);
 	ret = -EAGAIN;
 	shfs_cache_stat_inc(memerr);
 	goto err_out;
 
     found:
 	shfs_cache_stat_inc(evict);
+	trace_cache_evict(cce->addr);
 
 	/* unlink from hash collision table and available list */
 	shfs_cache_unlink(cce);
@@ -653,7 +856,7 @@ void shfs_cache_release(struct shfs_cache_entry *cce)
 	--shfs_vol.chunkcache->nb_ref_entries;
 #if !defined SHFS_CACHE_DISABLE && !defined SHFS_CACHE_IMMEDIATEDROP
 	if (likely(!cce->invalid)) {
-	    dlist_append(cce, shfs_vol.chunkcache->alist, alist);
+	    dlist_append(cce, shfs_cache_alist(shfs_cache_is_sub(cce)), alist);
 	} else {
             printd("Destroy invalid cache of chunk %llu\n", cce->addr);
 #else
@@ -663,10 +866,13 @@ void shfs_cache_release(struct shfs_cache_entry *cce)
 	    if (!cce->addr == 0) { /* note: blank buffers are not linked to any lists */
 		/* unlink element from hash table collision list
 		 * it is already unlinked from the available list (refcount was > 0 before) */
-		i = shfs_cache_htindex(cce->addr);
+		i = shfs_cache_htindex(cce->addr, cce->off);
 		dlist_unlink(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 	    }
 #endif /* SHFS_CACHE_DISABLE */
+#ifdef SHFS_CACHE_IMMEDIATEDROP
+	    trace_cache_evict(cce->addr);
+#endif /* SHFS_CACHE_IMMEDIATEDROP */
 	    shfs_cache_put_cce(cce);
 #ifdef SHFS_CACHE_IMMEDIATEDROP
 	    shfs_cache_stat_inc(evict);
@@ -677,6 +883,28 @@ void shfs_cache_release(struct shfs_cache_entry *cce)
     }
 }
 
+/*
+ * Release a cache buffer (like shfs_cache_release)
+ * but the buffer becomes the next candidate for eviction
+ * instead of the last one when it is not referenced anymore
+ */
+void shfs_cache_release_cold(struct shfs_cache_entry *cce)
+{
+#if !defined SHFS_CACHE_DISABLE && !defined SHFS_CACHE_IMMEDIATEDROP
+    BUG_ON(cce->refcount == 0);
+    BUG_ON(!shfs_aio_is_done(cce->t));
+
+    if (cce->refcount == 1 && likely(!cce->invalid)) {
+	printd("Release cache of chunk %llu as cold (caller=%p)\n", cce->addr, get_caller());
+	--cce->refcount;
+	--shfs_vol.chunkcache->nb_ref_entries;
+	dlist_prepend(cce, shfs_cache_alist(shfs_cache_is_sub(cce)), alist);
+	return;
+    }
+#endif /* SHFS_CACHE_DISABLE */
+    shfs_cache_release(cce);
+}
+
 /*
  * Release a cache buffer (like shfs_cache_release)
  * but also cancels an incomplete I/O request
@@ -726,16 +954,19 @@ void shfs_cache_release_ioabort(struct shfs_cache_entry *cce, SHFS_AIO_TOKEN *t)
 	    if (!cce->addr == 0) { /* note: blank buffers are not linked to any lists */
 		/* unlink element from hash table collision list
 		 * it is already unlinked from the available list (refcount was > 0 before) */
-		i = shfs_cache_htindex(cce->addr);
+		i = shfs_cache_htindex(cce->addr, cce->off);
 		dlist_unlink(cce, shfs_vol.chunkcache->htable[i].clist, clist);
 	    }
 #endif /* SHFS_CACHE_DISABLE */
+#ifdef SHFS_CACHE_IMMEDIATEDROP
+	    trace_cache_evict(cce->addr);
+#endif /* SHFS_CACHE_IMMEDIATEDROP */
 	    shfs_cache_put_cce(cce);
 #ifdef SHFS_CACHE_IMMEDIATEDROP
 	    shfs_cache_stat_inc(evict);
 #endif /* SHFS_CACHE_IMMEDIATEDROP */
 	} else {
-	    dlist_append(cce, shfs_vol.chunkcache->alist, alist);
+	    dlist_append(cce, shfs_cache_alist(shfs_cache_is_sub(cce)), alist);
 	}
     }
 }
@@ -747,7 +978,9 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 	uint32_t i;
 	uint32_t chunksize;
 	uint64_t nb_entries;
+	uint64_t nb_sentries;
 	uint64_t nb_ref_entries;
+	uint32_t subchk_size;
 	uint32_t htlen;
 	uint64_t depth, max_depth;
 	uint32_t nb_objs = 0;
@@ -769,8 +1002,8 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 		depth = 0;
 		dlist_foreach(cce, shfs_vol.chunkcache->htable[i].clist, clist) {
 #ifdef SHFS_CACHE_DEBUG
-			printk(" %12"PRIchk" chk: %s, refcount: %3"PRIu32"\n",
-			       cce->addr,
+			printk(" %12"PRIchk" chk (+%7"PRIu32" B): %s, refcount: %3"PRIu32"\n",
+			       cce->addr, cce->off,
 			       cce->invalid ? "INVALID" : "valid",
 			       cce->refcount);
 #endif
@@ -781,6 +1014,8 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 
 	chunksize      = shfs_vol.chunksize;
 	nb_entries     = shfs_vol.chunkcache->nb_entries;
+	nb_sentries    = shfs_vol.chunkcache->nb_sentries;
+	subchk_size    = shfs_vol.chunkcache->subchk_size;
 	nb_ref_entries = shfs_vol.chunkcache->nb_ref_entries;
 	htlen          = shfs_vol.chunkcache->htlen;
 	if (shfs_vol.chunkcache->pool) {
@@ -791,7 +1026,14 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 	fprintf(cio, " Number of buffers in cache:         %12"PRIu64" (total: %"PRIu64" KiB)\n",
 	        nb_entries,
 	        (nb_entries * chunksize) /1024);
-	fprintf(cio, " Number of used buffers in cache:    %12"PRIu32"\n",
+	if (subchk_size)
+		fprintf(cio, " Number of sub-chunk buffers:        %12"PRIu64" (total: %"PRIu64" KiB, %"PRIu32" B each)\n",
+			nb_sentries,
+			(nb_sentries * subchk_size) / 1024,
+			subchk_size);
+	else
+		fprintf(cio, " Sub-chunk buffers:                      disabled\n");
+	fprintf(cio, " Number of used buffers in cache:    %12"PRIu64"\n",
 	        nb_ref_entries);
 	fprintf(cio, " Hash table size:                    %12"PRIu32"\n",
 	        htlen);
@@ -823,6 +1065,7 @@ int shcmd_shfs_cache_info(FILE *cio, int argc, char *argv[])
 	fprintf(cio, "  Read-aheads:                       %12"PRIu32"\n", shfs_cache_stat_get(rdahead));
 	fprintf(cio, "  Misses:                            %12"PRIu32"\n", shfs_cache_stat_get(miss));
 	fprintf(cio, "  Blanks:                            %12"PRIu32"\n", shfs_cache_stat_get(blank));
+	fprintf(cio, "  Sub-chunk requests:                %12"PRIu32"\n", shfs_cache_stat_get(sub));
 	fprintf(cio, "  Evicts:                            %12"PRIu32"\n", shfs_cache_stat_get(evict));
 	fprintf(cio, "  Out of memory:                     %12"PRIu32"\n", shfs_cache_stat_get(memerr));
 	fprintf(cio, "  Successful I/O:                    %12"PRIu32"\n", shfs_cache_stat_get(iosuc));
@@ -62,6 +62,27 @@
 #endif
 #endif
 
+/*
+ * Sub-chunk caching
+ * Small reads (e.g., small range requests or small objects) are served by
+ * sub-chunk entries: each of them holds one sector group of a chunk only
+ * and is filled and evicted independently from the other groups of the chunk.
+ * Their buffers are taken from a separate pool, so that large chunks can be
+ * used for streaming without pinning a whole chunk buffer for a small read.
+ */
+#ifndef SHFS_CACHE_SUBCHK_SIZE
+#define SHFS_CACHE_SUBCHK_SIZE 4096 /* size of a sector group (power of 2, 0 = disabled) */
+#endif
+
+#ifndef SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS
+#define SHFS_CACHE_SUBCHK_POOL_NB_BUFFERS (4 * SHFS_CACHE_POOL_NB_BUFFERS)
+#endif
+
+#ifndef SHFS_CACHE_SUBCHK_RATIO
+#define SHFS_CACHE_SUBCHK_RATIO 4 /* reads touching less than 1/x of a chunk
+				   * are split into sub-chunk requests */
+#endif
+
 #ifdef SHFS_CACHE_POOL_MAXALLOC /* if enabled, cache allocates a pool by covering the left space completely */
 #ifndef SHFS_CACHE_POOL_MAXALLOC_THRESHOLD
 #define SHFS_CACHE_POOL_MAXALLOC_THRESHOLD (2 * 1024 * 1024) /* keep 2MB space left (note: don't put this value too small,
@@ -89,6 +110,8 @@ struct shfs_cache_entry {
 	struct mempool_obj *pobj;
 
 	chk_t addr;
+	uint32_t off; /* byte offset of buffer in chunk (sub-chunk entries only) */
+	uint32_t len; /* buffer length (= chunksize on chunk entries) */
 	uint32_t refcount;
 
 	dlist_el(alist); /* when part of the avaliable list */
@@ -112,10 +135,14 @@ struct shfs_cache_htel {
 
 struct shfs_cache {
 	struct mempool *pool;
+	struct mempool *spool; /* sub-chunk buffers */
+	uint32_t subchk_size; /* 0 if sub-chunk caching is unavailable */
+	uint32_t subchk_shift; /* log2(subchk_size) */
 	uint32_t htlen;
 	uint32_t htmask;
 	uint64_t nb_ref_entries;
 	uint64_t nb_entries;
+	uint64_t nb_sentries;
 
 #ifdef SHFS_CACHE_STATS
 	struct {
@@ -124,6 +151,7 @@ struct shfs_cache {
 		uint32_t rdahead;
 		uint32_t miss;
 		uint32_t blank;
+		uint32_t sub;
 		uint32_t evict;
 		uint32_t memerr;
 		uint32_t iosuc;
@@ -132,6 +160,7 @@ struct shfs_cache {
 #endif /* SHFS_CACHE_STATS */
 
 	struct dlist_head alist; /* list of available (loaded) but unreferenced entries */
+	struct dlist_head salist; /* same as alist but for sub-chunk entries */
 	struct shfs_cache_htel htable[]; /* hash table (all loaded entries (incl. referenced)) */
 };
 
@@ -157,6 +186,12 @@ struct shfs_cache {
 
 int shfs_alloc_cache(void);
 void shfs_flush_cache(void); /* releases unreferenced buffers */
+/* releases up to max unreferenced buffers, returns the number of released ones */
+uint32_t shfs_flush_cache_n(uint32_t max);
+#define SHFS_CACHE_FLUSH_STEP 16
+/* releases unreferenced buffers of the volume area [start, start + len),
+ * returns the number of released ones */
+uint32_t shfs_cache_invalidate(chk_t start, chk_t len);
 void shfs_free_cache(void);
 #define shfs_cache_ref_count() \
 	(shfs_vol.chunkcache->nb_ref_entries)
@@ -194,6 +229,35 @@ void shfs_free_cache(void);
  */
 int shfs_cache_aread(chk_t addr, shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp, struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out);
 
+/*
+ * Like shfs_cache_aread() but the caller is only interested in the byte range
+ * [off, off + len) of the chunk. If the range lies within a single sector
+ * group and the chunk is not cached as whole, a sub-chunk entry is returned.
+ * In each case, the returned buffer covers the whole range: use
+ * shfs_cache_data() to get the pointer to the data at a chunk byte offset.
+ * Note: Read-ahead is only done for chunk entries.
+ */
+int shfs_cache_aread_range(chk_t addr, uint32_t off, uint32_t len,
+			   shfs_aiocb_t *cb, void *cb_cookie, void *cb_argp,
+			   struct shfs_cache_entry **cce_out, SHFS_AIO_TOKEN **t_out);
+
+#define shfs_cache_data(cce, chk_off) \
+	((void *) ((uint8_t *) (cce)->buffer + ((chk_off) - (cce)->off)))
+
+/*
+ * Returns the number of bytes of the range [off, off + len) of a chunk
+ * that should be requested with a single shfs_cache_aread_range() call:
+ * small reads are split at sector group boundaries.
+ */
+static inline uint32_t shfs_cache_range_split(uint32_t off, uint32_t len)
+{
+	register uint32_t ssize = shfs_vol.chunkcache->subchk_size;
+
+	if (ssize && len <= (shfs_vol.chunksize / SHFS_CACHE_SUBCHK_RATIO))
+		return min(len, ssize - (off & (ssize - 1)));
+	return len;
+}
+
 /*
  * Function to retrieve a blank SHFS buffer from the cache for custom I/O
  * The returned buffer on *cce_out has no address (= 0) associated with it and does not initiate
@@ -209,6 +273,7 @@ int shfs_cache_eblank(struct shfs_cache_entry **cce_out);
 
 /* Release a shfs cache buffer */
 void shfs_cache_release(struct shfs_cache_entry *cce); /* Note: I/O needs to be done! */
+void shfs_cache_release_cold(struct shfs_cache_entry *cce); /* evicted first, I/O needs to be done */
 void shfs_cache_release_ioabort(struct shfs_cache_entry *cce, SHFS_AIO_TOKEN *t); /* I/O can be still in progress */
 
 /* synchronous I/O read using the cache */
@@ -0,0 +1,515 @@
+/*
+ * Chunk checksums and background scrubbing for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "shfs.h"
+#include "shfs_btable.h"
+#include "shfs_fio.h"
+#include "shfs_csum.h"
+#include "shfs_tools.h"
+#include "memacct.h"
+#include "shell.h"
+
+#ifdef SHFS_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+struct shfs_csum_stats shfs_csum_stats;
+struct shfs_scrub shfs_scrub = { .active = 0 };
+
+#define _shfs_csum_hentry(idx) \
+	((struct shfs_hentry *) ((uint8_t *) shfs_vol.htable_chunk_cache[ \
+	   SHFS_HTABLE_CHUNK_NO((idx), shfs_vol.htable_nb_entries_per_chunk)] \
+	 + SHFS_HTABLE_ENTRY_OFFSET((idx), shfs_vol.htable_nb_entries_per_chunk)))
+
+static inline int _shfs_csum_owns(struct shfs_hentry *hentry, chk_t addr)
+{
+	chk_t start, len;
+
+	if (SHFS_HENTRY_ISLINK(hentry))
+		return 0;
+	start = hentry->f_attr.chunk;
+	len = DIV_ROUND_UP(hentry->f_attr.offset + hentry->f_attr.len,
+	                   shfs_vol.chunksize);
+	return (addr >= start && addr < start + len);
+}
+
+/*
+ * Quarantine
+ * Note: Objects are looked up by a walk over the whole table, which is
+ *  fine since this happens on checksum mismatches only
+ */
+uint32_t shfs_csum_quarantine(chk_t addr)
+{
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	uint32_t n = 0;
+
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		if (bentry->quarantine || !_shfs_csum_owns(bentry->hentry, addr))
+			continue;
+
+		bentry->quarantine = 1;
+		hash_format(bentry->hentry->hash, shfs_vol.hlen, str_hash);
+		printk("SHFS: Checksum mismatch on chunk %"PRIchk": %c%s quarantined\n",
+		       addr, SHFS_HASH_INDICATOR_PREFIX, str_hash);
+		++n;
+	}
+	if (!n)
+		printk("SHFS: Checksum mismatch on chunk %"PRIchk"\n", addr);
+	return n;
+}
+
+/******************************************************************************
+ * Scrubber
+ ******************************************************************************/
+static inline void _shfs_scrub_refill(uint64_t now)
+{
+	uint64_t burst, dt;
+
+	if (!shfs_scrub.rate)
+		return;
+
+	burst = max((shfs_scrub.rate * SHFS_SCRUB_BURST_MS) / 1000,
+		    (uint64_t) shfs_vol.chunksize);
+	dt = min(now - shfs_scrub.t_last, 1000000000ull); /* avoid overflows */
+	shfs_scrub.tokens += (int64_t) ((shfs_scrub.rate * dt) / 1000000000ull);
+	if (shfs_scrub.tokens > (int64_t) burst)
+		shfs_scrub.tokens = (int64_t) burst;
+	shfs_scrub.t_last = now;
+}
+
+static void _shfs_scrub_check(struct shfs_scrub_slot *s, int ret)
+{
+	++shfs_scrub.done_chks;
+	if (unlikely(ret < 0)) {
+		++shfs_scrub.ioerr;
+		return;
+	}
+	if (!s->csum) {
+		++shfs_scrub.nocsum;
+		return;
+	}
+	if (likely(SHFS_CSUM_VALUE(crc32c(0, s->buf, shfs_vol.chunksize)) == s->csum))
+		return;
+	if (shfs_vol.csum_tbl[s->addr] != s->csum)
+		return; /* chunk was rewritten while it was read (e.g., object was replaced) */
+
+	++shfs_scrub.csumerr;
+	shfs_scrub.bad_objs += shfs_csum_quarantine(s->addr);
+}
+
+/* verifies completed reads */
+static inline void _shfs_scrub_reap(void)
+{
+	struct shfs_scrub_slot *s, tmp;
+	uint32_t i = 0;
+
+	while (i < shfs_scrub.nb_infly) {
+		s = &shfs_scrub.slot[i];
+		if (!shfs_aio_is_done(s->t)) {
+			++i;
+			continue;
+		}
+		_shfs_scrub_check(s, shfs_aio_finalize(s->t));
+
+		/* fill the gap with the last slot (buffers are swapped) */
+		tmp = *s;
+		*s = shfs_scrub.slot[--shfs_scrub.nb_infly];
+		shfs_scrub.slot[shfs_scrub.nb_infly] = tmp;
+	}
+}
+
+/* finds the next object on the volume, returns 0 when the walk is done */
+static int _shfs_scrub_next_obj(void)
+{
+	struct shfs_hentry *hentry;
+	struct shfs_bentry *bentry;
+
+	while (shfs_scrub.next_ent < shfs_vol.htable_nb_entries) {
+		hentry = _shfs_csum_hentry(shfs_scrub.next_ent);
+		++shfs_scrub.next_ent;
+		if (hash_is_zero(hentry->hash, shfs_vol.hlen) ||
+		    SHFS_HENTRY_ISLINK(hentry))
+			continue;
+		bentry = shfs_btable_lookup(shfs_vol.bt, hentry->hash);
+		if (!bentry || bentry->update || bentry->quarantine)
+			continue;
+
+		shfs_scrub.next_chk = hentry->f_attr.chunk;
+		shfs_scrub.end_chk = hentry->f_attr.chunk
+			+ DIV_ROUND_UP(hentry->f_attr.offset + hentry->f_attr.len,
+			               shfs_vol.chunksize);
+		++shfs_scrub.done_objs;
+		return 1;
+	}
+	return 0;
+}
+
+static void _shfs_scrub_start_pass(uint64_t now)
+{
+	shfs_scrub.t_next = 0;
+	shfs_scrub.next_ent = 0;
+	shfs_scrub.next_chk = 0;
+	shfs_scrub.end_chk = 0;
+	shfs_scrub.tokens = 0;
+	shfs_scrub.t_last = now;
+	shfs_scrub.t_start = now;
+	shfs_scrub.t_end = now;
+	shfs_scrub.done_chks = 0;
+	shfs_scrub.done_objs = 0;
+	shfs_scrub.nocsum = 0;
+	shfs_scrub.ioerr = 0;
+	shfs_scrub.csumerr = 0;
+	shfs_scrub.bad_objs = 0;
+	++shfs_scrub.nb_passes;
+}
+
+static void _shfs_scrub_free_buffers(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < shfs_scrub.qdepth; ++i) {
+		if (shfs_scrub.slot[i].buf)
+			memacct_free(MEMT_SHFS, shfs_scrub.slot[i].buf, shfs_vol.chunksize);
+		shfs_scrub.slot[i].buf = NULL;
+	}
+}
+
+void shfs_scrub_stop(void)
+{
+	uint32_t i;
+
+	if (!shfs_scrub.active)
+		return;
+
+	/* buffers can only be released after the device is done with them */
+	for (i = 0; i < shfs_scrub.nb_infly; ++i) {
+		shfs_aio_wait_nosched(shfs_scrub.slot[i].t);
+		shfs_aio_finalize(shfs_scrub.slot[i].t);
+	}
+	shfs_scrub.nb_infly = 0;
+	_shfs_scrub_free_buffers();
+	if (!shfs_scrub.t_next)
+		shfs_scrub.t_end = target_now_ns();
+	shfs_scrub.t_next = 0;
+	shfs_scrub.active = 0;
+}
+
+void _shfs_scrub_poll(void)
+{
+	struct shfs_scrub_slot *s;
+	uint64_t now;
+
+	now = target_now_ns();
+	if (shfs_scrub.t_next) {
+		if (now < shfs_scrub.t_next)
+			return; /* waiting for next pass */
+		_shfs_scrub_start_pass(now);
+	}
+
+	_shfs_scrub_reap();
+	_shfs_scrub_refill(now);
+
+	while (shfs_scrub.nb_infly < shfs_scrub.qdepth) {
+		if (shfs_scrub.next_chk == shfs_scrub.end_chk) {
+			if (!_shfs_scrub_next_obj())
+				break; /* all objects are requested */
+		}
+		if (shfs_scrub.rate && shfs_scrub.tokens <= 0)
+			break; /* bandwidth limit reached */
+
+		s = &shfs_scrub.slot[shfs_scrub.nb_infly];
+		s->t = shfs_aread_chunk(shfs_scrub.next_chk, 1, s->buf, NULL, NULL, NULL);
+		if (unlikely(!s->t)) {
+			if (errno == EAGAIN || errno == EBUSY)
+				break; /* out of device requests or AIO tokens, retry later */
+			++shfs_scrub.ioerr;
+			++shfs_scrub.done_chks;
+			++shfs_scrub.next_chk;
+			continue;
+		}
+		s->addr = shfs_scrub.next_chk++;
+		s->csum = shfs_vol.csum_tbl[s->addr];
+		shfs_scrub.tokens -= shfs_vol.chunksize;
+		++shfs_scrub.nb_infly;
+	}
+	shfs_aio_submit();
+
+	if (shfs_scrub.next_ent == shfs_vol.htable_nb_entries &&
+	    shfs_scrub.next_chk == shfs_scrub.end_chk &&
+	    shfs_scrub.nb_infly == 0) {
+		/* pass is done */
+		shfs_scrub.t_end = now;
+		if (shfs_scrub.csumerr || shfs_scrub.ioerr)
+			printk("SHFS: Scrub found %"PRIu64" checksum and %"PRIu64" I/O errors, "
+			       "%"PRIu32" objects quarantined\n",
+			       shfs_scrub.csumerr, shfs_scrub.ioerr, shfs_scrub.bad_objs);
+		if (shfs_scrub.interval) {
+			shfs_scrub.t_next = now + shfs_scrub.interval;
+		} else {
+			_shfs_scrub_free_buffers();
+			shfs_scrub.active = 0;
+		}
+	}
+}
+
+/******************************************************************************
+ * Shell commands
+ ******************************************************************************/
+static void _shfs_scrub_print_progress(FILE *cio)
+{
+	uint64_t now, elapsed;
+	int running = shfs_scrub.active && !shfs_scrub.t_next;
+
+	now = running ? target_now_ns() : shfs_scrub.t_end;
+	elapsed = (now - shfs_scrub.t_start) / 1000000; /* ms */
+
+	fprintf(cio, "Scrub pass %"PRIu32" %s\n", shfs_scrub.nb_passes,
+		running ? "in progress" : "done");
+	fprintf(cio, " Objects: %"PRIu32" (%"PRIu32" entries of %"PRIu32" walked)\n",
+		shfs_scrub.done_objs, shfs_scrub.next_ent, shfs_vol.htable_nb_entries);
+	fprintf(cio, " Chunks:  %"PRIu64" (%"PRIu64" without checksum)\n",
+		shfs_scrub.done_chks, shfs_scrub.nocsum);
+	fprintf(cio, " Errors:  %"PRIu64" checksum, %"PRIu64" I/O, %"PRIu32" objects quarantined\n",
+		shfs_scrub.csumerr, shfs_scrub.ioerr, shfs_scrub.bad_objs);
+	fprintf(cio, " Elapsed: %"PRIu64".%03"PRIu64" s, %"PRIu64" KiB/s",
+		elapsed / 1000, elapsed % 1000,
+		elapsed ? (shfs_scrub.done_chks * shfs_vol.chunksize) / elapsed * 1000 / 1024 : 0);
+	if (shfs_scrub.rate)
+		fprintf(cio, " (limit: %"PRIu64" KiB/s)", shfs_scrub.rate / 1024);
+	fprintf(cio, "\n");
+	if (shfs_scrub.active && shfs_scrub.t_next)
+		fprintf(cio, " Next pass in %"PRIu64" s\n",
+			(uint64_t) (shfs_scrub.t_next - min(shfs_scrub.t_next, target_now_ns())) / 1000000000);
+}
+
+static void _shfs_csum_print_stats(FILE *cio)
+{
+	fprintf(cio, "Chunk checksums: ");
+	if (!shfs_vol.csum_ref) {
+		fprintf(cio, "not available on this volume\n");
+		return;
+	}
+	if (!shfs_vol.csum_tbl) {
+		fprintf(cio, "not loaded (chunks are not verified)\n");
+		return;
+	}
+	fprintf(cio, "CRC32C\n");
+	fprintf(cio, " Verified on read: %"PRIu64" chunks, %"PRIu64" mismatches\n",
+		shfs_csum_stats.verified, shfs_csum_stats.failed);
+}
+
+static int _shfs_csum_list_quarantine(FILE *cio)
+{
+	char str_hash[(shfs_vol.hlen * 2) + 1];
+	struct sh_slice slice;
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	uint32_t n = 0;
+
+	sh_slice_init(&slice, cio);
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		if (!bentry->quarantine)
+			continue;
+		hash_format(bentry->hentry->hash, shfs_vol.hlen, str_hash);
+		fprintf(cio, "%c%s %.64s\n", SHFS_HASH_INDICATOR_PREFIX, str_hash,
+			bentry->hentry->name);
+		++n;
+		sh_slice_yield(&slice);
+	}
+	fprintf(cio, "%"PRIu32" objects in quarantine\n", n);
+	return 0;
+}
+
+static int _shfs_csum_release(FILE *cio, const char *path)
+{
+	struct shfs_bentry *bentry = NULL;
+	hash512_t h;
+
+	if (path[0] == SHFS_HASH_INDICATOR_PREFIX) {
+		if (hash_parse(path + 1, h, shfs_vol.hlen) == 0)
+			bentry = shfs_btable_lookup(shfs_vol.bt, h);
+#ifdef SHFS_OPENBYNAME
+	} else {
+		bentry = shfs_btable_lookup_byname(shfs_vol.bt, shfs_vol.htable_chunk_cache, path);
+#endif
+	}
+	if (!bentry) {
+		fprintf(cio, "%s: Not found\n", path);
+		return -1;
+	}
+	bentry->quarantine = 0;
+	return 0;
+}
+
+static int shcmd_shfs_scrub(FILE *cio, int argc, char *argv[])
+{
+	uint32_t qdepth = SHFS_SCRUB_QDEPTH;
+	uint64_t rate = SHFS_SCRUB_RATE;
+	uint64_t interval = 0;
+	int run = 0;
+	uint32_t i;
+	int a, ret = 0;
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		ret = -1;
+		goto out;
+	}
+
+	if (argc == 1) {
+		_shfs_csum_print_stats(cio);
+		if (shfs_scrub.nb_passes)
+			_shfs_scrub_print_progress(cio);
+		goto out;
+	}
+	if (argc == 2 && strcmp(argv[1], "-s") == 0) {
+		shfs_scrub_stop();
+		goto out;
+	}
+	if (argc == 2 && strcmp(argv[1], "-l") == 0) {
+		ret = _shfs_csum_list_quarantine(cio);
+		goto out;
+	}
+	if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+		for (a = 2; a < argc; ++a)
+			if (_shfs_csum_release(cio, argv[a]) < 0)
+				ret = -1;
+		goto out;
+	}
+
+	/* parse options */
+	for (a = 1; a < argc; ++a) {
+		if (strcmp(argv[a], "-r") == 0) {
+			run = 1;
+		} else if (strcmp(argv[a], "-q") == 0 && a + 1 < argc) {
+			qdepth = atoi(argv[++a]);
+			if (qdepth == 0 || qdepth > SHFS_SCRUB_MAX_QDEPTH) {
+				fprintf(cio, "Queue depth has to be between 1 and %u\n",
+					SHFS_SCRUB_MAX_QDEPTH);
+				ret = -1;
+				goto out;
+			}
+		} else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) {
+			rate = strtoull(argv[++a], NULL, 10);
+		} else if (strcmp(argv[a], "-i") == 0 && a + 1 < argc) {
+			interval = strtoull(argv[++a], NULL, 10);
+		} else {
+			goto usage;
+		}
+	}
+	if (!run)
+		goto usage;
+
+	if (!shfs_vol.csum_tbl) {
+		fprintf(cio, "Volume has no chunk checksums\n");
+		ret = -1;
+		goto out;
+	}
+	if (shfs_scrub.active) {
+		fprintf(cio, "A scrub is already in progress\n");
+		ret = -1;
+		goto out;
+	}
+
+	/* setup job */
+	memset(&shfs_scrub, 0, sizeof(shfs_scrub));
+	for (i = 0; i < qdepth; ++i) {
+		shfs_scrub.slot[i].buf = memacct_malloc(MEMT_SHFS, shfs_vol.ioalign, shfs_vol.chunksize);
+		if (!shfs_scrub.slot[i].buf) {
+			fprintf(cio, "Could not allocate read buffers: %s\n", strerror(ENOMEM));
+			shfs_scrub.qdepth = i;
+			_shfs_scrub_free_buffers();
+			ret = -1;
+			goto out;
+		}
+	}
+	shfs_scrub.qdepth = qdepth;
+	shfs_scrub.rate = rate * 1024 * 1024;
+	shfs_scrub.interval = interval * 3600ull * 1000000000ull;
+	_shfs_scrub_start_pass(target_now_ns());
+	shfs_scrub.active = 1;
+	fprintf(cio, "Scrubbing %"PRIu32" hash table entries\n", shfs_vol.htable_nb_entries);
+	goto out;
+
+ usage:
+	fprintf(cio, "Usage: %s -r [-q DEPTH] [-b MIB/S] [-i HOURS]\n", argv[0]);
+	fprintf(cio, "       %s [-s|-l]\n", argv[0]);
+	fprintf(cio, "       %s -c FILE...\n", argv[0]);
+	fprintf(cio, "Verifies chunk checksums of all objects in background\n");
+	fprintf(cio, "  -r           Start scrubbing\n");
+	fprintf(cio, "  -q DEPTH     Number of parallel chunk reads (default: %u)\n", SHFS_SCRUB_QDEPTH);
+	fprintf(cio, "  -b MIB/S     Bandwidth limit, 0 = unlimited (default: %u)\n", SHFS_SCRUB_RATE);
+	fprintf(cio, "  -i HOURS     Repeat scrubbing every HOURS (default: single pass)\n");
+	fprintf(cio, "  -s           Stop scrubbing\n");
+	fprintf(cio, "  -l           List objects in quarantine\n");
+	fprintf(cio, "  -c FILE...   Release objects from quarantine\n");
+	fprintf(cio, "Without arguments, checksum statistics and the progress are displayed\n");
+	ret = -1;
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+#ifdef HAVE_CTLDIR
+int register_shfs_csum_tools(struct ctldir *cd)
+#else
+int register_shfs_csum_tools(void)
+#endif
+{
+#ifdef HAVE_CTLDIR
+	/* ctldir entries (ignore errors) */
+	if (cd)
+		ctldir_register_shcmd(cd, "scrub", shcmd_shfs_scrub);
+#endif
+#ifdef HAVE_SHELL
+	/* shell commands (ignore errors) */
+	shell_register_cmd("scrub", shcmd_shfs_scrub);
+#endif
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Chunk checksums and background scrubbing for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _SHFS_CSUM_H_
+#define _SHFS_CSUM_H_
+
+#include "shfs_defs.h"
+#include "shfs.h"
+#include "crc32c.h"
+#include "likely.h"
+#ifdef HAVE_CTLDIR
+#include <target/ctldir.h>
+#endif
+
+/*
+ * Volumes that were created with a checksum area (shfs_mkfs -k) carry a
+ * CRC32C for each chunk. The table is held in memory while the volume is
+ * mounted (4 bytes per chunk) and every chunk that is read into the cache
+ * or by the synchronous shfs_fio_read*() functions is verified against it
+ * before it gets served. A mismatch fails the read with EIO and puts the
+ * objects that own the chunk into quarantine: they cannot be opened anymore
+ * until they are replaced or released manually. Because checksums cover
+ * whole chunks, the sub-chunk cache pool is disabled while the table is
+ * loaded.
+ *
+ * The scrubber walks all objects of the volume in the background and
+ * verifies their chunks by reading them directly from the device (the
+ * cache is bypassed). It is driven by shfs_scrub_poll() from the main loop
+ * and limited by a token bucket on the number of bytes read per second.
+ */
+#define SHFS_SCRUB_MAX_QDEPTH 16
+#ifndef SHFS_SCRUB_QDEPTH
+#define SHFS_SCRUB_QDEPTH 2
+#endif
+#ifndef SHFS_SCRUB_RATE
+#define SHFS_SCRUB_RATE 16 /* MiB/s, 0 = unlimited */
+#endif
+#define SHFS_SCRUB_BURST_MS 100 /* token bucket depth */
+
+/* returns 0 if buf matches the checksum of chunk addr (or there is none), -EIO otherwise */
+static inline int shfs_csum_verify(chk_t addr, const void *buf)
+{
+	uint32_t csum;
+
+	if (!shfs_vol.csum_tbl)
+		return 0;
+	csum = shfs_vol.csum_tbl[addr];
+	if (!csum)
+		return 0; /* chunk was written without checksum */
+	if (likely(SHFS_CSUM_VALUE(crc32c(0, buf, shfs_vol.chunksize)) == csum))
+		return 0;
+	return -EIO;
+}
+
+/* sets the in-memory checksum of chunk addr (the table chunk has to be written by the caller) */
+static inline void shfs_csum_set(chk_t addr, const void *buf)
+{
+	if (shfs_vol.csum_tbl)
+		shfs_vol.csum_tbl[addr] = SHFS_CSUM_VALUE(crc32c(0, buf, shfs_vol.chunksize));
+}
+
+/* table chunk that holds the checksum of chunk addr */
+#define shfs_csum_tbl_chunk(addr) \
+	((void *) ((uint8_t *) shfs_vol.csum_tbl + \
+	           CHUNKS_TO_BYTES(SHFS_CSUM_CHUNK_NO((addr), shfs_vol.chunksize), \
+	                           shfs_vol.chunksize)))
+
+/*
+ * Handles a checksum mismatch on chunk addr: all objects that are stored
+ * on it are put into quarantine. Returns the number of affected objects.
+ */
+uint32_t shfs_csum_quarantine(chk_t addr);
+
+struct shfs_csum_stats {
+	uint64_t verified; /* chunks verified on read */
+	uint64_t failed;   /* checksum mismatches on read */
+};
+
+extern struct shfs_csum_stats shfs_csum_stats;
+
+#define shfs_csum_stat_inc(name) \
+	do { \
+		++shfs_csum_stats.name; \
+	} while (0)
+
+/*
+ * Background scrubber
+ */
+struct shfs_scrub_slot {
+	SHFS_AIO_TOKEN *t;
+	void *buf;
+	chk_t addr;
+	uint32_t csum; /* expected checksum (when the read was issued) */
+};
+
+struct shfs_scrub {
+	int active; /* a pass is running or scheduled */
+	uint64_t interval; /* ns between passes, 0 = single pass */
+	uint64_t t_next; /* start of next pass (0 if a pass is running) */
+
+	/* current object */
+	uint32_t next_ent; /* next hash table entry to scrub */
+	chk_t next_chk;
+	chk_t end_chk;
+
+	/* in-flight reads */
+	uint32_t qdepth;
+	uint32_t nb_infly;
+	struct shfs_scrub_slot slot[SHFS_SCRUB_MAX_QDEPTH];
+
+	/* rate limiter (bytes per second, 0 = unlimited) */
+	uint64_t rate;
+	int64_t tokens;
+	uint64_t t_last;
+
+	/* progress of current (or last) pass */
+	uint32_t nb_passes;
+	uint64_t t_start;
+	uint64_t t_end;
+	uint64_t done_chks;
+	uint32_t done_objs;
+	uint64_t nocsum; /* chunks without checksum */
+	uint64_t ioerr;
+	uint64_t csumerr;
+	uint32_t bad_objs; /* objects that were put into quarantine */
+};
+
+extern struct shfs_scrub shfs_scrub;
+
+void _shfs_scrub_poll(void);
+void shfs_scrub_stop(void);
+
+/* called from the main loop */
+static inline void shfs_scrub_poll(void)
+{
+	if (likely(!shfs_scrub.active))
+		return;
+	_shfs_scrub_poll();
+}
+
+/**
+ * Registers checksum and scrubber commands to micro shell + ctldir (if *cd is not NULL)
+ */
+#ifdef HAVE_CTLDIR
+int register_shfs_csum_tools(struct ctldir *cd);
+#else
+int register_shfs_csum_tools(void);
+#endif
+
+#endif /* _SHFS_CSUM_H_ */
@@ -79,6 +79,10 @@ typedef uint64_t strp_t;
 #define SHFUNC_MD5       4
 #define SHFUNC_HAVAL     5
 
+/* chunk checksum type */
+#define SCSUM_NONE       0
+#define SCSUM_CRC32C     1
+
 /*
  * Helper
  */
@@ -165,6 +169,8 @@ struct shfs_hdr_config {
 	uint32_t           htable_bucket_count;
 	uint32_t           htable_entries_per_bucket;
 	uint8_t            allocator;
+	chk_t              csum_ref; /* if 0 => no chunk checksums */
+	uint8_t            csum_type;
 } __attribute__((packed));
 
 /**
@@ -230,6 +236,20 @@ struct shfs_hentry {
 #define SHFS_HTABLE_ENTRY_OFFSET(hentry_no, hentries_per_chunk) \
 	(((hentry_no) % (hentries_per_chunk)) * SHFS_HENTRY_SIZE)
 
+/*
+ * Chunk checksum area: one 32-bit checksum for each volume chunk
+ * (indexed by chunk address). 0 marks a chunk without checksum,
+ * that is why a computed 0 is stored as 0xFFFFFFFF.
+ */
+#define SHFS_CSUM_SIZE 4
+#define SHFS_CSUMS_PER_CHUNK(chunksize) ((chunksize) / SHFS_CSUM_SIZE)
+#define SHFS_CSUM_SIZE_CHUNKS(volsize, chunksize) \
+	DIV_ROUND_UP((volsize), SHFS_CSUMS_PER_CHUNK((chunksize)))
+#define SHFS_CSUM_CHUNK_NO(chk, chunksize) \
+	((chk) / SHFS_CSUMS_PER_CHUNK((chunksize)))
+#define SHFS_CSUM_VALUE(crc) \
+	((uint32_t) (crc) ? (uint32_t) (crc) : 0xFFFFFFFF)
+
 #define SHFS_HENTRY_ISHIDDEN(hentry) \
 	((hentry)->flags & (SHFS_EFLAG_HIDDEN))
 #define SHFS_HENTRY_ISDEFAULT(hentry) \
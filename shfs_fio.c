@@ -40,6 +40,9 @@
 #include "shfs.h"
 #include "shfs_btable.h"
 #include "shfs_cache.h"
+#ifdef SHFS_CSUM
+#include "shfs_csum.h"
+#endif
 
 #ifdef SHFS_STATS
 #include "shfs_stats.h"
@@ -48,7 +51,7 @@
 /*
  * Register open on bentry and return it on success
  */
-static inline SHFS_FD _shfs_fio_open_bentry(struct shfs_bentry *bentry)
+static inline SHFS_FD _shfs_fio_open_bentry(struct shfs_bentry *bentry, int account)
 {
 #ifdef SHFS_STATS
 	struct shfs_el_stats *estats;
@@ -62,6 +65,13 @@ static inline SHFS_FD _shfs_fio_open_bentry(struct shfs_bentry *bentry)
 		errno = EBUSY;
 		return NULL;
 	}
+#ifdef SHFS_CSUM
+	if (unlikely(bentry->quarantine)) {
+		/* contents are corrupted */
+		errno = EIO;
+		return NULL;
+	}
+#endif
 
 	++shfs_nb_open;
 	if (bentry->refcount == 0) {
@@ -70,9 +80,12 @@ static inline SHFS_FD _shfs_fio_open_bentry(struct shfs_bentry *bentry)
 	}
 	++bentry->refcount;
 #ifdef SHFS_STATS
-	estats = shfs_stats_from_bentry(bentry);
-	estats->laccess = gettimestamp_s();
-	++estats->h;
+	if (account) {
+		estats = shfs_stats_from_bentry(bentry);
+		estats->laccess = shfs_stats_clock;
+		++estats->h;
+		shfs_stats_wupdate(estats);
+	}
 #endif
 	return (SHFS_FD) bentry;
 }
@@ -88,11 +101,9 @@ struct shfs_bentry *_shfs_lookup_bentry_by_hash(hash512_t h)
 	bentry = shfs_btable_lookup(shfs_vol.bt, h);
 #ifdef SHFS_STATS
 	if (unlikely(!bentry)) {
-		estats = shfs_stats_from_mstats(h);
-		if (likely(estats != NULL)) {
-			estats->laccess = gettimestamp_s();
-			++estats->m;
-		}
+		estats = shfs_stats_mstats_miss(h);
+		estats->laccess = shfs_stats_clock;
+		shfs_stats_wupdate(estats);
 	}
 #endif
 	return bentry;
@@ -152,7 +163,7 @@ SHFS_FD shfs_fio_open(const char *path)
 		return NULL;
 	}
 
-	return _shfs_fio_open_bentry(bentry);
+	return _shfs_fio_open_bentry(bentry, 1);
 }
 
 SHFS_FD shfs_fio_openh(hash512_t h)
@@ -165,7 +176,29 @@ SHFS_FD shfs_fio_openh(hash512_t h)
 		return NULL;
 	}
 
-	return _shfs_fio_open_bentry(bentry);
+	return _shfs_fio_open_bentry(bentry, 1);
+}
+
+/*
+ * Opens a file without accounting an access to its statistics
+ * (e.g., for background cache warm-up)
+ */
+SHFS_FD shfs_fio_openh_nostats(hash512_t h)
+{
+	struct shfs_bentry *bentry;
+
+	if (unlikely(!shfs_mounted)) {
+		errno = ENODEV;
+		return NULL;
+	}
+
+	bentry = shfs_btable_lookup(shfs_vol.bt, h);
+	if (!bentry) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	return _shfs_fio_open_bentry(bentry, 0);
 }
 
 /*
@@ -248,73 +281,119 @@ void  shfs_fio_link_rpath(SHFS_FD f, char *out, size_t outlen)
 }
 
 /*
- * Slow sync I/O file read functions
+ * Sync I/O file read functions
  * Warning: These functions are using busy-waiting
+ *
+ * Chunk-aligned spans that fit into a (ioalign-aligned) vector element are
+ * read directly into the caller's buffer with multi-chunk requests; up to
+ * SHFS_FIO_MAX_INFLY requests are kept in flight. Only unaligned head and
+ * tail chunks are read to a bounce buffer and copied.
+ * Like cache fills, completed chunks are verified against the checksum
+ * table (if loaded) before the read returns.
  */
-int shfs_fio_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
-{
-	struct shfs_bentry *bentry = (struct shfs_bentry *) f;
-	struct shfs_hentry *hentry = bentry->hentry;
-	void     *chk_buf;
-	chk_t    chk_off;
-	uint64_t byt_off;
-	uint64_t buf_off;
-	uint64_t left;
-	uint64_t rlen;
-	int ret = 0;
-
-	/* check if entry is link to remote file */
-	if (SHFS_HENTRY_ISLINK(hentry))
-		return -EINVAL;
-
-	/* check boundaries */
-	if ((offset > hentry->f_attr.len) ||
-	    ((offset + len) > hentry->f_attr.len))
-		return -EINVAL;
+struct _shfs_fio_rstate {
+	SHFS_AIO_TOKEN *t[SHFS_FIO_MAX_INFLY];
+#ifdef SHFS_CSUM
+	struct {
+		chk_t addr;
+		chk_t len;
+		void *buf;
+	} req[SHFS_FIO_MAX_INFLY];
+#endif
+	unsigned int head;
+	unsigned int nb;
+	int nosched;
+	int ret; /* first error */
+};
 
-	/* pick chunk I/O buffer from pool */
-	chk_buf = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
-	if (!chk_buf)
-		return -ENOMEM;
+static inline void _shfs_fio_rwait_one(struct _shfs_fio_rstate *rs)
+{
+	SHFS_AIO_TOKEN *t = rs->t[rs->head];
+	int ret;
 
-	/* perform the I/O chunk-wise */
-	chk_off = shfs_volchk_foff(f, offset);
-	byt_off = shfs_volchkoff_foff(f, offset);
-	left = len;
-	buf_off = 0;
+	if (rs->nosched) {
+		shfs_aio_wait_nosched(t);
+	} else {
+		shfs_aio_wait(t);
+	}
+	ret = shfs_aio_finalize(t);
+#ifdef SHFS_CSUM
+	if (likely(ret >= 0) && shfs_vol.csum_tbl) {
+		chk_t c;
+
+		for (c = 0; c < rs->req[rs->head].len; ++c) {
+			if (unlikely(shfs_csum_verify(rs->req[rs->head].addr + c,
+						      (uint8_t *) rs->req[rs->head].buf +
+						      CHUNKS_TO_BYTES(c, shfs_vol.chunksize)) < 0)) {
+				shfs_csum_stat_inc(failed);
+				shfs_csum_quarantine(rs->req[rs->head].addr + c);
+				ret = -EIO;
+			} else {
+				shfs_csum_stat_inc(verified);
+			}
+		}
+	}
+#endif
+	if (unlikely(ret < 0 && rs->ret == 0))
+		rs->ret = ret;
+	rs->head = (rs->head + 1) % SHFS_FIO_MAX_INFLY;
+	--rs->nb;
+}
 
-	while (left) {
-		ret = shfs_read_chunk(chk_off, 1, chk_buf);
-		if (ret < 0)
-			goto out;
+static inline int _shfs_fio_rwait_all(struct _shfs_fio_rstate *rs)
+{
+	while (rs->nb)
+		_shfs_fio_rwait_one(rs);
+	return rs->ret;
+}
 
-		rlen = min(shfs_vol.chunksize - byt_off, left);
-		shfs_memcpy((uint8_t *) buf + buf_off,
-			    (uint8_t *) chk_buf + byt_off,
-			    rlen);
-		left -= rlen;
+/* issues reads for len chunks, splitted into requests of up to
+ * SHFS_FIO_MAXCHKS_PER_IO chunks */
+static int _shfs_fio_rissue(struct _shfs_fio_rstate *rs, chk_t start, chk_t len, void *buf)
+{
+	SHFS_AIO_TOKEN *t;
+	chk_t maxchks = SHFS_FIO_MAXCHKS_PER_IO;
+	chk_t n;
+
+	while (len) {
+		if (rs->nb == SHFS_FIO_MAX_INFLY)
+			_shfs_fio_rwait_one(rs);
+
+		n = min(len, maxchks);
+		t = shfs_aread_chunk(start, n, buf, NULL, NULL, NULL);
+		shfs_aio_submit();
+		if (unlikely(!t)) {
+			if (errno != EAGAIN && errno != EBUSY)
+				return -errno;
+			/* out of device requests or AIO tokens */
+			if (rs->nb)
+				_shfs_fio_rwait_one(rs);
+			else if (maxchks > 1)
+				maxchks >>= 1; /* request does not fit into device queue */
+			else if (rs->nosched)
+				shfs_poll_blkdevs();
+			else
+				shfs_aio_wait_slot(); /* yield CPU */
+			continue;
+		}
 
-		++chk_off;   /* go to next chunk */
-		byt_off = 0; /* byte offset is set on the first chunk only */
-		buf_off += rlen;
+		rs->t[(rs->head + rs->nb) % SHFS_FIO_MAX_INFLY] = t;
+#ifdef SHFS_CSUM
+		rs->req[(rs->head + rs->nb) % SHFS_FIO_MAX_INFLY].addr = start;
+		rs->req[(rs->head + rs->nb) % SHFS_FIO_MAX_INFLY].len = n;
+		rs->req[(rs->head + rs->nb) % SHFS_FIO_MAX_INFLY].buf = buf;
+#endif
+		++rs->nb;
+		start += n;
+		len -= n;
+		buf = (uint8_t *) buf + CHUNKS_TO_BYTES(n, shfs_vol.chunksize);
 	}
-
- out:
-	target_free(chk_buf);
-	return ret;
+	return 0;
 }
 
-int shfs_fio_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+static inline int _shfs_fio_check_range(SHFS_FD f, uint64_t offset, uint64_t len)
 {
-	struct shfs_bentry *bentry = (struct shfs_bentry *) f;
-	struct shfs_hentry *hentry = bentry->hentry;
-	void     *chk_buf;
-	chk_t    chk_off;
-	uint64_t byt_off;
-	uint64_t buf_off;
-	uint64_t left;
-	uint64_t rlen;
-	int ret = 0;
+	struct shfs_hentry *hentry = f->hentry;
 
 	/* check if entry is link to remote file */
 	if (SHFS_HENTRY_ISLINK(hentry))
@@ -324,137 +403,265 @@ int shfs_fio_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
 	if ((offset > hentry->f_attr.len) ||
 	    ((offset + len) > hentry->f_attr.len))
 		return -EINVAL;
+	return 0;
+}
 
-	/* pick chunk I/O buffer from pool */
-	chk_buf = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
-	if (!chk_buf)
-		return -ENOMEM;
+static inline __attribute__((always_inline))
+int _shfs_fio_readv(SHFS_FD f, uint64_t offset, const struct shfs_fio_iovec *iov,
+		    unsigned int iovcnt, int nosched)
+{
+	struct _shfs_fio_rstate rs;
+	void     *bbuf = NULL;
+	uint8_t  *dst;
+	chk_t    chk_off;
+	uint64_t byt_off;
+	uint64_t left;
+	uint64_t rlen;
+	uint64_t clen;
+	size_t   iov_off;
+	unsigned int i;
+	chk_t    n;
+	int ret;
+
+	left = 0;
+	for (i = 0; i < iovcnt; ++i)
+		left += iov[i].iov_len;
+	ret = _shfs_fio_check_range(f, offset, left);
+	if (ret < 0)
+		return ret;
+
+	rs.head = 0;
+	rs.nb = 0;
+	rs.nosched = nosched;
+	rs.ret = 0;
 
-	/* perform the I/O chunk-wise */
 	chk_off = shfs_volchk_foff(f, offset);
 	byt_off = shfs_volchkoff_foff(f, offset);
-	left = len;
-	buf_off = 0;
+	i = 0;
+	iov_off = 0;
 
 	while (left) {
-		ret = shfs_read_chunk_nosched(chk_off, 1, chk_buf);
-		if (ret < 0)
+		while (iov[i].iov_len == iov_off) {
+			++i; /* skip exhausted (or empty) vector elements */
+			iov_off = 0;
+		}
+		dst = (uint8_t *) iov[i].iov_base + iov_off;
+
+		/* direct I/O into caller's buffer */
+		n = 0;
+		if (byt_off == 0 && ((uintptr_t) dst & (shfs_vol.ioalign - 1)) == 0)
+			n = min((uint64_t) (iov[i].iov_len - iov_off), left) / shfs_vol.chunksize;
+		if (n) {
+			ret = _shfs_fio_rissue(&rs, chk_off, n, dst);
+			if (unlikely(ret < 0))
+				goto out;
+			clen = CHUNKS_TO_BYTES(n, shfs_vol.chunksize);
+			chk_off += n;
+			iov_off += clen;
+			left -= clen;
+			continue;
+		}
+
+		/* bounce unaligned chunk */
+		if (!bbuf) {
+			bbuf = target_malloc(shfs_vol.ioalign, shfs_vol.chunksize);
+			if (!bbuf) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+		ret = _shfs_fio_rissue(&rs, chk_off, 1, bbuf);
+		if (unlikely(ret < 0))
+			goto out;
+		ret = _shfs_fio_rwait_all(&rs);
+		if (unlikely(ret < 0))
 			goto out;
 
 		rlen = min(shfs_vol.chunksize - byt_off, left);
-		shfs_memcpy((uint8_t *) buf + buf_off,
-			    (uint8_t *) chk_buf + byt_off,
-			    rlen);
 		left -= rlen;
+		while (rlen) {
+			while (iov[i].iov_len == iov_off) {
+				++i;
+				iov_off = 0;
+			}
+			clen = min(rlen, (uint64_t) (iov[i].iov_len - iov_off));
+			shfs_memcpy((uint8_t *) iov[i].iov_base + iov_off,
+				    (uint8_t *) bbuf + byt_off,
+				    clen);
+			iov_off += clen;
+			byt_off += clen;
+			rlen -= clen;
+		}
 
 		++chk_off;   /* go to next chunk */
 		byt_off = 0; /* byte offset is set on the first chunk only */
-		buf_off += rlen;
 	}
 
  out:
-	target_free(chk_buf);
+	/* wait for requests in flight (they write to the caller's buffers) */
+	if (ret < 0)
+		_shfs_fio_rwait_all(&rs);
+	else
+		ret = _shfs_fio_rwait_all(&rs);
+	if (bbuf)
+		target_free(bbuf);
 	return ret;
 }
 
-int shfs_fio_cache_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+int shfs_fio_readv(SHFS_FD f, uint64_t offset, const struct shfs_fio_iovec *iov, unsigned int iovcnt)
+{
+	return _shfs_fio_readv(f, offset, iov, iovcnt, 0);
+}
+
+int shfs_fio_readv_nosched(SHFS_FD f, uint64_t offset, const struct shfs_fio_iovec *iov, unsigned int iovcnt)
+{
+	return _shfs_fio_readv(f, offset, iov, iovcnt, 1);
+}
+
+int shfs_fio_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+{
+	struct shfs_fio_iovec iov = { .iov_base = buf, .iov_len = len };
+
+	return _shfs_fio_readv(f, offset, &iov, 1, 0);
+}
+
+int shfs_fio_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+{
+	struct shfs_fio_iovec iov = { .iov_base = buf, .iov_len = len };
+
+	return _shfs_fio_readv(f, offset, &iov, 1, 1);
+}
+
+/*
+ * Cache references
+ * The reads for all chunks are issued before waiting for the first one
+ */
+static inline __attribute__((always_inline))
+int _shfs_fio_cache_getref(SHFS_FD f, uint64_t offset, uint64_t len,
+			   struct shfs_fio_cref *ref, unsigned int nb_ref, int nosched)
 {
-	struct shfs_bentry *bentry = (struct shfs_bentry *) f;
-	struct shfs_hentry *hentry = bentry->hentry;
-	struct shfs_cache_entry *cce;
 	chk_t    chk_off;
 	uint64_t byt_off;
-	uint64_t buf_off;
-	uint64_t left;
-	uint64_t rlen;
-	int ret = 0;
+	uint32_t rlen;
+	unsigned int i, nb;
+	int ret;
 
-	/* check if entry is link to remote file */
-	if (SHFS_HENTRY_ISLINK(hentry))
-		return -EINVAL;
+	ret = _shfs_fio_check_range(f, offset, len);
+	if (ret < 0)
+		return ret;
+	if (len == 0 || nb_ref == 0)
+		return 0;
 
-	/* check boundaries */
-	if ((offset > hentry->f_attr.len) ||
-	    ((offset + len) > hentry->f_attr.len))
-		return -EINVAL;
-
-	/* perform the I/O chunk-wise */
 	chk_off = shfs_volchk_foff(f, offset);
 	byt_off = shfs_volchkoff_foff(f, offset);
-	left = len;
-	buf_off = 0;
 
-	while (left) {
-		cce = shfs_cache_read(chk_off);
-		if (!cce) {
-			ret = -errno;
-			goto out;
+	/* issue requests
+	 * Note: small reads are served from sub-chunk buffers */
+	for (nb = 0; nb < nb_ref && len; ++nb) {
+		rlen = shfs_cache_range_split(byt_off, min(shfs_vol.chunksize - byt_off, len));
+		ret = shfs_cache_aread_range(chk_off, byt_off, rlen, NULL, NULL, NULL,
+					     &ref[nb].cce, &ref[nb]._t);
+		if (unlikely(ret == -EAGAIN)) {
+			if (nb)
+				break; /* return what we got so far */
+			/* out of buffers or tokens: wait and retry first chunk */
+			do {
+				if (!nosched)
+					schedule();
+				shfs_poll_blkdevs();
+				ret = shfs_cache_aread_range(chk_off, byt_off, rlen, NULL, NULL, NULL,
+							     &ref[nb].cce, &ref[nb]._t);
+			} while (ret == -EAGAIN);
 		}
+		if (unlikely(ret < 0))
+			goto err_release;
 
-		rlen = min(shfs_vol.chunksize - byt_off, left);
-		shfs_memcpy((uint8_t *) buf + buf_off,
-			    (uint8_t *) cce->buffer + byt_off,
-			    rlen);
-		left -= rlen;
+		ref[nb].data = shfs_cache_data(ref[nb].cce, byt_off);
+		ref[nb].len = rlen;
+		len -= rlen;
 
-		shfs_cache_release(cce);
+		byt_off += rlen;
+		if (byt_off == shfs_vol.chunksize) {
+			++chk_off;   /* go to next chunk */
+			byt_off = 0;
+		}
+	}
 
-		++chk_off;   /* go to next chunk */
-		byt_off = 0; /* byte offset is set on the first chunk only */
-		buf_off += rlen;
+	/* wait for completion */
+	ret = 0;
+	for (i = 0; i < nb; ++i) {
+		if (ref[i]._t) {
+			if (nosched) {
+				shfs_aio_wait_nosched(ref[i]._t);
+			} else {
+				shfs_aio_wait(ref[i]._t);
+			}
+			if (shfs_aio_finalize(ref[i]._t) < 0 && ret == 0)
+				ret = -EIO;
+			ref[i]._t = NULL;
+		} else if (unlikely(ref[i].cce->invalid && ret == 0)) {
+			ret = -EIO; /* cache buffer is broken */
+		}
 	}
+	if (unlikely(ret < 0))
+		goto err_release;
+	return (int) nb;
 
- out:
+ err_release:
+	for (i = 0; i < nb; ++i)
+		shfs_cache_release_ioabort(ref[i].cce, ref[i]._t);
 	return ret;
 }
 
-int shfs_fio_cache_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+int shfs_fio_cache_getref(SHFS_FD f, uint64_t offset, uint64_t len,
+			  struct shfs_fio_cref *ref, unsigned int nb_ref)
 {
-	struct shfs_bentry *bentry = (struct shfs_bentry *) f;
-	struct shfs_hentry *hentry = bentry->hentry;
-	struct shfs_cache_entry *cce;
-	chk_t    chk_off;
-	uint64_t byt_off;
-	uint64_t buf_off;
-	uint64_t left;
-	uint64_t rlen;
-	int ret = 0;
+	return _shfs_fio_cache_getref(f, offset, len, ref, nb_ref, 0);
+}
 
-	/* check if entry is link to remote file */
-	if (SHFS_HENTRY_ISLINK(hentry))
-		return -EINVAL;
+int shfs_fio_cache_getref_nosched(SHFS_FD f, uint64_t offset, uint64_t len,
+				  struct shfs_fio_cref *ref, unsigned int nb_ref)
+{
+	return _shfs_fio_cache_getref(f, offset, len, ref, nb_ref, 1);
+}
 
-	/* check boundaries */
-	if ((offset > hentry->f_attr.len) ||
-	    ((offset + len) > hentry->f_attr.len))
-		return -EINVAL;
+void shfs_fio_cache_putref(struct shfs_fio_cref *ref, unsigned int nb_ref)
+{
+	unsigned int i;
 
-	/* perform the I/O chunk-wise */
-	chk_off = shfs_volchk_foff(f, offset);
-	byt_off = shfs_volchkoff_foff(f, offset);
-	left = len;
-	buf_off = 0;
+	for (i = 0; i < nb_ref; ++i)
+		shfs_cache_release(ref[i].cce);
+}
 
-	while (left) {
-		cce = shfs_cache_read_nosched(chk_off);
-		if (!cce) {
-			ret = -errno;
-			goto out;
+static inline __attribute__((always_inline))
+int _shfs_fio_cache_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len, int nosched)
+{
+	struct shfs_fio_cref ref[SHFS_FIO_MAX_CREFS];
+	uint64_t buf_off = 0;
+	int i, nb;
+
+	while (len) {
+		nb = _shfs_fio_cache_getref(f, offset, len, ref, SHFS_FIO_MAX_CREFS, nosched);
+		if (unlikely(nb < 0))
+			return nb;
+
+		for (i = 0; i < nb; ++i) {
+			shfs_memcpy((uint8_t *) buf + buf_off, ref[i].data, ref[i].len);
+			buf_off += ref[i].len;
+			offset += ref[i].len;
+			len -= ref[i].len;
 		}
-
-		rlen = min(shfs_vol.chunksize - byt_off, left);
-		shfs_memcpy((uint8_t *) buf + buf_off,
-			    (uint8_t *) cce->buffer + byt_off,
-			    rlen);
-		left -= rlen;
-
-		shfs_cache_release(cce);
-
-		++chk_off;   /* go to next chunk */
-		byt_off = 0; /* byte offset is set on the first chunk only */
-		buf_off += rlen;
+		shfs_fio_cache_putref(ref, nb);
 	}
+	return 0;
+}
 
- out:
-	return ret;
+int shfs_fio_cache_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+{
+	return _shfs_fio_cache_read(f, offset, buf, len, 0);
+}
+
+int shfs_fio_cache_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len)
+{
+	return _shfs_fio_cache_read(f, offset, buf, len, 1);
 }
@@ -60,6 +60,11 @@ SHFS_FD shfs_fio_open(const char *path);
  * Opens a file/object via a hash digest
  */
 SHFS_FD shfs_fio_openh(hash512_t h);
+/**
+ * Opens a file/object via a hash digest without
+ * accounting the access to the element statistics
+ */
+SHFS_FD shfs_fio_openh_nostats(hash512_t h);
 /**
  * Creates a file descriptor clone
  */
@@ -132,13 +137,45 @@ static inline int shfs_fio_set_cookie(SHFS_FD f, void *cookie) {
  * Simple but synchronous file read
  * Note: Busy-waiting is used
  */
-/* direct read */
+#define SHFS_FIO_MAXCHKS_PER_IO 8 /* max. chunks per direct I/O request */
+#define SHFS_FIO_MAX_INFLY      4 /* max. direct I/O requests in flight */
+#define SHFS_FIO_MAX_CREFS      8 /* cache references per round of cache_read */
+
+struct shfs_fio_iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+/* direct read (chunk-aligned spans are read without copying) */
+int shfs_fio_readv(SHFS_FD f, uint64_t offset, const struct shfs_fio_iovec *iov, unsigned int iovcnt);
+int shfs_fio_readv_nosched(SHFS_FD f, uint64_t offset, const struct shfs_fio_iovec *iov, unsigned int iovcnt);
 int shfs_fio_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len);
 int shfs_fio_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len);
 /* read is using cache */
 int shfs_fio_cache_read(SHFS_FD f, uint64_t offset, void *buf, uint64_t len);
 int shfs_fio_cache_read_nosched(SHFS_FD f, uint64_t offset, void *buf, uint64_t len);
 
+/*
+ * References to cache buffers covering [offset, offset + len)
+ * Fills up to nb_ref references (one per chunk) and returns the number
+ * of filled ones, a negative error code otherwise. The filled references
+ * might cover less than len bytes; they have to be released with
+ * shfs_fio_cache_putref() afterwards.
+ */
+struct shfs_fio_cref {
+	struct shfs_cache_entry *cce;
+	void *data; /* points into cce->buffer */
+	size_t len;
+
+	SHFS_AIO_TOKEN *_t; /* private */
+};
+
+int shfs_fio_cache_getref(SHFS_FD f, uint64_t offset, uint64_t len,
+			  struct shfs_fio_cref *ref, unsigned int nb_ref);
+int shfs_fio_cache_getref_nosched(SHFS_FD f, uint64_t offset, uint64_t len,
+				  struct shfs_fio_cref *ref, unsigned int nb_ref);
+void shfs_fio_cache_putref(struct shfs_fio_cref *ref, unsigned int nb_ref);
+
 /*
  * Async file read
  */
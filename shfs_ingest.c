@@ -0,0 +1,851 @@
+/*
+ * Writable volume support for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#include <target/sys.h>
+#include <errno.h>
+#include <string.h>
+
+#include "likely.h"
+#include "shfs_ingest.h"
+#include "shfs.h"
+#include "shfs_btable.h"
+#include "shfs_alloc.h"
+#include "shfs_cache.h"
+#include "memacct.h"
+#ifdef SHFS_STATS
+#include "shfs_stats.h"
+#endif
+#ifdef SHFS_CSUM
+#include "shfs_csum.h"
+#endif
+
+#ifdef SHFS_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+/* operations that wait for a hash table update (the head is processed) */
+static struct dlist_head shfs_ingest_queue;
+/* operations with deferred submissions, served by shfs_ingest_poll() */
+struct dlist_head shfs_ingest_retry_queue;
+
+static void _shfs_ingest_run_queue(void);
+
+/* digests of SHA-256 volumes are computed on the fly */
+#define shfs_ingest_computes_hash() \
+	(shfs_vol.hfunc == SHFUNC_SHA && shfs_vol.hlen == SHA256_DIGEST_LEN)
+
+static struct shfs_ingest *_shfs_ingest_alloc(enum shfs_ingest_type type, unsigned int nb_buffers)
+{
+	struct shfs_ingest *si;
+	unsigned int i;
+
+	si = memacct_malloc(MEMT_SHFS, sizeof(void *), sizeof(*si));
+	if (!si) {
+		errno = ENOMEM;
+		goto err_out;
+	}
+	memset(si, 0, sizeof(*si));
+	for (i = 0; i < nb_buffers; ++i) {
+		si->buf[i] = memacct_malloc(MEMT_SHFS, shfs_vol.ioalign, shfs_vol.chunksize);
+		if (!si->buf[i]) {
+			errno = ENOMEM;
+			goto err_free_buffers;
+		}
+		++si->nb_buffers;
+	}
+	si->type = type;
+	si->state = SIS_WRITING;
+	dlist_init_el(si, queue);
+	dlist_init_el(si, retry);
+
+	++shfs_vol.nb_ingest;
+	++shfs_nb_open; /* keeps the volume mounted */
+	return si;
+
+ err_free_buffers:
+	for (i = 0; i < si->nb_buffers; ++i)
+		memacct_free(MEMT_SHFS, si->buf[i], shfs_vol.chunksize);
+	memacct_free(MEMT_SHFS, si, sizeof(*si));
+ err_out:
+	return NULL;
+}
+
+static void _shfs_ingest_free(struct shfs_ingest *si)
+{
+	unsigned int i;
+
+	for (i = 0; i < si->nb_buffers; ++i)
+		memacct_free(MEMT_SHFS, si->buf[i], shfs_vol.chunksize);
+	--shfs_vol.nb_ingest;
+	--shfs_nb_open;
+	memacct_free(MEMT_SHFS, si, sizeof(*si));
+}
+
+/* a submission did not fit into the device request queue */
+static inline void _shfs_ingest_defer(struct shfs_ingest *si)
+{
+	if (!dlist_is_linked(si, shfs_ingest_retry_queue, retry))
+		dlist_append(si, shfs_ingest_retry_queue, retry);
+}
+
+static inline void _shfs_ingest_undefer(struct shfs_ingest *si)
+{
+	if (dlist_is_linked(si, shfs_ingest_retry_queue, retry))
+		dlist_unlink(si, shfs_ingest_retry_queue, retry);
+}
+
+static void _shfs_ingest_finish(struct shfs_ingest *si, int ret)
+{
+	_shfs_ingest_undefer(si);
+	si->ret = ret;
+	si->state = SIS_DONE;
+	if (si->orphan) {
+		_shfs_ingest_free(si);
+		return;
+	}
+	if (si->dcb)
+		si->dcb(si, ret, si->cb_argp);
+}
+
+/* undoes the reservations of a failed operation */
+static void _shfs_ingest_fail(struct shfs_ingest *si, int ret)
+{
+	printd("Operation %p failed: %d\n", si, ret);
+	if (si->type == SIT_STORE) {
+		shfs_alist_unregister(shfs_vol.al, si->cchk, si->csize);
+	} else {
+		up(&si->bentry->updatelock);
+		si->bentry->update = 0;
+	}
+	_shfs_ingest_finish(si, ret);
+}
+
+/******************************************************************************
+ * File contents
+ ******************************************************************************/
+#ifdef SHFS_CSUM
+static int _shfs_ingest_csum_write(struct shfs_ingest *si);
+#define _shfs_ingest_is_flushed(si) \
+	((si)->nb_infly == 0 && (si)->nb_ready == 0 && (si)->csum_left == 0)
+#else
+#define _shfs_ingest_is_flushed(si) \
+	((si)->nb_infly == 0 && (si)->nb_ready == 0)
+#endif
+
+/* called when all submitted writes of a committed operation completed */
+static void _shfs_ingest_flushed(struct shfs_ingest *si)
+{
+#ifdef SHFS_CSUM
+	int ret;
+#endif
+
+	if (si->ret < 0) {
+		_shfs_ingest_fail(si, si->ret);
+		return;
+	}
+#ifdef SHFS_CSUM
+	if (shfs_vol.csum_tbl && si->csize && !si->csum_written) {
+		/* checksums have to be on the device before the entry is published */
+		si->csum_written = 1;
+		si->csum_left = SHFS_CSUM_CHUNK_NO(si->cchk + si->csize - 1, shfs_vol.chunksize)
+		                - SHFS_CSUM_CHUNK_NO(si->cchk, shfs_vol.chunksize) + 1;
+		ret = _shfs_ingest_csum_write(si);
+		if (unlikely(ret < 0)) {
+			si->ret = ret;
+			si->csum_left = 0;
+		}
+		if (!_shfs_ingest_is_flushed(si))
+			return; /* continues on write completion */
+		if (si->ret < 0) {
+			_shfs_ingest_fail(si, si->ret);
+			return;
+		}
+	}
+#endif
+
+	si->state = SIS_QUEUED;
+	dlist_append(si, shfs_ingest_queue, queue);
+	_shfs_ingest_run_queue();
+}
+
+static void _shfs_ingest_wcb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
+{
+	struct shfs_ingest *si = (struct shfs_ingest *) cookie;
+	unsigned int idx = (unsigned int) (uintptr_t) argp;
+	size_t len;
+	int ret;
+
+	ret = shfs_aio_finalize(t);
+	if (unlikely(ret < 0 && si->ret == 0)) {
+		printd("Could not write container chunk of %p: %d\n", si, ret);
+		si->ret = -EIO;
+	}
+#ifdef SHFS_CSUM
+	/* the checksum describes what is on the device now */
+	if (likely(ret >= 0))
+		shfs_csum_set(si->cchk + si->bchk[idx], si->buf[idx]);
+#endif
+	si->t[idx] = NULL;
+	--si->nb_infly;
+
+	len = si->blen[idx];
+	si->blen[idx] = 0;
+	if (si->wcb)
+		si->wcb(si, len, si->cb_argp);
+
+	if (si->state == SIS_FLUSHING && _shfs_ingest_is_flushed(si))
+		_shfs_ingest_flushed(si);
+}
+
+#ifdef SHFS_CSUM
+static void _shfs_ingest_ccb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
+{
+	struct shfs_ingest *si = (struct shfs_ingest *) cookie;
+	int ret;
+
+	ret = shfs_aio_finalize(t);
+	if (unlikely(ret < 0 && si->ret == 0)) {
+		printd("Could not write checksum table chunk of %p: %d\n", si, ret);
+		si->ret = -EIO;
+	}
+	--si->nb_infly;
+
+	if (si->state == SIS_FLUSHING && _shfs_ingest_is_flushed(si))
+		_shfs_ingest_flushed(si);
+}
+
+/* writes the checksum table chunks that cover the container
+ *  Chunks that do not fit into the device request queue are submitted
+ *  later by shfs_ingest_poll() */
+static int _shfs_ingest_csum_write(struct shfs_ingest *si)
+{
+	chk_t last = SHFS_CSUM_CHUNK_NO(si->cchk + si->csize - 1, shfs_vol.chunksize);
+	SHFS_AIO_TOKEN *t;
+	chk_t c;
+	int ret = 0;
+
+	while (si->csum_left) {
+		c = last - si->csum_left + 1;
+		t = shfs_awrite_chunk(shfs_vol.csum_ref + c, 1,
+		                      (uint8_t *) shfs_vol.csum_tbl + CHUNKS_TO_BYTES(c, shfs_vol.chunksize),
+		                      _shfs_ingest_ccb, si, NULL);
+		if (unlikely(!t)) {
+			if (errno == EAGAIN || errno == EBUSY)
+				_shfs_ingest_defer(si);
+			else
+				ret = -errno;
+			break;
+		}
+		++si->nb_infly;
+		--si->csum_left;
+	}
+	shfs_aio_submit();
+	return ret;
+}
+#endif
+
+/* submits the complete chunk buffers in order
+ *  Buffers that do not fit into the device request queue are submitted
+ *  later by shfs_ingest_poll() */
+static int _shfs_ingest_submit(struct shfs_ingest *si)
+{
+	SHFS_AIO_TOKEN *t;
+	unsigned int idx;
+	int ret = 0;
+
+	while (si->nb_ready) {
+		idx = si->sidx;
+		t = shfs_awrite_chunk(si->cchk + si->wchk, 1, si->buf[idx],
+		                      _shfs_ingest_wcb, si, (void *) (uintptr_t) idx);
+		if (unlikely(!t)) {
+			if (errno == EAGAIN || errno == EBUSY)
+				_shfs_ingest_defer(si);
+			else
+				ret = -errno;
+			break;
+		}
+		si->t[idx] = t;
+#ifdef SHFS_CSUM
+		si->bchk[idx] = si->wchk;
+#endif
+		++si->nb_infly;
+		++si->wchk;
+		si->sidx = (idx + 1) % si->nb_buffers;
+		--si->nb_ready;
+	}
+	shfs_aio_submit();
+	return ret;
+}
+
+struct shfs_ingest *shfs_ingest_open(uint64_t fsize, const char *name, const char *mime,
+                                     const hash512_t h, shfs_ingest_wcb_t *wcb, void *cb_argp)
+{
+	struct shfs_ingest *si;
+	chk_t csize;
+	chk_t cchk;
+	int ret;
+
+	if (unlikely(!shfs_mounted)) {
+		errno = ENODEV;
+		goto err_out;
+	}
+	if (!shfs_vol.al) {
+		errno = EROFS;
+		goto err_out;
+	}
+	if (!shfs_ingest_computes_hash()) {
+		if (shfs_vol.hfunc != SHFUNC_MANUAL) {
+			errno = ENOTSUP;
+			goto err_out;
+		}
+		if (!h) {
+			errno = EINVAL;
+			goto err_out;
+		}
+	}
+	if (h && hash_is_zero(h, shfs_vol.hlen)) {
+		errno = EINVAL;
+		goto err_out;
+	}
+	if (shfs_vol.nb_ingest >= SHFS_INGEST_MAX_JOBS) {
+		errno = EBUSY;
+		goto err_out;
+	}
+
+	csize = DIV_ROUND_UP(fsize, shfs_vol.chunksize);
+	si = _shfs_ingest_alloc(SIT_STORE, (csize < SHFS_INGEST_NB_BUFFERS) ?
+	                                   ((csize > 0) ? (unsigned int) csize : 1) :
+	                                   SHFS_INGEST_NB_BUFFERS);
+	if (!si)
+		goto err_out;
+
+	/* find and reserve container
+	 * Note: an empty file does not occupy any chunk, its container is
+	 *       placed into the volume label area that is always allocated */
+	cchk = csize ? shfs_alist_find_free(shfs_vol.al, csize) : 1;
+	if (cchk == 0 || cchk >= shfs_vol.volsize) {
+		printd("Could not find a free volume area of %"PRIchk" chunks\n", csize);
+		errno = ENOSPC;
+		goto err_free_si;
+	}
+	ret = shfs_alist_register(shfs_vol.al, cchk, csize);
+	if (ret < 0) {
+		errno = -ret;
+		goto err_free_si;
+	}
+	printd("Reserved container %"PRIchk"-%"PRIchk" for %"PRIu64" bytes\n",
+	       cchk, cchk + csize, fsize);
+
+	si->cchk = cchk;
+	si->csize = csize;
+	si->fsize = fsize;
+	si->pos = 0;
+	si->wchk = 0;
+	si->bidx = 0;
+	si->sidx = 0;
+	si->nb_ready = 0;
+	if (h) {
+		hash_copy(si->hash, h, shfs_vol.hlen);
+		si->hash_given = 1;
+	}
+	if (name)
+		strncpy(si->name, name, sizeof(si->name));
+	if (mime)
+		strncpy(si->mime, mime, sizeof(si->mime));
+	if (shfs_ingest_computes_hash())
+		sha256_init(&si->sha);
+	si->wcb = wcb;
+	si->cb_argp = cb_argp;
+	return si;
+
+ err_free_si:
+	_shfs_ingest_free(si);
+ err_out:
+	return NULL;
+}
+
+size_t shfs_ingest_room(struct shfs_ingest *si)
+{
+	uint32_t off = (uint32_t) (si->pos % shfs_vol.chunksize);
+	unsigned int idx;
+	unsigned int i;
+	size_t room = 0;
+
+	if (unlikely(si->state != SIS_WRITING || si->ret < 0))
+		return si->fsize - si->pos; /* write reports the error */
+
+	/* buffers are filled in ring order: count the free ones from the
+	 * current one on (in-flight buffers can complete out of order) */
+	for (i = 0; i < si->nb_buffers - si->nb_ready; ++i) {
+		idx = (si->bidx + i) % si->nb_buffers;
+		if (si->t[idx])
+			break;
+		room += shfs_vol.chunksize - (i == 0 ? off : 0);
+	}
+	return min(room, si->fsize - si->pos);
+}
+
+int shfs_ingest_write(struct shfs_ingest *si, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t off;
+	size_t n;
+	int ret;
+
+	if (unlikely(si->state != SIS_WRITING))
+		return -EINVAL;
+	if (unlikely(si->ret < 0))
+		return si->ret;
+	if (unlikely(len > si->fsize - si->pos))
+		return -EFBIG;
+	if (unlikely(len > shfs_ingest_room(si)))
+		return -EAGAIN; /* all buffers are busy: wait for write callback */
+
+	if (shfs_ingest_computes_hash())
+		sha256_update(&si->sha, buf, len);
+
+	while (len) {
+		off = (uint32_t) (si->pos % shfs_vol.chunksize);
+		n = shfs_vol.chunksize - off;
+		if (n > len)
+			n = len;
+		shfs_memcpy((uint8_t *) si->buf[si->bidx] + off, p, n);
+		si->blen[si->bidx] += n;
+		si->pos += n;
+		p       += n;
+		len     -= n;
+
+		if (off + n == shfs_vol.chunksize || si->pos == si->fsize) {
+			/* chunk is complete: zero tail of last chunk and write it out */
+			if (off + n < shfs_vol.chunksize)
+				memset((uint8_t *) si->buf[si->bidx] + off + n, 0,
+				       shfs_vol.chunksize - off - n);
+			++si->nb_ready;
+			si->bidx = (si->bidx + 1) % si->nb_buffers;
+		}
+	}
+
+	ret = _shfs_ingest_submit(si);
+	if (unlikely(ret < 0)) {
+		si->ret = ret;
+		return ret;
+	}
+	return 0;
+}
+
+int shfs_ingest_commit(struct shfs_ingest *si, shfs_ingest_dcb_t *dcb)
+{
+	uint8_t digest[SHA256_DIGEST_LEN];
+
+	if (unlikely(si->type != SIT_STORE || si->state != SIS_WRITING))
+		return -EINVAL;
+	if (unlikely(si->pos != si->fsize))
+		return -EINVAL; /* incomplete contents */
+
+	if (shfs_ingest_computes_hash()) {
+		sha256_final(&si->sha, digest);
+		if (si->hash_given) {
+			if (hash_compare(si->hash, digest, shfs_vol.hlen) != 0 &&
+			    si->ret == 0)
+				si->ret = -EBADMSG;
+		} else {
+			hash_copy(si->hash, digest, shfs_vol.hlen);
+		}
+	}
+
+	si->dcb = dcb;
+	si->state = SIS_FLUSHING;
+	if (_shfs_ingest_is_flushed(si))
+		_shfs_ingest_flushed(si);
+	return 0;
+}
+
+/******************************************************************************
+ * Hash table update
+ ******************************************************************************/
+/* searches a free entry in the hash table bucket of h */
+static int _shfs_ingest_find_slot(const hash512_t h, uint64_t *ent_idx)
+{
+	struct htable *bt = shfs_vol.bt;
+	struct htable_bkt *b;
+	uint32_t bkt_idx;
+	uint32_t i;
+
+	bkt_idx = _htable_bkt_no(h, bt->hlen, bt->nb_bkts);
+	b = bt->b[bkt_idx];
+	for (i = 0; i < bt->el_per_bkt; ++i) {
+		if (hash_is_zero(b->h[i], bt->hlen)) {
+			*ent_idx = ((uint64_t) bkt_idx * bt->el_per_bkt) + i;
+			return 0;
+		}
+	}
+	return -ENOSPC; /* bucket is full */
+}
+
+/* applies the written hash table entry to the in-memory tables */
+static void _shfs_ingest_apply(struct shfs_ingest *si)
+{
+	struct shfs_bentry *bentry;
+	struct shfs_hentry *hentry;
+	chk_t c = SHFS_HTABLE_CHUNK_NO(si->ent_idx, shfs_vol.htable_nb_entries_per_chunk);
+	off_t o = SHFS_HTABLE_ENTRY_OFFSET(si->ent_idx, shfs_vol.htable_nb_entries_per_chunk);
+#ifdef SHFS_STATS
+	struct shfs_el_stats el_stats;
+#endif
+	chk_t fchk, fsize;
+	int islink;
+
+	hentry = (struct shfs_hentry *)((uint8_t *) shfs_vol.htable_chunk_cache[c] + o);
+	if (si->type == SIT_STORE) {
+		/* drop buffers that were cached from this area before */
+		shfs_cache_invalidate(si->cchk, si->csize);
+
+		memcpy(hentry, (uint8_t *) si->buf[0] + o, sizeof(*hentry));
+		bentry = shfs_btable_feed(shfs_vol.bt, si->ent_idx, hentry->hash);
+#ifdef SHFS_CSUM
+		bentry->quarantine = 0;
+#endif
+#ifdef SHFS_STATS
+		/* load stats from miss table */
+		shfs_stats_set(bentry, shfs_stats_mstats_lookup(hentry->hash));
+		shfs_stats_mstats_drop(hentry->hash);
+#endif
+		printd("Entry %"PRIu64" published (container %"PRIchk"-%"PRIchk")\n",
+		       si->ent_idx, si->cchk, si->cchk + si->csize);
+	} else {
+		bentry = si->bentry;
+#ifdef SHFS_STATS
+		/* move current stats to miss table */
+		shfs_stats_collect(bentry, &el_stats);
+		shfs_stats_mstats_store(hentry->hash, &el_stats);
+		shfs_stats_set(bentry, NULL);
+#endif
+		islink = SHFS_HENTRY_ISLINK(hentry);
+		fchk = hentry->f_attr.chunk;
+		fsize = DIV_ROUND_UP(hentry->f_attr.offset + hentry->f_attr.len,
+		                     shfs_vol.chunksize);
+
+		memcpy(hentry, (uint8_t *) si->buf[0] + o, sizeof(*hentry));
+		shfs_btable_feed(shfs_vol.bt, si->ent_idx, hentry->hash);
+		if (shfs_vol.def_bentry == bentry)
+			shfs_vol.def_bentry = NULL;
+
+		/* release container */
+		if (!islink) {
+			shfs_alist_unregister(shfs_vol.al, fchk, fsize);
+			shfs_cache_invalidate(fchk, fsize);
+		}
+
+		/* unlock entry */
+		up(&bentry->updatelock);
+		bentry->update = 0;
+		printd("Entry %"PRIu64" removed\n", si->ent_idx);
+	}
+}
+
+/* the on-disk state is known now: finish this operation */
+static void _shfs_ingest_htdone(struct shfs_ingest *si)
+{
+	dlist_unlink(si, shfs_ingest_queue, queue);
+	if (si->ht_ret < 0) {
+		_shfs_ingest_fail(si, si->ht_ret);
+	} else {
+		_shfs_ingest_apply(si);
+		_shfs_ingest_finish(si, 0);
+	}
+	_shfs_ingest_run_queue();
+}
+
+static void _shfs_ingest_htcb(SHFS_AIO_TOKEN *t, void *cookie, void *argp)
+{
+	struct shfs_ingest *si = (struct shfs_ingest *) cookie;
+	int primary = (argp == NULL);
+	int ret;
+
+	ret = shfs_aio_finalize(t);
+	if (unlikely(ret < 0)) {
+		printd("Could not write %s hash table chunk: %d\n",
+		       primary ? "primary" : "backup", ret);
+		if (primary)
+			si->ht_ret = -EIO;
+	}
+	if (--si->ht_left || si->ht_todo)
+		return;
+	_shfs_ingest_htdone(si);
+}
+
+/* submits the pending hash table chunk writes (si->ht_todo) of an operation
+ *  Writes that do not fit into the device request queue are submitted
+ *  later by shfs_ingest_poll(). A failed primary write is returned, the
+ *  backup write is skipped then */
+static int _shfs_ingest_htwrite(struct shfs_ingest *si)
+{
+	chk_t c = SHFS_HTABLE_CHUNK_NO(si->ent_idx, shfs_vol.htable_nb_entries_per_chunk);
+	SHFS_AIO_TOKEN *t;
+	int ret = 0;
+
+	if (si->ht_todo & SIH_PRIMARY) {
+		t = shfs_awrite_chunk(shfs_vol.htable_ref + c, 1, si->buf[0],
+		                      _shfs_ingest_htcb, si, NULL);
+		if (unlikely(!t)) {
+			if (errno == EAGAIN || errno == EBUSY) {
+				_shfs_ingest_defer(si);
+			} else {
+				ret = -errno;
+				si->ht_todo = 0;
+			}
+			goto out;
+		}
+		si->ht_todo &= ~SIH_PRIMARY;
+		++si->ht_left;
+	}
+	if (si->ht_todo & SIH_BACKUP) {
+		t = shfs_awrite_chunk(shfs_vol.htable_bak_ref + c, 1, si->buf[0],
+		                      _shfs_ingest_htcb, si, (void *) si);
+		if (unlikely(!t)) {
+			if (errno == EAGAIN || errno == EBUSY) {
+				_shfs_ingest_defer(si);
+				goto out;
+			}
+			printd("Could not write backup hash table chunk\n");
+		} else {
+			++si->ht_left;
+		}
+		si->ht_todo &= ~SIH_BACKUP;
+	}
+
+ out:
+	shfs_aio_submit();
+	return ret;
+}
+
+/* writes the modified hash table chunk of an operation */
+static int _shfs_ingest_publish(struct shfs_ingest *si)
+{
+	struct shfs_hentry *hentry;
+	chk_t c;
+	off_t o;
+	int ret;
+
+	if (si->type == SIT_STORE) {
+		if (shfs_btable_lookup(shfs_vol.bt, si->hash))
+			return -EEXIST;
+		ret = _shfs_ingest_find_slot(si->hash, &si->ent_idx);
+		if (ret < 0)
+			return ret;
+	}
+
+	c = SHFS_HTABLE_CHUNK_NO(si->ent_idx, shfs_vol.htable_nb_entries_per_chunk);
+	o = SHFS_HTABLE_ENTRY_OFFSET(si->ent_idx, shfs_vol.htable_nb_entries_per_chunk);
+	shfs_memcpy(si->buf[0], shfs_vol.htable_chunk_cache[c], shfs_vol.chunksize);
+	hentry = (struct shfs_hentry *)((uint8_t *) si->buf[0] + o);
+	if (si->type == SIT_STORE) {
+		hash_copy(hentry->hash, si->hash, shfs_vol.hlen);
+		hentry->f_attr.chunk = si->cchk;
+		hentry->f_attr.offset = 0;
+		hentry->f_attr.len = si->fsize;
+		hentry->ts_creation = gettimestamp_s();
+		hentry->flags = 0;
+		memcpy(hentry->f_attr.mime, si->mime, sizeof(hentry->f_attr.mime));
+		memset(hentry->f_attr.encoding, 0, sizeof(hentry->f_attr.encoding));  /* currently unused */
+		memcpy(hentry->name, si->name, sizeof(hentry->name));
+	} else {
+		hash_clear(hentry->hash, shfs_vol.hlen);
+	}
+
+	si->state = SIS_PUBLISHING;
+	si->ht_ret = 0;
+	si->ht_left = 0;
+	si->ht_todo = SIH_PRIMARY | (shfs_vol.htable_bak_ref ? SIH_BACKUP : 0);
+	ret = _shfs_ingest_htwrite(si);
+	if (ret < 0) {
+		si->state = SIS_QUEUED;
+		return ret;
+	}
+	return 0;
+}
+
+static void _shfs_ingest_run_queue(void)
+{
+	struct shfs_ingest *si;
+	int ret;
+
+	while ((si = dlist_first_el(shfs_ingest_queue, struct shfs_ingest)) != NULL) {
+		if (si->state == SIS_PUBLISHING)
+			return; /* busy, continues on completion */
+
+		ret = _shfs_ingest_publish(si);
+		if (ret == 0)
+			return;
+		dlist_unlink(si, shfs_ingest_queue, queue);
+		_shfs_ingest_fail(si, ret);
+	}
+}
+
+struct shfs_ingest *shfs_ingest_remove(const hash512_t h, shfs_ingest_dcb_t *dcb, void *cb_argp)
+{
+	struct shfs_ingest *si;
+	struct shfs_bentry *bentry;
+
+	if (unlikely(!shfs_mounted)) {
+		errno = ENODEV;
+		goto err_out;
+	}
+	if (!shfs_vol.al) {
+		errno = EROFS;
+		goto err_out;
+	}
+	if (shfs_vol.nb_ingest >= SHFS_INGEST_MAX_JOBS) {
+		errno = EBUSY;
+		goto err_out;
+	}
+
+	bentry = shfs_btable_lookup(shfs_vol.bt, (uint8_t *) h);
+	if (!bentry) {
+		errno = ENOENT;
+		goto err_out;
+	}
+	if (bentry->update || bentry->refcount) {
+		errno = EBUSY; /* file is open or updated */
+		goto err_out;
+	}
+
+	si = _shfs_ingest_alloc(SIT_REMOVE, 1);
+	if (!si)
+		goto err_out;
+
+	/* lock entry: forbid further open() */
+	bentry->update = 1;
+	trydown(&bentry->updatelock);
+
+	si->bentry = bentry;
+	si->ent_idx = ((uint64_t) bentry->hentry_htchunk * shfs_vol.htable_nb_entries_per_chunk)
+	              + (bentry->hentry_htoffset / SHFS_HENTRY_SIZE);
+	hash_copy(si->hash, h, shfs_vol.hlen);
+	si->dcb = dcb;
+	si->cb_argp = cb_argp;
+
+	si->state = SIS_QUEUED;
+	dlist_append(si, shfs_ingest_queue, queue);
+	_shfs_ingest_run_queue(); /* Note: dcb might be called already */
+	return si;
+
+ err_out:
+	return NULL;
+}
+
+/* resubmits deferred writes */
+void _shfs_ingest_poll(void)
+{
+	struct shfs_ingest *si;
+	unsigned int n = 0;
+	int ret;
+
+	/* only the operations that are deferred currently are served: an
+	 * operation that still does not fit is appended again and completions
+	 * can finish (and unlink) any other operation of the queue */
+	dlist_foreach(si, shfs_ingest_retry_queue, retry)
+		++n;
+	while (n-- && (si = dlist_first_el(shfs_ingest_retry_queue, struct shfs_ingest))) {
+		dlist_unlink(si, shfs_ingest_retry_queue, retry);
+
+		switch (si->state) {
+		case SIS_WRITING:
+		case SIS_FLUSHING:
+			ret = _shfs_ingest_submit(si);
+#ifdef SHFS_CSUM
+			if (ret == 0 && si->csum_left)
+				ret = _shfs_ingest_csum_write(si);
+#endif
+			if (unlikely(ret < 0)) {
+				printd("Could not submit deferred writes of %p: %d\n", si, ret);
+				_shfs_ingest_undefer(si);
+				if (si->ret == 0)
+					si->ret = ret;
+				si->nb_ready = 0;
+#ifdef SHFS_CSUM
+				si->csum_left = 0;
+#endif
+				if (si->wcb)
+					si->wcb(si, 0, si->cb_argp); /* notify owner */
+			}
+			if (si->state == SIS_FLUSHING && _shfs_ingest_is_flushed(si))
+				_shfs_ingest_flushed(si);
+			break;
+		case SIS_PUBLISHING:
+			ret = _shfs_ingest_htwrite(si);
+			if (unlikely(ret < 0)) {
+				printd("Could not write primary hash table chunk: %d\n", ret);
+				si->ht_ret = ret;
+			}
+			if (si->ht_left == 0 && si->ht_todo == 0)
+				_shfs_ingest_htdone(si);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void shfs_ingest_close(struct shfs_ingest *si)
+{
+	si->wcb = NULL;
+	si->dcb = NULL;
+
+	switch (si->state) {
+	case SIS_WRITING:
+		/* abort store: unsubmitted buffers are dropped,
+		 * outstanding writes complete in background */
+		_shfs_ingest_undefer(si);
+		si->nb_ready = 0;
+		if (si->nb_infly == 0) {
+			shfs_alist_unregister(shfs_vol.al, si->cchk, si->csize);
+			_shfs_ingest_free(si);
+			break;
+		}
+		si->ret = -ECANCELED;
+		si->state = SIS_FLUSHING;
+		si->orphan = 1;
+		break;
+	case SIS_DONE:
+		_shfs_ingest_free(si);
+		break;
+	default:
+		/* committed: the operation completes in background */
+		si->orphan = 1;
+		break;
+	}
+}
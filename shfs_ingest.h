@@ -0,0 +1,202 @@
+/*
+ * Writable volume support for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _SHFS_INGEST_H_
+#define _SHFS_INGEST_H_
+
+#include <target/sys.h>
+#include "shfs.h"
+#include "shfs_defs.h"
+#include "sha256.h"
+#include "dlist.h"
+
+/*
+ * Storing and removing files on a mounted volume
+ *
+ * A file is stored by streaming its contents with shfs_ingest_write() to a
+ * volume area that was reserved on shfs_ingest_open(). Full chunks are
+ * written asynchronously from a small ring of chunk buffers (write-behind)
+ * while the hash digest is computed on the fly. Writing never waits for the
+ * device: shfs_ingest_room() tells how much data fits into the free chunk
+ * buffers, the owner is notified by the write callback when buffers became
+ * free again. Writes that did not fit into the device request queue are
+ * resubmitted by shfs_ingest_poll() from the main loop. shfs_ingest_commit()
+ * finally publishes the new hash table entry: The modified hash table chunk
+ * is written to the device first, the in-memory tables are updated after
+ * the write succeeded. Hash table updates are serialized, so that a file
+ * becomes visible atomically (or not at all).
+ *
+ * Digests are computed for SHA-256 volumes, volumes with manual hash
+ * digests require the digest to be passed on open.
+ * On volumes with chunk checksums, the checksums of the container are
+ * computed while its chunks are written and the affected checksum table
+ * chunks are written before the hash table entry.
+ */
+#ifndef SHFS_INGEST_NB_BUFFERS
+#define SHFS_INGEST_NB_BUFFERS 4 /* chunk buffers per store operation */
+#endif
+#ifndef SHFS_INGEST_MAX_JOBS
+#define SHFS_INGEST_MAX_JOBS 8 /* simultaneous store/remove operations */
+#endif
+
+struct shfs_ingest;
+
+/* called whenever a chunk reached the device (len input bytes are stored
+ * and its buffer is free again) or when a deferred write failed (len is 0) */
+typedef void (shfs_ingest_wcb_t)(struct shfs_ingest *si, size_t len, void *argp);
+/* called when the operation is done: ret is 0 on success, a negative errno code otherwise */
+typedef void (shfs_ingest_dcb_t)(struct shfs_ingest *si, int ret, void *argp);
+
+enum shfs_ingest_type {
+	SIT_STORE = 0,
+	SIT_REMOVE
+};
+
+enum shfs_ingest_state {
+	SIS_WRITING = 0, /* receiving file contents */
+	SIS_FLUSHING,    /* waiting for outstanding chunk writes */
+	SIS_QUEUED,      /* waiting for hash table update */
+	SIS_PUBLISHING,  /* hash table chunk is written */
+	SIS_DONE
+};
+
+/* pending hash table chunk writes */
+#define SIH_PRIMARY 0x01
+#define SIH_BACKUP  0x02
+
+struct shfs_ingest {
+	enum shfs_ingest_type type;
+	enum shfs_ingest_state state;
+	int ret;
+	int orphan; /* owner closed the operation before it was done */
+
+	hash512_t hash;
+	int hash_given;
+	char name[64];
+	char mime[32];
+
+	uint64_t fsize;
+	uint64_t pos;   /* number of bytes received */
+	chk_t cchk;     /* reserved container */
+	chk_t csize;
+	struct sha256_ctx sha;
+
+	/* write-behind chunk buffers */
+	void *buf[SHFS_INGEST_NB_BUFFERS];
+	size_t blen[SHFS_INGEST_NB_BUFFERS];
+	SHFS_AIO_TOKEN *t[SHFS_INGEST_NB_BUFFERS];
+#ifdef SHFS_CSUM
+	chk_t bchk[SHFS_INGEST_NB_BUFFERS]; /* container chunk of a submitted buffer */
+#endif
+	unsigned int nb_buffers;
+	unsigned int bidx;     /* buffer that is filled */
+	unsigned int sidx;     /* next complete buffer to submit */
+	unsigned int nb_ready; /* complete buffers that are not submitted yet */
+	chk_t wchk;     /* next container chunk to write */
+	unsigned int nb_infly;
+#ifdef SHFS_CSUM
+	int csum_written; /* checksum table chunks were submitted */
+	chk_t csum_left;  /* checksum table chunks that are not submitted yet */
+#endif
+
+	/* hash table update */
+	struct shfs_bentry *bentry;
+	uint64_t ent_idx;
+	unsigned int ht_todo; /* SIH_* writes that are not submitted yet */
+	unsigned int ht_left;
+	int ht_ret;
+
+	shfs_ingest_wcb_t *wcb;
+	shfs_ingest_dcb_t *dcb;
+	void *cb_argp;
+	dlist_el(queue);
+	dlist_el(retry); /* submissions are deferred */
+};
+
+/*
+ * Reserves a volume area for a file of fsize bytes
+ *  h is optional (NULL) on volumes where digests are computed (if it is
+ *  passed, the received contents are verified against it)
+ *  On errors, NULL is returned and errno is set:
+ *   EROFS (volume is read-only), ENOSPC (no free area), ENOTSUP (hash
+ *   function is not supported), EINVAL (digest required), EBUSY (too many
+ *   operations), ENOMEM, ENODEV (no volume mounted)
+ */
+struct shfs_ingest *shfs_ingest_open(uint64_t fsize, const char *name, const char *mime,
+                                     const hash512_t h, shfs_ingest_wcb_t *wcb, void *cb_argp);
+/* returns the number of bytes that shfs_ingest_write() accepts currently */
+size_t shfs_ingest_room(struct shfs_ingest *si);
+/*
+ * Appends file contents, returns 0 on success, a negative errno code otherwise
+ *  -EAGAIN: len exceeds shfs_ingest_room(), nothing was written (the write
+ *  callback is called when chunk buffers became free)
+ */
+int shfs_ingest_write(struct shfs_ingest *si, const void *buf, size_t len);
+/*
+ * Publishes the file after all contents were received
+ *  dcb is called on completion with:
+ *   0 (published), -EEXIST (an entry with the same digest exists already),
+ *   -EBADMSG (contents do not match the passed digest), -ENOSPC (hash table
+ *   bucket is full), -EIO
+ */
+int shfs_ingest_commit(struct shfs_ingest *si, shfs_ingest_dcb_t *dcb);
+/*
+ * Removes the entry with digest h from the volume
+ *  On errors, NULL is returned and errno is set (ENOENT, EBUSY: file is open)
+ */
+struct shfs_ingest *shfs_ingest_remove(const hash512_t h, shfs_ingest_dcb_t *dcb, void *cb_argp);
+/*
+ * Releases an operation: an uncommitted store is aborted, committed
+ * operations are completed in the background
+ */
+void shfs_ingest_close(struct shfs_ingest *si);
+
+#define shfs_ingest_is_done(si) \
+	((si)->state == SIS_DONE)
+
+/* operations with writes that did not fit into the device request queue */
+extern struct dlist_head shfs_ingest_retry_queue;
+
+void _shfs_ingest_poll(void);
+
+/* called from the main loop */
+static inline void shfs_ingest_poll(void)
+{
+	if (likely(dlist_is_empty(shfs_ingest_retry_queue)))
+		return;
+	_shfs_ingest_poll();
+}
+
+#endif /* _SHFS_INGEST_H_ */
@@ -40,39 +40,354 @@
 #include "shfs_tools.h"
 #include "shfs.h"
 #include "htable.h"
+#include "memacct.h"
 #ifdef HAVE_CTLDIR
 #include <target/ctldir.h>
 #endif
 #include "shell.h"
 
-#ifndef member_size
-#define member_size(s, m) sizeof(((s *) 0)->m)
+#ifndef CACHELINE_SIZE
+#define CACHELINE_SIZE 64
 #endif
 
-int shfs_init_mstats(uint32_t nb_bkts, uint32_t ent_per_bkt, uint8_t hlen)
+uint32_t shfs_stats_clock = 0;
+
+/*
+ * Element statistics
+ */
+int shfs_init_hstats(uint32_t nb_entries)
+{
+	register unsigned int i;
+
+	for (i = 0; i < SHFS_STATS_NB_SHARDS; ++i) {
+		shfs_vol.hstats[i] = memacct_malloc(MEMT_STATS, CACHELINE_SIZE,
+		                                    sizeof(struct shfs_el_stats) * nb_entries);
+		if (!shfs_vol.hstats[i])
+			goto err_free_hstats;
+		memset(shfs_vol.hstats[i], 0, sizeof(struct shfs_el_stats) * nb_entries);
+	}
+	shfs_stats_tick();
+	return 0;
+
+ err_free_hstats:
+	while (i)
+		memacct_free(MEMT_STATS, shfs_vol.hstats[--i],
+		             sizeof(struct shfs_el_stats) * nb_entries);
+	return -ENOMEM;
+}
+
+void shfs_free_hstats(void)
+{
+	register unsigned int i;
+
+	for (i = 0; i < SHFS_STATS_NB_SHARDS; ++i)
+		memacct_free(MEMT_STATS, shfs_vol.hstats[i],
+		             sizeof(struct shfs_el_stats) * shfs_vol.htable_nb_entries);
+}
+
+static void _shfs_stats_merge(struct shfs_el_stats *dst, const struct shfs_el_stats *src)
+{
+	/* Note: dst windows have to be aligned to the current minute */
+	register uint32_t i, x;
+
+	dst->h += src->h;
+	dst->m += src->m;
+#ifdef SHFS_STATS_HTTP
+	dst->c += src->c;
+#ifdef SHFS_STATS_HTTP_DPC
+	for (i = 0; i < SHFS_STATS_HTTP_DPCR; ++i)
+		dst->p[i] += src->p[i];
+#endif
+#endif
+#ifdef SHFS_STATS_HTTP
+	if (src->lupd > dst->lupd)
+		dst->lupd = src->lupd;
+#endif
+	if (src->laccess > dst->laccess)
+		dst->laccess = src->laccess;
+	for (i = 0; i < SHFS_STATS_NB_WINDOWS; ++i) {
+		x = dst->wmin - i;
+		if (x <= src->wmin && src->wmin - x < SHFS_STATS_NB_WINDOWS)
+			dst->w[x & (SHFS_STATS_NB_WINDOWS - 1)] +=
+				src->w[x & (SHFS_STATS_NB_WINDOWS - 1)];
+	}
+}
+
+void shfs_stats_collect(struct shfs_bentry *bentry, struct shfs_el_stats *out)
+{
+	register unsigned int i;
+
+	memset(out, 0, sizeof(*out));
+	out->wmin = shfs_stats_clock / 60;
+	for (i = 0; i < SHFS_STATS_NB_SHARDS; ++i)
+		_shfs_stats_merge(out, &shfs_vol.hstats[i][bentry->stats_idx]);
+}
+
+void shfs_stats_set(struct shfs_bentry *bentry, const struct shfs_el_stats *stats)
+{
+	register unsigned int i;
+
+	for (i = 0; i < SHFS_STATS_NB_SHARDS; ++i)
+		memset(&shfs_vol.hstats[i][bentry->stats_idx], 0, sizeof(*stats));
+	if (stats)
+		memcpy(shfs_stats_from_bentry(bentry), stats, sizeof(*stats));
+}
+
+/*
+ * Miss statistics (Space-Saving)
+ */
+#define _mstats_el(i) (&shfs_vol.mstats.el[(i)])
+#define _mstats_heap_m(k) (_mstats_el(shfs_vol.mstats.heap[(k)])->stats.m)
+
+static inline uint32_t _mstats_hidx(const hash512_t h)
+{
+	register uint32_t v = 2166136261u; /* FNV-1a */
+	register uint8_t i;
+
+	for (i = 0; i < shfs_vol.hlen; ++i) {
+		v ^= h[i];
+		v *= 16777619u;
+	}
+	return v & shfs_vol.mstats.idx_mask;
+}
+
+/* returns the index position of h or of the free index entry where h would be placed */
+static inline uint32_t _mstats_idx_find(const hash512_t h)
+{
+	register uint32_t p = _mstats_hidx(h);
+
+	while (shfs_vol.mstats.idx[p] &&
+	       hash_compare(_mstats_el(shfs_vol.mstats.idx[p] - 1)->h, h, shfs_vol.hlen))
+		p = (p + 1) & shfs_vol.mstats.idx_mask;
+	return p;
+}
+
+static void _mstats_idx_rm(uint32_t p)
+{
+	/* backward shift deletion for linear probing */
+	register uint32_t n, home;
+
+	shfs_vol.mstats.idx[p] = 0;
+	n = (p + 1) & shfs_vol.mstats.idx_mask;
+	while (shfs_vol.mstats.idx[n]) {
+		home = _mstats_hidx(_mstats_el(shfs_vol.mstats.idx[n] - 1)->h);
+		if (((n - home) & shfs_vol.mstats.idx_mask) >=
+		    ((n - p) & shfs_vol.mstats.idx_mask)) {
+			shfs_vol.mstats.idx[p] = shfs_vol.mstats.idx[n];
+			shfs_vol.mstats.idx[n] = 0;
+			p = n;
+		}
+		n = (n + 1) & shfs_vol.mstats.idx_mask;
+	}
+}
+
+static inline void _mstats_heap_swap(uint32_t k0, uint32_t k1)
+{
+	register uint32_t s0 = shfs_vol.mstats.heap[k0];
+	register uint32_t s1 = shfs_vol.mstats.heap[k1];
+
+	shfs_vol.mstats.heap[k0] = s1;
+	shfs_vol.mstats.heap[k1] = s0;
+	_mstats_el(s1)->hpos = k0;
+	_mstats_el(s0)->hpos = k1;
+}
+
+static void _mstats_heap_up(uint32_t k)
+{
+	while (k && _mstats_heap_m((k - 1) >> 1) > _mstats_heap_m(k)) {
+		_mstats_heap_swap(k, (k - 1) >> 1);
+		k = (k - 1) >> 1;
+	}
+}
+
+static void _mstats_heap_down(uint32_t k)
+{
+	register uint32_t c;
+
+	for (;;) {
+		c = (k << 1) + 1;
+		if (c >= shfs_vol.mstats.nb_used)
+			break;
+		if (c + 1 < shfs_vol.mstats.nb_used &&
+		    _mstats_heap_m(c + 1) < _mstats_heap_m(c))
+			++c;
+		if (_mstats_heap_m(k) <= _mstats_heap_m(c))
+			break;
+		_mstats_heap_swap(k, c);
+		k = c;
+	}
+}
+
+/*
+ * Picks a slot for h that is not in the table yet (idx position p):
+ * A free slot is returned while there are some, otherwise the slot with
+ * the smallest miss count is evicted and handed over (heap root)
+ */
+static struct shfs_mstats_el *_mstats_claim(const hash512_t h, uint32_t p)
+{
+	struct shfs_mstats_el *mel;
+	uint32_t s;
+
+	if (shfs_vol.mstats.nb_used < shfs_vol.mstats.nb_slots) {
+		s = shfs_vol.mstats.nb_used++;
+		mel = _mstats_el(s);
+		mel->hpos = s;
+		shfs_vol.mstats.heap[s] = s;
+	} else {
+		s = shfs_vol.mstats.heap[0];
+		mel = _mstats_el(s);
+		_mstats_idx_rm(_mstats_idx_find(mel->h));
+		p = _mstats_idx_find(h); /* index layout might have changed */
+	}
+	hash_copy(mel->h, h, shfs_vol.hlen);
+	shfs_vol.mstats.idx[p] = s + 1;
+	return mel;
+}
+
+int shfs_init_mstats(uint32_t nb_slots)
 {
-	shfs_vol.mstats.el_ht = alloc_htable(nb_bkts, ent_per_bkt, hlen,
-	                                     sizeof(struct shfs_el_stats), 0);
-	if (!shfs_vol.mstats.el_ht)
-		return -errno;
+	uint32_t idx_len;
+
+	if (!nb_slots)
+		nb_slots = 1;
+	/* index has at least twice as many entries as there are slots */
+	idx_len = 2;
+	while (idx_len < (nb_slots << 1))
+		idx_len <<= 1;
+
+	shfs_vol.mstats.el = memacct_malloc(MEMT_STATS, CACHELINE_SIZE, nb_slots * sizeof(struct shfs_mstats_el));
+	if (!shfs_vol.mstats.el)
+		goto err_out;
+	shfs_vol.mstats.heap = memacct_malloc(MEMT_STATS, CACHELINE_SIZE, nb_slots * sizeof(uint32_t));
+	if (!shfs_vol.mstats.heap)
+		goto err_free_el;
+	shfs_vol.mstats.idx = memacct_malloc(MEMT_STATS, CACHELINE_SIZE, idx_len * sizeof(uint32_t));
+	if (!shfs_vol.mstats.idx)
+		goto err_free_heap;
+	memset(shfs_vol.mstats.idx, 0, idx_len * sizeof(uint32_t));
+	shfs_vol.mstats.idx_mask = idx_len - 1;
+	shfs_vol.mstats.nb_slots = nb_slots;
+	shfs_vol.mstats.nb_used = 0;
 	shfs_vol.mstats.i = 0;
 	shfs_vol.mstats.e = 0;
 
 	return 0;
+
+ err_free_heap:
+	memacct_free(MEMT_STATS, shfs_vol.mstats.heap, nb_slots * sizeof(uint32_t));
+ err_free_el:
+	memacct_free(MEMT_STATS, shfs_vol.mstats.el, nb_slots * sizeof(struct shfs_mstats_el));
+ err_out:
+	return -ENOMEM;
 }
 
 void shfs_free_mstats(void)
 {
-	free_htable(shfs_vol.mstats.el_ht);
+	memacct_free(MEMT_STATS, shfs_vol.mstats.idx,
+	             (shfs_vol.mstats.idx_mask + 1) * sizeof(uint32_t));
+	memacct_free(MEMT_STATS, shfs_vol.mstats.heap,
+	             shfs_vol.mstats.nb_slots * sizeof(uint32_t));
+	memacct_free(MEMT_STATS, shfs_vol.mstats.el,
+	             shfs_vol.mstats.nb_slots * sizeof(struct shfs_mstats_el));
+}
+
+struct shfs_el_stats *shfs_stats_mstats_lookup(const hash512_t h)
+{
+	uint32_t p = _mstats_idx_find(h);
+
+	if (!shfs_vol.mstats.idx[p])
+		return NULL;
+	return &_mstats_el(shfs_vol.mstats.idx[p] - 1)->stats;
+}
+
+struct shfs_el_stats *shfs_stats_mstats_miss(const hash512_t h)
+{
+	struct shfs_mstats_el *mel;
+	uint64_t min_m;
+	uint32_t p;
+
+	p = _mstats_idx_find(h);
+	if (likely(shfs_vol.mstats.idx[p])) {
+		mel = _mstats_el(shfs_vol.mstats.idx[p] - 1);
+	} else {
+		min_m = shfs_vol.mstats.nb_used < shfs_vol.mstats.nb_slots ?
+			0 : _mstats_heap_m(0);
+		mel = _mstats_claim(h, p);
+		memset(&mel->stats, 0, sizeof(mel->stats));
+		mel->stats.m = min_m;
+		mel->err = min_m;
+	}
+	++mel->stats.m;
+	_mstats_heap_up(mel->hpos); /* new element on a non-full table */
+	_mstats_heap_down(mel->hpos);
+	return &mel->stats;
+}
+
+struct shfs_el_stats *shfs_stats_mstats_store(const hash512_t h, const struct shfs_el_stats *stats)
+{
+	struct shfs_mstats_el *mel;
+	uint32_t p;
+
+	p = _mstats_idx_find(h);
+	if (shfs_vol.mstats.idx[p]) {
+		mel = _mstats_el(shfs_vol.mstats.idx[p] - 1);
+	} else {
+		/* do not evict elements that were missed more often */
+		if (shfs_vol.mstats.nb_used == shfs_vol.mstats.nb_slots &&
+		    stats->m < _mstats_heap_m(0))
+			return NULL;
+		mel = _mstats_claim(h, p);
+	}
+	memcpy(&mel->stats, stats, sizeof(mel->stats));
+	mel->err = 0;
+	_mstats_heap_up(mel->hpos);
+	_mstats_heap_down(mel->hpos);
+	return &mel->stats;
+}
+
+void shfs_stats_mstats_drop(const hash512_t h)
+{
+	struct shfs_mstats_el *mel;
+	uint32_t p, s, k, last;
+
+	p = _mstats_idx_find(h);
+	if (!shfs_vol.mstats.idx[p])
+		return;
+	s = shfs_vol.mstats.idx[p] - 1;
+	_mstats_idx_rm(p);
+
+	/* remove slot from heap */
+	k = _mstats_el(s)->hpos;
+	last = --shfs_vol.mstats.nb_used;
+	if (k != last) {
+		_mstats_heap_swap(k, last);
+		_mstats_heap_up(k);
+		_mstats_heap_down(k);
+	}
+
+	/* keep slots dense: move last slot to the freed one */
+	if (s != last) {
+		mel = _mstats_el(s);
+		memcpy(mel, _mstats_el(last), sizeof(*mel));
+		shfs_vol.mstats.heap[mel->hpos] = s;
+		shfs_vol.mstats.idx[_mstats_idx_find(mel->h)] = s + 1;
+	}
+}
+
+void shfs_stats_mstats_clear(void)
+{
+	memset(shfs_vol.mstats.idx, 0,
+	       (shfs_vol.mstats.idx_mask + 1) * sizeof(uint32_t));
+	shfs_vol.mstats.nb_used = 0;
 }
 
 int shfs_dump_mstats(shfs_dump_el_stats_t dump_el, void *dump_el_argp) {
 	int ret;
-	struct htable_el *el;
+	uint32_t s;
 
-	foreach_htable_el(shfs_vol.mstats.el_ht, el) {
-		ret = dump_el(dump_el_argp, *el->h, 0,
-		              (struct shfs_el_stats *) el->private);
+	for (s = 0; s < shfs_vol.mstats.nb_used; ++s) {
+		ret = dump_el(dump_el_argp, _mstats_el(s)->h, 0,
+		              &_mstats_el(s)->stats);
 		if (ret < 0)
 			return ret;
 	}
@@ -83,10 +398,11 @@ int shfs_dump_mstats(shfs_dump_el_stats_t dump_el, void *dump_el_argp) {
 int shfs_dump_hstats(shfs_dump_el_stats_t dump_el, void *dump_el_argp) {
 	int ret;
 	struct htable_el *el;
+	struct shfs_el_stats stats;
 
 	foreach_htable_el(shfs_vol.bt, el) {
-		ret = dump_el(dump_el_argp, *el->h, 1,
-		              shfs_stats_from_bentry((struct shfs_bentry *) el->private));
+		shfs_stats_collect((struct shfs_bentry *) el->private, &stats);
+		ret = dump_el(dump_el_argp, *el->h, 1, &stats);
 		if (ret < 0)
 			return ret;
 	}
@@ -97,13 +413,32 @@ int shfs_dump_hstats(shfs_dump_el_stats_t dump_el, void *dump_el_argp) {
 /* -------------------------------------------------------------------
  * SHFS stats exporter
  * ------------------------------------------------------------------- */
+#ifndef SHFS_STATS_EXP_BUFLEN
+#define SHFS_STATS_EXP_BUFLEN (32 * 1024) /* bytes per write request */
+#endif
+#define SHFS_STATS_EXP_NB_BUFS 2
+
+struct _stats_dev_buf {
+	void *b;
+	int infly; /* I/O request in progress */
+	int ret;
+};
+
 struct _stats_dev {
 	struct blkdev *bd;
-	void *buf;
-	size_t seek;
-	size_t flushed;
-
-	struct semaphore lock;
+	struct _stats_dev_buf buf[SHFS_STATS_EXP_NB_BUFS];
+	size_t buf_len;
+	unsigned int bidx; /* current buffer */
+	size_t bpos; /* position on current buffer */
+	sector_t sec; /* next sector to write */
+
+	uint64_t seq; /* number of exports */
+	uint32_t last_ts; /* timestamp of last export */
+	uint64_t nb_recs;
+	uint32_t since;
+	int detached; /* device could not be re-attached after a suspend */
+
+	sem_t lock;
 };
 
 static struct _stats_dev *_stats_dev = NULL;
@@ -123,7 +458,7 @@ static int _shcmd_shfs_print_el_stats(void *argp, hash512_t h, int available, st
 		strftimestamp_s(str_date, sizeof(str_date),
 		                "%b %e, %g %H:%M", stats->laccess);
 #ifdef SHFS_STATS_HTTP
-		fprintf(cio, "%c%s %c%c %6"PRIu32" [ %6"PRIu32" | ",
+		fprintf(cio, "%c%s %c%c %6"PRIu64" [ %6"PRIu64" | ",
 		        SHFS_HASH_INDICATOR_PREFIX,
 		        str_hash,
 		        available ? 'I' : ' ',
@@ -132,19 +467,25 @@ static int _shcmd_shfs_print_el_stats(void *argp, hash512_t h, int available, st
 		        stats->c ); /* completed file request */
 #ifdef SHFS_STATS_HTTP_DPC
 		for (i=0; i<SHFS_STATS_HTTP_DPCR; ++i)
-			fprintf(cio, "%6"PRIu32" ", stats->p[i]);
+			fprintf(cio, "%6"PRIu64" ", stats->p[i]);
 #endif
-		fprintf(cio, "] %6"PRIu32" %-16s\n",
+		fprintf(cio, "] %6"PRIu64" %5"PRIu64" %5"PRIu64" %5"PRIu64" %-16s\n",
 			stats->m, /* missed */
+		        shfs_stats_wsum(stats, 1), /* requests in last 1, 5, 15 min */
+		        shfs_stats_wsum(stats, 5),
+		        shfs_stats_wsum(stats, 15),
 		        str_date);
 #else
-		fprintf(cio, "%c%s %c%c %8"PRIu32" %8"PRIu32" %-16s\n",
+		fprintf(cio, "%c%s %c%c %8"PRIu64" %8"PRIu64" %5"PRIu64" %5"PRIu64" %5"PRIu64" %-16s\n",
 		        SHFS_HASH_INDICATOR_PREFIX,
 		        str_hash,
 		        available ? 'I' : ' ',
 		        available ? 'N' : ' ',
 		        stats->h, /* hits */
 		        stats->m, /* missed */
+		        shfs_stats_wsum(stats, 1), /* requests in last 1, 5, 15 min */
+		        shfs_stats_wsum(stats, 5),
+		        shfs_stats_wsum(stats, 15),
 		        str_date);
 #endif
 	}
@@ -168,6 +509,10 @@ static int shcmd_shfs_stats(FILE *cio, int argc, char *argv[])
 		fprintf(cio, "Invalid element requests: %8"PRIu32"\n", shfs_vol.mstats.i);
 	if (shfs_vol.mstats.e)
 		fprintf(cio, "Errors on requests:       %8"PRIu32"\n", shfs_vol.mstats.e);
+	if (shfs_stats_mstats_untracked_max())
+		fprintf(cio, "Miss table is full (%"PRIu32" slots): miss counts are approximate,\n"
+		        " untracked elements were missed at most %"PRIu64" times\n",
+		        shfs_vol.mstats.nb_slots, shfs_stats_mstats_untracked_max());
 
  out:
 	up(&shfs_mount_lock);
@@ -176,185 +521,290 @@ static int shcmd_shfs_stats(FILE *cio, int argc, char *argv[])
 
 
 /* stats export */
-#define _stats_dev_reset() do { _stats_dev->seek = 0; _stats_dev->flushed = 0; } while(0)
+static void _stats_dev_aiocb(int ret, void *argp)
+{
+	struct _stats_dev_buf *sbuf = argp;
+
+	sbuf->ret = ret;
+	sbuf->infly = 0;
+}
+
+static int _stats_dev_wait(struct _stats_dev_buf *sbuf)
+{
+	while (sbuf->infly) {
+		blkdev_poll_req(_stats_dev->bd);
+		schedule(); /* yield CPU */
+	}
+	return sbuf->ret;
+}
+
+static int _stats_dev_submit(struct _stats_dev_buf *sbuf, sector_t sec, sector_t nb_sec)
+{
+	int ret;
+
+	sbuf->ret = 0;
+	sbuf->infly = 1;
+ retry:
+	ret = blkdev_async_write(_stats_dev->bd, sec, nb_sec, sbuf->b,
+	                         _stats_dev_aiocb, sbuf);
+	if (unlikely(ret == -EAGAIN)) {
+		/* request queue is full */
+		blkdev_poll_req(_stats_dev->bd);
+		schedule();
+		goto retry;
+	}
+	if (unlikely(ret < 0)) {
+		sbuf->infly = 0;
+		return ret;
+	}
+	blkdev_async_io_submit(_stats_dev->bd);
+	return 0;
+}
 
 static int _stats_dev_flush(void)
 {
 	/* Note lock has to be held by caller! */
-	register sector_t sec;
-	register size_t bleft, bpos;
+	struct _stats_dev_buf *sbuf = &_stats_dev->buf[_stats_dev->bidx];
+	sector_t nb_sec;
 	int ret;
 
-	if (_stats_dev->seek <= _stats_dev->flushed)
+	if (!_stats_dev->bpos)
 		return 0; /* nothing to write */
 
+	/* fillup rest of last sector with zeros */
+	nb_sec = DIV_ROUND_UP(_stats_dev->bpos, blkdev_ssize(_stats_dev->bd));
+	memset((uint8_t *) sbuf->b + _stats_dev->bpos, 0,
+	       (nb_sec * blkdev_ssize(_stats_dev->bd)) - _stats_dev->bpos);
+	if (unlikely((_stats_dev->sec + nb_sec) * blkdev_ssize(_stats_dev->bd)
+	             > blkdev_size(_stats_dev->bd)))
+		return -ENOSPC;
 
-	/* calculate address */
-	sec = _stats_dev->seek / blkdev_ssize(_stats_dev->bd);
-	if (_stats_dev->seek % blkdev_ssize(_stats_dev->bd) == 0) {
-		/* correct sec because buffer points to previous
-		 * that is filled up completely */
-		--sec;
-	} else {
-		/* fillup rest of buffer with zeros */
-		bpos = _stats_dev->seek % blkdev_ssize(_stats_dev->bd); /* pos on buffer */
-		bleft = blkdev_ssize(_stats_dev->bd) - bpos; /* left bytes on buffer */
-		memset((uint8_t *) _stats_dev->buf + bpos, 0, bleft);
-	}
+	ret = _stats_dev_submit(sbuf, _stats_dev->sec, nb_sec);
+	if (unlikely(ret < 0))
+		return ret;
+	_stats_dev->sec += nb_sec;
+	_stats_dev->bpos = 0;
 
-	/* write */
-	ret = blkdev_sync_io(_stats_dev->bd, sec, 1, 1, _stats_dev->buf); /* yields CPU */
-	if (ret >= 0)
-		_stats_dev->flushed = _stats_dev->seek;
-	return ret;
+	/* switch to next buffer: wait for its previous write to complete */
+	_stats_dev->bidx = (_stats_dev->bidx + 1) % SHFS_STATS_EXP_NB_BUFS;
+	return _stats_dev_wait(&_stats_dev->buf[_stats_dev->bidx]);
 }
 
-
 static int _stats_dev_write(const void *data, size_t len)
 {
 	/* Note lock has to be held by caller! */
-	register size_t bleft;
-	register size_t bpos, dpos;
 	register size_t clen;
 	int ret;
 
-	dpos = 0;
 	while (len) {
-		bpos = _stats_dev->seek % blkdev_ssize(_stats_dev->bd); /* pos on buffer */
-		bleft = blkdev_ssize(_stats_dev->bd) - bpos; /* left bytes on buffer */
-		clen = min(bleft, len);
-
-		shfs_memcpy((uint8_t *) _stats_dev->buf + bpos, (uint8_t *) data + dpos, clen);
-		_stats_dev->seek += clen;
-
-		if (bpos + clen == blkdev_ssize(_stats_dev->bd)) {
-			/* write buffer to disk and clear it */
+		clen = min(_stats_dev->buf_len - _stats_dev->bpos, len);
+		memcpy((uint8_t *) _stats_dev->buf[_stats_dev->bidx].b + _stats_dev->bpos,
+		       data, clen);
+		_stats_dev->bpos += clen;
+		data = (const uint8_t *) data + clen;
+		len -= clen;
+
+		if (_stats_dev->bpos == _stats_dev->buf_len) {
 			ret = _stats_dev_flush();
-			if (ret < 0) {
-				_stats_dev->seek -= clen; /* revert increasing seek */
+			if (unlikely(ret < 0))
 				return ret;
-			}
 		}
-
-		dpos += clen;
-		len  -= clen;
 	}
-
 	return 0;
 }
 
+/* record length without the hash digest */
+#ifdef SHFS_STATS_HTTP
+#ifdef SHFS_STATS_HTTP_DPC
+#define _STATS_EXP_REC_FLEN \
+	(sizeof(uint8_t) + sizeof(uint32_t) + (3 * sizeof(uint64_t)) \
+	 + (SHFS_STATS_HTTP_DPCR * sizeof(uint64_t)) + (3 * sizeof(uint32_t)))
+#else
+#define _STATS_EXP_REC_FLEN \
+	(sizeof(uint8_t) + sizeof(uint32_t) + (3 * sizeof(uint64_t)) \
+	 + (3 * sizeof(uint32_t)))
+#endif
+#else
+#define _STATS_EXP_REC_FLEN \
+	(sizeof(uint8_t) + sizeof(uint32_t) + (2 * sizeof(uint64_t)) \
+	 + (3 * sizeof(uint32_t)))
+#endif
+
+static inline size_t _stats_exp_rec_len(void)
+{
+	return shfs_vol.hlen + _STATS_EXP_REC_FLEN;
+}
+
+#define _stats_exp_put(p, v) \
+	do { memcpy((p), &(v), sizeof(v)); (p) += sizeof(v); } while (0)
+
 static int _shcmd_shfs_export_el_stats(void *argp, hash512_t h, int available, struct shfs_el_stats *stats)
 {
 #if defined SHFS_STATS_HTTP && defined SHFS_STATS_HTTP_DPC
 	register unsigned int i;
 #endif
-	char sbuf[256];
-	size_t slen;
-	int ret = 0;
+	uint8_t rec[sizeof(hash512_t) + _STATS_EXP_REC_FLEN];
+	register uint8_t *p = rec;
+	uint8_t flags;
+	uint32_t req;
+	int ret;
 
-	hash_unparse(h, shfs_vol.hlen, sbuf);
-	ret = _stats_dev_write(sbuf, shfs_vol.hlen * 2);
-	if (unlikely(ret < 0))
-		goto out;
+	if (!stats->laccess)
+		return 0; /* never accessed */
+#ifdef SHFS_STATS_HTTP
+	if (stats->laccess < _stats_dev->since && stats->lupd < _stats_dev->since)
+		return 0; /* unchanged since last export */
+#else
+	if (stats->laccess < _stats_dev->since)
+		return 0; /* unchanged since last export */
+#endif
 
-	slen = snprintf(sbuf, sizeof(sbuf), ";%"PRIu32";%"PRIu32";%"PRIu32,
-	                stats->laccess,
-	                stats->h,
-	                stats->m);
-	ret = _stats_dev_write(sbuf, slen);
+	memcpy(p, h, shfs_vol.hlen);
+	p += shfs_vol.hlen;
+	flags = available ? SHFS_STATS_EXP_RF_LOADED : 0;
+	_stats_exp_put(p, flags);
+	_stats_exp_put(p, stats->laccess);
+	_stats_exp_put(p, stats->h);
+	_stats_exp_put(p, stats->m);
+#ifdef SHFS_STATS_HTTP
+	_stats_exp_put(p, stats->c);
+#ifdef SHFS_STATS_HTTP_DPC
+	for (i=0; i<SHFS_STATS_HTTP_DPCR; ++i)
+		_stats_exp_put(p, stats->p[i]);
+#endif
+#endif
+	req = (uint32_t) shfs_stats_wsum(stats, 1);
+	_stats_exp_put(p, req);
+	req = (uint32_t) shfs_stats_wsum(stats, 5);
+	_stats_exp_put(p, req);
+	req = (uint32_t) shfs_stats_wsum(stats, 15);
+	_stats_exp_put(p, req);
+
+	ret = _stats_dev_write(rec, (size_t) (p - rec));
 	if (unlikely(ret < 0))
-		goto out;
+		return ret;
+	++_stats_dev->nb_recs;
+	sh_slice_yield((struct sh_slice *) argp); /* do not disturb serving */
+	return 0;
+}
 
-#ifdef SHFS_STATS_HTTP
-	slen = snprintf(sbuf, sizeof(sbuf), ";%"PRIu32, stats->c);
-	ret = _stats_dev_write(sbuf, slen);
+/* clears the magic of the previous export so that it does not
+ * validate the records that are overwritten now */
+static int _stats_exp_inval(void)
+{
+	struct _stats_dev_buf *sbuf = &_stats_dev->buf[_stats_dev->bidx];
+	int ret;
+
+	memset(sbuf->b, 0, blkdev_ssize(_stats_dev->bd));
+	ret = _stats_dev_submit(sbuf, 0, 1);
 	if (unlikely(ret < 0))
-		goto out;
+		return ret;
+	return _stats_dev_wait(sbuf);
+}
+
+static int _stats_exp_hdr(uint32_t ts, int delta)
+{
+	struct _stats_dev_buf *sbuf = &_stats_dev->buf[_stats_dev->bidx];
+	struct shfs_stats_exp_hdr *hdr = sbuf->b;
+	int ret;
 
+	memset(hdr, 0, blkdev_ssize(_stats_dev->bd));
+	memcpy(hdr->magic, SHFS_STATS_EXP_MAGIC, sizeof(SHFS_STATS_EXP_MAGIC));
+	hdr->version  = SHFS_STATS_EXP_VERSION;
+	hdr->hdr_len  = sizeof(*hdr);
+	hdr->rec_len  = (uint16_t) _stats_exp_rec_len();
+	hdr->hlen     = shfs_vol.hlen;
+	hdr->flags    = delta ? SHFS_STATS_EXP_F_DELTA : 0;
+#ifdef SHFS_STATS_HTTP
+	hdr->flags   |= SHFS_STATS_EXP_F_HTTP;
 #ifdef SHFS_STATS_HTTP_DPC
-	for (i=0; i<SHFS_STATS_HTTP_DPCR; ++i) {
-		slen = snprintf(sbuf, sizeof(sbuf), ";%"PRIu32, stats->p[i]);
-		ret = _stats_dev_write(sbuf, slen);
-		if (unlikely(ret < 0))
-			goto out;
-	}
+	hdr->nb_dpc   = SHFS_STATS_HTTP_DPCR;
 #endif
 #endif
-	_stats_dev_write("\n", 1); /* exclusive terminating zero */
+	hdr->data_off = blkdev_ssize(_stats_dev->bd);
+	hdr->ts       = ts;
+	hdr->since    = _stats_dev->since;
+	hdr->seq      = _stats_dev->seq;
+	hdr->nb_recs  = _stats_dev->nb_recs;
+	hdr->invalid  = shfs_vol.mstats.i;
+	hdr->errors   = shfs_vol.mstats.e;
+
+	ret = _stats_dev_submit(sbuf, 0, 1);
 	if (unlikely(ret < 0))
-		goto out;
-
- out:
-	return ret;
+		return ret;
+	return _stats_dev_wait(sbuf);
 }
 
 static int shcmd_shfs_stats_export(FILE *cio, int argc, char *argv[])
 {
-#if defined SHFS_STATS_HTTP && defined SHFS_STATS_HTTP_DPC
+	struct sh_slice sl;
+	uint32_t ts;
+	int delta = 0;
 	register unsigned int i;
-#endif
-	char sbuf[128];
-	int slen;
 	int ret = 0;
 
+	if (argc >= 2 && strcmp(argv[1], "-d") == 0) {
+		delta = 1;
+	} else if (argc >= 2) {
+		fprintf(cio, "Usage: %s [-d]\n", argv[0]);
+		fprintf(cio, "  -d  delta export: only elements changed since last export\n");
+		return -1;
+	}
+
+	down(&_stats_dev->lock);
 	down(&shfs_mount_lock);
 	if (!shfs_mounted) {
 		fprintf(cio, "No SHFS filesystem mounted\n");
 		ret = -1;
 		goto out;
 	}
-
-	_stats_dev_reset();
-
-	slen = snprintf(sbuf, sizeof(sbuf),
-	                "x%uk(hash);u%ug(laccess);u%us(hits);u%us(miss)",
-	                shfs_vol.hlen,
-	                member_size(struct shfs_el_stats, laccess),
-	                member_size(struct shfs_el_stats, h),
-	                member_size(struct shfs_el_stats, m));
-	ret = _stats_dev_write(sbuf, slen);
-	if (unlikely(ret < 0))
-		goto out;
-
-
-#ifdef SHFS_STATS_HTTP
-	slen = snprintf(sbuf, sizeof(sbuf), ";u%us(completed)",
-	                member_size(struct shfs_el_stats, c));
-	ret = _stats_dev_write(sbuf, slen);
-	if (unlikely(ret < 0))
+	if (_stats_dev->detached) {
+		fprintf(cio, "Export device got lost on resume\n");
+		ret = -1;
 		goto out;
-
-#ifdef SHFS_STATS_HTTP_DPC
-	for (i=0; i<SHFS_STATS_HTTP_DPCR; ++i) {
-		slen = snprintf(sbuf, sizeof(sbuf), ";u%us(%u%%)",
-		                member_size(struct shfs_el_stats, p[i]),
-		                SHFS_STATS_HTTP_DPC_THRESHOLD_PERCENTAGE(i));
-		ret = _stats_dev_write(sbuf, slen);
-		if (unlikely(ret < 0))
-			goto out;
 	}
-#endif
-#endif
-	ret = _stats_dev_write("\n", 1); /* exclusive terminating zero */
-	if (unlikely(ret < 0))
-		goto out;
 
-	ret = shfs_dump_stats(_shcmd_shfs_export_el_stats, NULL);
-	if (unlikely(ret < 0))
-		goto out;
+	ts = shfs_stats_clock;
+	_stats_dev->since = (delta && _stats_dev->seq) ? _stats_dev->last_ts : 0;
+	_stats_dev->nb_recs = 0;
+	_stats_dev->bidx = 0;
+	_stats_dev->bpos = 0;
+	_stats_dev->sec = 1; /* sector 0 is for header */
 
-	ret = _stats_dev_write("", 1); /* terminating zero */
+	ret = _stats_exp_inval();
 	if (unlikely(ret < 0))
-		goto out;
-
+		goto err_wait;
+	sh_slice_init(&sl, cio);
+	ret = shfs_dump_stats(_shcmd_shfs_export_el_stats, &sl);
+	if (unlikely(ret < 0))
+		goto err_wait;
 	ret = _stats_dev_flush();
 	if (unlikely(ret < 0))
-		goto out;
+		goto err_wait;
+	for (i = 0; i < SHFS_STATS_EXP_NB_BUFS; ++i) {
+		ret = _stats_dev_wait(&_stats_dev->buf[i]);
+		if (unlikely(ret < 0))
+			goto err_wait;
+	}
 
+	/* header is written last: it validates the records */
+	++_stats_dev->seq;
+	ret = _stats_exp_hdr(ts, delta);
+	if (unlikely(ret < 0))
+		goto err_wait;
+	_stats_dev->last_ts = ts;
 	ret = 0;
  out:
 	up(&shfs_mount_lock);
+	up(&_stats_dev->lock);
 	return ret;
+
+ err_wait:
+	for (i = 0; i < SHFS_STATS_EXP_NB_BUFS; ++i)
+		_stats_dev_wait(&_stats_dev->buf[i]);
+	fprintf(cio, "Could not export statistics: %s\n", strerror(-ret));
+	ret = -1;
+	goto out;
 }
 
 #ifdef HAVE_CTLDIR
@@ -379,6 +829,7 @@ int register_shfs_stats_tools(void)
 
 int init_shfs_stats_export(blkdev_id_t bd_id)
 {
+	register unsigned int i;
 	int ret;
 
 	_stats_dev = _xmalloc(sizeof(*_stats_dev), 0);
@@ -392,17 +843,26 @@ int init_shfs_stats_export(blkdev_id_t bd_id)
 		ret = -errno;
 		goto err_free_stats_dev;
 	}
-	_stats_dev->buf = _xmalloc(blkdev_ssize(_stats_dev->bd), blkdev_ssize(_stats_dev->bd));
-	if (!_stats_dev->buf) {
-		ret = -ENOMEM;
-		goto err_close_bd;
+	_stats_dev->buf_len = ALIGN_UP(SHFS_STATS_EXP_BUFLEN, blkdev_ssize(_stats_dev->bd));
+	for (i = 0; i < SHFS_STATS_EXP_NB_BUFS; ++i) {
+		_stats_dev->buf[i].b = _xmalloc(_stats_dev->buf_len, blkdev_ssize(_stats_dev->bd));
+		if (!_stats_dev->buf[i].b) {
+			ret = -ENOMEM;
+			goto err_free_bufs;
+		}
+		_stats_dev->buf[i].infly = 0;
+		_stats_dev->buf[i].ret = 0;
 	}
 
 	init_SEMAPHORE(&_stats_dev->lock, 1); /* serializes exports */
-	_stats_dev->seek = 0;
+	_stats_dev->seq = 0;
+	_stats_dev->last_ts = 0;
+	_stats_dev->detached = 0;
 	return 0;
 
- err_close_bd:
+ err_free_bufs:
+	while (i)
+		xfree(_stats_dev->buf[--i].b);
 	close_blkdev(_stats_dev->bd);
  err_free_stats_dev:
 	xfree(_stats_dev);
@@ -410,12 +870,45 @@ int init_shfs_stats_export(blkdev_id_t bd_id)
 	return ret;
 }
 
+/* detaches/re-attaches the export device across a suspend of the VM
+ * Note: shfs_stats_export_resume() has to be called in any case
+ *       because the export lock is held in between */
+int shfs_stats_export_suspend(void)
+{
+	register unsigned int i;
+
+	if (!_stats_dev)
+		return 0;
+
+	down(&_stats_dev->lock);
+	for (i = 0; i < SHFS_STATS_EXP_NB_BUFS; ++i)
+		_stats_dev_wait(&_stats_dev->buf[i]);
+	return blkdev_suspend(_stats_dev->bd); /* lock is kept until resume */
+}
+
+int shfs_stats_export_resume(void)
+{
+	int ret;
+
+	if (!_stats_dev)
+		return 0;
+
+	ret = blkdev_resume(_stats_dev->bd);
+	if (ret < 0)
+		_stats_dev->detached = 1;
+	up(&_stats_dev->lock);
+	return ret;
+}
+
 void exit_shfs_stats_export(void)
 {
+	register unsigned int i;
+
 	if (_stats_dev) {
 		down(&_stats_dev->lock);
 
-		xfree(_stats_dev->buf);
+		for (i = 0; i < SHFS_STATS_EXP_NB_BUFS; ++i)
+			xfree(_stats_dev->buf[i].b);
 		close_blkdev(_stats_dev->bd);
 		xfree(_stats_dev);
 	}
@@ -36,6 +36,7 @@
 #ifndef _SHFS_STATS_H_
 #define _SHFS_STATS_H_
 
+#include <stddef.h>
 #include "shfs_stats_data.h"
 #include "shfs_btable.h"
 #include "shfs_fio.h"
@@ -47,9 +48,10 @@
 
 /*
  * Retrieve stats structure from SHFS btable entry
+ * NOTE: This returns the stats of the shard of the calling CPU
  */
 #define shfs_stats_from_bentry(bentry) \
-	(&((bentry)->hstats))
+	(&(shfs_vol.hstats[shfs_stats_shard_id()][(bentry)->stats_idx]))
 
 /*
  * Retrieves stats structure from an SHFS_FD
@@ -64,54 +66,105 @@ static inline struct shfs_el_stats *shfs_stats_from_fd(SHFS_FD f) {
 }
 
 /*
- * Retrieves stats element from miss stats table
- * NOTE: A new entry is created automatically, if it does not
- * exist yet
+ * Updates the coarse stats clock, called once per main loop iteration
  */
-static inline struct shfs_el_stats *shfs_stats_from_mstats(hash512_t h) {
-	int is_new;
-	struct htable_el *el;
-	struct shfs_el_stats *el_stats;
-
-	el = htable_lookup_add(shfs_vol.mstats.el_ht, h, &is_new);
-	if (unlikely(!el))
-		return NULL;
-
-	el_stats = (struct shfs_el_stats *) el->private;
-	if (is_new)
-		memset(el_stats, 0, sizeof(*el_stats));
-	return el_stats;
+static inline void shfs_stats_tick(void) {
+	shfs_stats_clock = (uint32_t) gettimestamp_s();
 }
 
 /*
- * Deletes an entry from mstat table
+ * Accounts a request to an element for windowed rates
  */
-static inline void shfs_stats_mstats_drop(hash512_t h) {
-	struct htable_el *el;
+static inline void shfs_stats_wupdate(struct shfs_el_stats *stats) {
+	register uint32_t cur = shfs_stats_clock / 60;
+	register uint32_t i;
+
+	if (unlikely(cur != stats->wmin)) {
+		if (cur - stats->wmin >= SHFS_STATS_NB_WINDOWS) {
+			memset(stats->w, 0, sizeof(stats->w));
+		} else {
+			for (i = stats->wmin + 1; i != cur + 1; ++i)
+				stats->w[i & (SHFS_STATS_NB_WINDOWS - 1)] = 0;
+		}
+		stats->wmin = cur;
+	}
+	++stats->w[cur & (SHFS_STATS_NB_WINDOWS - 1)];
+}
+
+/*
+ * Returns the number of requests within the last nb_min minutes
+ * (including the current one)
+ */
+static inline uint64_t shfs_stats_wsum(const struct shfs_el_stats *stats, uint32_t nb_min) {
+	register uint32_t cur = shfs_stats_clock / 60;
+	register uint32_t i, x;
+	register uint64_t sum = 0;
+
+	if (nb_min > SHFS_STATS_NB_WINDOWS)
+		nb_min = SHFS_STATS_NB_WINDOWS;
+	for (i = 0; i < nb_min; ++i) {
+		x = cur - i;
+		if (x <= stats->wmin && stats->wmin - x < SHFS_STATS_NB_WINDOWS)
+			sum += stats->w[x & (SHFS_STATS_NB_WINDOWS - 1)];
+	}
+	return sum;
+}
+
+/*
+ * Sums up the stats of an element over all shards (out)
+ * or overwrites them with stats (shard of calling CPU only, NULL clears them)
+ */
+void shfs_stats_collect(struct shfs_bentry *bentry, struct shfs_el_stats *out);
+void shfs_stats_set(struct shfs_bentry *bentry, const struct shfs_el_stats *stats);
 
-	el = htable_lookup(shfs_vol.mstats.el_ht, h);
-	if (!el)
-		return;
-	htable_rm(shfs_vol.mstats.el_ht, el);
+/*
+ * Miss stats table (bounded, Space-Saving)
+ *  shfs_stats_mstats_miss() accounts a miss for h: If h is not in
+ *  the table yet, it replaces the least missed element when all slots
+ *  are occupied
+ *  shfs_stats_mstats_store() puts a copy of stats to the table but
+ *  does not evict elements that were missed more often (returns NULL then)
+ *  shfs_stats_mstats_lookup() returns NULL when h is not in the table
+ */
+struct shfs_el_stats *shfs_stats_mstats_miss(const hash512_t h);
+struct shfs_el_stats *shfs_stats_mstats_store(const hash512_t h, const struct shfs_el_stats *stats);
+struct shfs_el_stats *shfs_stats_mstats_lookup(const hash512_t h);
+void shfs_stats_mstats_drop(const hash512_t h);
+void shfs_stats_mstats_clear(void);
+
+/*
+ * Returns the maximum overestimation of the miss counter of
+ * an element from the miss stats table
+ */
+static inline uint64_t shfs_stats_mstats_err(const struct shfs_el_stats *stats) {
+	return ((const struct shfs_mstats_el *)
+	        ((const uint8_t *) stats - offsetof(struct shfs_mstats_el, stats)))->err;
+}
+
+/*
+ * Upper bound of misses of an element that is not in the miss stats table
+ */
+static inline uint64_t shfs_stats_mstats_untracked_max(void) {
+	if (shfs_vol.mstats.nb_used < shfs_vol.mstats.nb_slots)
+		return 0;
+	return shfs_vol.mstats.el[shfs_vol.mstats.heap[0]].stats.m;
 }
 
 /*
  * Resetting statistics
  */
 static inline void shfs_reset_mstats(void) {
-	htable_clear(shfs_vol.mstats.el_ht);
+	shfs_stats_mstats_clear();
 	shfs_vol.mstats.i = 0;
 	shfs_vol.mstats.e = 0;
 }
 
 static inline void shfs_reset_hstats(void) {
-	struct htable_el *el;
-	struct shfs_el_stats *el_stats;
+	register unsigned int i;
 
-	foreach_htable_el(shfs_vol.bt, el) {
-		el_stats = shfs_stats_from_bentry((struct shfs_bentry *) el->private);
-		memset(el_stats, 0, sizeof(*el_stats));
-	}
+	for (i = 0; i < SHFS_STATS_NB_SHARDS; ++i)
+		memset(shfs_vol.hstats[i], 0,
+		       sizeof(struct shfs_el_stats) * shfs_vol.htable_nb_entries);
 }
 
 #define shfs_reset_stats() \
@@ -150,5 +203,7 @@ int register_shfs_stats_tools(struct ctldir *cd);
 int register_shfs_stats_tools(void);
 #endif
 void exit_shfs_stats_export(void);
+int shfs_stats_export_suspend(void);
+int shfs_stats_export_resume(void);
 
 #endif /* _SHFS_STATS_H_ */
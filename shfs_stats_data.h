@@ -60,27 +60,128 @@
  #endif
 #endif
 
-struct shfs_mstats {
-	uint32_t i; /* invalid requests */
-	uint32_t e; /* errors */
-	struct htable *el_ht; /* hash table of elements that are not in cache */
-};
+/*
+ * Miss statistics are kept in a fixed number of slots that are managed
+ * with the Space-Saving algorithm (Metwally et al.): When all slots are
+ * occupied, a newly missed element takes over the slot with the smallest
+ * miss count. This bounds memory usage on random hash scans while the
+ * most frequently missed elements stay in the table. Reported miss counts
+ * are upper bounds, the true count is at least (m - err) of the slot.
+ */
+#ifndef SHFS_MSTATS_NB_SLOTS
+#define SHFS_MSTATS_NB_SLOTS 1024
+#endif
+
+/*
+ * Element statistics of loaded entries are not part of the btable entry:
+ * They are kept in dense arrays (indexed by the hash table entry number),
+ * one per shard. Each CPU updates its own shard only, readers sum them up.
+ * A target can provide shfs_stats_shard_id() for multi-core builds.
+ */
+#ifndef SHFS_STATS_NB_SHARDS
+#define SHFS_STATS_NB_SHARDS 1
+#endif
+#if SHFS_STATS_NB_SHARDS > 1
+ #ifndef shfs_stats_shard_id
+  #error "SHFS_STATS_NB_SHARDS > 1 requires shfs_stats_shard_id()"
+ #endif
+#else
+ #undef shfs_stats_shard_id
+ #define shfs_stats_shard_id() 0
+#endif
+
+/* per-minute request counters for windowed rates (last 1, 5, 15 min) */
+#define SHFS_STATS_NB_WINDOWS 16 /* has to be a power of 2 and >= 15 */
 
 struct shfs_el_stats {
-	uint32_t laccess; /* last access timestamp */
-	uint32_t h; /* element hit */
-	uint32_t m; /* element miss */
+	uint64_t h; /* element hit */
+	uint64_t m; /* element miss */
 #ifdef SHFS_STATS_HTTP
-	uint32_t c; /* successfully completed file transfers (even partial) */
+	uint64_t c; /* successfully completed file transfers (even partial) */
 
 	/* download progress counters */
 #ifdef SHFS_STATS_HTTP_DPC
-	uint32_t p[SHFS_STATS_HTTP_DPCR];
+	uint64_t p[SHFS_STATS_HTTP_DPCR];
 #endif
+	uint32_t lupd; /* timestamp of last update of the counters above */
 #endif
+	uint32_t laccess; /* last access timestamp */
+	uint32_t wmin; /* minute of last window update */
+	uint32_t w[SHFS_STATS_NB_WINDOWS]; /* requests per minute (ring) */
 };
 
-int shfs_init_mstats(uint32_t nb_bkts, uint32_t ent_per_bkt, uint8_t hlen);
+struct shfs_mstats_el {
+	hash512_t h;
+	struct shfs_el_stats stats;
+	uint64_t err; /* overestimation of stats.m (Space-Saving) */
+	uint32_t hpos; /* position on min-heap */
+};
+
+struct shfs_mstats {
+	uint32_t i; /* invalid requests */
+	uint32_t e; /* errors */
+
+	/* elements that are not in cache (bounded, see above) */
+	uint32_t nb_slots;
+	uint32_t nb_used;
+	uint32_t idx_mask;
+	uint32_t *idx; /* open addressing index: slot number + 1, 0 = empty */
+	uint32_t *heap; /* min-heap of slot numbers ordered by stats.m */
+	struct shfs_mstats_el *el;
+};
+
+/*
+ * Binary stats export format (version 1)
+ *
+ * Sector 0 holds the header, records start at data_off and are packed
+ * back-to-back (little endian):
+ *   uint8_t  hash[hlen];
+ *   uint8_t  flags;          SHFS_STATS_EXP_RF_*
+ *   uint32_t laccess;
+ *   uint64_t hits;
+ *   uint64_t miss;
+ *   uint64_t completed;      only if flags of header has SHFS_STATS_EXP_F_HTTP
+ *   uint64_t p[nb_dpc];      download progress counters (HTTP)
+ *   uint32_t req[3];         requests within the last 1, 5, 15 minutes
+ * Delta exports contain elements that were accessed or whose HTTP
+ * counters changed since 'since'.
+ * The magic of the previous header is cleared before any record is
+ * written and the header is written after all records, so a reader that
+ * finds a valid header can rely on nb_recs.
+ * scripts/decode-stats.py decodes this format.
+ */
+#define SHFS_STATS_EXP_MAGIC      "MCSTATS"
+#define SHFS_STATS_EXP_VERSION    1
+
+#define SHFS_STATS_EXP_F_DELTA    0x01 /* only elements changed since 'since' */
+#define SHFS_STATS_EXP_F_HTTP     0x02 /* records contain completed counter */
+
+#define SHFS_STATS_EXP_RF_LOADED  0x01 /* element is available on the volume */
+
+struct shfs_stats_exp_hdr {
+	char     magic[8];
+	uint16_t version;
+	uint16_t hdr_len;
+	uint16_t rec_len;
+	uint8_t  hlen;
+	uint8_t  flags;
+	uint8_t  nb_dpc;
+	uint8_t  _reserved[3];
+	uint32_t data_off; /* byte offset of first record */
+	uint32_t ts; /* export timestamp */
+	uint32_t since; /* delta exports: elements changed since this timestamp */
+	uint64_t seq; /* export sequence number */
+	uint64_t nb_recs;
+	uint32_t invalid; /* invalid element requests */
+	uint32_t errors; /* errors on requests */
+} __attribute__((packed));
+
+/* coarse clock (seconds), updated once per main loop iteration */
+extern uint32_t shfs_stats_clock;
+
+int shfs_init_mstats(uint32_t nb_slots);
 void shfs_free_mstats(void);
+int shfs_init_hstats(uint32_t nb_entries);
+void shfs_free_hstats(void);
 
 #endif
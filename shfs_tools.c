@@ -56,11 +56,14 @@ static int shcmd_shfs_ls(FILE *cio, int argc, char *argv[])
 	char str_name[sizeof(hentry->name) + 1];
 	char str_mime[sizeof(hentry->f_attr.mime) + 1];
 	char str_date[20];
+	struct sh_slice sl;
 
+	/* mount lock keeps bucket table valid while yielding */
 	down(&shfs_mount_lock);
 	if (!shfs_mounted)
 		goto out;
 
+	sh_slice_init(&sl, cio);
 	str_hash[(shfs_vol.hlen * 2)] = '\0';
 	str_name[sizeof(hentry->name)] = '\0';
 	str_mime[sizeof(hentry->f_attr.mime)] = '\0';
@@ -127,6 +130,8 @@ static int shcmd_shfs_ls(FILE *cio, int argc, char *argv[])
 		fprintf(cio, "%-16s %s\n",
 		       str_date,
 		       str_name);
+
+		sh_slice_yield(&sl);
 	}
 
  out:
@@ -139,11 +144,13 @@ static int shcmd_shfs_lsof(FILE *cio, int argc, char *argv[])
 	struct htable_el *el;
 	struct shfs_bentry *bentry;
 	char str_hash[(shfs_vol.hlen * 2) + 1];
+	struct sh_slice sl;
 
 	down(&shfs_mount_lock);
 	if (!shfs_mounted)
 		goto out;
 
+	sh_slice_init(&sl, cio);
 	str_hash[(shfs_vol.hlen * 2)] = '\0';
 
 	foreach_htable_el(shfs_vol.bt, el) {
@@ -155,6 +162,7 @@ static int shcmd_shfs_lsof(FILE *cio, int argc, char *argv[])
 			        str_hash,
 			        bentry->refcount);
 		}
+		sh_slice_yield(&sl);
 	}
 
  out:
@@ -231,9 +239,11 @@ static int shcmd_shfs_file(FILE *cio, int argc, char *argv[])
 
 static int shcmd_shfs_cat(FILE *cio, int argc, char *argv[])
 {
-	char buf[1024];
-	uint64_t fsize, left, cur, dlen, plen;
+	struct shfs_fio_cref ref[SHFS_FIO_MAX_CREFS];
+	uint64_t fsize, left, cur;
+	const char *p, *end, *nul;
 	unsigned int i;
+	int j, nb;
 	SHFS_FD f;
 	int ret = 0;
 
@@ -253,27 +263,30 @@ static int shcmd_shfs_cat(FILE *cio, int argc, char *argv[])
 		left = fsize;
 		cur = 0;
 		while (left) {
-			dlen = min(left, sizeof(buf) - 1);
-
-			ret = shfs_fio_cache_read(f, cur, buf, dlen);
-			if (ret < 0) {
+			/* print directly from cache buffers */
+			nb = shfs_fio_cache_getref(f, cur, left, ref, SHFS_FIO_MAX_CREFS);
+			if (nb < 0) {
+				ret = nb;
 				fprintf(cio, "%s: Read error: %s\n", argv[i], strerror(-ret));
 				shfs_fio_close(f);
 				goto out;
 			}
-			buf[dlen] = '\0'; /* set terminating character for fprintf */
-			plen = 0;
-			while (plen < dlen) {
-				plen += fprintf(cio, "%s", buf + plen);
-				if (plen < dlen) {
-					/* terminating character found earlier than expected
-					 * continue printing after this character */
-					++plen;
+			for (j = 0; j < nb; ++j) {
+				p = ref[j].data;
+				end = p + ref[j].len;
+				while (p < end) {
+					/* terminating characters are skipped */
+					nul = memchr(p, '\0', end - p);
+					if (!nul)
+						nul = end;
+					fwrite(p, 1, nul - p, cio);
+					p = nul + 1;
 				}
+				left -= ref[j].len;
+				cur += ref[j].len;
 			}
+			shfs_fio_cache_putref(ref, nb);
 			fflush(cio);
-			left -= dlen;
-			cur += dlen;
 		}
 		shfs_fio_close(f);
 	}
@@ -285,9 +298,10 @@ static int shcmd_shfs_cat(FILE *cio, int argc, char *argv[])
 
 static int shcmd_shfs_dumpfile(FILE *cio, int argc, char *argv[])
 {
+	struct shfs_fio_cref ref[SHFS_FIO_MAX_CREFS];
 	SHFS_FD f;
-	char buf[1024];
-	uint64_t fsize, left, cur, dlen;
+	uint64_t fsize, left, cur;
+	int i, nb;
 	int ret = 0;
 
 	if (argc <= 1) {
@@ -305,15 +319,18 @@ static int shcmd_shfs_dumpfile(FILE *cio, int argc, char *argv[])
 	left = fsize;
 	cur = 0;
 	while (left) {
-		dlen = min(left, sizeof(buf));
-		ret = shfs_fio_cache_read(f, cur, buf, dlen);
-		if (ret < 0) {
+		nb = shfs_fio_cache_getref(f, cur, left, ref, SHFS_FIO_MAX_CREFS);
+		if (nb < 0) {
+			ret = nb;
 			fprintf(cio, "%s: Read error: %s\n", argv[1], strerror(-ret));
 			goto out;
 		}
-		hexdump(cio, buf, dlen, "", HDAT_RELATIVE, cur, 16, 4, 1);
-		left -= dlen;
-		cur += dlen;
+		for (i = 0; i < nb; ++i) {
+			hexdump(cio, ref[i].data, ref[i].len, "", HDAT_RELATIVE, cur, 16, 4, 1);
+			left -= ref[i].len;
+			cur += ref[i].len;
+		}
+		shfs_fio_cache_putref(ref, nb);
 	}
 
  out:
@@ -440,13 +457,32 @@ static int shcmd_shfs_remount(FILE *cio, int argc, char *argv[])
 
 static int shcmd_shfs_flush_cache(FILE *cio, int argc, char *argv[])
 {
+    struct sh_slice sl;
+    uint32_t left, n;
+    int ret = 0;
+
+    down(&shfs_mount_lock);
     if (!shfs_mounted) {
 	    fprintf(cio, "No SHFS filesystem is mounted\n");
-	    return -1;
+	    ret = -1;
+	    goto out;
     }
 
-    shfs_flush_cache();
-    return 0;
+    /* flush in steps: the main loop continues in between, buffers that
+     * became unreferenced meanwhile are flushed as well */
+    sh_slice_init(&sl, cio);
+    left = shfs_vol.chunkcache->nb_entries;
+    while (left) {
+	    n = shfs_flush_cache_n(min(left, (uint32_t) SHFS_CACHE_FLUSH_STEP));
+	    if (!n)
+		    break; /* no unreferenced buffers left */
+	    left -= n;
+	    sh_slice_yield(&sl);
+    }
+
+ out:
+    up(&shfs_mount_lock);
+    return ret;
 }
 
 static int shcmd_shfs_prefetch_cache(FILE *cio, int argc, char *argv[])
@@ -603,14 +639,6 @@ void uuid_unparse(const uuid_t uu, char *out)
 	        uu[8], uu[9], uu[10], uu[11], uu[12], uu[13], uu[14], uu[15]);
 }
 
-void hash_unparse(const hash512_t h, uint8_t hlen, char *out)
-{
-	uint8_t i;
-
-	for (i = 0; i < hlen; i++)
-		snprintf(out + (2*i), 3, "%02x", h[i]);
-}
-
 size_t strftimestamp_s(char *s, size_t slen, const char *fmt, uint64_t ts_sec)
 {
 	struct tm *tm;
@@ -58,7 +58,7 @@ int register_shfs_tools(void);
 #ifdef __MINIOS__
 void uuid_unparse(const uuid_t uu, char *out);
 #endif
-void hash_unparse(const hash512_t h, uint8_t hlen, char *out);
+#define hash_unparse(h, hlen, out) hash_format((h), (hlen), (out))
 
 size_t strftimestamp_s(char *s, size_t slen, const char *fmt, uint64_t ts_sec);
 
@@ -0,0 +1,561 @@
+/*
+ * Asynchronous cache warm-up for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "shfs.h"
+#include "shfs_btable.h"
+#include "shfs_cache.h"
+#include "shfs_fio.h"
+#include "shfs_tools.h"
+#include "shfs_warmup.h"
+#ifdef SHFS_STATS
+#include "shfs_stats.h"
+#endif
+#include "shell.h"
+
+#ifdef SHFS_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+struct shfs_warmup shfs_warmup = { .active = 0 };
+
+/* releases completed reads */
+static inline void _shfs_warmup_reap(void)
+{
+	struct shfs_warmup_slot *s;
+	uint32_t i = 0;
+
+	while (i < shfs_warmup.nb_infly) {
+		s = &shfs_warmup.slot[i];
+		if (!shfs_aio_is_done(s->t)) {
+			++i;
+			continue;
+		}
+		if (unlikely(s->cce->invalid))
+			++shfs_warmup.ioerr;
+		shfs_cache_release_ioabort(s->cce, s->t);
+		++shfs_warmup.done_chks;
+
+		/* fill the gap with the last slot */
+		*s = shfs_warmup.slot[--shfs_warmup.nb_infly];
+	}
+}
+
+static inline void _shfs_warmup_refill(uint64_t now)
+{
+	uint64_t burst, dt;
+
+	if (!shfs_warmup.rate)
+		return;
+
+	burst = max((shfs_warmup.rate * SHFS_WARMUP_BURST_MS) / 1000,
+		    (uint64_t) shfs_vol.chunksize);
+	dt = min(now - shfs_warmup.t_last, 1000000000ull); /* avoid overflows */
+	shfs_warmup.tokens += (int64_t) ((shfs_warmup.rate * dt) / 1000000000ull);
+	if (shfs_warmup.tokens > (int64_t) burst)
+		shfs_warmup.tokens = (int64_t) burst;
+	shfs_warmup.t_last = now;
+}
+
+/* closes current object and opens the next one that can be read */
+static int _shfs_warmup_next_obj(void)
+{
+	if (shfs_warmup.f) {
+		shfs_fio_close(shfs_warmup.f);
+		shfs_warmup.f = NULL;
+		++shfs_warmup.done_objs;
+	}
+
+	while (shfs_warmup.next_obj < shfs_warmup.nb_objs) {
+		shfs_warmup.f = shfs_fio_openh_nostats(shfs_warmup.obj[shfs_warmup.next_obj++]);
+		if (!shfs_warmup.f) {
+			++shfs_warmup.failed_objs;
+			continue;
+		}
+		if (shfs_fio_islink(shfs_warmup.f)) {
+			shfs_fio_close(shfs_warmup.f);
+			shfs_warmup.f = NULL;
+			++shfs_warmup.done_objs;
+			continue;
+		}
+		shfs_warmup.next_chk = 0;
+		shfs_warmup.nb_chks = shfs_fio_size_chks(shfs_warmup.f);
+		return 1;
+	}
+	return 0;
+}
+
+static void _shfs_warmup_finish(void)
+{
+	shfs_warmup.active = 0;
+	shfs_warmup.t_end = target_now_ns();
+	free(shfs_warmup.obj);
+	shfs_warmup.obj = NULL;
+}
+
+void shfs_warmup_stop(void)
+{
+	uint32_t i;
+
+	if (!shfs_warmup.active)
+		return;
+
+	for (i = 0; i < shfs_warmup.nb_infly; ++i)
+		shfs_cache_release_ioabort(shfs_warmup.slot[i].cce,
+					   shfs_warmup.slot[i].t);
+	shfs_warmup.nb_infly = 0;
+	if (shfs_warmup.f) {
+		shfs_fio_close(shfs_warmup.f);
+		shfs_warmup.f = NULL;
+	}
+	_shfs_warmup_finish();
+}
+
+void _shfs_warmup_poll(void)
+{
+	struct shfs_cache_entry *cce;
+	SHFS_AIO_TOKEN *t;
+	int ret;
+
+	_shfs_warmup_reap();
+
+	if (unlikely(shfs_warmup.f && shfs_warmup.f->update)) {
+		/* volume is going to be unmounted or entry gets updated */
+		printd("Warm-up aborted: Volume is busy\n");
+		shfs_warmup_stop();
+		return;
+	}
+
+	_shfs_warmup_refill(target_now_ns());
+
+	while (shfs_warmup.nb_infly < shfs_warmup.qdepth) {
+		if (!shfs_warmup.f || shfs_warmup.next_chk == shfs_warmup.nb_chks) {
+			if (!_shfs_warmup_next_obj())
+				break; /* all objects are requested */
+		}
+		if (shfs_warmup.rate && shfs_warmup.tokens <= 0)
+			break; /* bandwidth limit reached */
+
+		ret = shfs_fio_cache_aread(shfs_warmup.f, shfs_warmup.next_chk,
+					   NULL, NULL, NULL, &cce, &t);
+		if (unlikely(ret == -EAGAIN))
+			break; /* out of cache buffers or AIO tokens, retry later */
+		++shfs_warmup.next_chk;
+		if (unlikely(ret < 0)) {
+			++shfs_warmup.ioerr;
+			++shfs_warmup.done_chks;
+			continue;
+		}
+		if (ret == 0) {
+			/* already in cache */
+			shfs_cache_release(cce);
+			++shfs_warmup.done_chks;
+			continue;
+		}
+		shfs_warmup.tokens -= shfs_vol.chunksize;
+		shfs_warmup.slot[shfs_warmup.nb_infly].cce = cce;
+		shfs_warmup.slot[shfs_warmup.nb_infly].t = t;
+		++shfs_warmup.nb_infly;
+	}
+
+	if (!shfs_warmup.f && shfs_warmup.nb_infly == 0)
+		_shfs_warmup_finish();
+}
+
+/*
+ * Job setup
+ */
+static struct shfs_bentry *_shfs_warmup_lookup(const char *path)
+{
+	hash512_t h;
+
+	if (path[0] == SHFS_HASH_INDICATOR_PREFIX) {
+		if (hash_parse(path + 1, h, shfs_vol.hlen) < 0)
+			return NULL;
+		return shfs_btable_lookup(shfs_vol.bt, h);
+	}
+#ifdef SHFS_OPENBYNAME
+	return shfs_btable_lookup_byname(shfs_vol.bt, shfs_vol.htable_chunk_cache, path);
+#else
+	return NULL;
+#endif
+}
+
+static int _shfs_warmup_add(FILE *cio, const char *path)
+{
+	struct shfs_bentry *bentry;
+
+	bentry = _shfs_warmup_lookup(path);
+	if (!bentry) {
+		fprintf(cio, "%s: Not found\n", path);
+		++shfs_warmup.failed_objs;
+		return -ENOENT;
+	}
+	if (SHFS_HENTRY_ISLINK(bentry->hentry))
+		return 0; /* nothing to cache */
+
+	hash_copy(shfs_warmup.obj[shfs_warmup.nb_objs++],
+		  bentry->hentry->hash, shfs_vol.hlen);
+	shfs_warmup.total_chks += shfs_fio_size_chks(bentry);
+	return 0;
+}
+
+/* adds objects listed in a manifest object (one name or ?hash per line) */
+static int _shfs_warmup_add_manifest(FILE *cio, const char *path)
+{
+	SHFS_FD f;
+	uint64_t fsize;
+	uint32_t nb_lines;
+	hash512_t *obj;
+	char *buf, *line, *end;
+	uint64_t i;
+	int ret;
+
+	f = shfs_fio_open(path);
+	if (!f) {
+		fprintf(cio, "Could not open %s: %s\n", path, strerror(errno));
+		return -ENOENT;
+	}
+	shfs_fio_size(f, &fsize);
+	if (fsize > SHFS_WARMUP_MANIFEST_MAXLEN) {
+		fprintf(cio, "%s: Manifest is too big\n", path);
+		ret = -EFBIG;
+		goto err_close_f;
+	}
+	buf = malloc(fsize + 1);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto err_close_f;
+	}
+	ret = shfs_fio_read(f, 0, buf, fsize);
+	if (ret < 0) {
+		fprintf(cio, "%s: Read error: %s\n", path, strerror(-ret));
+		goto err_free_buf;
+	}
+	buf[fsize] = '\0';
+
+	/* count lines to allocate the object list */
+	nb_lines = 1;
+	for (i = 0; i < fsize; ++i)
+		if (buf[i] == '\n')
+			++nb_lines;
+	obj = realloc(shfs_warmup.obj,
+		      (shfs_warmup.nb_objs + nb_lines) * sizeof(hash512_t));
+	if (!obj) {
+		ret = -ENOMEM;
+		goto err_free_buf;
+	}
+	shfs_warmup.obj = obj;
+
+	for (line = buf; line; line = end) {
+		end = strchr(line, '\n');
+		if (end)
+			*(end++) = '\0';
+		line += strspn(line, " \t\r");
+		line[strcspn(line, " \t\r")] = '\0';
+		if (line[0] == '\0' || line[0] == '#')
+			continue; /* empty line or comment */
+		_shfs_warmup_add(cio, line); /* ignore errors */
+	}
+	ret = 0;
+
+ err_free_buf:
+	free(buf);
+ err_close_f:
+	shfs_fio_close(f);
+	return ret;
+}
+
+#ifdef SHFS_STATS
+/* adds the n objects with the most hits (hottest first) */
+struct _shfs_warmup_top {
+	uint64_t h;
+	struct shfs_bentry *bentry;
+};
+
+static inline void _shfs_warmup_top_down(struct _shfs_warmup_top *heap,
+					 uint32_t len, uint32_t i)
+{
+	struct _shfs_warmup_top tmp;
+	uint32_t c;
+
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= len)
+			return;
+		if (c + 1 < len && heap[c + 1].h < heap[c].h)
+			++c;
+		if (heap[i].h <= heap[c].h)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[c];
+		heap[c] = tmp;
+		i = c;
+	}
+}
+
+static int _shfs_warmup_add_top(uint32_t n)
+{
+	struct _shfs_warmup_top *heap;
+	struct shfs_el_stats stats;
+	struct htable_el *el;
+	struct shfs_bentry *bentry;
+	uint32_t len = 0;
+	uint32_t i;
+
+	heap = malloc(n * sizeof(*heap));
+	if (!heap)
+		return -ENOMEM;
+
+	/* min-heap of the n elements with the most hits */
+	foreach_htable_el(shfs_vol.bt, el) {
+		bentry = el->private;
+		if (SHFS_HENTRY_ISLINK(bentry->hentry))
+			continue;
+		shfs_stats_collect(bentry, &stats);
+		if (!stats.h)
+			continue;
+		if (len < n) {
+			heap[len].h = stats.h;
+			heap[len].bentry = bentry;
+			++len;
+			if (len == n) {
+				for (i = n / 2; i > 0; --i)
+					_shfs_warmup_top_down(heap, len, i - 1);
+			}
+		} else if (stats.h > heap[0].h) {
+			heap[0].h = stats.h;
+			heap[0].bentry = bentry;
+			_shfs_warmup_top_down(heap, len, 0);
+		}
+	}
+	if (len < n) {
+		for (i = len / 2; i > 0; --i)
+			_shfs_warmup_top_down(heap, len, i - 1);
+	}
+
+	/* pop from heap: coldest element goes to the end of the list */
+	shfs_warmup.nb_objs = len;
+	while (len) {
+		bentry = heap[0].bentry;
+		hash_copy(shfs_warmup.obj[len - 1], bentry->hentry->hash, shfs_vol.hlen);
+		shfs_warmup.total_chks += shfs_fio_size_chks(bentry);
+		heap[0] = heap[--len];
+		_shfs_warmup_top_down(heap, len, 0);
+	}
+
+	free(heap);
+	return 0;
+}
+#endif
+
+static void _shfs_warmup_print_progress(FILE *cio)
+{
+	uint64_t now, elapsed;
+
+	now = shfs_warmup.active ? target_now_ns() : shfs_warmup.t_end;
+	elapsed = (now - shfs_warmup.t_start) / 1000000; /* ms */
+
+	fprintf(cio, "Warm-up %s\n", shfs_warmup.active ? "in progress" : "done");
+	fprintf(cio, " Objects: %"PRIu32"/%"PRIu32" (%"PRIu32" failed)\n",
+		shfs_warmup.done_objs, shfs_warmup.nb_objs, shfs_warmup.failed_objs);
+	fprintf(cio, " Chunks:  %"PRIu64"/%"PRIu64" (%"PRIu64"%%), %"PRIu64" I/O errors\n",
+		shfs_warmup.done_chks, shfs_warmup.total_chks,
+		shfs_warmup.total_chks ? (shfs_warmup.done_chks * 100) / shfs_warmup.total_chks : 100,
+		shfs_warmup.ioerr);
+	fprintf(cio, " Elapsed: %"PRIu64".%03"PRIu64" s, %"PRIu64" KiB/s",
+		elapsed / 1000, elapsed % 1000,
+		elapsed ? (shfs_warmup.done_chks * shfs_vol.chunksize) / elapsed * 1000 / 1024 : 0);
+	if (shfs_warmup.rate)
+		fprintf(cio, " (limit: %"PRIu64" KiB/s)", shfs_warmup.rate / 1024);
+	fprintf(cio, "\n");
+	if (shfs_warmup.active)
+		fprintf(cio, " In flight: %"PRIu32"/%"PRIu32"\n",
+			shfs_warmup.nb_infly, shfs_warmup.qdepth);
+}
+
+static int shcmd_shfs_warmup(FILE *cio, int argc, char *argv[])
+{
+	uint32_t qdepth = SHFS_WARMUP_QDEPTH;
+	uint64_t rate = SHFS_WARMUP_RATE;
+	const char *manifest = NULL;
+	uint32_t top = 0;
+	char *end;
+	int i, ret = 0;
+
+	down(&shfs_mount_lock);
+	if (!shfs_mounted) {
+		fprintf(cio, "No SHFS filesystem is mounted\n");
+		ret = -1;
+		goto out;
+	}
+
+	if (argc == 1) {
+		if (!shfs_warmup.t_start)
+			fprintf(cio, "No warm-up was started\n");
+		else
+			_shfs_warmup_print_progress(cio);
+		goto out;
+	}
+	if (argc == 2 && strcmp(argv[1], "-s") == 0) {
+		shfs_warmup_stop();
+		goto out;
+	}
+
+	/* parse options */
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+			qdepth = atoi(argv[++i]);
+			if (qdepth == 0 || qdepth > SHFS_WARMUP_MAX_QDEPTH) {
+				fprintf(cio, "Queue depth has to be between 1 and %u\n",
+					SHFS_WARMUP_MAX_QDEPTH);
+				ret = -1;
+				goto out;
+			}
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			rate = strtoull(argv[++i], &end, 10);
+			if (argv[i][0] == '-' || end == argv[i] || *end != '\0' ||
+			    rate > SHFS_WARMUP_MAX_RATE) {
+				fprintf(cio, "Bandwidth limit has to be between 0 and %u MiB/s\n",
+					SHFS_WARMUP_MAX_RATE);
+				ret = -1;
+				goto out;
+			}
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			manifest = argv[++i];
+#ifdef SHFS_STATS
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			long n = strtol(argv[++i], &end, 10);
+
+			if (end == argv[i] || *end != '\0' || n <= 0) {
+				fprintf(cio, "Number of files has to be a positive integer\n");
+				ret = -1;
+				goto out;
+			}
+			/* there cannot be more candidates than volume entries */
+			top = (uint32_t) (n > (long) shfs_vol.htable_nb_entries ?
+					  shfs_vol.htable_nb_entries : n);
+#endif
+		} else {
+			goto usage;
+		}
+	}
+	if (!manifest && !top && i == argc)
+		goto usage;
+
+	if (shfs_warmup.active) {
+		fprintf(cio, "A warm-up is already in progress\n");
+		ret = -1;
+		goto out;
+	}
+
+	/* setup job */
+	memset(&shfs_warmup, 0, sizeof(shfs_warmup));
+	shfs_warmup.qdepth = qdepth;
+	shfs_warmup.rate = rate * 1024 * 1024;
+	shfs_warmup.obj = malloc(max((uint32_t) (argc - i) + top, 1u) * sizeof(hash512_t));
+	if (!shfs_warmup.obj) {
+		fprintf(cio, "Could not allocate object list: %s\n", strerror(ENOMEM));
+		ret = -1;
+		goto out;
+	}
+#ifdef SHFS_STATS
+	if (top)
+		_shfs_warmup_add_top(top);
+#endif
+	for (; i < argc; ++i)
+		_shfs_warmup_add(cio, argv[i]);
+	if (manifest && _shfs_warmup_add_manifest(cio, manifest) < 0) {
+		free(shfs_warmup.obj);
+		shfs_warmup.obj = NULL;
+		ret = -1;
+		goto out;
+	}
+
+	shfs_warmup.t_start = target_now_ns();
+	shfs_warmup.t_last = shfs_warmup.t_start;
+	shfs_warmup.t_end = shfs_warmup.t_start;
+	shfs_warmup.active = 1;
+	fprintf(cio, "Warming up %"PRIu32" objects (%"PRIu64" chunks)\n",
+		shfs_warmup.nb_objs, shfs_warmup.total_chks);
+	goto out;
+
+ usage:
+	fprintf(cio, "Usage: %s [-q DEPTH] [-b MIB/S] [-m MANIFEST]", argv[0]);
+#ifdef SHFS_STATS
+	fprintf(cio, " [-t N]");
+#endif
+	fprintf(cio, " [FILE]...\n");
+	fprintf(cio, "       %s [-s]\n", argv[0]);
+	fprintf(cio, "Loads files into the cache in background\n");
+	fprintf(cio, "  -q DEPTH     Number of parallel chunk reads (default: %u)\n", SHFS_WARMUP_QDEPTH);
+	fprintf(cio, "  -b MIB/S     Bandwidth limit, 0 = unlimited (default: %u)\n", SHFS_WARMUP_RATE);
+	fprintf(cio, "  -m MANIFEST  Warm up files listed in MANIFEST (one per line)\n");
+#ifdef SHFS_STATS
+	fprintf(cio, "  -t N         Warm up N files with most hits\n");
+#endif
+	fprintf(cio, "  -s           Stop current warm-up\n");
+	fprintf(cio, "Without arguments, the progress is displayed\n");
+	ret = -1;
+ out:
+	up(&shfs_mount_lock);
+	return ret;
+}
+
+#ifdef HAVE_CTLDIR
+int register_shfs_warmup_tools(struct ctldir *cd)
+#else
+int register_shfs_warmup_tools(void)
+#endif
+{
+#ifdef HAVE_CTLDIR
+	/* ctldir entries (ignore errors) */
+	if (cd)
+		ctldir_register_shcmd(cd, "warmup", shcmd_shfs_warmup);
+#endif
+#ifdef HAVE_SHELL
+	/* shell commands (ignore errors) */
+	shell_register_cmd("warmup", shcmd_shfs_warmup);
+#endif
+	return 0;
+}
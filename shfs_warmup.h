@@ -0,0 +1,124 @@
+/*
+ * Asynchronous cache warm-up for Simple hash filesystem (SHFS)
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _SHFS_WARMUP_H_
+#define _SHFS_WARMUP_H_
+
+#include "shfs_defs.h"
+#include "shfs_fio.h"
+#include "likely.h"
+#ifdef HAVE_CTLDIR
+#include <target/ctldir.h>
+#endif
+
+/*
+ * The warm-up engine fills the chunk cache with a list of objects in the
+ * background: shfs_warmup_poll() is called from the main loop and keeps up
+ * to qdepth chunk reads in flight, limited by a token bucket on the number
+ * of bytes read per second. Objects are opened one after another, so that
+ * the engine holds at most one file open.
+ */
+#define SHFS_WARMUP_MAX_QDEPTH 64
+#ifndef SHFS_WARMUP_QDEPTH
+#define SHFS_WARMUP_QDEPTH 8
+#endif
+#ifndef SHFS_WARMUP_RATE
+#define SHFS_WARMUP_RATE 64 /* MiB/s, 0 = unlimited */
+#endif
+#define SHFS_WARMUP_MAX_RATE 16384 /* MiB/s, keeps the token refill within 64 bits */
+#define SHFS_WARMUP_BURST_MS 100 /* token bucket depth */
+#define SHFS_WARMUP_MANIFEST_MAXLEN (1024 * 1024)
+
+struct shfs_warmup_slot {
+	struct shfs_cache_entry *cce;
+	SHFS_AIO_TOKEN *t;
+};
+
+struct shfs_warmup {
+	int active;
+
+	/* object list */
+	hash512_t *obj;
+	uint32_t nb_objs;
+	uint32_t next_obj;
+
+	/* current object */
+	SHFS_FD f;
+	chk_t next_chk;
+	chk_t nb_chks;
+
+	/* in-flight reads */
+	uint32_t qdepth;
+	uint32_t nb_infly;
+	struct shfs_warmup_slot slot[SHFS_WARMUP_MAX_QDEPTH];
+
+	/* rate limiter (bytes per second, 0 = unlimited) */
+	uint64_t rate;
+	int64_t tokens;
+	uint64_t t_last;
+
+	/* progress */
+	uint64_t t_start;
+	uint64_t t_end;
+	uint64_t total_chks;
+	uint64_t done_chks;
+	uint32_t done_objs;
+	uint32_t failed_objs; /* not found or unreadable */
+	uint64_t ioerr;
+};
+
+extern struct shfs_warmup shfs_warmup;
+
+void _shfs_warmup_poll(void);
+void shfs_warmup_stop(void);
+
+/* called from the main loop */
+static inline void shfs_warmup_poll(void)
+{
+	if (likely(!shfs_warmup.active))
+		return;
+	_shfs_warmup_poll();
+}
+
+/**
+ * Registers warm-up commands to micro shell + ctldir (if *cd is not NULL)
+ */
+#ifdef HAVE_CTLDIR
+int register_shfs_warmup_tools(struct ctldir *cd);
+#else
+int register_shfs_warmup_tools(void);
+#endif
+
+#endif /* _SHFS_WARMUP_H_ */
@@ -130,7 +130,7 @@ struct blkdev *open_blkdev(blkdev_id_t id, int mode)
 
   printd("%s has a size of %"PRIu64" bytes\n", bd->dev, (uint64_t) (bd->size * bd->ssize));
 
-  bd->reqpool = alloc_simple_mempool(MAX_REQUESTS, sizeof(struct _blkdev_req));
+  bd->reqpool = alloc_simple_mempool(MEMT_BLKDEV, MAX_REQUESTS, sizeof(struct _blkdev_req));
   if (!bd->reqpool) {
     errno = ENOMEM;
     goto err_close_fd;
@@ -95,6 +95,9 @@ struct _blkdev_req {
 struct blkdev *open_blkdev(blkdev_id_t id, int mode);
 void close_blkdev(struct blkdev *bd);
 #define blkdev_refcount(bd) ((bd)->refcount)
+/* suspend is not supported on this platform: devices stay attached */
+#define blkdev_suspend(bd) (0)
+#define blkdev_resume(bd) (0)
 
 int blkdev_id_parse(const char *id, blkdev_id_t *out);
 #define blkdev_id_unparse(id, out, maxlen) \
@@ -104,6 +104,7 @@
 
 #define MEMP_NUM_TCP_PCB CONFIG_LWIP_NUM_TCPCON /* max num of sim. TCP connections */
 #define MEMP_NUM_TCP_PCB_LISTEN 32 /* max num of sim. TCP listeners */
+#define TCP_LISTEN_BACKLOG 1 /* bounds half-open connections per listener */
 
 /*
  * DNS options
@@ -124,6 +125,11 @@
 #define CHECKSUM_GEN_ICMP 0
 #define CHECKSUM_GEN_ICMP6 0
 #else
+#if defined CONFIG_TAPIF && defined CONFIG_TAPIF_OFFLOAD
+/* TCP/UDP checksums are completed by the host (vnet header, see tapif.c) */
+#define CHECKSUM_GEN_UDP 0
+#define CHECKSUM_GEN_TCP 0
+#endif
 #define LWIP_CHECKSUM_ON_COPY 1
 #endif
 
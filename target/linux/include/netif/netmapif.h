@@ -70,6 +70,7 @@ struct netmapif {
     /* the following fields are used internally */
     struct netmap_if *_nifp;
     struct netmap_ring *_txring;
+    unsigned int _rx_next; /* rx ring (offset) that is served first on the next poll */
     int _fd;
 #ifndef CONFIG_LWIP_NOTHREADS
     volatile int _thread_exit;
@@ -90,6 +91,9 @@ struct netmapif {
  * thread get scheduled frequently.
  */
 void netmapif_poll(struct netif *netif);
+/* Same as netmapif_poll() but receives at most budget packets
+ * (0: no limit). Returns the number of received packets. */
+unsigned int netmapif_poll_budget(struct netif *netif, unsigned int budget);
 #endif
 
 err_t netmapif_init(struct netif *netif);
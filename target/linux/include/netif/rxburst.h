@@ -0,0 +1,104 @@
+/*
+ * Burst delivery of received frames to lwIP
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ *
+ */
+#ifndef __RXBURST_H__
+#define __RXBURST_H__
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+/*
+ * Receive paths first collect the frames of a poll into a burst and
+ * hand them over to lwIP afterwards. While lwIP processes a frame, the
+ * headers of the following one are prefetched.
+ *
+ * A poll is bounded by a budget (number of frames, 0 = no limit) so that
+ * an RX flood cannot starve the rest of the main loop (e.g., block I/O
+ * completions). The poll functions return the number of frames that were
+ * taken from the device: if this equals the budget, more frames might be
+ * pending.
+ */
+#ifndef NETIF_RX_BURST
+#define NETIF_RX_BURST 32
+#endif
+
+#define netif_rx_budget_left(budget, done) \
+	((budget) == 0 || (done) < (budget))
+
+struct rxburst {
+	unsigned int n;
+	struct pbuf *p[NETIF_RX_BURST];
+};
+
+typedef void (*rxburst_input_fn)(struct pbuf *p, struct netif *netif);
+
+static inline void rxburst_init(struct rxburst *b)
+{
+	b->n = 0;
+}
+
+static inline int rxburst_full(const struct rxburst *b)
+{
+	return (b->n == NETIF_RX_BURST);
+}
+
+static inline void rxburst_add(struct rxburst *b, struct pbuf *p)
+{
+	b->p[b->n++] = p;
+}
+
+static inline void rxburst_deliver(struct rxburst *b, struct netif *netif,
+				   rxburst_input_fn input)
+{
+	unsigned int i;
+
+	if (b->n)
+		__builtin_prefetch(b->p[0]->payload);
+	for (i = 0; i < b->n; ++i) {
+		if (i + 2 < b->n)
+			__builtin_prefetch(b->p[i + 2]);
+		if (i + 1 < b->n) {
+			/* Ethernet, IP and TCP header */
+			__builtin_prefetch(b->p[i + 1]->payload);
+			__builtin_prefetch((uint8_t *) b->p[i + 1]->payload + 64);
+		}
+		input(b->p[i], netif);
+	}
+	b->n = 0;
+}
+
+#endif /* __RXBURST_H__ */
@@ -46,6 +46,9 @@ err_t tapif_init(struct netif *netif);
  * thread get scheduled frequently.
  */
 void tapif_poll(struct netif *netif);
+/* Same as tapif_poll() but reads at most budget frames (0: no limit).
+ * Returns the number of frames that were read. */
+unsigned int tapif_poll_budget(struct netif *netif, unsigned int budget);
 #endif
 
 #endif /* LWIP_TAPIF_H */
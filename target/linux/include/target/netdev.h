@@ -56,6 +56,8 @@
   netmapif_init
 #define target_netif_poll \
   netmapif_poll
+#define target_netif_poll_budget \
+  netmapif_poll_budget
 
 #else
 #include <netif/tapif.h>
@@ -63,6 +65,8 @@
   tapif_init
 #define target_netif_poll \
   tapif_poll
+#define target_netif_poll_budget \
+  tapif_poll_budget
 
 #endif
 
@@ -102,6 +102,20 @@ void app_shutdown(unsigned reason);
 	pth_spawn(PTH_ATTR_DEFAULT, (void * (*)(void *)) (func), (argp))
 #define exit_thread() \
 	pth_exit(NULL)
+#elif defined SHFS_FUSE
+/*
+ * The FUSE frontend serves requests from multiple threads that
+ * share a big lock: schedule() releases it while waiting for I/O
+ */
+void shfs_fuse_yield(void);
+
+#define thread (void *)
+#define schedule() \
+	shfs_fuse_yield()
+#define create_thread(name, func, argp) \
+	do {} while (0)
+#define exit_thread() \
+	do {} while (0)
 #else
 #define thread (void *)
 #define schedule() \
@@ -78,6 +78,7 @@
  */
 
 #include <netif/netmapif.h>
+#include <netif/rxburst.h>
 #include <sys/sysctl.h> /* sysctl */
 
 #include <ifaddrs.h>	/* getifaddrs */
@@ -415,7 +416,6 @@ netmapif_receive(struct netmap_ring *rxring, unsigned int cur, struct pbuf *p)
 	unsigned int len;
 
 	/* copy payload from netmap ring */
-	cur    = rxring->cur;
 	slot   = &rxring->slot[cur];
 	cur    = nm_ring_next(rxring, cur);
 	s_buf  = NETMAP_BUF(rxring, slot->buf_idx);;
@@ -460,27 +460,38 @@ netmapif_receive(struct netmap_ring *rxring, unsigned int cur, struct pbuf *p)
 /*
  * Receive packets from netmap ring and send them to
  * netmapif_input()
+ * Packets are copied out of the ring in bursts: the slots are returned
+ * to the ring before the burst is passed to lwIP. At most budget
+ * packets are received (0: no limit). The ring that is served first
+ * rotates when the budget is used up, so that a flooded ring does not
+ * starve the others.
  */
-void netmapif_poll(struct netif *netif)
+unsigned int netmapif_poll_budget(struct netif *netif, unsigned int budget)
 {
   struct netmapif *nmi = netif->state;
-  unsigned int i;
+  unsigned int i, k, nb_rings;
   struct netmap_ring *rxring;
   unsigned int slots, tot_slots;
   unsigned int cur, next, pkg_len;
+  unsigned int done = 0;
+  struct rxburst burst;
   struct pbuf *p;
 
+  rxburst_init(&burst);
+
   /* call receive ioctl (TODO: expose filedescriptor to do rx select/poll outside of this function) */
   ioctl(nmi->_fd, NIOCRXSYNC, NULL);
 
   /* query all rx queues */
-  for (i = nmi->dev->first_rx_ring; i <= nmi->dev->last_rx_ring; ++i) {
+  nb_rings = nmi->dev->last_rx_ring - nmi->dev->first_rx_ring + 1;
+  for (k = 0; k < nb_rings; ++k) {
+    i = nmi->dev->first_rx_ring + ((nmi->_rx_next + k) % nb_rings);
     rxring = NETMAP_RXRING(nmi->_nifp, i);
 
     /* handle received packets */
     tot_slots = nm_ring_space(rxring);
     cur = rxring->cur;
-    while (tot_slots) {
+    while (tot_slots && netif_rx_budget_left(budget, done)) {
       pkg_len = netmapif_get_rxlen(rxring, cur, &next, &slots);
       LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_poll: %c%c.r%u: "
 				"incoming data %u bytes, %u slots\n",
@@ -491,13 +502,16 @@ void netmapif_poll(struct netif *netif)
 	LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_poll: %c%c.r%u: "
 				  "could not receive packet: too big!?\n",
 				  netif->name[0], netif->name[1], i));
-	p = NULL;
+	LINK_STATS_INC(link.lenerr);
+	LINK_STATS_INC(link.drop);
       } else {
 	p = pbuf_alloc(PBUF_RAW, (u16_t) (pkg_len + ETH_PAD_SIZE), PBUF_POOL);
 	if (unlikely(!p)) {
 	  LWIP_DEBUGF(NETIF_DEBUG, ("netmapif_poll: %c%c.r%u: "
 				    "could not allocate pbuf, dropping packet\n",
 				    netif->name[0], netif->name[1], i));
+	  LINK_STATS_INC(link.memerr);
+	  LINK_STATS_INC(link.drop);
 	} else {
 	  /* copy received data into pbuf */
 #if ETH_PAD_SIZE
@@ -507,14 +521,33 @@ void netmapif_poll(struct netif *netif)
 #if ETH_PAD_SIZE
 	  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif /* ETH_PAD_SIZE */
+	  LINK_STATS_INC(link.recv);
+	  rxburst_add(&burst, p);
 	}
       }
-      netmapif_input(p, netif);
       cur = next;
       tot_slots -= slots;
+      ++done;
+
+      if (rxburst_full(&burst)) {
+	rxring->head = rxring->cur = cur;
+	rxburst_deliver(&burst, netif, netmapif_input);
+      }
     }
     rxring->head = rxring->cur = cur;
+    if (!netif_rx_budget_left(budget, done)) {
+      nmi->_rx_next = (i - nmi->dev->first_rx_ring + 1) % nb_rings;
+      break;
+    }
   }
+
+  rxburst_deliver(&burst, netif, netmapif_input);
+  return done;
+}
+
+void netmapif_poll(struct netif *netif)
+{
+  netmapif_poll_budget(netif, 0);
 }
 
 #ifndef CONFIG_LWIP_NOTHREADS
@@ -687,6 +720,7 @@ err_t netmapif_init(struct netif *netif)
 	}
     }
     nmi->_nifp = nmi->dev->nifp;
+    nmi->_rx_next = 0;
 
     /* unlikely that this fails, nm_open() should have checked the parameters (hopefully) */
     if (nmi->dev->req.nr_rx_rings < nmi->dev->first_rx_ring ||
@@ -32,6 +32,7 @@
 
 #include "netif/tapif.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -40,6 +41,7 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/socket.h>
+#include <sys/select.h>
 
 
 #include "lwip/debug.h"
@@ -50,8 +52,11 @@
 #include "lwip/mem.h"
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
+#include "lwip/stats.h"
+#include "lwip/inet_chksum.h"
 
 #include "netif/etharp.h"
+#include "netif/rxburst.h"
 #include "lwip/ethip6.h"
 
 #if defined(LWIP_DEBUG) && defined(LWIP_TCPDUMP)
@@ -65,16 +70,27 @@
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #define DEVTAP "/dev/net/tun"
+#define DEVNAME "tap0" /* replaced by the name that the kernel assigns */
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
-#define IFCONFIG_ARGS "tap0 inet %d.%d.%d.%d " NETMASK_ARGS
+#define IFCONFIG_ARGS "%s inet %d.%d.%d.%d " NETMASK_ARGS
+#ifdef CONFIG_TAPIF_OFFLOAD
+#include <linux/virtio_net.h>
+#define TAPIF_VNET
+#endif
 #elif defined(openbsd)
 #define DEVTAP "/dev/tun0"
+#define DEVNAME "tun0"
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
-#define IFCONFIG_ARGS "tun0 inet %d.%d.%d.%d " NETMASK_ARGS " link0"
+#define IFCONFIG_ARGS "%s inet %d.%d.%d.%d " NETMASK_ARGS " link0"
 #else /* others */
 #define DEVTAP "/dev/tap0"
+#define DEVNAME "tap0"
 #define NETMASK_ARGS "netmask %d.%d.%d.%d"
-#define IFCONFIG_ARGS "tap0 inet %d.%d.%d.%d " NETMASK_ARGS
+#define IFCONFIG_ARGS "%s inet %d.%d.%d.%d " NETMASK_ARGS
+#endif
+
+#ifndef IFNAMSIZ
+#define IFNAMSIZ 16
 #endif
 
 #define IFNAME0 't'
@@ -84,25 +100,130 @@
 #define TAPIF_DEBUG LWIP_DBG_OFF
 #endif
 
+/* Number of tap queues (file descriptors) attached to the device.
+ * More than one queue requires a kernel with IFF_MULTI_QUEUE support
+ * (Linux 3.8+); the host spreads flows over the queues. */
+#ifndef TAPIF_QUEUES
+#define TAPIF_QUEUES 1
+#endif
+#if !defined(IFF_MULTI_QUEUE) && TAPIF_QUEUES > 1
+#undef TAPIF_QUEUES
+#define TAPIF_QUEUES 1
+#endif
+
+/* Maximum number of pbufs that are handed over to writev() as they are,
+ * longer chains are flattened into a buffer first */
+#ifndef TAPIF_TX_MAXIOV
+#define TAPIF_TX_MAXIOV 64
+#endif
+#define TAPIF_RX_MAXIOV 8
+
+/* RX frames are read into a pool pbuf chain of MTU size. Anything
+ * beyond that (GRO super-frames) lands in a per-interface overflow
+ * buffer and is copied into additional pbufs afterwards. */
+#define TAPIF_RX_PLEN(netif) ((netif)->mtu + SIZEOF_ETH_HDR + 4 /* VLAN */ + ETH_PAD_SIZE)
+#define TAPIF_RXBUF_LEN (0x10000 + SIZEOF_ETH_HDR)
+#define TAPIF_TXBUF_LEN 0x10000
+
+#ifdef TAPIF_VNET
+#define TAPIF_VNET_HLEN (sizeof(struct virtio_net_hdr))
+#else
+#define TAPIF_VNET_HLEN 0
+#endif
+
 struct tapif {
   struct eth_addr *ethaddr;
   /* Add whatever per-interface state that is needed here. */
-  int fd;
+  int fd[TAPIF_QUEUES];
+  unsigned int nb_queues;
+  unsigned int rx_next; /* queue that is served first on the next poll */
+  char ifname[IFNAMSIZ];
+  u8_t *rxbuf;
+  u8_t *txbuf;
 };
 
 /* Forward declarations. */
-static void  tapif_input(struct netif *netif);
+static unsigned int tapif_input(struct netif *netif, unsigned int budget);
 
 #ifndef CONFIG_LWIP_NOTHREADS
 static void tapif_thread(void *data);
 #endif
 
 /*-----------------------------------------------------------------------------------*/
+static int
+low_level_open(struct tapif *tapif, unsigned int q)
+{
+  int fd;
+#ifdef TAPIF_VNET
+  int hlen;
+#endif
+
+  fd = open(DEVTAP, O_RDWR);
+  LWIP_DEBUGF(TAPIF_DEBUG, ("tapif_init: queue %u: fd %d\n", q, fd));
+  if(fd == -1) {
+#ifdef linux
+    perror("tapif_init: try running \"modprobe tun\" or rebuilding your kernel with CONFIG_TUN; cannot open "DEVTAP);
+#else
+    perror("tapif_init: cannot open "DEVTAP);
+#endif
+    return -1;
+  }
+
+#ifdef linux
+  {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP|IFF_NO_PI;
+#ifdef TAPIF_VNET
+    ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
+#if TAPIF_QUEUES > 1
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif
+    if (q > 0) /* attach further queues to the same device */
+      strncpy(ifr.ifr_name, tapif->ifname, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
+      perror("tapif_init: "DEVTAP" ioctl TUNSETIFF");
+      goto err_close;
+    }
+    if (q == 0)
+      strncpy(tapif->ifname, ifr.ifr_name, IFNAMSIZ - 1);
+  }
+
+#ifdef TAPIF_VNET
+  hlen = TAPIF_VNET_HLEN;
+  if (ioctl(fd, TUNSETVNETHDRSZ, &hlen) < 0) {
+    perror("tapif_init: "DEVTAP" ioctl TUNSETVNETHDRSZ");
+    goto err_close;
+  }
+  if (q == 0) {
+    /* offloads are a device property: let the host skip checksumming
+     * and segmentation of frames that are sent to us */
+    if (ioctl(fd, TUNSETOFFLOAD,
+              TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN) < 0)
+      perror("tapif_init: "DEVTAP" ioctl TUNSETOFFLOAD (receiving without offloads)");
+  }
+#endif /* TAPIF_VNET */
+#endif /* Linux */
+
+  /* frames are drained in bursts until EAGAIN */
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+    perror("tapif_init: fcntl O_NONBLOCK");
+    goto err_close;
+  }
+  return fd;
+
+ err_close:
+  close(fd);
+  return -1;
+}
+
 static void
 low_level_init(struct netif *netif)
 {
   struct tapif *tapif;
-  char buf[sizeof(IFCONFIG_ARGS) + sizeof(IFCONFIG_BIN) + 50];
+  char buf[sizeof(IFCONFIG_ARGS) + sizeof(IFCONFIG_BIN) + IFNAMSIZ + 50];
+  unsigned int q;
 
   tapif = (struct tapif *)netif->state;
 
@@ -117,32 +238,24 @@ low_level_init(struct netif *netif)
   tapif->ethaddr->addr[5] = 0xab;
 
   /* Do whatever else is needed to initialize interface. */
-
-  tapif->fd = open(DEVTAP, O_RDWR);
-  LWIP_DEBUGF(TAPIF_DEBUG, ("tapif_init: fd %d\n", tapif->fd));
-  if(tapif->fd == -1) {
-#ifdef linux
-    perror("tapif_init: try running \"modprobe tun\" or rebuilding your kernel with CONFIG_TUN; cannot open "DEVTAP);
-#else
-    perror("tapif_init: cannot open "DEVTAP);
-#endif
-    exit(1);
-  }
-
-#ifdef linux
-  {
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    ifr.ifr_flags = IFF_TAP|IFF_NO_PI;
-    if (ioctl(tapif->fd, TUNSETIFF, (void *) &ifr) < 0) {
-      perror("tapif_init: "DEVTAP" ioctl TUNSETIFF");
-      exit(1);
+  strncpy(tapif->ifname, DEVNAME, sizeof(tapif->ifname) - 1);
+  tapif->nb_queues = 0;
+  tapif->rx_next = 0;
+  for (q = 0; q < TAPIF_QUEUES; ++q) {
+    tapif->fd[q] = low_level_open(tapif, q);
+    if (tapif->fd[q] < 0) {
+      if (q == 0)
+        exit(1);
+      fprintf(stderr, "tapif_init: %s: continuing with %u queue(s)\n",
+              tapif->ifname, q);
+      break;
     }
+    ++tapif->nb_queues;
   }
-#endif /* Linux */
   netif_set_link_up(netif);
 
   sprintf(buf, IFCONFIG_BIN IFCONFIG_ARGS,
+           tapif->ifname,
            ip4_addr1(&(netif->gw)),
            ip4_addr2(&(netif->gw)),
            ip4_addr3(&(netif->gw)),
@@ -163,6 +276,138 @@ low_level_init(struct netif *netif)
 #endif
 
 }
+/*-----------------------------------------------------------------------------------*/
+/*
+ * low_level_prepare():
+ *
+ * Parses the headers of an outgoing frame and fills in the vnet header:
+ * TCP and UDP checksums are left to the host (lwIP does not generate
+ * them with offloading), TCP frames that are larger than the MTU are
+ * segmented by the host (TSO). In order to keep flows on a single queue,
+ * the TX queue is selected by hashing addresses and ports.
+ *
+ * Returns the TX queue index, or -1 if the headers are not contained in
+ * the first len bytes of the frame.
+ */
+/*-----------------------------------------------------------------------------------*/
+#define _need(n) do { if ((n) > len) return ((n) > tot_len) ? 0 : -1; } while (0)
+
+static int
+low_level_prepare(struct netif *netif, u8_t *frame, u16_t len, u16_t tot_len,
+                  void *vhdr)
+{
+  struct tapif *tapif = (struct tapif *)netif->state;
+  u16_t l3off = SIZEOF_ETH_HDR;
+  u16_t l4off, l4len, thl, mss;
+  u16_t csum_off;
+  u8_t proto;
+  const u8_t *saddr, *daddr;
+  unsigned int alen, i;
+  u32_t acc, hash;
+  int v6;
+#ifdef TAPIF_VNET
+  struct virtio_net_hdr *vh = (struct virtio_net_hdr *) vhdr;
+
+  memset(vh, 0, sizeof(*vh));
+#endif
+
+  _need(SIZEOF_ETH_HDR);
+  switch ((frame[12] << 8) | frame[13]) {
+  case ETHTYPE_IP:
+    _need(l3off + 20);
+    l4off = l3off + (frame[l3off] & 0x0f) * 4;
+    _need(l4off);
+    if ((frame[l3off + 6] & 0x3f) || frame[l3off + 7])
+      return 0; /* fragment */
+    proto = frame[l3off + 9];
+    l4len = ((frame[l3off + 2] << 8) | frame[l3off + 3]) - (l4off - l3off);
+    saddr = &frame[l3off + 12];
+    daddr = &frame[l3off + 16];
+    alen  = 4;
+    v6    = 0;
+    break;
+#if LWIP_IPV6
+  case ETHTYPE_IPV6:
+    _need(l3off + 40);
+    l4off = l3off + 40;
+    proto = frame[l3off + 6]; /* extension headers are not offloaded */
+    l4len = (frame[l3off + 4] << 8) | frame[l3off + 5];
+    saddr = &frame[l3off + 8];
+    daddr = &frame[l3off + 24];
+    alen  = 16;
+    v6    = 1;
+    break;
+#endif /* LWIP_IPV6 */
+  default:
+    return 0;
+  }
+
+  switch (proto) {
+  case IP_PROTO_TCP:
+    _need(l4off + 20);
+    thl = (frame[l4off + 12] >> 4) * 4;
+    _need(l4off + thl);
+    csum_off = 16;
+    break;
+  case IP_PROTO_UDP:
+    _need(l4off + 8);
+    thl = 8;
+    csum_off = 6;
+    break;
+  default:
+    return 0;
+  }
+
+  /* flow hash over addresses and ports */
+  hash = 0;
+  if (tapif->nb_queues > 1) {
+    for (i = 0; i < alen; i += 4) {
+      hash ^= (saddr[i] << 24) | (saddr[i + 1] << 16) | (saddr[i + 2] << 8) | saddr[i + 3];
+      hash ^= (daddr[i] << 24) | (daddr[i + 1] << 16) | (daddr[i + 2] << 8) | daddr[i + 3];
+    }
+    hash ^= (frame[l4off] << 24) | (frame[l4off + 1] << 16) | (frame[l4off + 2] << 8) | frame[l4off + 3];
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    hash %= tapif->nb_queues;
+  }
+
+#ifdef TAPIF_VNET
+  /* the checksum field has to carry the (non-inverted) pseudo header sum */
+  acc = proto + l4len;
+  for (i = 0; i < alen; i += 2) {
+    acc += (saddr[i] << 8) | saddr[i + 1];
+    acc += (daddr[i] << 8) | daddr[i + 1];
+  }
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  frame[l4off + csum_off]     = (u8_t) (acc >> 8);
+  frame[l4off + csum_off + 1] = (u8_t) (acc & 0xff);
+
+  vh->flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  vh->csum_start  = l4off;
+  vh->csum_offset = csum_off;
+
+  if (proto == IP_PROTO_TCP) {
+    mss = netif->mtu - (l4off - l3off) - thl;
+    if (tot_len - l4off - thl > mss) {
+      vh->gso_type = v6 ? VIRTIO_NET_HDR_GSO_TCPV6 : VIRTIO_NET_HDR_GSO_TCPV4;
+      vh->gso_size = mss;
+      vh->hdr_len  = l4off + thl;
+    }
+  }
+#else
+  LWIP_UNUSED_ARG(vhdr);
+  LWIP_UNUSED_ARG(thl);
+  LWIP_UNUSED_ARG(acc);
+  LWIP_UNUSED_ARG(mss);
+  LWIP_UNUSED_ARG(csum_off);
+  LWIP_UNUSED_ARG(l4len);
+  LWIP_UNUSED_ARG(v6);
+#endif /* TAPIF_VNET */
+  return (int) hash;
+}
+#undef _need
+
 /*-----------------------------------------------------------------------------------*/
 /*
  * low_level_output():
@@ -171,16 +416,27 @@ low_level_init(struct netif *netif)
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * The pbuf chain is handed over to writev() without copying; only chains
+ * that are longer than TAPIF_TX_MAXIOV or that have the protocol headers
+ * split over several pbufs are flattened.
+ *
  */
 /*-----------------------------------------------------------------------------------*/
 
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf *q;
-  char buf[1514];
-  char *bufptr;
+  struct iovec iov[TAPIF_TX_MAXIOV + 1];
   struct tapif *tapif;
+  struct pbuf *q;
+  unsigned int iovcnt, first;
+  int qidx = -1;
+  err_t err = ERR_OK;
+#ifdef TAPIF_VNET
+  struct virtio_net_hdr vh;
+#else
+  char vh; /* unused */
+#endif
 
   tapif = (struct tapif *)netif->state;
 #if 0
@@ -189,24 +445,49 @@ low_level_output(struct netif *netif, struct pbuf *p)
     return ERR_OK;
     }
 #endif
-  /* initiate transfer(); */
+#if ETH_PAD_SIZE
+  pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
 
-  bufptr = &buf[0];
+  /* initiate transfer(); */
+  first = 0;
+#ifdef TAPIF_VNET
+  iov[0].iov_base = &vh;
+  iov[0].iov_len  = sizeof(vh);
+  first = 1;
+#endif
+  iovcnt = first;
+  for(q = p; q != NULL && iovcnt < TAPIF_TX_MAXIOV + first; q = q->next) {
+    iov[iovcnt].iov_base = q->payload;
+    iov[iovcnt].iov_len  = q->len;
+    ++iovcnt;
+  }
 
-  for(q = p; q != NULL; q = q->next) {
-    /* Send the data from the pbuf to the interface, one pbuf at a
-       time. The size of the data in each pbuf is kept in the ->len
-       variable. */
-    /* send data from(q->payload, q->len); */
-    memcpy(bufptr, q->payload, q->len);
-    bufptr += q->len;
+  if (q == NULL)
+    qidx = low_level_prepare(netif, (u8_t *) p->payload, p->len, p->tot_len, &vh);
+  if (q != NULL || qidx < 0) {
+    /* flatten the chain */
+    pbuf_copy_partial(p, tapif->txbuf, p->tot_len, 0);
+    iov[first].iov_base = tapif->txbuf;
+    iov[first].iov_len  = p->tot_len;
+    iovcnt = first + 1;
+    qidx = low_level_prepare(netif, tapif->txbuf, p->tot_len, p->tot_len, &vh);
   }
 
   /* signal that packet should be sent(); */
-  if(write(tapif->fd, buf, p->tot_len) == -1) {
-    perror("tapif: write");
+  if(writev(tapif->fd[qidx], iov, iovcnt) == -1) {
+    LWIP_DEBUGF(TAPIF_DEBUG, ("tapif: writev failed: %d\n", errno));
+    LINK_STATS_INC(link.err);
+    LINK_STATS_INC(link.drop);
+    err = (errno == EAGAIN || errno == ENOBUFS) ? ERR_MEM : ERR_IF;
+  } else {
+    LINK_STATS_INC(link.xmit);
   }
-  return ERR_OK;
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+  return err;
 }
 /*-----------------------------------------------------------------------------------*/
 /*
@@ -215,47 +496,123 @@ low_level_output(struct netif *netif, struct pbuf *p)
  * Should allocate a pbuf and transfer the bytes of the incoming
  * packet from the interface into the pbuf.
  *
+ * The frame is read directly into a pool pbuf chain. Returns -EAGAIN
+ * when the queue is drained, otherwise 0 and the received pbuf in *out
+ * (NULL if the frame was dropped).
+ *
  */
 /*-----------------------------------------------------------------------------------*/
-static struct pbuf *
-low_level_input(struct tapif *tapif)
+static int
+low_level_input(struct netif *netif, int fd, struct pbuf **out)
 {
+  struct tapif *tapif = (struct tapif *)netif->state;
+  struct iovec iov[TAPIF_RX_MAXIOV + 2];
+  unsigned int iovcnt = 0;
   struct pbuf *p, *q;
-  u16_t len;
-  char buf[1514];
-  char *bufptr;
+  ssize_t len;
+  u16_t plen;
+#ifdef TAPIF_VNET
+  struct virtio_net_hdr vh;
+  u16_t csum;
+
+  iov[iovcnt].iov_base = &vh;
+  iov[iovcnt].iov_len  = sizeof(vh);
+  ++iovcnt;
+#endif
+
+  *out = NULL;
 
-  /* Obtain the size of the packet and put it into the "len"
-     variable. */
-  len = read(tapif->fd, buf, sizeof(buf));
+  /* We allocate a pbuf chain of pbufs from the pool. */
+  p = pbuf_alloc(PBUF_RAW, TAPIF_RX_PLEN(netif), PBUF_POOL);
+  plen = 0;
+  if (p != NULL) {
+#if ETH_PAD_SIZE
+    pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
+    for(q = p; q != NULL && iovcnt < TAPIF_RX_MAXIOV; q = q->next) {
+      iov[iovcnt].iov_base = q->payload;
+      iov[iovcnt].iov_len  = q->len;
+      plen += q->len;
+      ++iovcnt;
+    }
+  }
+  /* overflow for super-frames, or the whole frame when it gets dropped */
+  iov[iovcnt].iov_base = tapif->rxbuf;
+  iov[iovcnt].iov_len  = TAPIF_RXBUF_LEN;
+  ++iovcnt;
+
+  len = readv(fd, iov, iovcnt);
+  if (len < 0) {
+    if (p != NULL)
+      pbuf_free(p);
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      LWIP_DEBUGF(TAPIF_DEBUG, ("tapif: readv failed: %d\n", errno));
+    return -EAGAIN;
+  }
 #if 0
     if(((double)rand()/(double)RAND_MAX) < 0.2) {
     printf("drop\n");
     return NULL;
     }
 #endif
+  len -= TAPIF_VNET_HLEN;
 
-  /* We allocate a pbuf chain of pbufs from the pool. */
-  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
-
-  if(p != NULL) {
-    /* We iterate over the pbuf chain until we have read the entire
-       packet into the pbuf. */
-    bufptr = &buf[0];
-    for(q = p; q != NULL; q = q->next) {
-      /* Read enough bytes to fill this pbuf in the chain. The
-         available data in the pbuf is given by the q->len
-         variable. */
-      /* read data into(q->payload, q->len); */
-      memcpy(q->payload, bufptr, q->len);
-      bufptr += q->len;
-    }
-    /* acknowledge that packet has been read(); */
-  } else {
+  if (p == NULL) {
     /* drop packet(); */
+    LINK_STATS_INC(link.memerr);
+    LINK_STATS_INC(link.drop);
+    return 0;
+  }
+  if (len < SIZEOF_ETH_HDR || len > 0xFFFF - ETH_PAD_SIZE) {
+    LINK_STATS_INC(link.lenerr);
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+    return 0;
+  }
+
+  if (len <= plen) {
+    pbuf_realloc(p, (u16_t) len);
+  } else {
+    /* super-frame: copy the tail that went into the overflow buffer */
+    pbuf_realloc(p, plen);
+    q = pbuf_alloc(PBUF_RAW, (u16_t) (len - plen), PBUF_POOL);
+    if (q == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      pbuf_free(p);
+      return 0;
+    }
+    pbuf_take(q, tapif->rxbuf, (u16_t) (len - plen));
+    pbuf_cat(p, q);
   }
 
-  return p;
+#ifdef TAPIF_VNET
+#if CHECKSUM_CHECK_TCP || CHECKSUM_CHECK_UDP
+  if (vh.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+    /* the host left the checksum to us: lwIP would reject the frame
+     * otherwise */
+    if (vh.csum_start + vh.csum_offset + 2 > p->len) {
+      LINK_STATS_INC(link.chkerr);
+      LINK_STATS_INC(link.drop);
+      pbuf_free(p);
+      return 0;
+    }
+    pbuf_header(p, -(s16_t) vh.csum_start);
+    csum = inet_chksum_pbuf(p);
+    pbuf_header(p, (s16_t) vh.csum_start);
+    memcpy((u8_t *) p->payload + vh.csum_start + vh.csum_offset, &csum, sizeof(csum));
+  }
+#else
+  LWIP_UNUSED_ARG(csum);
+#endif /* CHECKSUM_CHECK_TCP || CHECKSUM_CHECK_UDP */
+#endif /* TAPIF_VNET */
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+  LINK_STATS_INC(link.recv);
+  *out = p;
+  return 0;
 }
 /*-----------------------------------------------------------------------------------*/
 static inline void
@@ -263,21 +620,33 @@ _tapif_poll(struct netif *netif, struct timeval *timeout)
 {
   struct tapif *tapif = (struct tapif *)netif->state;
   fd_set fdset;
+  int maxfd = -1;
+  unsigned int q;
 
   FD_ZERO(&fdset);
-  FD_SET(tapif->fd, &fdset);
+  for (q = 0; q < tapif->nb_queues; ++q) {
+    FD_SET(tapif->fd[q], &fdset);
+    if (tapif->fd[q] > maxfd)
+      maxfd = tapif->fd[q];
+  }
 
   /* Wait for a packet to arrive and handle it */
-  if (select(tapif->fd + 1, &fdset, NULL, NULL, timeout))
-    tapif_input(netif);
+  if (select(maxfd + 1, &fdset, NULL, NULL, timeout) > 0)
+    tapif_input(netif, 0);
 }
 
 #ifdef CONFIG_LWIP_NOTHREADS
+unsigned int
+tapif_poll_budget(struct netif *netif, unsigned int budget)
+{
+  /* the queues are non-blocking: read them without select() */
+  return tapif_input(netif, budget);
+}
+
 void
 tapif_poll(struct netif *netif)
 {
-  struct timeval zero = { 0, 0 }; /* do not block */
-  _tapif_poll(netif, &zero);
+  tapif_input(netif, 0);
 }
 
 #else
@@ -293,33 +662,12 @@ tapif_thread(void *arg)
 }
 #endif
 
-/*-----------------------------------------------------------------------------------*/
-/*
- * tapif_input():
- *
- * This function should be called when a packet is ready to be read
- * from the interface. It uses the function low_level_input() that
- * should handle the actual reception of bytes from the network
- * interface.
- *
- */
 /*-----------------------------------------------------------------------------------*/
 static void
-tapif_input(struct netif *netif)
+tapif_deliver(struct pbuf *p, struct netif *netif)
 {
-  struct tapif *tapif;
   struct eth_hdr *ethhdr;
-  struct pbuf *p;
-
 
-  tapif = (struct tapif *)netif->state;
-
-  p = low_level_input(tapif);
-
-  if(p == NULL) {
-    LWIP_DEBUGF(TAPIF_DEBUG, ("tapif_input: low_level_input returned NULL\n"));
-    return;
-  }
   ethhdr = (struct eth_hdr *)p->payload;
 
   switch(htons(ethhdr->type)) {
@@ -346,6 +694,56 @@ tapif_input(struct netif *netif)
     break;
   }
 }
+
+/*
+ * tapif_input():
+ *
+ * This function should be called when a packet is ready to be read
+ * from the interface. It uses the function low_level_input() that
+ * should handle the actual reception of bytes from the network
+ * interface.
+ *
+ * Frames are collected into bursts of up to NETIF_RX_BURST frames that
+ * are handed over to lwIP at once. At most budget frames (0: no limit)
+ * are read per call. Queues are drained one after another; the queue
+ * that exhausted the budget is served first on the next call.
+ * Returns the number of frames that were read.
+ *
+ */
+/*-----------------------------------------------------------------------------------*/
+static unsigned int
+tapif_input(struct netif *netif, unsigned int budget)
+{
+  struct tapif *tapif;
+  struct rxburst burst;
+  struct pbuf *p;
+  unsigned int done = 0;
+  unsigned int i, q;
+
+  tapif = (struct tapif *)netif->state;
+  rxburst_init(&burst);
+
+  for (i = 0; i < tapif->nb_queues; ++i) {
+    q = (tapif->rx_next + i) % tapif->nb_queues;
+    while (low_level_input(netif, tapif->fd[q], &p) == 0) {
+      ++done;
+      if(p == NULL) {
+        LWIP_DEBUGF(TAPIF_DEBUG, ("tapif_input: low_level_input dropped a frame\n"));
+      } else {
+        rxburst_add(&burst, p);
+        if (rxburst_full(&burst))
+          rxburst_deliver(&burst, netif, tapif_deliver);
+      }
+      if (!netif_rx_budget_left(budget, done)) {
+        tapif->rx_next = q;
+        goto out;
+      }
+    }
+  }
+ out:
+  rxburst_deliver(&burst, netif, tapif_deliver);
+  return done;
+}
 /*-----------------------------------------------------------------------------------*/
 /*
  * tapif_init():
@@ -365,6 +763,15 @@ tapif_init(struct netif *netif)
   if (!tapif) {
     return ERR_MEM;
   }
+  memset(tapif, 0, sizeof(*tapif));
+  tapif->rxbuf = malloc(TAPIF_RXBUF_LEN);
+  tapif->txbuf = malloc(TAPIF_TXBUF_LEN);
+  if (!tapif->rxbuf || !tapif->txbuf) {
+    free(tapif->rxbuf);
+    free(tapif->txbuf);
+    mem_free(tapif);
+    return ERR_MEM;
+  }
   netif->state = tapif;
   netif->name[0] = IFNAME0;
   netif->name[1] = IFNAME1;
@@ -132,7 +132,7 @@ struct blkdev *open_blkdev(blkdev_id_t id, int mode)
 	goto err;
   }
 
-  bd->reqpool = alloc_simple_mempool(MAX_REQUESTS, sizeof(struct _blkdev_req));
+  bd->reqpool = alloc_simple_mempool(MEMT_BLKDEV, MAX_REQUESTS, sizeof(struct _blkdev_req));
   if (!bd->reqpool) {
 	errno = ENOMEM;
 	goto err_free_bd;
@@ -197,12 +197,58 @@ void close_blkdev(struct blkdev *bd)
     else
       _open_bd_list = bd->_next;
 
-    shutdown_blkfront(bd->dev);
+    if (bd->dev) /* NULL when detached by blkdev_suspend() */
+      shutdown_blkfront(bd->dev);
     free_mempool(bd->reqpool);
     xfree(bd);
   }
 }
 
+int blkdev_suspend(struct blkdev *bd)
+{
+  if (!bd->dev)
+    return 0; /* already detached */
+  if (blkdev_avail_req(bd) != MAX_REQUESTS)
+    return -EBUSY; /* there are requests in flight */
+
+  shutdown_blkfront(bd->dev);
+  bd->dev = NULL;
+  return 0;
+}
+
+int blkdev_resume(struct blkdev *bd)
+{
+  struct blkfront_info info;
+
+  if (bd->dev)
+    return 0; /* still attached */
+
+  bd->dev = init_blkfront(bd->nname, &info);
+  if (!bd->dev)
+    return -ENODEV;
+
+  /* the backend has to provide the same disk again */
+  if (info.sectors != bd->info.sectors ||
+      info.sector_size != bd->info.sector_size ||
+      ((bd->info.mode & O_RDWR) && !(info.mode & O_RDWR)))
+    goto err_shutdown_blkfront;
+  bd->info = info;
+
+#ifdef CONFIG_SELECT_POLL
+  bd->fd = blkfront_open(bd->dev);
+  if (bd->fd < 0)
+    goto err_shutdown_blkfront;
+#endif
+
+  blkdev_async_io_wait_slot(bd);
+  return 0;
+
+ err_shutdown_blkfront:
+  shutdown_blkfront(bd->dev);
+  bd->dev = NULL;
+  return -ENODEV;
+}
+
 void _blkdev_async_io_cb(struct blkfront_aiocb *aiocb, int ret)
 {
 	struct mempool_obj *robj;
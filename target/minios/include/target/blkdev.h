@@ -84,6 +84,15 @@ struct blkdev *open_blkdev(blkdev_id_t id, int mode);
 void close_blkdev(struct blkdev *bd);
 #define blkdev_refcount(bd) ((bd)->refcount)
 
+/*
+ * Detaches/re-attaches the frontend of an open device across a suspend
+ * of the VM (e.g., live migration). The descriptor stays valid but no I/O
+ * is allowed while the device is detached. blkdev_resume() fails when the
+ * backend does not provide the same disk geometry anymore.
+ */
+int blkdev_suspend(struct blkdev *bd);
+int blkdev_resume(struct blkdev *bd);
+
 int blkdev_id_parse(const char *id, blkdev_id_t *out);
 #define blkdev_id_unparse(id, out, maxlen) \
      (snprintf((out), (maxlen), "%u", (id)))
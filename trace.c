@@ -0,0 +1,406 @@
+/*
+ * Tracepoints with in-memory trace rings
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <target/sys.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "trace.h"
+#include "memacct.h"
+#include "shell.h"
+
+#ifdef TRACE_DEBUG
+#define ENABLE_DEBUG
+#endif
+#include "debug.h"
+
+#ifndef CACHELINE_SIZE
+#define CACHELINE_SIZE 64
+#endif
+
+#define TRACE_DUMP_YIELD 256 /* yield CPU every x printed events */
+#define TRACE_CLK_SHIFT   20 /* fixed point precision of clock conversion */
+
+struct trace_ring {
+	struct trace_rec *ev;
+	uint64_t head; /* number of recorded events since last clear */
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+static const struct {
+	const char *name;
+	const char *cat;
+	const char *span; /* async span name for Chrome trace (NULL = instant) */
+	char ph;          /* Chrome trace phase */
+	const char *arg;
+	int arg_hex;
+	const char *val; /* NULL = no value */
+} _tev_desc[TEV_NB] = {
+	[TEV_CACHE_HIT]     = { "cache_hit",     "shfs", NULL,   'i', "chunk", 0, NULL },
+	[TEV_CACHE_HITWAIT] = { "cache_hitwait", "shfs", NULL,   'i', "chunk", 0, NULL },
+	[TEV_CACHE_MISS]    = { "cache_miss",    "shfs", NULL,   'i', "chunk", 0, NULL },
+	[TEV_CACHE_EVICT]   = { "cache_evict",   "shfs", NULL,   'i', "chunk", 0, NULL },
+	[TEV_AIO_SUBMIT]    = { "aio_submit",    "shfs", "aio",  'b', "chunk", 0, NULL },
+	[TEV_AIO_DONE]      = { "aio_done",      "shfs", "aio",  'e', "chunk", 0, "ret" },
+	[TEV_SESS_ACCEPT]   = { "sess_accept",   "http", "sess", 'b', "sess",  1, "nb_sess" },
+	[TEV_SESS_CLOSE]    = { "sess_close",    "http", "sess", 'e', "sess",  1, "type" },
+	[TEV_REQ_STATE]     = { "req_state",     "http", NULL,   'i', "req",   1, "state" },
+	[TEV_IORETRY_WAIT]  = { "ioretry_wait",  "http", NULL,   'i', "sess",  1, NULL },
+	[TEV_IORETRY_RUN]   = { "ioretry_run",   "http", NULL,   'i', "sess",  1, NULL },
+};
+
+static const struct {
+	const char *name;
+	uint32_t mask;
+} _trace_classes[] = {
+	{ "cache",   TRACE_C_CACHE },
+	{ "aio",     TRACE_C_AIO },
+	{ "sess",    TRACE_C_SESS },
+	{ "req",     TRACE_C_REQ },
+	{ "ioretry", TRACE_C_IORETRY },
+	{ "all",     TRACE_C_ALL },
+	{ NULL, 0 }
+};
+
+uint32_t trace_mask = 0;
+static struct trace_ring _trace_ring[TRACE_NB_CPUS];
+static uint32_t _trace_ring_mask = 0; /* nb_events - 1 */
+static int _trace_dumping = 0;
+
+/* reference point for clock -> time conversion */
+static uint64_t _trace_ref_clk;
+static uint64_t _trace_ref_ns;
+
+int init_trace(uint32_t nb_events)
+{
+	uint32_t nb;
+	int i;
+	int ret;
+
+	for (nb = 1; nb < nb_events; nb <<= 1);
+
+	for (i = 0; i < TRACE_NB_CPUS; ++i) {
+		_trace_ring[i].ev = memacct_malloc(MEMT_TRACE, CACHELINE_SIZE,
+						   nb * sizeof(struct trace_rec));
+		if (!_trace_ring[i].ev) {
+			ret = -ENOMEM;
+			goto err_free_rings;
+		}
+		_trace_ring[i].head = 0;
+	}
+	_trace_ring_mask = nb - 1;
+	_trace_ref_ns = target_now_ns();
+	_trace_ref_clk = trace_clock();
+	trace_mask = 0;
+	return 0;
+
+ err_free_rings:
+	for (--i; i >= 0; --i) {
+		memacct_free(MEMT_TRACE, _trace_ring[i].ev,
+			     nb * sizeof(struct trace_rec));
+		_trace_ring[i].ev = NULL;
+	}
+	return ret;
+}
+
+void exit_trace(void)
+{
+	int i;
+
+	trace_mask = 0;
+	for (i = 0; i < TRACE_NB_CPUS; ++i) {
+		if (_trace_ring[i].ev)
+			memacct_free(MEMT_TRACE, _trace_ring[i].ev,
+				     (_trace_ring_mask + 1) * sizeof(struct trace_rec));
+		_trace_ring[i].ev = NULL;
+	}
+}
+
+void _trace_record(uint16_t ev, uint64_t arg, uint32_t val)
+{
+	struct trace_ring *r = &_trace_ring[trace_cpu_id()];
+	struct trace_rec *rec;
+
+	rec = &r->ev[r->head & _trace_ring_mask];
+	rec->ts = trace_clock();
+	rec->arg = arg;
+	rec->val = val;
+	rec->ev = ev;
+	++r->head;
+}
+
+/*
+ * Clock -> nanoseconds conversion factor (fixed point)
+ * With TSC, the rate is measured over the whole time since init_trace()
+ */
+static uint64_t _trace_clk_mult(void)
+{
+#ifdef TRACE_CLOCK_TSC
+	uint64_t dclk = trace_clock() - _trace_ref_clk;
+	uint64_t dns  = target_now_ns() - _trace_ref_ns;
+
+	while (dns >= (1ull << (63 - TRACE_CLK_SHIFT))) {
+		dns >>= 1;
+		dclk >>= 1;
+	}
+	if (unlikely(dclk == 0 || dns == 0))
+		return (1ull << TRACE_CLK_SHIFT);
+	return (dns << TRACE_CLK_SHIFT) / dclk;
+#else
+	return (1ull << TRACE_CLK_SHIFT);
+#endif
+}
+
+/* converts an event timestamp to ns since init_trace() */
+static inline uint64_t _trace_clk2ns(uint64_t ts, uint64_t mult)
+{
+	uint64_t d = ts - _trace_ref_clk;
+
+	return ((d >> TRACE_CLK_SHIFT) * mult) +
+		(((d & ((1ull << TRACE_CLK_SHIFT) - 1)) * mult) >> TRACE_CLK_SHIFT);
+}
+
+static inline uint64_t _trace_ring_nb_events(struct trace_ring *r)
+{
+	if (r->head > (uint64_t) _trace_ring_mask + 1)
+		return (uint64_t) _trace_ring_mask + 1;
+	return r->head;
+}
+
+static void _trace_clear(void)
+{
+	int i;
+
+	for (i = 0; i < TRACE_NB_CPUS; ++i)
+		_trace_ring[i].head = 0;
+}
+
+static void _trace_print_rec(FILE *cio, int chrome, int cpu,
+			     struct trace_rec *rec, uint64_t ns, int first)
+{
+	uint16_t ev = rec->ev;
+
+	if (chrome) {
+		fprintf(cio, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+			"\"ts\":%"PRIu64".%03"PRIu64",\"pid\":0,\"tid\":%d,",
+			first ? "" : ",\n",
+			_tev_desc[ev].span ? _tev_desc[ev].span : _tev_desc[ev].name,
+			_tev_desc[ev].cat, _tev_desc[ev].ph,
+			ns / 1000, ns % 1000, cpu);
+		if (_tev_desc[ev].span)
+			fprintf(cio, "\"id\":\"0x%"PRIx64"\",", rec->arg);
+		else
+			fprintf(cio, "\"s\":\"t\",");
+		if (_tev_desc[ev].arg_hex)
+			fprintf(cio, "\"args\":{\"%s\":\"0x%"PRIx64"\"",
+				_tev_desc[ev].arg, rec->arg);
+		else
+			fprintf(cio, "\"args\":{\"%s\":%"PRIu64,
+				_tev_desc[ev].arg, rec->arg);
+		if (_tev_desc[ev].val)
+			fprintf(cio, ",\"%s\":%"PRId32, _tev_desc[ev].val,
+				(int32_t) rec->val);
+		fprintf(cio, "}}");
+		return;
+	}
+
+	/* perf script like: comm pid [cpu] secs.usecs: event: args */
+	fprintf(cio, "%16s %5d [%03d] %5"PRIu64".%06"PRIu64": %s:%s: ",
+		"minicache", 0, cpu,
+		ns / 1000000000, (ns / 1000) % 1000000,
+		_tev_desc[ev].cat, _tev_desc[ev].name);
+	if (_tev_desc[ev].arg_hex)
+		fprintf(cio, "%s=0x%"PRIx64, _tev_desc[ev].arg, rec->arg);
+	else
+		fprintf(cio, "%s=%"PRIu64, _tev_desc[ev].arg, rec->arg);
+	if (_tev_desc[ev].val)
+		fprintf(cio, " %s=%"PRId32, _tev_desc[ev].val, (int32_t) rec->val);
+	fprintf(cio, "\n");
+}
+
+/* merges the per-CPU rings by timestamp, oldest event first */
+static void _trace_dump(FILE *cio, int chrome)
+{
+	uint64_t pos[TRACE_NB_CPUS];
+	uint64_t mult;
+	uint64_t count = 0;
+	struct trace_rec *rec, *min_rec;
+	int min_cpu;
+	int i;
+
+	mult = _trace_clk_mult();
+	for (i = 0; i < TRACE_NB_CPUS; ++i)
+		pos[i] = _trace_ring[i].head - _trace_ring_nb_events(&_trace_ring[i]);
+
+	if (chrome)
+		fprintf(cio, "{\"traceEvents\":[\n");
+	for (;;) {
+		min_rec = NULL;
+		min_cpu = 0;
+		for (i = 0; i < TRACE_NB_CPUS; ++i) {
+			if (pos[i] == _trace_ring[i].head)
+				continue;
+			rec = &_trace_ring[i].ev[pos[i] & _trace_ring_mask];
+			if (!min_rec || rec->ts < min_rec->ts) {
+				min_rec = rec;
+				min_cpu = i;
+			}
+		}
+		if (!min_rec)
+			break; /* all rings consumed */
+
+		_trace_print_rec(cio, chrome, min_cpu, min_rec,
+				 _trace_clk2ns(min_rec->ts, mult), (count == 0));
+		++pos[min_cpu];
+		if ((++count % TRACE_DUMP_YIELD) == 0)
+			schedule();
+	}
+	if (chrome)
+		fprintf(cio, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+static uint32_t _trace_parse_classes(FILE *cio, int argc, char *argv[])
+{
+	uint32_t mask = 0;
+	int i, j;
+
+	if (argc == 0)
+		return TRACE_C_ALL;
+	for (i = 0; i < argc; ++i) {
+		for (j = 0; _trace_classes[j].name; ++j) {
+			if (strcmp(argv[i], _trace_classes[j].name) == 0) {
+				mask |= _trace_classes[j].mask;
+				break;
+			}
+		}
+		if (!_trace_classes[j].name) {
+			fprintf(cio, "Unknown trace class: %s\n", argv[i]);
+			return 0;
+		}
+	}
+	return mask;
+}
+
+static int shcmd_trace(FILE *cio, int argc, char *argv[])
+{
+	uint32_t mask;
+	uint32_t saved_mask;
+	int i;
+
+	if (unlikely(!_trace_ring[0].ev)) {
+		fprintf(cio, "Trace rings are not allocated\n");
+		return -1;
+	}
+
+	if (argc < 2) {
+		fprintf(cio, "Enabled classes:");
+		for (i = 0; _trace_classes[i].mask != TRACE_C_ALL; ++i) {
+			if (trace_mask & _trace_classes[i].mask)
+				fprintf(cio, " %s", _trace_classes[i].name);
+		}
+		fprintf(cio, "%s\n", trace_mask ? "" : " none");
+		for (i = 0; i < TRACE_NB_CPUS; ++i) {
+			fprintf(cio, "CPU %d: %"PRIu64" events recorded, %"PRIu64" overwritten\n",
+				i, _trace_ring[i].head,
+				_trace_ring[i].head - _trace_ring_nb_events(&_trace_ring[i]));
+		}
+		return 0;
+	}
+
+	if (unlikely(_trace_dumping)) {
+		fprintf(cio, "Trace dump is in progress\n");
+		return -1;
+	}
+
+	if (strcmp(argv[1], "on") == 0) {
+		mask = _trace_parse_classes(cio, argc - 2, &argv[2]);
+		if (!mask)
+			return -1;
+		trace_mask |= mask;
+		return 0;
+	}
+	if (strcmp(argv[1], "off") == 0) {
+		mask = _trace_parse_classes(cio, argc - 2, &argv[2]);
+		if (!mask)
+			return -1;
+		trace_mask &= ~mask;
+		return 0;
+	}
+	if (strcmp(argv[1], "clear") == 0) {
+		_trace_clear();
+		return 0;
+	}
+	if (strcmp(argv[1], "dump") == 0) {
+		if (argc > 3 || (argc == 3 && strcmp(argv[2], "-c") != 0))
+			goto usage;
+
+		/* rings are not written while they are dumped */
+		saved_mask = trace_mask;
+		trace_mask = 0;
+		_trace_dumping = 1;
+		_trace_dump(cio, (argc == 3));
+		_trace_dumping = 0;
+		trace_mask = saved_mask;
+		return 0;
+	}
+
+ usage:
+	fprintf(cio, "Usage: %s [on|off [CLASS]...]\n", argv[0]);
+	fprintf(cio, "       %s clear\n", argv[0]);
+	fprintf(cio, "       %s dump [-c]\n", argv[0]);
+	fprintf(cio, "Classes: cache aio sess req ioretry all (default)\n");
+	fprintf(cio, "  -c  Chrome trace format (JSON) instead of perf script format\n");
+	return -1;
+}
+
+#ifdef HAVE_CTLDIR
+int register_trace_tools(struct ctldir *cd)
+#else
+int register_trace_tools(void)
+#endif
+{
+#ifdef HAVE_CTLDIR
+	/* ctldir entries (ignore errors) */
+	if (cd)
+		ctldir_register_shcmd(cd, "trace", shcmd_trace);
+#endif
+#ifdef HAVE_SHELL
+	/* shell commands (ignore errors) */
+	shell_register_cmd("trace", shcmd_trace);
+#endif
+	return 0;
+}
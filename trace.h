@@ -0,0 +1,172 @@
+/*
+ * Tracepoints with in-memory trace rings
+ *
+ * Authors: Simon Kuenzer <simon.kuenzer@neclab.eu>
+ *
+ *
+ * Copyright (c) 2013-2017, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <target/sys.h>
+#include <stdint.h>
+#include "likely.h"
+#ifdef HAVE_CTLDIR
+#include <target/ctldir.h>
+#endif
+
+/*
+ * Static tracepoints
+ *
+ * Each tracepoint belongs to a class that can be enabled at runtime
+ * (see shell command 'trace'). When enabled, a compact binary event with
+ * a cycle counter timestamp is written to the trace ring of the current
+ * CPU. The oldest events are overwritten when a ring is full. When a class
+ * is disabled, a tracepoint costs a single predicted branch. Without
+ * HAVE_TRACE, all tracepoints are compiled out.
+ */
+#define TRACE_C_CACHE    0x01 /* cache hit/miss/evict */
+#define TRACE_C_AIO      0x02 /* cache I/O submit/complete */
+#define TRACE_C_SESS     0x04 /* HTTP session accept/close */
+#define TRACE_C_REQ      0x08 /* HTTP request state transitions */
+#define TRACE_C_IORETRY  0x10 /* HTTP I/O retries */
+#define TRACE_C_ALL      0x1f
+
+enum trace_ev {
+	TEV_CACHE_HIT = 0,  /* arg: chunk */
+	TEV_CACHE_HITWAIT,  /* arg: chunk */
+	TEV_CACHE_MISS,     /* arg: chunk */
+	TEV_CACHE_EVICT,    /* arg: evicted chunk */
+	TEV_AIO_SUBMIT,     /* arg: chunk */
+	TEV_AIO_DONE,       /* arg: chunk, val: return code */
+	TEV_SESS_ACCEPT,    /* arg: session, val: nb of open sessions */
+	TEV_SESS_CLOSE,     /* arg: session, val: close type */
+	TEV_REQ_STATE,      /* arg: request, val: new state */
+	TEV_IORETRY_WAIT,   /* arg: session */
+	TEV_IORETRY_RUN,    /* arg: session */
+	TEV_NB
+};
+
+struct trace_rec {
+	uint64_t ts;  /* cycle counter */
+	uint64_t arg;
+	uint32_t val;
+	uint16_t ev;  /* enum trace_ev */
+	uint16_t _pad;
+};
+
+/*
+ * A target can provide trace_cpu_id() for multi-core builds,
+ * one ring is allocated per CPU
+ */
+#ifndef TRACE_NB_CPUS
+#define TRACE_NB_CPUS 1
+#endif
+#if TRACE_NB_CPUS > 1
+ #ifndef trace_cpu_id
+  #error "TRACE_NB_CPUS > 1 requires trace_cpu_id()"
+ #endif
+#else
+ #undef trace_cpu_id
+ #define trace_cpu_id() 0
+#endif
+
+#ifndef TRACE_RING_NB_EVENTS
+#define TRACE_RING_NB_EVENTS 8192 /* per CPU, rounded up to a power of 2 */
+#endif
+
+/* timestamp source: TSC on x86, target clock (ns) otherwise */
+#if defined __x86_64__ || defined __i386__
+#define TRACE_CLOCK_TSC
+static inline uint64_t trace_clock(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define trace_clock() target_now_ns()
+#endif
+
+#ifdef HAVE_TRACE
+extern uint32_t trace_mask;
+
+int init_trace(uint32_t nb_events);
+void exit_trace(void);
+void _trace_record(uint16_t ev, uint64_t arg, uint32_t val);
+
+#define trace_point(cls, ev, arg, val)					\
+	do {								\
+		if (unlikely(trace_mask & (cls)))			\
+			_trace_record((ev), (uint64_t) (arg), (uint32_t) (val)); \
+	} while (0)
+
+/**
+ * Registers trace command to micro shell + ctldir (if *cd is not NULL)
+ */
+#ifdef HAVE_CTLDIR
+int register_trace_tools(struct ctldir *cd);
+#else
+int register_trace_tools(void);
+#endif
+
+#else /* HAVE_TRACE */
+
+#define trace_point(cls, ev, arg, val) do {} while (0)
+
+#endif /* HAVE_TRACE */
+
+/* tracepoints */
+#define trace_cache_hit(chk) \
+	trace_point(TRACE_C_CACHE, TEV_CACHE_HIT, (chk), 0)
+#define trace_cache_hitwait(chk) \
+	trace_point(TRACE_C_CACHE, TEV_CACHE_HITWAIT, (chk), 0)
+#define trace_cache_miss(chk) \
+	trace_point(TRACE_C_CACHE, TEV_CACHE_MISS, (chk), 0)
+#define trace_cache_evict(chk) \
+	trace_point(TRACE_C_CACHE, TEV_CACHE_EVICT, (chk), 0)
+#define trace_aio_submit(chk) \
+	trace_point(TRACE_C_AIO, TEV_AIO_SUBMIT, (chk), 0)
+#define trace_aio_done(chk, ret) \
+	trace_point(TRACE_C_AIO, TEV_AIO_DONE, (chk), (ret))
+#define trace_sess_accept(hsess, nb_sess) \
+	trace_point(TRACE_C_SESS, TEV_SESS_ACCEPT, (uintptr_t) (hsess), (nb_sess))
+#define trace_sess_close(hsess, type) \
+	trace_point(TRACE_C_SESS, TEV_SESS_CLOSE, (uintptr_t) (hsess), (type))
+#define trace_req_state(hreq, state) \
+	trace_point(TRACE_C_REQ, TEV_REQ_STATE, (uintptr_t) (hreq), (state))
+#define trace_ioretry_wait(hsess) \
+	trace_point(TRACE_C_IORETRY, TEV_IORETRY_WAIT, (uintptr_t) (hsess), 0)
+#define trace_ioretry_run(hsess) \
+	trace_point(TRACE_C_IORETRY, TEV_IORETRY_RUN, (uintptr_t) (hsess), 0)
+
+#endif /* _TRACE_H_ */